@@ -27,10 +27,25 @@
 #include <assert.h>
 
 
+/* Row masks have an empty row on each side of the board, so that
+ * vertical neighbors of any board row can be accessed unconditionally.
+ */
+#define NUM_MASK_ROWS		(BOARD_MAX_HEIGHT + 2)
+
+#define SHIFT_MASK_ROW(row, delta_x)					\
+  ((delta_x) > 0 ? (row) << 1 : ((delta_x) < 0 ? (row) >> 1 : (row)))
+
+
 static inline int  amazon_has_any_legal_move
 		     (const char grid[BOARD_FULL_GRID_SIZE],
 		      int pos);
 
+static int	   advance_distance_front (uint64_t front[NUM_MASK_ROWS],
+					   uint64_t reached[NUM_MASK_ROWS],
+					   const uint64_t empty[NUM_MASK_ROWS],
+					   int height,
+					   AmazonsDistance distance);
+
 
 /* Just handle weird situations when there are no amazons of either
  * color on board.  Even if a player has no legal move, he is still to
@@ -198,14 +213,67 @@ amazon_has_any_legal_move (const char grid[BOARD_FULL_GRID_SIZE], int pos)
 }
 
 
+/* Generate all legal moves.  For each amazon, walk all queen rays
+ * from it to find where it can move, then all rays from there to find
+ * where it can shoot.  The square it left counts as empty then.
+ */
+void
+amazons_generate_legal_moves (const Board *board, BoardRuleSet rule_set,
+			      int color, BoardMoveList *moves)
+{
+  const char *grid = board->grid;
+  int max_ray_points = ((board->width - 1) + (board->height - 1)
+			+ 2 * (MIN (board->width, board->height) - 1));
+  int from;
+
+  assert (rule_set < NUM_AMAZONS_RULE_SETS);
+  UNUSED (rule_set);
+
+  moves->positions_per_move = 3;
+
+  for (from = POSITION (0, 0); ON_GRID (grid, from);
+       from += (BOARD_MAX_WIDTH + 1) - board->width) {
+    for (; ON_GRID (grid, from); from++) {
+      int k;
+
+      if (grid[from] != color)
+	continue;
+
+      for (k = 0; k < 8; k++) {
+	int to;
+
+	for (to = from + delta[k]; grid[to] == EMPTY; to += delta[k]) {
+	  int *positions;
+	  int i;
+
+	  board_move_list_reserve (moves, 3 * max_ray_points);
+	  positions = moves->positions + 3 * moves->num_moves;
+
+	  for (i = 0; i < 8; i++) {
+	    int shoot_arrow_to;
+
+	    for (shoot_arrow_to = to + delta[i];
+		 grid[shoot_arrow_to] == EMPTY || shoot_arrow_to == from;
+		 shoot_arrow_to += delta[i]) {
+	      *positions++ = from;
+	      *positions++ = to;
+	      *positions++ = shoot_arrow_to;
+	    }
+	  }
+
+	  moves->num_moves = (positions - moves->positions) / 3;
+	}
+      }
+    }
+  }
+}
+
+
 void
 amazons_play_move (Board *board, int color, va_list move)
 {
-  char *grid = board->grid;
   int to_x;
   int to_y;
-  AmazonsMoveStackEntry *stack_entry
-    = ALLOCATE_AMAZONS_MOVE_STACK_ENTRY (board);
   BoardAmazonsMoveData move_data;
 
   to_x	    = va_arg (move, int);
@@ -217,12 +285,26 @@ amazons_play_move (Board *board, int color, va_list move)
   assert (ON_BOARD (board,
 		    move_data.shoot_arrow_to.x, move_data.shoot_arrow_to.y));
 
-  assert (grid[POINT_TO_POSITION (move_data.from)] == color);
+  amazons_play_move_at (board, color, POINT_TO_POSITION (move_data.from),
+			POSITION (to_x, to_y),
+			POINT_TO_POSITION (move_data.shoot_arrow_to));
+}
+
+
+/* Same as amazons_play_move(), but the move is given as positions. */
+void
+amazons_play_move_at (Board *board, int color,
+		      int from, int to, int shoot_arrow_to)
+{
+  char *grid = board->grid;
+  AmazonsMoveStackEntry *stack_entry
+    = ALLOCATE_AMAZONS_MOVE_STACK_ENTRY (board);
+
+  assert (grid[from] == color);
 
-  stack_entry->from		   = POINT_TO_POSITION (move_data.from);
-  stack_entry->to		   = POSITION (to_x, to_y);
-  stack_entry->misc.shoot_arrow_to
-    = POINT_TO_POSITION (move_data.shoot_arrow_to);
+  stack_entry->from		   = from;
+  stack_entry->to		   = to;
+  stack_entry->misc.shoot_arrow_to = shoot_arrow_to;
 
   stack_entry->to_contents = grid[stack_entry->to];
   stack_entry->shoot_arrow_to_contents
@@ -273,6 +355,33 @@ amazons_add_dummy_move_entry (Board *board)
 }
 
 
+/* Update symmetry keys for the last move on `board', which must not
+ * be undone yet.
+ */
+void
+amazons_update_symmetry_keys (Board *board)
+{
+  const AmazonsMoveStackEntry *stack_entry
+    = (const AmazonsMoveStackEntry *) board->move_stack_pointer - 1;
+
+  if (stack_entry->from != NULL_POSITION) {
+    const char *grid = board->grid;
+    int color = grid[stack_entry->to];
+
+    /* An arrow may be shot back to where the amazon came from. */
+    board_toggle_symmetry_keys (board, stack_entry->from,
+				color, grid[stack_entry->from]);
+    board_toggle_symmetry_keys (board, stack_entry->to,
+				stack_entry->to_contents, color);
+
+    if (stack_entry->misc.shoot_arrow_to != stack_entry->from) {
+      board_toggle_symmetry_keys (board, stack_entry->misc.shoot_arrow_to,
+				  stack_entry->shoot_arrow_to_contents, ARROW);
+    }
+  }
+}
+
+
 void
 amazons_validate_board (const Board *board)
 {
@@ -374,6 +483,197 @@ amazons_parse_move (int board_width, int board_height, const char *move_string,
 }
 
 
+
+/* Amazons-specific function. */
+
+/* Estimate territory of both players: empty points which amazons of
+ * one color can reach in fewer moves than those of the other color.
+ * Distances are counted over empty points in queen or king moves,
+ * depending on `distance'.  Points at equal distance from both colors
+ * and points no amazon can reach are neutral.
+ *
+ * Once all regions are separated, the estimate is the usual score of
+ * the game: the number of points each player can still fill.
+ *
+ * All points reachable at each distance are found at once, using bit
+ * masks of board rows.  If `territory' is not NULL, points of black
+ * and white territory are set to BLACK and WHITE, respectively; other
+ * points are not touched.  If `black_territory' or `white_territory'
+ * are not NULL, they receive the number of points in territories.
+ */
+void
+amazons_estimate_territory (const Board *board, AmazonsDistance distance,
+			    char *territory,
+			    int *black_territory, int *white_territory)
+{
+  uint64_t empty[NUM_MASK_ROWS];
+  uint64_t fronts[NUM_COLORS][NUM_MASK_ROWS];
+  uint64_t reached[NUM_COLORS][NUM_MASK_ROWS];
+  uint64_t owned[NUM_COLORS][NUM_MASK_ROWS];
+  int have_fronts[NUM_COLORS] = { 1, 1 };
+  int num_owned_points[NUM_COLORS] = { 0, 0 };
+  int height = board->height;
+  int x;
+  int y;
+
+  assert (board->game == GAME_AMAZONS);
+  assert (distance == AMAZONS_QUEEN_DISTANCE
+	  || distance == AMAZONS_KING_DISTANCE);
+
+  for (y = 0; y < NUM_MASK_ROWS; y++) {
+    empty[y]			= 0;
+    fronts[BLACK_INDEX][y]	= 0;
+    fronts[WHITE_INDEX][y]	= 0;
+    owned[BLACK_INDEX][y]	= 0;
+    owned[WHITE_INDEX][y]	= 0;
+  }
+
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < board->width; x++) {
+      int contents = board->grid[POSITION (x, y)];
+
+      if (contents == EMPTY)
+	empty[y + 1] |= (uint64_t) 1 << x;
+      else if (IS_STONE (contents))
+	fronts[COLOR_INDEX (contents)][y + 1] |= (uint64_t) 1 << x;
+    }
+  }
+
+  for (y = 0; y < NUM_MASK_ROWS; y++) {
+    reached[BLACK_INDEX][y] = fronts[BLACK_INDEX][y];
+    reached[WHITE_INDEX][y] = fronts[WHITE_INDEX][y];
+  }
+
+  /* Advance both colors one move at a time.  A point belongs to the
+   * color that reaches it first.
+   */
+  while (have_fronts[BLACK_INDEX] || have_fronts[WHITE_INDEX]) {
+    if (have_fronts[BLACK_INDEX]) {
+      have_fronts[BLACK_INDEX]
+	= advance_distance_front (fronts[BLACK_INDEX], reached[BLACK_INDEX],
+				  empty, height, distance);
+    }
+
+    if (have_fronts[WHITE_INDEX]) {
+      have_fronts[WHITE_INDEX]
+	= advance_distance_front (fronts[WHITE_INDEX], reached[WHITE_INDEX],
+				  empty, height, distance);
+    }
+
+    for (y = 1; y <= height; y++) {
+      owned[BLACK_INDEX][y] |= (fronts[BLACK_INDEX][y]
+				& ~reached[WHITE_INDEX][y]);
+      owned[WHITE_INDEX][y] |= (fronts[WHITE_INDEX][y]
+				& ~reached[BLACK_INDEX][y]);
+    }
+  }
+
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < board->width; x++) {
+      int owner;
+
+      if (owned[BLACK_INDEX][y + 1] & ((uint64_t) 1 << x))
+	owner = BLACK;
+      else if (owned[WHITE_INDEX][y + 1] & ((uint64_t) 1 << x))
+	owner = WHITE;
+      else
+	continue;
+
+      num_owned_points[COLOR_INDEX (owner)]++;
+      if (territory)
+	territory[POSITION (x, y)] = owner;
+    }
+  }
+
+  if (black_territory)
+    *black_territory = num_owned_points[BLACK_INDEX];
+  if (white_territory)
+    *white_territory = num_owned_points[WHITE_INDEX];
+}
+
+
+/* Find all points one move further from the amazons than the current
+ * `front', which are not `reached' yet.  Replace the front with them
+ * and add them to `reached'.  Return non-zero if the new front is not
+ * empty.
+ *
+ * For queen distance, the front is shifted in each of eight
+ * directions step by step, stopping at non-empty points, until no
+ * rays remain.
+ */
+static int
+advance_distance_front (uint64_t front[NUM_MASK_ROWS],
+			uint64_t reached[NUM_MASK_ROWS],
+			const uint64_t empty[NUM_MASK_ROWS],
+			int height, AmazonsDistance distance)
+{
+  uint64_t next_front[NUM_MASK_ROWS];
+  uint64_t have_new_points = 0;
+  int y;
+
+  if (distance == AMAZONS_QUEEN_DISTANCE) {
+    int delta_x;
+    int delta_y;
+
+    for (y = 1; y <= height; y++)
+      next_front[y] = 0;
+
+    for (delta_y = -1; delta_y <= 1; delta_y++) {
+      for (delta_x = -1; delta_x <= 1; delta_x++) {
+	uint64_t rays[NUM_MASK_ROWS];
+	uint64_t have_rays;
+
+	if (delta_x == 0 && delta_y == 0)
+	  continue;
+
+	for (y = 0; y <= height + 1; y++)
+	  rays[y] = front[y];
+
+	/* Rows are updated in place, so traverse them in the direction
+	 * opposite to `delta_y'.  Padding rows stay zero.
+	 */
+	do {
+	  have_rays = 0;
+
+	  if (delta_y > 0) {
+	    for (y = height; y >= 1; y--) {
+	      rays[y] = SHIFT_MASK_ROW (rays[y - 1], delta_x) & empty[y];
+	      have_rays |= rays[y];
+	    }
+	  }
+	  else {
+	    for (y = 1; y <= height; y++) {
+	      rays[y] = (SHIFT_MASK_ROW (rays[y - delta_y], delta_x)
+			 & empty[y]);
+	      have_rays |= rays[y];
+	    }
+	  }
+
+	  for (y = 1; y <= height; y++)
+	    next_front[y] |= rays[y];
+	} while (have_rays);
+      }
+    }
+  }
+  else {
+    for (y = 1; y <= height; y++) {
+      uint64_t neighbors = front[y - 1] | front[y] | front[y + 1];
+
+      next_front[y] = ((neighbors | (neighbors << 1) | (neighbors >> 1))
+		       & empty[y]);
+    }
+  }
+
+  for (y = 1; y <= height; y++) {
+    front[y]	= next_front[y] & ~reached[y];
+    reached[y] |= front[y];
+    have_new_points |= front[y];
+  }
+
+  return have_new_points != 0;
+}
+
+
 /*
  * Local Variables:
  * tab-width: 8
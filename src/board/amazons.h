@@ -69,11 +69,19 @@ int		amazons_is_legal_move (const Board *board,
 				       BoardRuleSet rule_set,
 				       int color, va_list move);
 
+void		amazons_generate_legal_moves (const Board *board,
+					      BoardRuleSet rule_set,
+					      int color,
+					      BoardMoveList *moves);
+
 void		amazons_play_move (Board *board, int color, va_list move);
+void		amazons_play_move_at (Board *board, int color,
+				      int from, int to, int shoot_arrow_to);
 void		amazons_undo (Board *board);
 
 void		amazons_apply_changes (Board *board, int num_changes);
 void		amazons_add_dummy_move_entry (Board *board);
+void		amazons_update_symmetry_keys (Board *board);
 
 void		amazons_format_move (int board_width, int board_height,
 				     StringBuffer *buffer, va_list move);
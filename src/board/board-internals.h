@@ -50,18 +50,68 @@
 #define ON_GRID(grid, pos)	((grid) [pos] != OFF_GRID)
 
 
+/* Find index of the lowest set bit with a de Bruijn sequence multiply.
+ * `bits' must not be zero.
+ */
+static inline int
+lowest_bit_index (uint64_t bits)
+{
+  static const int de_bruijn_bit_indices[64] = {
+     0,	 1, 48,	 2, 57, 49, 28,	 3, 61, 58, 50, 42, 38, 29, 17,	 4,
+    62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,	 5,
+    63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+    46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,	 9, 13,	 8,  7,	 6
+  };
+
+  return de_bruijn_bit_indices[((bits & (~bits + 1))
+				* 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+
+/* Count set bits in parallel: in pairs, then nibbles, then bytes. */
+static inline int
+count_bits (uint64_t bits)
+{
+  bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+  bits = ((bits & 0x3333333333333333ULL)
+	  + ((bits >> 2) & 0x3333333333333333ULL));
+  bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+
+  return (int) ((bits * 0x0101010101010101ULL) >> 56);
+}
+
+
+/* Finalizer of the SplitMix64 generator.  Spreads small distinct
+ * integers over all 64 bits, which makes XOR of keys of stones a good
+ * position hash.
+ */
+static inline uint64_t
+mix_key (uint64_t value)
+{
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+
+  return value ^ (value >> 31);
+}
+
+
 /* Cast expressions are not allowed as lvalues by ISO C and may be
  * frowned upon by strict compilers, hence the tricks below.  Must be
  * optimized away in any case.
  */
 
+/* In no-undo mode, the first entry is reused for every move.  Move
+ * stack pointer always points just past it then.
+ */
 #define ALLOCATE_MOVE_STACK_ENTRY(board, MoveStackEntryType)		\
-  (((board)->move_stack_pointer == (board)->move_stack_end		\
-    ? board_increase_move_stack_size (board)				\
-    : (void) 0),							\
-   (board)->move_stack_pointer						\
-     = (MoveStackEntryType *) (board)->move_stack_pointer + 1,		\
-   (MoveStackEntryType *) (board)->move_stack_pointer - 1)
+  ((board)->no_undo							\
+   ? (MoveStackEntryType *) (board)->move_stack				\
+   : (((board)->move_stack_pointer == (board)->move_stack_end		\
+       ? board_increase_move_stack_size (board)				\
+       : (void) 0),							\
+      (board)->move_stack_pointer					\
+	= (MoveStackEntryType *) (board)->move_stack_pointer + 1,	\
+      (MoveStackEntryType *) (board)->move_stack_pointer - 1))
 
 #define POP_MOVE_STACK_ENTRY(board, MoveStackEntryType)			\
   ((MoveStackEntryType *)						\
@@ -91,9 +141,18 @@ struct _BoardChangeStackEntry {
 
 inline void	board_undo_changes (Board *board, int num_undos);
 
+void		board_toggle_symmetry_keys (Board *board, int pos,
+					    int old_contents,
+					    int new_contents);
+
 int		determine_position_delta (int delta_x, int delta_y);
 
 void		board_increase_move_stack_size (Board *board);
+void		board_ensure_change_stack_space (Board *board,
+						 int num_entries);
+
+void		board_move_list_reserve (BoardMoveList *list,
+					 int num_positions);
 
 
 extern const int	delta[8];
@@ -27,10 +27,15 @@
 #include "../quarry.h"
 
 
+/* SGF point values (`a'-`z', then `A'-`Z') allow boards up to 52x52.
+ * Positions use a fixed stride, so BOARD_GRID_SIZE is large enough
+ * for any board.  Arrays kept for a particular board should be sized
+ * with BOARD_GRID_SIZE_FOR() instead.
+ */
 #define BOARD_MIN_WIDTH		5
 #define BOARD_MIN_HEIGHT	5
-#define BOARD_MAX_WIDTH		25
-#define BOARD_MAX_HEIGHT	25
+#define BOARD_MAX_WIDTH		52
+#define BOARD_MAX_HEIGHT	52
 
 #define POSITION(x, y)		((1 + (y)) * (1 + BOARD_MAX_WIDTH) + (1 + (x)))
 #define POINT_TO_POSITION(point)		\
@@ -50,6 +55,11 @@
 #define BOARD_FULL_GRID_SIZE	(POSITION (BOARD_MAX_WIDTH,		\
 					   BOARD_MAX_HEIGHT) + 1)
 
+/* Number of positions needed to index all points of a board with
+ * given dimensions, including its off-grid border.
+ */
+#define BOARD_GRID_SIZE_FOR(width, height)	(POSITION ((width), (height)) + 1)
+
 #define ON_SIZED_GRID(width, height, x, y)				\
   ((unsigned int) (x) < (unsigned int) (width)				\
    && (unsigned int) (y) < (unsigned int) (height))
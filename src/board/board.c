@@ -24,6 +24,9 @@
 
 #include "board-internals.h"
 #include "game-info.h"
+#include "go.h"
+#include "reversi.h"
+#include "amazons.h"
 #include "utils.h"
 
 #include <assert.h>
@@ -37,9 +40,20 @@
 #define CHANGE_STACK_SIZE_INCREMENT	BOARD_MAX_POSITIONS
 
 
+static void	set_move_functions (Board *board);
+static void	empty_stacks (Board *board);
 static void	clear_board_grid (Board *board);
 
-static void	ensure_change_stack_space (Board *board, int num_entries);
+static int	parse_horizontal_letter (Game game, char character);
+
+static void	allocate_symmetry_zobrist (Board *board);
+static void	reset_symmetry_keys (Board *board);
+static void	update_move_symmetry_keys (Board *board);
+static void	update_symmetry_keys (const Board *board,
+				      uint64_t keys[BOARD_NUM_TRANSFORMS],
+				      int x, int y,
+				      int old_contents, int new_contents);
+static int	is_applicable_transform (const Board *board, int transform);
 
 
 const int delta[8] = {
@@ -59,6 +73,17 @@ const int delta[8] = {
  */
 Board *
 board_new (Game game, int width, int height)
+{
+  return board_new_with_engine (game, width, height, BOARD_ENGINE_DEFAULT);
+}
+
+
+/* Same as board_new(), but use specified engine for playing and
+ * undoing moves.  Engines produce identical boards, but differ in
+ * speed.
+ */
+Board *
+board_new_with_engine (Game game, int width, int height, BoardEngine engine)
 {
   Board *board = utils_malloc (sizeof (Board));
   int move_stack_bytes
@@ -68,30 +93,36 @@ board_new (Game game, int width, int height)
   assert (game >= FIRST_GAME && GAME_IS_SUPPORTED (game));
   assert (BOARD_MIN_WIDTH <= width && width <= BOARD_MAX_WIDTH);
   assert (BOARD_MIN_HEIGHT <= height && height <= BOARD_MAX_HEIGHT);
+  assert (engine == BOARD_ENGINE_DEFAULT || engine == BOARD_ENGINE_BITBOARD);
 
   board->game   = game;
   board->width  = width;
   board->height = height;
+  board->engine = engine;
+  board->no_undo = 0;
+  board->estimate_territory = 0;
+  board->symmetry_zobrist = NULL;
 
-  board->is_legal_move = game_info[game].is_legal_move;
-  board->play_move     = game_info[game].play_move;
-  board->undo	       = game_info[game].undo;
+  board->grid = utils_malloc (BOARD_GRID_SIZE_FOR (width, height));
 
+  set_move_functions (board);
   clear_board_grid (board);
+  if (game == GAME_GO)
+    go_allocate_game_data (board);
   if (game_info[game].reset_game_data)
     game_info[game].reset_game_data (board, 1);
 
   board->move_number = 0;
 
   board->move_stack = utils_malloc (move_stack_bytes);
-  board->move_stack_pointer = board->move_stack;
   board->move_stack_end = (char *) board->move_stack + move_stack_bytes;
 
   board->change_stack = utils_malloc (width * height
 				      * sizeof (BoardChangeStackEntry));
-  board->change_stack_pointer = board->change_stack;
   board->change_stack_end = (board->change_stack + width * height);
 
+  empty_stacks (board);
+
   return board;
 }
 
@@ -102,6 +133,11 @@ board_delete (Board *board)
 {
   assert (board);
 
+  if (board->game == GAME_GO)
+    go_free_game_data (board);
+
+  utils_free (board->symmetry_zobrist);
+  utils_free (board->grid);
   utils_free (board->move_stack);
   utils_free (board->change_stack);
   utils_free (board);
@@ -121,9 +157,12 @@ board_duplicate_without_stacks (const Board *board)
 
   assert (board);
 
-  board_copy = board_new (board->game, board->width, board->height);
+  board_copy = board_new_with_engine (board->game,
+				      board->width, board->height,
+				      board->engine);
 
   board_copy->move_number = board->move_number;
+  board_set_no_undo_mode (board_copy, board->no_undo);
 
   for (y = 0, pos = POSITION (0, 0); y < board->height; y++) {
     for (x = 0; x < board->width; x++, pos++)
@@ -131,8 +170,15 @@ board_duplicate_without_stacks (const Board *board)
     pos += BOARD_MAX_WIDTH + 1 - board->width;
   }
 
-  if (board->game == GAME_GO)
-    memcpy (&board_copy->data.go, &board->data.go, sizeof (GoBoardData));
+  if (board->game == GAME_GO) {
+    go_copy_game_data (board_copy, board);
+    board_copy->estimate_territory = board->estimate_territory;
+  }
+  else if (board->game == GAME_REVERSI)
+    board_copy->data.reversi = board->data.reversi;
+
+  if (board->symmetry_zobrist)
+    board_set_symmetry_keys (board_copy, 1);
 
   return board_copy;
 }
@@ -151,30 +197,51 @@ board_set_parameters (Board *board, Game game, int width, int height)
     = (((int) (width * height * game_info[game].relative_num_moves_per_game))
        * game_info[game].stack_entry_size);
   int need_full_reset = 1;
+  int size_changed;
+  int need_go_data;
 
   assert (board);
   assert (game >= FIRST_GAME && GAME_IS_SUPPORTED (game));
   assert (BOARD_MIN_WIDTH <= width && width <= BOARD_MAX_WIDTH);
   assert (BOARD_MIN_HEIGHT <= height && height <= BOARD_MAX_HEIGHT);
 
-  if (board->width != width || board->height != height
-      || board->move_stack_pointer != board->move_stack) {
+  size_changed = (board->width != width || board->height != height);
+  need_go_data = (game == GAME_GO
+		  && (board->game != GAME_GO || size_changed));
+
+  if (board->game == GAME_GO && (game != GAME_GO || size_changed))
+    go_free_game_data (board);
+
+  if (size_changed || board->move_stack_pointer != board->move_stack) {
+    if (size_changed) {
+      board->grid = utils_realloc (board->grid,
+				   BOARD_GRID_SIZE_FOR (width, height));
+    }
+
     board->width  = width;
     board->height = height;
     clear_board_grid (board);
   }
-  else if (board->game != game) {
+  else if (board->game == game)
+    need_full_reset = 0;
+
+  if (board->game != game) {
     board->game = game;
-    board->is_legal_move = game_info[game].is_legal_move;
-    board->play_move     = game_info[game].play_move;
-    board->undo		 = game_info[game].undo;
+    set_move_functions (board);
   }
-  else
-    need_full_reset = 0;
+
+  if (need_go_data)
+    go_allocate_game_data (board);
 
   if (game_info[game].reset_game_data)
     game_info[game].reset_game_data (board, need_full_reset);
 
+  if (board->symmetry_zobrist) {
+    utils_free (board->symmetry_zobrist);
+    allocate_symmetry_zobrist (board);
+    reset_symmetry_keys (board);
+  }
+
   board->move_number = 0;
 
   if ((char *) board->move_stack_end - (char *) board->move_stack
@@ -183,8 +250,6 @@ board_set_parameters (Board *board, Game game, int width, int height)
     board->move_stack_end = ((char *) board->move_stack + move_stack_bytes);
   }
 
-  board->move_stack_pointer = board->move_stack;
-
   if (board->change_stack_end - board->change_stack != width * height) {
     board->change_stack = utils_realloc (board->change_stack,
 					 (width * height
@@ -192,7 +257,58 @@ board_set_parameters (Board *board, Game game, int width, int height)
     board->change_stack_end = board->change_stack + width * height;
   }
 
+  empty_stacks (board);
+}
+
+
+/* Turn no-undo mode on or off.  In this mode moves and position
+ * changes are not saved on board stacks, which makes them cheaper,
+ * but board_undo() cannot be used.  This is meant for code that only
+ * needs final positions, like bulk game replay or random playouts.
+ * Stacks are emptied in any case.
+ *
+ * Since no move history is kept, board_is_game_over() cannot see
+ * passes that end a Go game on a board in no-undo mode.
+ */
+void
+board_set_no_undo_mode (Board *board, int no_undo)
+{
+  assert (board);
+
+  board->no_undo = (no_undo != 0);
+  empty_stacks (board);
+}
+
+
+static void
+set_move_functions (Board *board)
+{
+  if (board->engine == BOARD_ENGINE_BITBOARD && board->game == GAME_GO) {
+    board->is_legal_move = go_bitboard_is_legal_move;
+    board->play_move	 = go_bitboard_play_move;
+    board->undo		 = go_bitboard_undo;
+  }
+  else {
+    board->is_legal_move = game_info[board->game].is_legal_move;
+    board->play_move	 = game_info[board->game].play_move;
+    board->undo		 = game_info[board->game].undo;
+  }
+}
+
+
+static void
+empty_stacks (Board *board)
+{
+  board->move_stack_pointer = board->move_stack;
+  if (board->no_undo) {
+    board->move_stack_pointer = ((char *) board->move_stack
+				 + game_info[board->game].stack_entry_size);
+  }
+
   board->change_stack_pointer = board->change_stack;
+
+  if (board->game == GAME_GO)
+    board->data.go.num_saved_liberty_sets = 0;
 }
 
 
@@ -313,13 +429,81 @@ board_play_move (Board *board, int color, ...)
     board_increase_move_stack_size (board);
 
   memcpy (((BoardStackEntry *) board->move_stack_pointer).grid_copy,
-	  board->grid, BOARD_GRID_SIZE * sizeof (char));
+	  board->grid, BOARD_GRID_SIZE_FOR (board->width, board->height));
 #endif
 
   va_start (move, color);
   board->play_move (board, color, move);
   va_end (move);
 
+  if (board->symmetry_zobrist)
+    update_move_symmetry_keys (board);
+
+#if BOARD_VALIDATION_LEVEL > 0
+  board_validate (board);
+#endif
+}
+
+
+/* The following functions play a move of specific game, just like
+ * board_play_move() does.  However, they take positions rather than
+ * coordinates and bypass variable argument lists and move function
+ * pointers, so they are cheaper for code that plays many moves.
+ */
+
+/* Play a Go move at `pos', which may be PASS_MOVE. */
+inline void
+board_play_go_move_fast (Board *board, int color, int pos)
+{
+  assert (board);
+  assert (board->game == GAME_GO);
+  assert (IS_STONE (color));
+
+  if (board->engine == BOARD_ENGINE_BITBOARD)
+    go_bitboard_play_move_at (board, color, pos);
+  else
+    go_play_move_at (board, color, pos);
+
+  if (board->symmetry_zobrist)
+    update_move_symmetry_keys (board);
+
+#if BOARD_VALIDATION_LEVEL > 0
+  board_validate (board);
+#endif
+}
+
+
+inline void
+board_play_reversi_move_fast (Board *board, int color, int pos)
+{
+  assert (board);
+  assert (board->game == GAME_REVERSI);
+  assert (IS_STONE (color));
+
+  reversi_play_move_at (board, color, pos);
+
+  if (board->symmetry_zobrist)
+    update_move_symmetry_keys (board);
+
+#if BOARD_VALIDATION_LEVEL > 0
+  board_validate (board);
+#endif
+}
+
+
+inline void
+board_play_amazons_move_fast (Board *board, int color,
+			      int from, int to, int shoot_arrow_to)
+{
+  assert (board);
+  assert (board->game == GAME_AMAZONS);
+  assert (IS_STONE (color));
+
+  amazons_play_move_at (board, color, from, to, shoot_arrow_to);
+
+  if (board->symmetry_zobrist)
+    update_move_symmetry_keys (board);
+
 #if BOARD_VALIDATION_LEVEL > 0
   board_validate (board);
 #endif
@@ -345,7 +529,7 @@ board_apply_changes
     board_increase_move_stack_size (board);
 
   memcpy (((BoardStackEntry *) board->move_stack_pointer).grid_copy,
-	  board->grid, BOARD_GRID_SIZE * sizeof (char));
+	  board->grid, BOARD_GRID_SIZE_FOR (board->width, board->height));
 #endif
 
   num_changes = 0;
@@ -356,7 +540,11 @@ board_apply_changes
 
   assert (num_changes > 0);
 
-  ensure_change_stack_space (board, num_changes);
+  /* Changes are saved even in no-undo mode, since game-specific code
+   * uses them to update its data.  In that mode they are dropped
+   * right afterwards.
+   */
+  board_ensure_change_stack_space (board, num_changes);
 
   for (color = 0; color < NUM_ON_GRID_VALUES; color++) {
     if (change_lists[color]) {
@@ -369,6 +557,9 @@ board_apply_changes
 	board->change_stack_pointer->contents = board->grid[pos];
 	board->change_stack_pointer++;
 
+	if (board->symmetry_zobrist)
+	  board_toggle_symmetry_keys (board, pos, board->grid[pos], color);
+
 	board->grid[pos] = color;
       }
     }
@@ -376,6 +567,9 @@ board_apply_changes
 
   game_info[board->game].apply_changes (board, num_changes);
 
+  if (board->no_undo)
+    board->change_stack_pointer -= num_changes;
+
 #if BOARD_VALIDATION_LEVEL > 0
   board_validate (board);
 #endif
@@ -398,7 +592,7 @@ board_add_dummy_move_entry (Board *board)
     board_increase_move_stack_size (board);
 
   memcpy (((BoardStackEntry *) board->move_stack_pointer).grid_copy,
-	  board->grid, BOARD_GRID_SIZE * sizeof (char));
+	  board->grid, BOARD_GRID_SIZE_FOR (board->width, board->height));
 #endif
 
   game_info[board->game].add_dummy_move_entry (board);
@@ -415,13 +609,21 @@ board_undo (Board *board, int num_undos)
   int k;
 
   assert (board);
+  assert (!board->no_undo);
 
   assert (((char *) board->move_stack_pointer
 	   - (num_undos * game_info[board->game].stack_entry_size))
 	  >= (char *) board->move_stack);
 
-  for (k = 0; k < num_undos; k++)
+  for (k = 0; k < num_undos; k++) {
+    /* The keys still match the position right after the move, so the
+     * same update reverts it.
+     */
+    if (board->symmetry_zobrist)
+      update_move_symmetry_keys (board);
+
     board->undo (board);
+  }
 
 #if BOARD_VALIDATION_LEVEL > 0
   board_validate (board);
@@ -450,6 +652,7 @@ board_get_move_number (const Board *board, int num_moves_backward)
 {
   assert (board);
   assert (num_moves_backward >= 0);
+  assert (num_moves_backward == 0 || !board->no_undo);
   assert (((char *) board->move_stack_pointer
 	   - (num_moves_backward * game_info[board->game].stack_entry_size))
 	  >= (char *) board->move_stack);
@@ -467,6 +670,28 @@ board_get_move_number (const Board *board, int num_moves_backward)
 }
 
 
+/* Fill `moves' with all legal moves of `color' and return their
+ * number.  SGF rule sets allow nearly anything, so moves legal
+ * according to the default rules are generated for them.  Passes are
+ * never included, even if they are legal.
+ */
+int
+board_generate_legal_moves (const Board *board, BoardRuleSet rule_set,
+			    int color, BoardMoveList *moves)
+{
+  assert (board);
+  assert (rule_set >= FIRST_RULE_SET);
+  assert (IS_STONE (color));
+  assert (moves);
+
+  moves->num_moves = 0;
+  game_info[board->game].generate_legal_moves (board, rule_set, color,
+					       moves);
+
+  return moves->num_moves;
+}
+
+
 inline void
 board_undo_changes (Board *board, int num_changes)
 {
@@ -474,12 +699,485 @@ board_undo_changes (Board *board, int num_changes)
 
   for (k = 0; k < num_changes; k++) {
     board->change_stack_pointer--;
+
+    if (board->symmetry_zobrist) {
+      int pos = board->change_stack_pointer->position;
+
+      board_toggle_symmetry_keys (board, pos, board->grid[pos],
+				  board->change_stack_pointer->contents);
+    }
+
     board->grid[board->change_stack_pointer->position]
       = board->change_stack_pointer->contents;
   }
 }
 
 
+
+/* Board snapshots store the position on a board, but not its move
+ * history, so that it can be restored in place later.  Only points of
+ * the actual board are stored, followed by whatever game-specific data
+ * is needed to restore the board exactly.  Thus a snapshot of a 19x19
+ * Go board takes a few kilobytes and restoring it takes time
+ * proportional to the board's area, not to the maximal one.
+ *
+ * Snapshot memory has no particular alignment beyond that of `int',
+ * so game data is only accessed with memcpy().
+ */
+struct _BoardSnapshot {
+  MEMORY_POOL_ITEM_INDEX;
+
+  Game		 game;
+  int		 width;
+  int		 height;
+  BoardEngine	 engine;
+
+  unsigned int	 move_number;
+
+  /* Board grid rows followed by game data. */
+  char		 memory[1];
+};
+
+
+/* Initialize a pool for snapshots of boards of the same game,
+ * dimensions and engine as `board'.
+ */
+void
+board_snapshot_pool_init (BoardSnapshotPool *pool, const Board *board)
+{
+  int snapshot_size;
+
+  assert (pool);
+  assert (board);
+
+  pool->game   = board->game;
+  pool->width  = board->width;
+  pool->height = board->height;
+  pool->engine = board->engine;
+
+  snapshot_size = (STRUCTURE_FIELD_OFFSET (BoardSnapshot, memory)
+		   + board->width * board->height);
+  if (board->game == GAME_GO)
+    snapshot_size += go_get_snapshot_data_size (board);
+  else if (board->game == GAME_REVERSI)
+    snapshot_size += sizeof (ReversiBoardData);
+
+  /* Keep `int' fields of all snapshots in a chunk aligned. */
+  snapshot_size = ROUND_UP (snapshot_size, sizeof (int));
+
+  memory_pool_init (&pool->pool, snapshot_size,
+		    STRUCTURE_FIELD_OFFSET (BoardSnapshot, item_index));
+}
+
+
+/* Free all snapshots allocated from the pool.  If memory pools are
+ * disabled at compile time, snapshots must have been deleted with
+ * board_snapshot_delete() before.
+ */
+void
+board_snapshot_pool_dispose (BoardSnapshotPool *pool)
+{
+  assert (pool);
+
+#if ENABLE_MEMORY_POOLS
+  memory_pool_flush (&pool->pool);
+#endif
+}
+
+
+/* Take a snapshot of `board', which must match the pool.  Restoring
+ * it with board_snapshot_restore() later brings the board to the same
+ * position, including Go ko state and prisoners.  Move history is not
+ * stored.
+ */
+BoardSnapshot *
+board_snapshot_take (BoardSnapshotPool *pool, const Board *board)
+{
+  BoardSnapshot *snapshot;
+  char *data;
+  int y;
+
+  assert (pool);
+  assert (board);
+  assert (board->game == pool->game
+	  && board->width == pool->width && board->height == pool->height
+	  && board->engine == pool->engine);
+
+  snapshot = memory_pool_alloc (&pool->pool);
+
+  snapshot->game	= board->game;
+  snapshot->width	= board->width;
+  snapshot->height	= board->height;
+  snapshot->engine	= board->engine;
+  snapshot->move_number = board->move_number;
+
+  for (y = 0, data = snapshot->memory; y < board->height;
+       y++, data += board->width)
+    memcpy (data, board->grid + POSITION (0, y), board->width);
+
+  if (board->game == GAME_GO)
+    go_take_snapshot_data (board, data);
+  else if (board->game == GAME_REVERSI)
+    memcpy (data, &board->data.reversi, sizeof (ReversiBoardData));
+
+  return snapshot;
+}
+
+
+/* Restore a position stored in `snapshot' on `board', which must be
+ * of the same game, dimensions and engine as the board the snapshot
+ * was taken from.  Board stacks are emptied, so moves played before
+ * cannot be undone afterwards.
+ */
+void
+board_snapshot_restore (const BoardSnapshot *snapshot, Board *board)
+{
+  const char *data;
+  int y;
+
+  assert (snapshot);
+  assert (board);
+  assert (board->game == snapshot->game
+	  && board->width == snapshot->width
+	  && board->height == snapshot->height
+	  && board->engine == snapshot->engine);
+
+  board->move_number = snapshot->move_number;
+
+  for (y = 0, data = snapshot->memory; y < board->height;
+       y++, data += board->width)
+    memcpy (board->grid + POSITION (0, y), data, board->width);
+
+  if (board->game == GAME_GO)
+    go_restore_snapshot_data (board, data);
+  else if (board->game == GAME_REVERSI)
+    memcpy (&board->data.reversi, data, sizeof (ReversiBoardData));
+
+  empty_stacks (board);
+
+  if (board->symmetry_zobrist)
+    reset_symmetry_keys (board);
+
+#if BOARD_VALIDATION_LEVEL > 0
+  board_validate (board);
+#endif
+}
+
+
+void
+board_snapshot_delete (BoardSnapshotPool *pool, BoardSnapshot *snapshot)
+{
+  assert (pool);
+  assert (snapshot);
+
+  memory_pool_free (&pool->pool, snapshot);
+}
+
+
+
+
+/* Symmetry keys identify a position regardless of how the board is
+ * rotated or mirrored and, for Go, of which color is which.  For each
+ * transform, a Zobrist key of the transformed position is kept.  The
+ * canonical key is then the smallest of the keys, found without
+ * transforming the board.
+ *
+ * Zobrist values of (point, contents) pairs come from mix_key() rather
+ * than from random tables, so there is no shared state to initialize.
+ * A board with maintained keys precomputes them into its own table,
+ * so that a changed point costs a row of XORs.  Moves report the
+ * points they change (see update_move_symmetry_keys()), while
+ * board_apply_changes() and board_undo_changes() update keys for the
+ * points they write.
+ */
+
+/* Enable or disable maintaining symmetry keys on `board'.  Without
+ * them, board_compute_canonical_key() has to hash the whole board on
+ * each call.
+ */
+void
+board_set_symmetry_keys (Board *board, int enable)
+{
+  assert (board);
+
+  if (enable && !board->symmetry_zobrist) {
+    allocate_symmetry_zobrist (board);
+    reset_symmetry_keys (board);
+  }
+  else if (!enable && board->symmetry_zobrist) {
+    utils_free (board->symmetry_zobrist);
+    board->symmetry_zobrist = NULL;
+  }
+}
+
+
+/* Update symmetry keys of `board' for a change of contents of `pos'.
+ * Must only be called if the board maintains the keys.
+ */
+void
+board_toggle_symmetry_keys (Board *board, int pos,
+			    int old_contents, int new_contents)
+{
+  if (old_contents != new_contents) {
+    int point = POSITION_Y (pos) * board->width + POSITION_X (pos);
+    const uint64_t *old_values
+      = (board->symmetry_zobrist
+	 + (point * NUM_ON_GRID_VALUES + old_contents) * BOARD_NUM_TRANSFORMS);
+    const uint64_t *new_values
+      = (board->symmetry_zobrist
+	 + (point * NUM_ON_GRID_VALUES + new_contents) * BOARD_NUM_TRANSFORMS);
+    int k;
+
+    assert (0 <= old_contents && old_contents < NUM_ON_GRID_VALUES);
+    assert (0 <= new_contents && new_contents < NUM_ON_GRID_VALUES);
+
+    for (k = 0; k < BOARD_NUM_TRANSFORMS; k++)
+      board->symmetry_keys[k] ^= old_values[k] ^ new_values[k];
+  }
+}
+
+
+/* Compute a key of the position on `board' that is the same for all
+ * positions differing only by a board symmetry and, for Go, by colors.
+ * If `transform' is not NULL, it receives the transform that brings
+ * the position to its canonical form, to be used with
+ * board_point_transform() and board_transform_contents().  Only board
+ * contents are hashed: callers that need to tell apart positions with
+ * different ko state or player to move must account for that.
+ */
+uint64_t
+board_compute_canonical_key (const Board *board, int *transform)
+{
+  uint64_t computed_keys[BOARD_NUM_TRANSFORMS];
+  const uint64_t *keys;
+  int best_transform = BOARD_TRANSFORM_IDENTITY;
+  int k;
+
+  assert (board);
+
+  if (board->symmetry_zobrist)
+    keys = board->symmetry_keys;
+  else {
+    int x;
+    int y;
+
+    memset (computed_keys, 0, sizeof computed_keys);
+
+    for (y = 0; y < board->height; y++) {
+      for (x = 0; x < board->width; x++) {
+	int contents = board->grid[POSITION (x, y)];
+
+	if (contents != EMPTY)
+	  update_symmetry_keys (board, computed_keys, x, y, EMPTY, contents);
+      }
+    }
+
+    keys = computed_keys;
+  }
+
+  for (k = 1; k < BOARD_NUM_TRANSFORMS; k++) {
+    if (is_applicable_transform (board, k) && keys[k] < keys[best_transform])
+      best_transform = k;
+  }
+
+  if (transform)
+    *transform = best_transform;
+
+  return (keys[best_transform]
+	  ^ mix_key (((uint64_t) board->game << 16)
+		     | (board->width << 8) | board->height));
+}
+
+
+/* Map `point' of a `width' by `height' board through `transform'. */
+void
+board_point_transform (BoardPoint *point, int width, int height,
+		       int transform)
+{
+  assert (point);
+  assert (ON_SIZED_GRID (width, height, point->x, point->y));
+  assert (0 <= transform && transform < BOARD_NUM_TRANSFORMS);
+
+  if (transform & BOARD_TRANSFORM_TRANSPOSE) {
+    int temp = point->x;
+
+    point->x = point->y;
+    point->y = temp;
+
+    temp   = width;
+    width  = height;
+    height = temp;
+  }
+
+  if (transform & BOARD_TRANSFORM_MIRROR_X)
+    point->x = width - 1 - point->x;
+  if (transform & BOARD_TRANSFORM_MIRROR_Y)
+    point->y = height - 1 - point->y;
+}
+
+
+/* The inverse of board_point_transform(): map a point of the
+ * transformed board back to the `width' by `height' board.
+ */
+void
+board_point_untransform (BoardPoint *point, int width, int height,
+			 int transform)
+{
+  int transformed_width  = width;
+  int transformed_height = height;
+
+  assert (point);
+  assert (0 <= transform && transform < BOARD_NUM_TRANSFORMS);
+
+  if (transform & BOARD_TRANSFORM_TRANSPOSE) {
+    transformed_width  = height;
+    transformed_height = width;
+  }
+
+  assert (ON_SIZED_GRID (transformed_width, transformed_height,
+			 point->x, point->y));
+
+  if (transform & BOARD_TRANSFORM_MIRROR_X)
+    point->x = transformed_width - 1 - point->x;
+  if (transform & BOARD_TRANSFORM_MIRROR_Y)
+    point->y = transformed_height - 1 - point->y;
+
+  if (transform & BOARD_TRANSFORM_TRANSPOSE) {
+    int temp = point->x;
+
+    point->x = point->y;
+    point->y = temp;
+  }
+}
+
+
+/* Return what `contents' of a point becomes under `transform'. */
+int
+board_transform_contents (int contents, int transform)
+{
+  assert (0 <= transform && transform < BOARD_NUM_TRANSFORMS);
+
+  if ((transform & BOARD_TRANSFORM_SWAP_COLORS) && IS_STONE (contents))
+    return OTHER_COLOR (contents);
+
+  return contents;
+}
+
+
+/* Allocate and fill the Zobrist table of `board'.  Values of each
+ * (point, contents) pair under all transforms are stored together.
+ * Empty points and inapplicable transforms get zeros, so they never
+ * change the keys.
+ */
+static void
+allocate_symmetry_zobrist (Board *board)
+{
+  uint64_t *values;
+  int x;
+  int y;
+  int contents;
+
+  board->symmetry_zobrist
+    = utils_malloc (board->width * board->height * NUM_ON_GRID_VALUES
+		    * BOARD_NUM_TRANSFORMS * sizeof (uint64_t));
+
+  for (y = 0, values = board->symmetry_zobrist; y < board->height; y++) {
+    for (x = 0; x < board->width; x++) {
+      for (contents = 0; contents < NUM_ON_GRID_VALUES;
+	   contents++, values += BOARD_NUM_TRANSFORMS) {
+	memset (values, 0, BOARD_NUM_TRANSFORMS * sizeof (uint64_t));
+	if (contents != EMPTY)
+	  update_symmetry_keys (board, values, x, y, EMPTY, contents);
+      }
+    }
+  }
+}
+
+
+static void
+reset_symmetry_keys (Board *board)
+{
+  int x;
+  int y;
+
+  memset (board->symmetry_keys, 0, sizeof board->symmetry_keys);
+
+  for (y = 0; y < board->height; y++) {
+    for (x = 0; x < board->width; x++) {
+      board_toggle_symmetry_keys (board, POSITION (x, y),
+				  EMPTY, board->grid[POSITION (x, y)]);
+    }
+  }
+}
+
+
+/* Update symmetry keys for the points changed by the last move stack
+ * entry.  The board must still be in the position right after it, so
+ * this serves both playing the move and undoing it.  Entries of
+ * board_apply_changes() are skipped by game-specific code, since keys
+ * are updated as their changes are applied and undone.
+ */
+static void
+update_move_symmetry_keys (Board *board)
+{
+  if (board->game == GAME_GO)
+    go_update_symmetry_keys (board);
+  else if (board->game == GAME_REVERSI)
+    reversi_update_symmetry_keys (board);
+  else if (board->game == GAME_AMAZONS)
+    amazons_update_symmetry_keys (board);
+}
+
+
+/* Update `keys' for a change of contents of point (x, y).  Only keys
+ * of applicable transforms are maintained.
+ */
+static void
+update_symmetry_keys (const Board *board,
+		      uint64_t keys[BOARD_NUM_TRANSFORMS], int x, int y,
+		      int old_contents, int new_contents)
+{
+  int k;
+
+  for (k = 0; k < BOARD_NUM_TRANSFORMS; k++) {
+    if (is_applicable_transform (board, k)) {
+      BoardPoint point;
+      uint64_t point_index;
+
+      point.x = x;
+      point.y = y;
+      board_point_transform (&point, board->width, board->height, k);
+
+      /* Applicable transforms don't change board dimensions. */
+      point_index = point.y * board->width + point.x;
+
+      if (old_contents != EMPTY) {
+	int contents = board_transform_contents (old_contents, k);
+
+	keys[k] ^= mix_key (((uint64_t) contents << 32) | point_index);
+      }
+
+      if (new_contents != EMPTY) {
+	int contents = board_transform_contents (new_contents, k);
+
+	keys[k] ^= mix_key (((uint64_t) contents << 32) | point_index);
+      }
+    }
+  }
+}
+
+
+static int
+is_applicable_transform (const Board *board, int transform)
+{
+  return (((transform & BOARD_TRANSFORM_TRANSPOSE) == 0
+	   || board->width == board->height)
+	  && ((transform & BOARD_TRANSFORM_SWAP_COLORS) == 0
+	      || board->game == GAME_GO));
+}
+
+
+
 
 /* Allocate an entry on stack.  The duty of the function is to
  * reallocate the stack if there is no more space in it.  It also
@@ -503,20 +1201,42 @@ board_increase_move_stack_size (Board *board)
 }
 
 
-static void
-ensure_change_stack_space (Board *board, int num_entries)
+/* Make sure there is space for `num_positions' more positions in
+ * given move list.  Generators call this before storing moves.
+ */
+void
+board_move_list_reserve (BoardMoveList *list, int num_positions)
+{
+  int num_needed_positions = (list->num_moves * list->positions_per_move
+			      + num_positions);
+
+  if (num_needed_positions > list->num_allocated_positions) {
+    do
+      list->num_allocated_positions *= 2;
+    while (num_needed_positions > list->num_allocated_positions);
+
+    list->positions = utils_realloc (list->positions,
+				     (list->num_allocated_positions
+				      * sizeof (int)));
+  }
+}
+
+
+void
+board_ensure_change_stack_space (Board *board, int num_entries)
 {
   if (board->change_stack_pointer + num_entries > board->change_stack_end) {
     int size_increment = ((1 + (num_entries - 1) / CHANGE_STACK_SIZE_INCREMENT)
 			  * CHANGE_STACK_SIZE_INCREMENT);
     int new_stack_size = (board->change_stack_end - board->change_stack
 			  + size_increment);
+    int num_used_entries = board->change_stack_pointer - board->change_stack;
 
     board->change_stack
       = utils_realloc (board->change_stack,
 		       new_stack_size * sizeof (BoardChangeStackEntry));
     board->change_stack_end = board->change_stack + new_stack_size;
-    board->change_stack_pointer = board->change_stack_end - size_increment;
+    board->change_stack_pointer = board->change_stack + num_used_entries;
   }
 }
 
@@ -572,6 +1292,34 @@ board_validate (const Board *board)
 
 
 
+/* Create an empty move list for board_generate_legal_moves().  The
+ * same list can be reused for any number of calls.
+ */
+BoardMoveList *
+board_move_list_new (void)
+{
+  BoardMoveList *list = utils_malloc (sizeof (BoardMoveList));
+
+  list->num_moves		= 0;
+  list->positions_per_move	= 1;
+  list->num_allocated_positions = BOARD_MAX_POSITIONS;
+  list->positions = utils_malloc (BOARD_MAX_POSITIONS * sizeof (int));
+
+  return list;
+}
+
+
+void
+board_move_list_delete (BoardMoveList *list)
+{
+  assert (list);
+
+  utils_free (list->positions);
+  utils_free (list);
+}
+
+
+
 BoardPositionList *
 board_position_list_new (const int *positions, int num_positions)
 {
@@ -816,10 +1564,40 @@ game_from_game_name (const char *game_name, int case_sensitive)
 }
 
 
+/* Store the horizontal coordinate of column `x' in `coordinate' and
+ * return its length.  Columns beyond the game's coordinate letters
+ * get two letters, like `AA', `AB' and so on for Go.
+ */
+int
+game_get_horizontal_coordinate (Game game, int x, char coordinate[3])
+{
+  const char *coordinates = game_info[game].horizontal_coordinates;
+  int num_coordinates = strlen (coordinates);
+
+  assert (game >= FIRST_GAME && GAME_IS_SUPPORTED (game));
+  assert (0 <= x && x < BOARD_MAX_WIDTH);
+
+  if (x < num_coordinates) {
+    coordinate[0] = coordinates[x];
+    coordinate[1] = 0;
+
+    return 1;
+  }
+
+  coordinate[0] = coordinates[x / num_coordinates - 1];
+  coordinate[1] = coordinates[x % num_coordinates];
+  coordinate[2] = 0;
+
+  return 2;
+}
+
+
 void
 game_format_point (Game game, int board_width, int board_height,
 		   StringBuffer *buffer, int x, int y)
 {
+  char coordinate[3];
+
   assert (game >= FIRST_GAME && GAME_IS_SUPPORTED (game));
   assert (BOARD_MIN_WIDTH <= board_width && board_width <= BOARD_MAX_WIDTH);
   assert (BOARD_MIN_HEIGHT <= board_height
@@ -827,8 +1605,8 @@ game_format_point (Game game, int board_width, int board_height,
   assert (buffer);
   assert (ON_SIZED_GRID (board_width, board_height, x, y));
 
-  string_buffer_cprintf (buffer, "%c%d", 
-			 game_info[game].horizontal_coordinates[x],
+  game_get_horizontal_coordinate (game, x, coordinate);
+  string_buffer_cprintf (buffer, "%s%d", coordinate,
 			 (game_info[game].reversed_vertical_coordinates
 			  ? board_height - y : y + 1));
 }
@@ -933,7 +1711,8 @@ game_parse_point (Game game, int board_width, int board_height,
 		  const char *point_string, int *x, int *y)
 {
   int x_temp;
-  char x_normalized;
+  int second_letter;
+  int num_letters = 1;
 
   assert (game >= FIRST_GAME && GAME_IS_SUPPORTED (game));
   assert (BOARD_MIN_WIDTH <= board_width && board_width <= BOARD_MAX_WIDTH);
@@ -943,35 +1722,33 @@ game_parse_point (Game game, int board_width, int board_height,
   assert (x);
   assert (y);
 
-  if ('A' <= *point_string && *point_string < 'Z')
-    x_temp = *point_string - 'A';
-  else if ('a' <= *point_string && *point_string < 'z')
-    x_temp = *point_string - 'a';
-  else
+  x_temp = parse_horizontal_letter (game, point_string[0]);
+  if (x_temp < 0)
     return 0;
 
-  x_normalized = game_info[game].horizontal_coordinates[0] + x_temp;
-  if (x_temp < board_width
-      && game_info[game].horizontal_coordinates[x_temp] == x_normalized)
-    *x = x_temp;
-  else if (x_temp - 1 < board_width
-	   && (game_info[game].horizontal_coordinates[x_temp - 1]
-	       == x_normalized))
-    *x = x_temp - 1;
-  else
+  second_letter = parse_horizontal_letter (game, point_string[1]);
+  if (second_letter >= 0) {
+    x_temp = ((x_temp + 1) * strlen (game_info[game].horizontal_coordinates)
+	      + second_letter);
+    num_letters = 2;
+  }
+
+  if (x_temp >= board_width)
     return 0;
 
-  if ('1' <= *(point_string + 1) && *(point_string + 1) <= '9') {
+  *x = x_temp;
+
+  if ('1' <= point_string[num_letters] && point_string[num_letters] <= '9') {
     int num_characters_eaten;
 
-    sscanf (point_string + 1, "%d%n", y, &num_characters_eaten);
+    sscanf (point_string + num_letters, "%d%n", y, &num_characters_eaten);
     if (*y <= board_height) {
       if (game_info[game].reversed_vertical_coordinates)
 	*y = board_height - *y;
       else
 	(*y)--;
 
-      return 1 + num_characters_eaten;
+      return num_letters + num_characters_eaten;
     }
   }
 
@@ -979,6 +1756,25 @@ game_parse_point (Game game, int board_width, int board_height,
 }
 
 
+/* Return the index of `character' among the game's horizontal
+ * coordinate letters, ignoring case, or -1 if it is not one of them.
+ */
+static int
+parse_horizontal_letter (Game game, char character)
+{
+  const char *coordinates = game_info[game].horizontal_coordinates;
+  const char *letter;
+
+  if ('a' <= character && character <= 'z')
+    character += 'A' - 'a';
+  else if (!('A' <= character && character <= 'Z'))
+    return -1;
+
+  letter = strchr (coordinates, character);
+  return letter ? letter - coordinates : -1;
+}
+
+
 BoardPositionList *
 game_parse_position_list (Game game, int board_width, int board_height,
 			  const char *positions_string)
@@ -31,6 +31,7 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 
 
@@ -78,33 +79,136 @@ struct _BoardPoint {
 };
 
 
+/* Symmetries of a board, as combinations of flags.  A transform first
+ * transposes the board (swaps `x' and `y'), then mirrors it.  Flag
+ * BOARD_TRANSFORM_SWAP_COLORS exchanges black and white.  Transposing
+ * transforms only apply to square boards and color swapping only to
+ * Go.  See board_compute_canonical_key().
+ */
+#define BOARD_TRANSFORM_IDENTITY	0
+#define BOARD_TRANSFORM_MIRROR_X	1
+#define BOARD_TRANSFORM_MIRROR_Y	2
+#define BOARD_TRANSFORM_TRANSPOSE	4
+#define BOARD_TRANSFORM_SWAP_COLORS	8
+
+#define BOARD_NUM_TRANSFORMS		16
+
+
 
 /* Go-specific definitions. */
 
-#define GO_STRING_RING_SIZE	(BOARD_MAX_POSITIONS			\
-				 + BOARD_MAX_WIDTH + BOARD_MAX_HEIGHT)
+/* Size of the string ring of a board with given dimensions.  This is
+ * more than the number of strings there can be, so that a free string
+ * number is usually found at once.
+ */
+#define GO_STRING_RING_SIZE_FOR(width, height)				\
+  ((width) * (height) + (width) + (height))
+
+#define GO_STRING_RING_SIZE						\
+  GO_STRING_RING_SIZE_FOR (BOARD_MAX_WIDTH, BOARD_MAX_HEIGHT)
 
 #define PASS_X			NULL_X
 #define PASS_Y			NULL_Y
 #define PASS_MOVE		NULL_POSITION
 #define IS_PASS(x, y)		IS_NULL_POINT ((x), (y))
 
+/* Bitboard rows.  Row zero and the last row are always empty so that
+ * neighbors of any on-board row can be accessed without checks.
+ */
+#define GO_BITBOARD_NUM_ROWS	(BOARD_MAX_HEIGHT + 2)
+
+
 
+typedef struct _GoBitboard	GoBitboard;
 typedef struct _GoBoardData	GoBoardData;
 
+typedef struct _GoReader		GoReader;
+typedef struct _GoTacticalAnalysis	GoTacticalAnalysis;
+
+typedef enum {
+  GO_READING_UNKNOWN,
+  GO_READING_CAPTURED,
+  GO_READING_SURVIVES
+} GoReadingResult;
+
+/* A set of board points.  Point (x, y) is bit `x' of row `y + 1'. */
+struct _GoBitboard {
+  uint64_t	rows[GO_BITBOARD_NUM_ROWS];
+};
+
+/* Arrays indexed by positions or string numbers are sized for the
+ * actual board and allocated in one block by go_allocate_game_data(),
+ * so that small boards stay small.
+ */
 struct _GoBoardData{
   int		ko_master;
   int		ko_position;
   int		prisoners[NUM_COLORS];
 
+  int		grid_size;
+  int		string_ring_size;
+
+  /* Liberties of string `k' are `liberty_set_size' words starting at
+   * `liberty_sets + k * liberty_set_size'.  Point (x, y) is bit
+   * `y * width + x' of the set, so that sets have no padding.
+   * `liberty_bits' maps positions to bit indices and
+   * `liberty_positions' maps them back.
+   */
+  int		liberty_set_size;
+
   int		last_string_number;
-  int		string_number[BOARD_GRID_SIZE];
-  int		liberties[GO_STRING_RING_SIZE];
+  int	       *string_number;
+  int	       *liberties;
+  uint64_t     *liberty_sets;
+  unsigned short *liberty_bits;
+  unsigned short *liberty_positions;
+
+  /* Liberty sets of strings that moves on the move stack have merged
+   * with other strings, saved for undoing those moves.  Allocated on
+   * demand and emptied along with the move stack.
+   */
+  uint64_t     *saved_liberty_sets;
+  int		num_saved_liberty_sets;
+  int		max_saved_liberty_sets;
 
   unsigned int	position_mark;
   unsigned int	string_mark;
-  unsigned int	marked_positions[BOARD_GRID_SIZE];
-  unsigned int	marked_strings[GO_STRING_RING_SIZE];
+  unsigned int *marked_positions;
+  unsigned int *marked_strings;
+
+  /* Only maintained by the bitboard engine, which doesn't use string
+   * data above.
+   */
+  GoBitboard	stones[NUM_COLORS];
+  GoBitboard	on_board;
+
+  /* Territory estimate, only maintained if the board's
+   * `estimate_territory' flag is set.  `influence' is positive where
+   * black dominates and negative where white does.  `estimated_grid'
+   * holds board contents the influence currently corresponds to.
+   */
+  int	       *influence;
+  char	       *estimated_grid;
+  int		estimated_territory[NUM_COLORS];
+
+  /* Scratch space for walking strings and regions, one more entry
+   * than there are points on the board.  Functions using it never
+   * call each other while they do.
+   */
+  int	       *queue;
+};
+
+
+
+/* Reversi-specific definitions. */
+
+typedef struct _ReversiBoardData	ReversiBoardData;
+
+/* Disks of each color as 64-bit bitboards, point (x, y) being bit
+ * `8 * y + x'.  Only maintained for boards up to 8x8.
+ */
+struct _ReversiBoardData {
+  uint64_t	disks[NUM_COLORS];
 };
 
 
@@ -127,6 +231,17 @@ union _BoardAbstractMoveData {
 };
 
 
+/* How amazons_estimate_territory() measures distance to a point: in
+ * queen moves (amazon moves, the usual choice during the game) or in
+ * king moves (single steps, which better reflects who will fill a
+ * region once it is contested).
+ */
+typedef enum {
+  AMAZONS_QUEEN_DISTANCE,
+  AMAZONS_KING_DISTANCE
+} AmazonsDistance;
+
+
 
 typedef enum {
   FIRST_RULE_SET,
@@ -147,6 +262,16 @@ typedef enum {
 } BoardRuleSet;
 
 
+/* Implementation of move playing and undoing.  Currently, only Go
+ * has an alternative (bitboard) engine.  For other games, engine
+ * choice is ignored.
+ */
+typedef enum {
+  BOARD_ENGINE_DEFAULT,
+  BOARD_ENGINE_BITBOARD
+} BoardEngine;
+
+
 typedef struct _BoardChangeStackEntry	BoardChangeStackEntry;
 typedef struct _Board			Board;
 
@@ -161,10 +286,32 @@ struct _Board {
   Game			     game;
   int			     width;
   int			     height;
+  BoardEngine		     engine;
+
+  /* If nonzero, moves are not saved on the stacks and so cannot be
+   * undone.  See board_set_no_undo_mode().
+   */
+  int			     no_undo;
+
+  /* Go only.  If nonzero, an estimate of territory is updated with
+   * each move.  See go_set_territory_estimation().
+   */
+  int			     estimate_territory;
+
+  /* If not NULL, position keys under all board transforms are updated
+   * with each move.  `symmetry_zobrist' holds Zobrist values of every
+   * point and contents under each transform.  See
+   * board_set_symmetry_keys().
+   */
+  uint64_t		    *symmetry_zobrist;
+  uint64_t		     symmetry_keys[BOARD_NUM_TRANSFORMS];
 
   unsigned int		     move_number;
 
-  char			     grid[BOARD_FULL_GRID_SIZE];
+  /* Allocated for the board's dimensions, BOARD_GRID_SIZE_FOR() bytes
+   * in total.
+   */
+  char			    *grid;
 
   void			    *move_stack;
   void			    *move_stack_pointer;
@@ -180,6 +327,7 @@ struct _Board {
 
   union {
     GoBoardData		     go;
+    ReversiBoardData	     reversi;
   } data;
 };
 
@@ -192,13 +340,48 @@ struct _BoardPositionList {
 };
 
 
+typedef struct _BoardMoveList		BoardMoveList;
+
+/* Moves generated by board_generate_legal_moves().  For Go and
+ * Reversi, each move is a single position.  For Amazons, a move takes
+ * three consecutive positions: the amazon, where it moves to and
+ * where it shoots an arrow to.
+ */
+struct _BoardMoveList {
+  int		num_moves;
+  int		positions_per_move;
+
+  int		num_allocated_positions;
+  int	       *positions;
+};
+
+
+typedef struct _BoardSnapshot		BoardSnapshot;
+typedef struct _BoardSnapshotPool	BoardSnapshotPool;
+
+/* Snapshots are allocated from pools, each serving boards of one
+ * game, size and engine.  See board_snapshot_take().
+ */
+struct _BoardSnapshotPool {
+  MemoryPool	 pool;
+
+  Game		 game;
+  int		 width;
+  int		 height;
+  BoardEngine	 engine;
+};
+
+
 Board *		board_new (Game game, int width, int height);
+Board *		board_new_with_engine (Game game, int width, int height,
+				       BoardEngine engine);
 void		board_delete (Board *board);
 
 Board *		board_duplicate_without_stacks (const Board *board);
 
 void		board_set_parameters (Board *board, Game game,
 				      int width, int height);
+void		board_set_no_undo_mode (Board *board, int no_undo);
 #define board_clear(board)						\
   board_set_parameters ((board), (board)->game,				\
 			(board)->width, (board)->height)
@@ -212,6 +395,12 @@ inline int	board_is_legal_move (const Board *board, BoardRuleSet rule_set,
 				     int color, ...);
 
 inline void	board_play_move (Board *board, int color, ...);
+inline void	board_play_go_move_fast (Board *board, int color, int pos);
+inline void	board_play_reversi_move_fast (Board *board, int color,
+					      int pos);
+inline void	board_play_amazons_move_fast (Board *board, int color,
+					      int from, int to,
+					      int shoot_arrow_to);
 void		board_apply_changes
 		  (Board *board,
 		   const BoardPositionList *const
@@ -223,11 +412,43 @@ inline int	board_undo (Board *board, int num_moves);
 int		board_get_move_number (const Board *board,
 				       int num_moves_backward);
 
+int		board_generate_legal_moves (const Board *board,
+					    BoardRuleSet rule_set, int color,
+					    BoardMoveList *moves);
+
+
+void		board_snapshot_pool_init (BoardSnapshotPool *pool,
+					  const Board *board);
+void		board_snapshot_pool_dispose (BoardSnapshotPool *pool);
+
+BoardSnapshot *	board_snapshot_take (BoardSnapshotPool *pool,
+				     const Board *board);
+void		board_snapshot_restore (const BoardSnapshot *snapshot,
+					Board *board);
+void		board_snapshot_delete (BoardSnapshotPool *pool,
+				       BoardSnapshot *snapshot);
+
+
+void		board_set_symmetry_keys (Board *board, int enable);
+uint64_t	board_compute_canonical_key (const Board *board,
+					     int *transform);
+
+void		board_point_transform (BoardPoint *point,
+				       int width, int height, int transform);
+void		board_point_untransform (BoardPoint *point,
+					 int width, int height,
+					 int transform);
+int		board_transform_contents (int contents, int transform);
+
 
 inline void	board_dump (const Board *board);
 inline void	board_validate (const Board *board);
 
 
+BoardMoveList *	board_move_list_new (void);
+void		board_move_list_delete (BoardMoveList *list);
+
+
 BoardPositionList *  board_position_list_new (const int *positions,
 					      int num_positions);
 BoardPositionList *  board_position_list_new_empty (int num_positions);
@@ -271,6 +492,8 @@ void		     board_position_list_mark_on_grid
 Game		game_from_game_name (const char *game_name,
 				     int case_sensitive);
 
+int		game_get_horizontal_coordinate (Game game, int x,
+						char coordinate[3]);
 void		game_format_point (Game game,
 				   int board_width, int board_height,
 				   StringBuffer *buffer, int x, int y);
@@ -365,6 +588,7 @@ int		     go_is_same_string (Board *board,
 					int _x1, int _y1, int _x2, int _y2);
 
 BoardPositionList *  go_get_string_stones (Board *board, int x, int y);
+BoardPositionList *  go_get_string_liberties (Board *board, int x, int y);
 BoardPositionList *  go_get_logically_dead_stones (Board *board, int x, int y);
 
 void		     go_score_game (Board *board, const char *dead_stones,
@@ -381,6 +605,50 @@ void		     go_guess_dead_stones
 			const BoardPositionList *black_territory,
 			const BoardPositionList *white_territory);
 
+void		     go_set_territory_estimation (Board *board, int enable);
+void		     go_get_territory_estimate (const Board *board,
+						char *territory,
+						int *black_territory,
+						int *white_territory);
+
+
+/* Result of go_reader_analyze().  Each list holds all stones of the
+ * strings in it, sorted.  A string is in at most one list.
+ */
+struct _GoTacticalAnalysis {
+  /* Strings with one liberty, unless they are in `ladder_captures'. */
+  BoardPositionList  *stones_in_atari;
+
+  /* Strings that can be captured in a ladder. */
+  BoardPositionList  *ladder_captures;
+
+  /* Strings that lose a simple capture race whoever moves first. */
+  BoardPositionList  *lost_semeai;
+
+  int		      num_nodes;
+  int		      incomplete;
+};
+
+
+GoReader *	     go_reader_new (int node_budget, int cache_size);
+void		     go_reader_delete (GoReader *reader);
+
+GoReadingResult	     go_reader_read_ladder (GoReader *reader,
+					    const Board *board,
+					    int x, int y, int color_to_play,
+					    int *move_x, int *move_y);
+GoReadingResult	     go_reader_read_semeai (GoReader *reader,
+					    const Board *board,
+					    int x1, int y1, int x2, int y2,
+					    int color_to_play);
+void		     go_reader_analyze (GoReader *reader, const Board *board,
+					int color_to_play,
+					GoTacticalAnalysis *analysis,
+					const volatile int *cancellation_flag);
+
+void		     go_tactical_analysis_dispose
+		       (GoTacticalAnalysis *analysis);
+
 
 
 /* Reversi-specific function. */
@@ -389,6 +657,15 @@ void		     reversi_count_disks (const Board *board,
 					  int *num_white_disks);
 
 
+
+/* Amazons-specific function. */
+void		     amazons_estimate_territory (const Board *board,
+						 AmazonsDistance distance,
+						 char *territory,
+						 int *black_territory,
+						 int *white_territory);
+
+
 #endif /* QUARRY_BOARD_H */
 
 
@@ -62,6 +62,9 @@ struct _GameInfo {
   BoardPlayMoveFunction		 play_move;
   BoardUndoFunction		 undo;
 
+  void (* generate_legal_moves)	(const Board *board, BoardRuleSet rule_set,
+				 int color, BoardMoveList *moves);
+
   void (* apply_changes)	(Board *board, int num_changes);
   void (* add_dummy_move_entry)	(Board *board);
 
@@ -17,6 +17,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -31,6 +32,7 @@ const GameInfo game_info[] = {
     "ABCDEFGHJKLMNOPQRSTUVWXYZ", 1,
     NULL, go_reset_game_data,
     go_is_legal_move, go_play_move, go_undo,
+    go_generate_legal_moves,
     go_apply_changes, go_add_dummy_move_entry,
     go_format_move, go_parse_move,
     go_validate_board, go_dump_board,
@@ -43,8 +45,9 @@ const GameInfo game_info[] = {
   { N_("Reversi"), 8, "8\00010\000", BLACK, reversi_adjust_color_to_play,
     NULL,
     "ABCDEFGHIJKLMNOPQRSTUVWXY", 0,
-    reversi_get_default_setup, NULL,
+    reversi_get_default_setup, reversi_reset_game_data,
     reversi_is_legal_move, reversi_play_move, reversi_undo,
+    reversi_generate_legal_moves,
     reversi_apply_changes, reversi_add_dummy_move_entry,
     reversi_format_move, reversi_parse_move,
     reversi_validate_board, reversi_dump_board,
@@ -60,6 +63,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -75,6 +79,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -90,6 +95,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -105,6 +111,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -120,6 +127,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -135,6 +143,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -150,6 +159,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -165,6 +175,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -180,6 +191,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -195,6 +207,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -210,6 +223,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -225,6 +239,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -240,6 +255,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -255,6 +271,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -270,6 +287,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -284,6 +302,7 @@ const GameInfo game_info[] = {
     "ABCDEFGHIJKLMNOPQRSTUVWXY", 1,
     amazons_get_default_setup, NULL,
     amazons_is_legal_move, amazons_play_move, amazons_undo,
+    amazons_generate_legal_moves,
     amazons_apply_changes, amazons_add_dummy_move_entry,
     amazons_format_move, amazons_parse_move,
     amazons_validate_board, amazons_dump_board,
@@ -299,6 +318,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -314,6 +334,7 @@ const GameInfo game_info[] = {
     NULL, 0,
     NULL, NULL,
     NULL, NULL, NULL,
+    NULL,
     NULL, NULL,
     NULL, NULL,
     NULL, NULL,
@@ -0,0 +1,1041 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This file is part of Quarry.                                    *
+ *                                                                 *
+ * Copyright (C) 2006 Paul Pogonyshev.                             *
+ *                                                                 *
+ * This program is free software; you can redistribute it and/or   *
+ * modify it under the terms of the GNU General Public License as  *
+ * published by the Free Software Foundation; either version 2 of  *
+ * the License, or (at your option) any later version.             *
+ *                                                                 *
+ * This program is distributed in the hope that it will be useful, *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of  *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the   *
+ * GNU General Public License for more details.                    *
+ *                                                                 *
+ * You should have received a copy of the GNU General Public       *
+ * License along with this program; if not, write to the Free      *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,     *
+ * Boston, MA 02110-1301, USA.                                     *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Tactical reading for Go: ladders and simple capture races.
+ *
+ * Reading is done on a private scratch board of the default engine,
+ * whose liberty sets give liberties of any string at once.  Each move
+ * played counts as a node and a query that runs out of its node
+ * budget gives GO_READING_UNKNOWN.  Definite results are cached under
+ * a Zobrist-style hash of the position, so reading the same position
+ * again (e.g. when the user returns to a node) is almost free.
+ *
+ * A reader must not be used by more than one thread at a time.
+ */
+
+
+#include "go.h"
+#include "board-internals.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+
+/* Strings with more liberties are not considered in capture races.
+ * Races are read to the end, so this bounds their size.
+ */
+#define SEMEAI_MAX_LIBERTIES	4
+
+/* At most this many captures are tried to get a string out of a
+ * ladder.  Defender's moves live in recursive frames, so they must be
+ * few even on the largest boards.
+ */
+#define LADDER_MAX_CAPTURES	8
+
+
+typedef struct _GoReaderCacheEntry	GoReaderCacheEntry;
+
+struct _GoReaderCacheEntry {
+  uint64_t	    key;
+  int		    result;
+  int		    move;
+};
+
+struct _GoReader {
+  Board		   *board;
+  int		    position_is_set_up;
+  uint64_t	    position_hash;
+
+  int		    node_budget;
+  int		    num_nodes;
+  int		    total_num_nodes;
+  int		    incomplete;
+  const volatile int *cancellation_flag;
+
+  GoReaderCacheEntry *cache;
+  int		    cache_mask;
+
+  /* Both sized for the dimensions of `board'.  `stones' is scratch
+   * space for find_capturing_moves(), which is called at each level of
+   * recursion.
+   */
+  unsigned int	    mark;
+  unsigned int	   *marks;
+  int		   *stones;
+};
+
+
+/* Cached queries.  Results are always for the string of the first
+ * position.
+ */
+enum {
+  QUERY_LADDER_ATTACK,
+  QUERY_LADDER_DEFENSE,
+  QUERY_SEMEAI_OWNER_FIRST,
+  QUERY_SEMEAI_OPPONENT_FIRST
+};
+
+/* Capture race outcomes for the player to move. */
+enum {
+  SEMEAI_LOSS = -1,
+  SEMEAI_SEKI,
+  SEMEAI_WIN,
+  SEMEAI_UNKNOWN
+};
+
+/* String categories of go_reader_analyze(). */
+enum {
+  STRING_UNFLAGGED,
+  STRING_IN_ATARI,
+  STRING_LADDER_CAPTURE,
+  STRING_LOST_SEMEAI
+};
+
+
+static void	set_up_position (GoReader *reader, const Board *board,
+				 const volatile int *cancellation_flag);
+static void	tear_down_position (GoReader *reader);
+
+static GoReadingResult
+		read_cached (GoReader *reader, int query, int pos1, int pos2,
+			     int *move);
+
+static GoReadingResult
+		attack_ladder (GoReader *reader, int pos, int *move);
+static GoReadingResult
+		defend_ladder (GoReader *reader, int pos, int *move);
+static int	read_semeai (GoReader *reader, int own, int other,
+			     int other_passed);
+
+static int	count_node (GoReader *reader);
+static int	is_legal_move (const Board *board, int color, int pos);
+static int	get_liberties (const Board *board, int pos,
+			       int *liberties, int max_liberties);
+static int	count_empty_neighbors (const char *grid, int pos);
+static int	is_closed_race (const Board *board, int pos1, int pos2);
+static int	find_capturing_moves (GoReader *reader, int pos,
+				      int *moves, int max_moves);
+static int	mark_string (GoReader *reader, int pos, int *stones);
+
+
+/* Create a reader that spends at most `node_budget' moves on one
+ * query and caches results of `cache_size' queries (rounded up to a
+ * power of two).
+ */
+GoReader *
+go_reader_new (int node_budget, int cache_size)
+{
+  GoReader *reader = utils_malloc0 (sizeof (GoReader));
+  int num_cache_entries = 1;
+
+  assert (node_budget > 0);
+  assert (cache_size > 0);
+
+  while (num_cache_entries < cache_size)
+    num_cache_entries *= 2;
+
+  reader->node_budget = node_budget;
+  reader->cache	      = utils_malloc0 (num_cache_entries
+				       * sizeof (GoReaderCacheEntry));
+  reader->cache_mask  = num_cache_entries - 1;
+
+  return reader;
+}
+
+
+void
+go_reader_delete (GoReader *reader)
+{
+  assert (reader);
+
+  if (reader->board)
+    board_delete (reader->board);
+
+  utils_free (reader->marks);
+  utils_free (reader->stones);
+  utils_free (reader->cache);
+  utils_free (reader);
+}
+
+
+/* Read a ladder on the string at (x, y).  If the string's owner is to
+ * play, find whether the string, which should be in atari, can escape.
+ * Otherwise, find whether the opponent can capture the string, which
+ * should have at most two liberties, by ataris alone.  If `move_x'
+ * and `move_y' are not NULL, they receive the move that works: the
+ * first atari or the escaping move.  They are set to NULL_X and NULL_Y
+ * if no move is needed or none works.
+ */
+GoReadingResult
+go_reader_read_ladder (GoReader *reader, const Board *board,
+		       int x, int y, int color_to_play,
+		       int *move_x, int *move_y)
+{
+  int stones[BOARD_MAX_POSITIONS];
+  int pos = POSITION (x, y);
+  int move = NULL_POSITION;
+  GoReadingResult result;
+
+  assert (reader);
+  assert (board);
+  assert (board->game == GAME_GO);
+  assert (ON_BOARD (board, x, y));
+  assert (IS_STONE (board->grid[pos]));
+  assert (IS_STONE (color_to_play));
+
+  set_up_position (reader, board, NULL);
+
+  /* Stones are marked in increasing order, so the first one is a
+   * representative the same for any stone of the string.
+   */
+  mark_string (reader, pos, stones);
+  result = read_cached (reader,
+			(color_to_play == board->grid[pos]
+			 ? QUERY_LADDER_DEFENSE : QUERY_LADDER_ATTACK),
+			stones[0], NULL_POSITION, &move);
+
+  tear_down_position (reader);
+
+  if (move_x && move_y) {
+    *move_x = (move != NULL_POSITION ? POSITION_X (move) : NULL_X);
+    *move_y = (move != NULL_POSITION ? POSITION_Y (move) : NULL_Y);
+  }
+
+  return result;
+}
+
+
+/* Read a capture race between two adjacent strings of different
+ * colors, at (x1, y1) and (x2, y2), and return its outcome for the
+ * first string.  Only moves that fill liberties of the opponent's
+ * string are considered, so the strings are assumed to have no way of
+ * gaining liberties.  Seki counts as survival.  Strings with more than
+ * a few liberties are not read and give GO_READING_UNKNOWN.
+ */
+GoReadingResult
+go_reader_read_semeai (GoReader *reader, const Board *board,
+		       int x1, int y1, int x2, int y2, int color_to_play)
+{
+  int stones[BOARD_MAX_POSITIONS];
+  int pos1 = POSITION (x1, y1);
+  int pos2 = POSITION (x2, y2);
+  GoReadingResult result = GO_READING_UNKNOWN;
+
+  assert (reader);
+  assert (board);
+  assert (board->game == GAME_GO);
+  assert (ON_BOARD (board, x1, y1));
+  assert (ON_BOARD (board, x2, y2));
+  assert (IS_STONE (board->grid[pos1]));
+  assert (board->grid[pos2] == OTHER_COLOR (board->grid[pos1]));
+  assert (IS_STONE (color_to_play));
+
+  set_up_position (reader, board, NULL);
+
+  if (LIBERTIES (reader->board, pos1) <= SEMEAI_MAX_LIBERTIES
+      && LIBERTIES (reader->board, pos2) <= SEMEAI_MAX_LIBERTIES) {
+    mark_string (reader, pos1, stones);
+    pos1 = stones[0];
+    mark_string (reader, pos2, stones);
+    pos2 = stones[0];
+
+    result = read_cached (reader,
+			  (color_to_play == board->grid[pos1]
+			   ? QUERY_SEMEAI_OWNER_FIRST
+			   : QUERY_SEMEAI_OPPONENT_FIRST),
+			  pos1, pos2, NULL);
+  }
+
+  tear_down_position (reader);
+
+  return result;
+}
+
+
+/* Find strings in atari, strings that can be captured in a ladder and
+ * strings that lose a simple capture race (see
+ * go_reader_read_semeai()).  Strings in atari whose owner is to play
+ * count as ladder captures if they cannot escape.  Strings with two
+ * liberties count as ladder captures if the opponent can capture them
+ * when given a move, whoever is actually to play.
+ *
+ * If `cancellation_flag' is not NULL, reading stops as soon as it is
+ * set, from another thread, which must store to it atomically (e.g.
+ * with g_atomic_int_set()).  Unfinished queries are treated as if the
+ * strings were safe and `analysis->incomplete' is set, as it is when
+ * the node budget runs out.  Free the analysis with
+ * go_tactical_analysis_dispose().
+ */
+void
+go_reader_analyze (GoReader *reader, const Board *board, int color_to_play,
+		   GoTacticalAnalysis *analysis,
+		   const volatile int *cancellation_flag)
+{
+  int stones[BOARD_MAX_POSITIONS];
+  int string_positions[BOARD_MAX_POSITIONS];
+  char string_categories[BOARD_MAX_POSITIONS];
+  int string_indices[GO_STRING_RING_SIZE];
+  char categories[BOARD_GRID_SIZE];
+  int lists[NUM_ON_GRID_VALUES][BOARD_MAX_POSITIONS];
+  int list_lengths[NUM_ON_GRID_VALUES];
+  const char *grid;
+  int num_strings = 0;
+  int x;
+  int y;
+  int pos;
+  int k;
+
+  assert (reader);
+  assert (board);
+  assert (board->game == GAME_GO);
+  assert (IS_STONE (color_to_play));
+  assert (analysis);
+
+  set_up_position (reader, board, cancellation_flag);
+  grid = reader->board->grid;
+
+  for (k = 0; k < board->data.go.string_ring_size; k++)
+    string_indices[k] = -1;
+
+  /* Stones are scanned in increasing order of positions, so each
+   * string is represented by the same stone as in single queries.
+   */
+  for (y = 0, pos = POSITION (0, 0); y < board->height; y++) {
+    for (x = 0; x < board->width; x++, pos++) {
+      if (IS_STONE (grid[pos])
+	  && string_indices[STRING_NUMBER (reader->board, pos)] == -1) {
+	int num_liberties = LIBERTIES (reader->board, pos);
+	int category = STRING_UNFLAGGED;
+
+	if (num_liberties == 1) {
+	  category = STRING_IN_ATARI;
+
+	  if (grid[pos] == color_to_play
+	      && (read_cached (reader, QUERY_LADDER_DEFENSE, pos,
+			       NULL_POSITION, NULL)
+		  == GO_READING_CAPTURED))
+	    category = STRING_LADDER_CAPTURE;
+	}
+	else if (num_liberties == 2
+		 && (read_cached (reader, QUERY_LADDER_ATTACK, pos,
+				  NULL_POSITION, NULL)
+		     == GO_READING_CAPTURED))
+	  category = STRING_LADDER_CAPTURE;
+
+	string_indices[STRING_NUMBER (reader->board, pos)] = num_strings;
+	string_positions[num_strings]			 = pos;
+	string_categories[num_strings++]		 = category;
+      }
+    }
+
+    pos += BOARD_MAX_WIDTH + 1 - board->width;
+  }
+
+  /* Capture races between unflagged strings, each pair read once with
+   * either player moving first.  Strings that could extend out of the
+   * race are not considered, since moves that gain liberties are not
+   * read.
+   */
+  for (k = 0; k < num_strings; k++) {
+    int num_stones;
+    int i;
+
+    if (string_categories[k] != STRING_UNFLAGGED
+	|| LIBERTIES (reader->board, string_positions[k]) > SEMEAI_MAX_LIBERTIES)
+      continue;
+
+    num_stones = mark_string (reader, string_positions[k], stones);
+    for (i = 0; i < num_stones * 4; i++) {
+      int neighbor = stones[i / 4] + delta[i % 4];
+      int other;
+
+      if (grid[neighbor] != OTHER_COLOR (grid[string_positions[k]]))
+	continue;
+
+      other = string_indices[STRING_NUMBER (reader->board, neighbor)];
+      if (other < k
+	  || string_categories[other] == STRING_IN_ATARI
+	  || string_categories[other] == STRING_LADDER_CAPTURE
+	  || (LIBERTIES (reader->board, string_positions[other])
+	      > SEMEAI_MAX_LIBERTIES)
+	  || !is_closed_race (reader->board,
+			      string_positions[k], string_positions[other]))
+	continue;
+
+      if (read_cached (reader, QUERY_SEMEAI_OWNER_FIRST,
+		       string_positions[k], string_positions[other], NULL)
+	  == GO_READING_CAPTURED
+	  && read_cached (reader, QUERY_SEMEAI_OPPONENT_FIRST,
+			  string_positions[k], string_positions[other], NULL)
+	  == GO_READING_CAPTURED)
+	string_categories[k] = STRING_LOST_SEMEAI;
+      else if (read_cached (reader, QUERY_SEMEAI_OWNER_FIRST,
+			    string_positions[other], string_positions[k],
+			    NULL)
+	       == GO_READING_CAPTURED
+	       && read_cached (reader, QUERY_SEMEAI_OPPONENT_FIRST,
+			       string_positions[other], string_positions[k],
+			       NULL)
+	       == GO_READING_CAPTURED)
+	string_categories[other] = STRING_LOST_SEMEAI;
+
+      if (string_categories[k] != STRING_UNFLAGGED)
+	break;
+    }
+  }
+
+  board_fill_grid (reader->board, categories, STRING_UNFLAGGED);
+  for (k = 0; k < num_strings; k++) {
+    if (string_categories[k] != STRING_UNFLAGGED) {
+      int num_stones = mark_string (reader, string_positions[k], stones);
+      int i;
+
+      for (i = 0; i < num_stones; i++)
+	categories[stones[i]] = string_categories[k];
+    }
+  }
+
+  list_lengths[STRING_IN_ATARI]	      = 0;
+  list_lengths[STRING_LADDER_CAPTURE] = 0;
+  list_lengths[STRING_LOST_SEMEAI]    = 0;
+
+  for (y = 0, pos = POSITION (0, 0); y < board->height; y++) {
+    for (x = 0; x < board->width; x++, pos++) {
+      if (categories[pos] != STRING_UNFLAGGED)
+	lists[(int) categories[pos]][list_lengths[(int) categories[pos]]++] = pos;
+    }
+
+    pos += BOARD_MAX_WIDTH + 1 - board->width;
+  }
+
+  analysis->stones_in_atari
+    = (list_lengths[STRING_IN_ATARI]
+       ? board_position_list_new (lists[STRING_IN_ATARI],
+				  list_lengths[STRING_IN_ATARI])
+       : NULL);
+  analysis->ladder_captures
+    = (list_lengths[STRING_LADDER_CAPTURE]
+       ? board_position_list_new (lists[STRING_LADDER_CAPTURE],
+				  list_lengths[STRING_LADDER_CAPTURE])
+       : NULL);
+  analysis->lost_semeai
+    = (list_lengths[STRING_LOST_SEMEAI]
+       ? board_position_list_new (lists[STRING_LOST_SEMEAI],
+				  list_lengths[STRING_LOST_SEMEAI])
+       : NULL);
+
+  analysis->num_nodes  = reader->total_num_nodes;
+  analysis->incomplete = reader->incomplete;
+
+  tear_down_position (reader);
+}
+
+
+void
+go_tactical_analysis_dispose (GoTacticalAnalysis *analysis)
+{
+  assert (analysis);
+
+  if (analysis->stones_in_atari)
+    board_position_list_delete (analysis->stones_in_atari);
+  if (analysis->ladder_captures)
+    board_position_list_delete (analysis->ladder_captures);
+  if (analysis->lost_semeai)
+    board_position_list_delete (analysis->lost_semeai);
+}
+
+
+
+/* Set up the scratch board to the position on `board' and compute the
+ * position hash.  Ko matters for reading, so it is part of the hash.
+ */
+static void
+set_up_position (GoReader *reader, const Board *board,
+		 const volatile int *cancellation_flag)
+{
+  int stones[NUM_COLORS][BOARD_MAX_POSITIONS];
+  int num_stones[NUM_COLORS];
+  uint64_t position_hash;
+  int x;
+  int y;
+  int pos;
+
+  if (!reader->board
+      || reader->board->width != board->width
+      || reader->board->height != board->height) {
+    if (!reader->board)
+      reader->board = board_new (GAME_GO, board->width, board->height);
+    else {
+      board_set_parameters (reader->board, GAME_GO,
+			    board->width, board->height);
+    }
+
+    utils_free (reader->marks);
+    utils_free (reader->stones);
+
+    reader->mark   = 0;
+    reader->marks  = utils_malloc0 (BOARD_GRID_SIZE_FOR (board->width,
+							 board->height)
+				    * sizeof (unsigned int));
+    reader->stones = utils_malloc (board->width * board->height
+				   * sizeof (int));
+  }
+
+  position_hash = mix_key ((board->width << 8) | board->height);
+
+  num_stones[BLACK_INDEX] = 0;
+  num_stones[WHITE_INDEX] = 0;
+
+  for (y = 0, pos = POSITION (0, 0); y < board->height; y++) {
+    for (x = 0; x < board->width; x++, pos++) {
+      if (IS_STONE (board->grid[pos])) {
+	int color_index = COLOR_INDEX (board->grid[pos]);
+
+	stones[color_index][num_stones[color_index]++] = pos;
+	position_hash ^= mix_key ((pos << 2) | board->grid[pos]);
+      }
+    }
+
+    pos += BOARD_MAX_WIDTH + 1 - board->width;
+  }
+
+  if (num_stones[BLACK_INDEX] + num_stones[WHITE_INDEX] > 0) {
+    BoardPositionList *black_stones
+      = board_position_list_new (stones[BLACK_INDEX], num_stones[BLACK_INDEX]);
+    BoardPositionList *white_stones
+      = board_position_list_new (stones[WHITE_INDEX], num_stones[WHITE_INDEX]);
+    const BoardPositionList *position_lists[NUM_ON_GRID_VALUES];
+
+    position_lists[EMPTY]		  = NULL;
+    position_lists[BLACK]		  = black_stones;
+    position_lists[WHITE]		  = white_stones;
+    position_lists[SPECIAL_ON_GRID_VALUE] = NULL;
+
+    board_apply_changes (reader->board, position_lists);
+
+    board_position_list_delete (black_stones);
+    board_position_list_delete (white_stones);
+
+    reader->position_is_set_up = 1;
+  }
+
+  reader->board->data.go.ko_master   = board->data.go.ko_master;
+  reader->board->data.go.ko_position = board->data.go.ko_position;
+
+  if (board->data.go.ko_master != EMPTY) {
+    position_hash ^= mix_key (((uint64_t) 1 << 32)
+			      | (board->data.go.ko_position << 2)
+			      | board->data.go.ko_master);
+  }
+
+  reader->position_hash	    = position_hash;
+  reader->total_num_nodes   = 0;
+  reader->incomplete	    = 0;
+  reader->cancellation_flag = cancellation_flag;
+}
+
+
+/* Return the scratch board to the empty position. */
+static void
+tear_down_position (GoReader *reader)
+{
+  if (reader->position_is_set_up) {
+    board_undo (reader->board, 1);
+    reader->position_is_set_up = 0;
+  }
+
+  reader->board->data.go.ko_master = EMPTY;
+  reader->cancellation_flag	   = NULL;
+}
+
+
+/* Look a query up in the cache and read it if it is not there.  Each
+ * query gets the full node budget.
+ */
+static GoReadingResult
+read_cached (GoReader *reader, int query, int pos1, int pos2, int *move)
+{
+  uint64_t key = (reader->position_hash
+		  ^ mix_key (((uint64_t) (query + 1) << 40)
+			     | (pos1 << 20) | pos2));
+  GoReaderCacheEntry *entry;
+  GoReadingResult result;
+  int found_move = NULL_POSITION;
+
+  if (key == 0)
+    key = 1;
+
+  entry = reader->cache + (key & reader->cache_mask);
+  if (entry->key == key) {
+    if (move)
+      *move = entry->move;
+
+    return entry->result;
+  }
+
+  reader->num_nodes = 0;
+
+  switch (query) {
+  case QUERY_LADDER_ATTACK:
+    result = attack_ladder (reader, pos1, &found_move);
+    break;
+
+  case QUERY_LADDER_DEFENSE:
+    result = defend_ladder (reader, pos1, &found_move);
+    break;
+
+  default:
+    {
+      int outcome = (query == QUERY_SEMEAI_OWNER_FIRST
+		     ? read_semeai (reader, pos1, pos2, 0)
+		     : read_semeai (reader, pos2, pos1, 0));
+
+      if (outcome == SEMEAI_UNKNOWN)
+	result = GO_READING_UNKNOWN;
+      else if (query == QUERY_SEMEAI_OWNER_FIRST)
+	result = (outcome == SEMEAI_LOSS
+		  ? GO_READING_CAPTURED : GO_READING_SURVIVES);
+      else
+	result = (outcome == SEMEAI_WIN
+		  ? GO_READING_CAPTURED : GO_READING_SURVIVES);
+    }
+  }
+
+  reader->total_num_nodes += reader->num_nodes;
+
+  if (result != GO_READING_UNKNOWN) {
+    entry->key	  = key;
+    entry->result = result;
+    entry->move	  = found_move;
+  }
+  else
+    reader->incomplete = 1;
+
+  if (move)
+    *move = found_move;
+
+  return result;
+}
+
+
+
+/* Ladder reading.  The attacker only plays ataris and the defender
+ * only extends or captures a neighbor string in atari.
+ */
+
+/* Attacker to play.  The string at `pos' is captured if it is in atari
+ * or every atari on it leads to a captured string.
+ */
+static GoReadingResult
+attack_ladder (GoReader *reader, int pos, int *move)
+{
+  Board *board = reader->board;
+  int attacker = OTHER_COLOR (board->grid[pos]);
+  int liberties[3];
+  int num_liberties = get_liberties (board, pos, liberties, 3);
+  GoReadingResult result = GO_READING_SURVIVES;
+  int k;
+
+  if (num_liberties == 1) {
+    if (!is_legal_move (board, attacker, liberties[0]))
+      return GO_READING_SURVIVES;
+
+    *move = liberties[0];
+    return GO_READING_CAPTURED;
+  }
+
+  if (num_liberties > 2)
+    return GO_READING_SURVIVES;
+
+  /* Try first the atari that leaves the defender a poorer escape. */
+  if (count_empty_neighbors (board->grid, liberties[0])
+      < count_empty_neighbors (board->grid, liberties[1])) {
+    int temp = liberties[0];
+
+    liberties[0] = liberties[1];
+    liberties[1] = temp;
+  }
+
+  for (k = 0; k < 2; k++) {
+    GoReadingResult defense_result;
+    int defense_move;
+
+    if (!is_legal_move (board, attacker, liberties[k]))
+      continue;
+
+    if (!count_node (reader))
+      return GO_READING_UNKNOWN;
+
+    board_play_go_move_fast (board, attacker, liberties[k]);
+    defense_result = defend_ladder (reader, pos, &defense_move);
+    board_undo (board, 1);
+
+    if (defense_result == GO_READING_CAPTURED) {
+      *move = liberties[k];
+      return GO_READING_CAPTURED;
+    }
+
+    if (defense_result == GO_READING_UNKNOWN)
+      result = GO_READING_UNKNOWN;
+  }
+
+  return result;
+}
+
+
+/* Defender to play.  The string at `pos' survives if it is not in
+ * atari or some move gets it out of atari for good.
+ */
+static GoReadingResult
+defend_ladder (GoReader *reader, int pos, int *move)
+{
+  Board *board = reader->board;
+  int defender = board->grid[pos];
+  int moves[LADDER_MAX_CAPTURES + 1];
+  int num_moves;
+  GoReadingResult result = GO_READING_CAPTURED;
+  int k;
+
+  if (LIBERTIES (board, pos) > 1)
+    return GO_READING_SURVIVES;
+
+  num_moves = find_capturing_moves (reader, pos, moves, LADDER_MAX_CAPTURES);
+  get_liberties (board, pos, moves + num_moves, 1);
+  for (k = 0; k < num_moves; k++) {
+    if (moves[k] == moves[num_moves])
+      break;
+  }
+
+  if (k == num_moves)
+    num_moves++;
+
+  for (k = 0; k < num_moves; k++) {
+    GoReadingResult move_result;
+    int attack_move;
+
+    if (!is_legal_move (board, defender, moves[k]))
+      continue;
+
+    if (!count_node (reader))
+      return GO_READING_UNKNOWN;
+
+    board_play_go_move_fast (board, defender, moves[k]);
+
+    if (LIBERTIES (board, pos) > 2)
+      move_result = GO_READING_SURVIVES;
+    else if (LIBERTIES (board, pos) == 2)
+      move_result = attack_ladder (reader, pos, &attack_move);
+    else
+      move_result = GO_READING_CAPTURED;
+
+    board_undo (board, 1);
+
+    if (move_result == GO_READING_SURVIVES) {
+      *move = moves[k];
+      return GO_READING_SURVIVES;
+    }
+
+    if (move_result == GO_READING_UNKNOWN)
+      result = GO_READING_UNKNOWN;
+  }
+
+  return result;
+}
+
+
+
+/* Read a capture race between string at `own', whose owner is to
+ * play, and the string at `other'.  Moves are only made on liberties
+ * of the opponent's string, never into atari.  A player who has no
+ * such move passes; two passes in a row mean seki.
+ */
+static int
+read_semeai (GoReader *reader, int own, int other, int other_passed)
+{
+  Board *board = reader->board;
+  int color = board->grid[own];
+  int liberties[SEMEAI_MAX_LIBERTIES + 1];
+  int num_liberties = get_liberties (board, other, liberties,
+				     SEMEAI_MAX_LIBERTIES + 1);
+  int best_outcome = SEMEAI_LOSS;
+  int num_moves_tried = 0;
+  int outcome_unknown = 0;
+  int k;
+
+  if (num_liberties == 1 && is_legal_move (board, color, liberties[0]))
+    return SEMEAI_WIN;
+
+  /* The string has gained liberties by capturing something, which is
+   * beyond simple races.
+   */
+  if (num_liberties > SEMEAI_MAX_LIBERTIES
+      || LIBERTIES (board, own) > SEMEAI_MAX_LIBERTIES)
+    return SEMEAI_UNKNOWN;
+
+  for (k = 0; k < num_liberties; k++) {
+    int outcome;
+
+    if (!is_legal_move (board, color, liberties[k]))
+      continue;
+
+    if (!count_node (reader))
+      return SEMEAI_UNKNOWN;
+
+    board_play_go_move_fast (board, color, liberties[k]);
+
+    if (LIBERTIES (board, liberties[k]) > 1) {
+      num_moves_tried++;
+      outcome = read_semeai (reader, other, own, 0);
+    }
+    else
+      outcome = SEMEAI_WIN;
+
+    board_undo (board, 1);
+
+    /* Skipped self-ataris give SEMEAI_WIN for the opponent, which is
+     * never chosen below.
+     */
+    if (outcome == SEMEAI_UNKNOWN)
+      outcome_unknown = 1;
+    else if (-outcome > best_outcome) {
+      best_outcome = -outcome;
+      if (best_outcome == SEMEAI_WIN)
+	return SEMEAI_WIN;
+    }
+  }
+
+  if (num_moves_tried == 0) {
+    int outcome;
+
+    if (other_passed)
+      return SEMEAI_SEKI;
+
+    if (!count_node (reader))
+      return SEMEAI_UNKNOWN;
+
+    outcome = read_semeai (reader, other, own, 1);
+    return (outcome == SEMEAI_UNKNOWN ? SEMEAI_UNKNOWN : -outcome);
+  }
+
+  return (outcome_unknown ? SEMEAI_UNKNOWN : best_outcome);
+}
+
+
+
+/* Count a node of the current query.  Return zero if the node budget
+ * is exhausted or reading has been cancelled.
+ */
+static int
+count_node (GoReader *reader)
+{
+  if (reader->num_nodes >= reader->node_budget
+      || (reader->cancellation_flag && *reader->cancellation_flag))
+    return 0;
+
+  reader->num_nodes++;
+  return 1;
+}
+
+
+/* Same as go_is_legal_move() with the default rule set: no ko
+ * violations and no suicides.
+ */
+static int
+is_legal_move (const Board *board, int color, int pos)
+{
+  const char *grid = board->grid;
+  int k;
+
+  if (grid[pos] != EMPTY
+      || (color == OTHER_COLOR (board->data.go.ko_master)
+	  && pos == board->data.go.ko_position))
+    return 0;
+
+  for (k = 0; k < 4; k++) {
+    int neighbor = pos + delta[k];
+
+    if (LIBERTY (grid, neighbor))
+      return 1;
+
+    if (grid[neighbor] == color) {
+      if (LIBERTIES (board, neighbor) > 1)
+	return 1;
+    }
+    else if (IS_STONE (grid[neighbor]) && LIBERTIES (board, neighbor) == 1)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* Store up to `max_liberties' liberties of the string at `pos' in
+ * `liberties' and return their number.
+ */
+static int
+get_liberties (const Board *board, int pos, int *liberties,
+	       int max_liberties)
+{
+  const uint64_t *liberty_set = LIBERTY_SET (board,
+					     STRING_NUMBER (board, pos));
+  int num_liberties = 0;
+  int k;
+
+  for (k = 0; k < board->data.go.liberty_set_size; k++) {
+    uint64_t word;
+
+    for (word = liberty_set[k]; word; word &= word - 1) {
+      if (num_liberties == max_liberties)
+	return num_liberties;
+
+      liberties[num_liberties++] = LIBERTY_POSITION (board,
+						     (k * 64
+						      + lowest_bit_index (word)));
+    }
+  }
+
+  return num_liberties;
+}
+
+
+static int
+count_empty_neighbors (const char *grid, int pos)
+{
+  return (LIBERTY (grid, NORTH (pos)) + LIBERTY (grid, SOUTH (pos))
+	  + LIBERTY (grid, WEST (pos)) + LIBERTY (grid, EAST (pos)));
+}
+
+
+/* Determine if neither of the strings at `pos1' and `pos2' can gain
+ * liberties by extending, i.e. if all empty points next to their
+ * liberties are liberties of one of the strings too.
+ */
+static int
+is_closed_race (const Board *board, int pos1, int pos2)
+{
+  int string_number1 = STRING_NUMBER (board, pos1);
+  int string_number2 = STRING_NUMBER (board, pos2);
+  int liberties[2 * SEMEAI_MAX_LIBERTIES];
+  int num_liberties;
+  int k;
+
+  num_liberties = get_liberties (board, pos1, liberties,
+				 SEMEAI_MAX_LIBERTIES);
+  num_liberties += get_liberties (board, pos2, liberties + num_liberties,
+				  SEMEAI_MAX_LIBERTIES);
+
+  for (k = 0; k < num_liberties; k++) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+      int neighbor = liberties[k] + delta[i];
+
+      if (LIBERTY (board->grid, neighbor)
+	  && !HAS_LIBERTY (board, string_number1, neighbor)
+	  && !HAS_LIBERTY (board, string_number2, neighbor))
+	return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/* Find up to `max_moves' moves that capture a string in atari next to
+ * the string at `pos'.  Return the number of moves stored in `moves'.
+ */
+static int
+find_capturing_moves (GoReader *reader, int pos, int *moves, int max_moves)
+{
+  const Board *board = reader->board;
+  const char *grid = board->grid;
+  int other = OTHER_COLOR (grid[pos]);
+  int *stones = reader->stones;
+  int num_stones = mark_string (reader, pos, stones);
+  int num_moves = 0;
+  int k;
+
+  for (k = 0; k < num_stones && num_moves < max_moves; k++) {
+    int i;
+
+    for (i = 0; i < 4 && num_moves < max_moves; i++) {
+      int neighbor = stones[k] + delta[i];
+
+      if (grid[neighbor] == other && LIBERTIES (board, neighbor) == 1) {
+	int liberty;
+	int j;
+
+	get_liberties (board, neighbor, &liberty, 1);
+	for (j = 0; j < num_moves; j++) {
+	  if (moves[j] == liberty)
+	    break;
+	}
+
+	if (j == num_moves)
+	  moves[num_moves++] = liberty;
+      }
+    }
+  }
+
+  return num_moves;
+}
+
+
+/* Mark all stones of the string at `pos' with a new mark and store
+ * them in `stones' in increasing order.  Return their number.
+ */
+static int
+mark_string (GoReader *reader, int pos, int *stones)
+{
+  const char *grid = reader->board->grid;
+  int color = grid[pos];
+  int num_stones = 1;
+  int k;
+
+  reader->mark++;
+  reader->marks[pos] = reader->mark;
+  stones[0] = pos;
+
+  for (k = 0; k < num_stones; k++) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+      int neighbor = stones[k] + delta[i];
+
+      if (grid[neighbor] == color && reader->marks[neighbor] != reader->mark) {
+	reader->marks[neighbor] = reader->mark;
+	stones[num_stones++] = neighbor;
+      }
+    }
+  }
+
+  qsort (stones, num_stones, sizeof (int), utils_compare_ints);
+  return num_stones;
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -27,19 +27,31 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
 #endif
 
 
-#define LIBERTY(grid, pos)	((grid) [pos] == EMPTY)
-
-#define STRING_NUMBER(board, pos)					\
-  ((board)->data.go.string_number[pos])
-
-#define LIBERTIES(board, pos)						\
-  ((board)->data.go.liberties[STRING_NUMBER ((board), (pos))])
+#define ADD_LIBERTY(board, string_number, pos)				\
+  (LIBERTY_SET ((board), (string_number))[LIBERTY_BIT ((board), (pos))	\
+					   / 64]			\
+   |= (uint64_t) 1 << (LIBERTY_BIT ((board), (pos)) % 64))
+#define REMOVE_LIBERTY(board, string_number, pos)			\
+  (LIBERTY_SET ((board), (string_number))[LIBERTY_BIT ((board), (pos))	\
+					   / 64]			\
+   &= ~((uint64_t) 1 << (LIBERTY_BIT ((board), (pos)) % 64)))
+#define CLEAR_LIBERTY_SET(board, string_number)				\
+  memset (LIBERTY_SET ((board), (string_number)), 0,			\
+	  (board)->data.go.liberty_set_size * sizeof (uint64_t))
+
+/* Free a string.  Liberty sets of free strings are kept empty. */
+#define FREE_STRING(board, string_number)				\
+  do {									\
+    (board)->data.go.liberties[string_number] = -1;			\
+    CLEAR_LIBERTY_SET ((board), (string_number));			\
+  } while (0)
 
 #define MARK_POSITION(board, pos)					\
   ((board)->data.go.marked_positions[pos]				\
@@ -48,6 +60,12 @@
   ((board)->data.go.marked_positions[pos]				\
    != (board)->data.go.position_mark)
 
+/* Nonzero if it is cheaper to rebuild all strings than to update the
+ * ones affected by `num_changes' changed points.
+ */
+#define REBUILD_ALL_STRINGS(board, num_changes)				\
+  (4 * (num_changes) > (board)->width * (board)->height)
+
 #define MARK_STRING(board, pos)						\
   ((board)->data.go.marked_strings[STRING_NUMBER ((board), (pos))]	\
    = (board)->data.go.string_mark)
@@ -56,10 +74,37 @@
    != (board)->data.go.string_mark)
 
 
+#define BITBOARD_ROW(y)		((y) + 1)
+#define BITBOARD_BIT(x)		((uint64_t) 1 << (x))
+
+/* Nonzero if any point of bitboard row `k' given in `row' is adjacent
+ * to a point in `empty'.
+ */
+#define BITBOARD_ROW_TOUCHES(empty, k, row)				\
+  ((((row) | ((row) << 1) | ((row) >> 1)) & (empty)[k])			\
+   | ((row) & ((empty)[(k) - 1] | (empty)[(k) + 1])))
+
+
+/* A stone influences points up to this (Manhattan) distance away. */
+#define INFLUENCE_RADIUS	4
+
+/* Minimal influence for an empty point to be counted as territory. */
+#define TERRITORY_INFLUENCE	6
+
+#define INFLUENCE_OWNER(influence)					\
+  ((influence) >= TERRITORY_INFLUENCE ? BLACK				\
+   : (influence) <= -TERRITORY_INFLUENCE ? WHITE : EMPTY)
+
+
 enum {
   ALLY = EMPTY + 1,
   OPPONENT,
-  CAPTURE
+  CAPTURE,
+
+  /* An empty neighbor the move has added to liberties of its only
+   * ally string.
+   */
+  NEW_LIBERTY
 };
 
 enum {
@@ -73,22 +118,331 @@ static int	is_suicide (const Board *board, int color, int pos);
 
 
 static void	rebuild_strings (Board *board);
+static void	forget_changed_point (Board *board, int pos,
+				      int old_contents);
+static void	update_changed_strings (Board *board,
+					const BoardChangeStackEntry *changes,
+					int num_changes);
 
 static void	do_play_move (Board *board, int color, int pos);
 static void	do_play_over_own_stone (Board *board, int pos);
 static void	do_play_over_enemy_stone (Board *board, int pos);
 
 static int	join_strings (Board *board, int color, int pos,
-			      int new_liberties, int *allies, int num_allies);
+			      int new_liberties, int *allies, int num_allies,
+			      char status[4]);
 static int	remove_string (Board *board, int pos);
 static int	change_string_number (Board *board, int pos,
 				      int string_number);
 static void	reconstruct_string (Board *board, int color, int pos,
-				    int single_liberty);
+				    int liberty);
+static void	save_liberty_set (Board *board, int string_number);
+static void	restore_liberty_set (Board *board, int string_number);
 
 
 static int	allocate_string (Board *board);
 
+static void	do_play_pass (Board *board, int color);
+
+
+static void	rebuild_bitboards (Board *board);
+static void	compute_empty_bitboard (const Board *board,
+					uint64_t empty[GO_BITBOARD_NUM_ROWS]);
+
+static int	bitboard_move_is_suicide (const Board *board, int color,
+					  int x, int y);
+static void	do_play_bitboard_move (Board *board, int color, int x, int y);
+
+static int	trace_bitboard_string (const uint64_t *stones,
+				       const uint64_t *empty,
+				       int row, uint64_t bit, uint64_t *string,
+				       int *top, int *bottom);
+static inline int
+		grow_bitboard_string_row (const uint64_t *stones,
+					  const uint64_t *empty,
+					  uint64_t *string, int k);
+static int	remove_bitboard_string (Board *board, int color,
+					const uint64_t *string,
+					int top, int bottom, uint64_t *empty);
+static void	set_bitboard_point (Board *board, int pos, int contents);
+
+
+static void	compute_influence (const Board *board,
+				   int influence[BOARD_GRID_SIZE],
+				   int territory[NUM_COLORS]);
+static void	reset_territory_estimate (Board *board);
+static void	update_territory_estimate (Board *board, int pos);
+static void	update_estimated_point (Board *board, int pos);
+static void	spread_influence (int *influence, const char *estimated_grid,
+				  int *territory, int width, int height,
+				  int pos, int sign);
+
+
+/* Influence of a stone on points at each distance from it. */
+static const int influence_weights[INFLUENCE_RADIUS + 1] = { 0, 8, 4, 2, 1 };
+
+
+static int	get_game_data_size (const GoBoardData *data);
+
+
+/* Allocate arrays of Go data for the board's current dimensions.
+ * Their contents is initialized by go_reset_game_data().
+ */
+void
+go_allocate_game_data (Board *board)
+{
+  GoBoardData *data = &board->data.go;
+  char *block;
+  int x;
+  int y;
+
+  data->grid_size	 = BOARD_GRID_SIZE_FOR (board->width, board->height);
+  data->string_ring_size = GO_STRING_RING_SIZE_FOR (board->width,
+						    board->height);
+  data->liberty_set_size = (board->width * board->height + 63) / 64;
+
+  /* Arrays are ordered by alignment requirements. */
+  block = utils_malloc (get_game_data_size (data));
+
+  data->liberty_sets = (uint64_t *) block;
+  block += data->string_ring_size * data->liberty_set_size * sizeof (uint64_t);
+
+  data->string_number = (int *) block;
+  block += data->grid_size * sizeof (int);
+
+  data->liberties = (int *) block;
+  block += data->string_ring_size * sizeof (int);
+
+  data->marked_positions = (unsigned int *) block;
+  block += data->grid_size * sizeof (unsigned int);
+
+  data->marked_strings = (unsigned int *) block;
+  block += data->string_ring_size * sizeof (unsigned int);
+
+  data->influence = (int *) block;
+  block += data->grid_size * sizeof (int);
+
+  data->queue = (int *) block;
+  block += (board->width * board->height + 1) * sizeof (int);
+
+  data->liberty_bits = (unsigned short *) block;
+  block += data->grid_size * sizeof (unsigned short);
+
+  data->liberty_positions = (unsigned short *) block;
+  block += board->width * board->height * sizeof (unsigned short);
+
+  data->estimated_grid = block;
+
+  data->saved_liberty_sets     = NULL;
+  data->num_saved_liberty_sets = 0;
+  data->max_saved_liberty_sets = 0;
+
+  /* Off-grid positions are never added to liberty sets. */
+  memset (data->liberty_bits, 0, data->grid_size * sizeof (unsigned short));
+  for (y = 0; y < board->height; y++) {
+    for (x = 0; x < board->width; x++) {
+      data->liberty_bits[POSITION (x, y)]	       = y * board->width + x;
+      data->liberty_positions[y * board->width + x] = POSITION (x, y);
+    }
+  }
+}
+
+
+void
+go_free_game_data (Board *board)
+{
+  utils_free (board->data.go.liberty_sets);
+  utils_free (board->data.go.saved_liberty_sets);
+}
+
+
+/* Copy all Go data of `source' to `destination', which must have been
+ * allocated for the same board dimensions.  Data only needed for
+ * undoing moves is not copied.
+ */
+void
+go_copy_game_data (Board *destination, const Board *source)
+{
+  GoBoardData *destination_data = &destination->data.go;
+  const GoBoardData *source_data = &source->data.go;
+  GoBoardData copy = *source_data;
+
+  assert (destination_data->grid_size == source_data->grid_size
+	  && (destination_data->string_ring_size
+	      == source_data->string_ring_size));
+
+  memcpy (destination_data->liberty_sets, source_data->liberty_sets,
+	  get_game_data_size (source_data));
+
+  copy.liberty_sets	= destination_data->liberty_sets;
+  copy.string_number	= destination_data->string_number;
+  copy.liberties	= destination_data->liberties;
+  copy.marked_positions = destination_data->marked_positions;
+  copy.marked_strings	= destination_data->marked_strings;
+  copy.influence	= destination_data->influence;
+  copy.queue		= destination_data->queue;
+  copy.liberty_bits	= destination_data->liberty_bits;
+  copy.liberty_positions = destination_data->liberty_positions;
+  copy.estimated_grid	= destination_data->estimated_grid;
+
+  /* The destination has no move stack to undo. */
+  copy.saved_liberty_sets     = destination_data->saved_liberty_sets;
+  copy.num_saved_liberty_sets = 0;
+  copy.max_saved_liberty_sets = destination_data->max_saved_liberty_sets;
+
+  *destination_data = copy;
+}
+
+
+static int
+get_game_data_size (const GoBoardData *data)
+{
+  /* The number of board points is not stored, but it is never more
+   * than the grid size.
+   */
+  return (data->string_ring_size * data->liberty_set_size * sizeof (uint64_t)
+	  + data->grid_size * (4 * sizeof (int) + 2 * sizeof (unsigned short)
+			       + sizeof (char))
+	  + data->string_ring_size * 2 * sizeof (int));
+}
+
+
+
+/* Go data stored in board snapshots (see board_snapshot_take()).  The
+ * header is followed by bitboard rows if the board uses the bitboard
+ * engine, or by string numbers of the board's points and liberty
+ * counts of the string ring otherwise.  Liberty sets are not stored,
+ * since they are larger than the rest and cheap to rebuild from the
+ * grid.
+ *
+ * Snapshot memory has no particular alignment, so it is only accessed
+ * with memcpy().
+ */
+typedef struct _GoSnapshotHeader	GoSnapshotHeader;
+
+struct _GoSnapshotHeader {
+  int		ko_master;
+  int		ko_position;
+  int		prisoners[NUM_COLORS];
+  int		last_string_number;
+};
+
+
+int
+go_get_snapshot_data_size (const Board *board)
+{
+  if (board->engine == BOARD_ENGINE_BITBOARD) {
+    return (sizeof (GoSnapshotHeader)
+	    + NUM_COLORS * board->height * sizeof (uint64_t));
+  }
+
+  return (sizeof (GoSnapshotHeader)
+	  + ((board->width * board->height + board->data.go.string_ring_size)
+	     * sizeof (int)));
+}
+
+
+void
+go_take_snapshot_data (const Board *board, char *data)
+{
+  GoSnapshotHeader header;
+  int k;
+  int y;
+
+  header.ko_master		= board->data.go.ko_master;
+  header.ko_position		= board->data.go.ko_position;
+  header.prisoners[BLACK_INDEX] = board->data.go.prisoners[BLACK_INDEX];
+  header.prisoners[WHITE_INDEX] = board->data.go.prisoners[WHITE_INDEX];
+  header.last_string_number	= board->data.go.last_string_number;
+
+  memcpy (data, &header, sizeof (GoSnapshotHeader));
+  data += sizeof (GoSnapshotHeader);
+
+  if (board->engine == BOARD_ENGINE_BITBOARD) {
+    for (k = BLACK_INDEX; k <= WHITE_INDEX; k++) {
+      memcpy (data, board->data.go.stones[k].rows + BITBOARD_ROW (0),
+	      board->height * sizeof (uint64_t));
+      data += board->height * sizeof (uint64_t);
+    }
+
+    return;
+  }
+
+  for (y = 0; y < board->height; y++) {
+    memcpy (data, board->data.go.string_number + POSITION (0, y),
+	    board->width * sizeof (int));
+    data += board->width * sizeof (int);
+  }
+
+  memcpy (data, board->data.go.liberties,
+	  board->data.go.string_ring_size * sizeof (int));
+}
+
+
+/* Restore Go data from a snapshot.  Board grid must already be
+ * restored.
+ */
+void
+go_restore_snapshot_data (Board *board, const char *data)
+{
+  GoSnapshotHeader header;
+  int k;
+  int y;
+
+  memcpy (&header, data, sizeof (GoSnapshotHeader));
+  data += sizeof (GoSnapshotHeader);
+
+  board->data.go.ko_master		= header.ko_master;
+  board->data.go.ko_position		= header.ko_position;
+  board->data.go.prisoners[BLACK_INDEX] = header.prisoners[BLACK_INDEX];
+  board->data.go.prisoners[WHITE_INDEX] = header.prisoners[WHITE_INDEX];
+  board->data.go.last_string_number	= header.last_string_number;
+
+  if (board->engine == BOARD_ENGINE_BITBOARD) {
+    for (k = BLACK_INDEX; k <= WHITE_INDEX; k++) {
+      memcpy (board->data.go.stones[k].rows + BITBOARD_ROW (0), data,
+	      board->height * sizeof (uint64_t));
+      data += board->height * sizeof (uint64_t);
+    }
+  }
+  else {
+    const char *grid = board->grid;
+    int pos;
+
+    /* Keep liberty sets of free strings empty. */
+    for (k = 0; k < board->data.go.string_ring_size; k++) {
+      if (board->data.go.liberties[k] != -1)
+	CLEAR_LIBERTY_SET (board, k);
+    }
+
+    for (y = 0; y < board->height; y++) {
+      memcpy (board->data.go.string_number + POSITION (0, y), data,
+	      board->width * sizeof (int));
+      data += board->width * sizeof (int);
+    }
+
+    memcpy (board->data.go.liberties, data,
+	    board->data.go.string_ring_size * sizeof (int));
+
+    for (pos = POSITION (0, 0); ON_GRID (grid, pos);
+	 pos += (BOARD_MAX_WIDTH + 1) - board->width) {
+      for (; ON_GRID (grid, pos); pos++) {
+	if (grid[pos] == EMPTY) {
+	  for (k = 0; k < 4; k++) {
+	    int neighbor = pos + delta[k];
+
+	    if (IS_STONE (grid[neighbor]))
+	      ADD_LIBERTY (board, STRING_NUMBER (board, neighbor), pos);
+	  }
+	}
+      }
+    }
+  }
+
+  if (board->estimate_territory)
+    reset_territory_estimate (board);
+}
+
 
 void
 go_reset_game_data (Board *board, int forced_reset)
@@ -101,8 +455,12 @@ go_reset_game_data (Board *board, int forced_reset)
   if (forced_reset) {
     int k;
 
-    for (k = 0; k < GO_STRING_RING_SIZE; k++)
+    for (k = 0; k < board->data.go.string_ring_size; k++)
       board->data.go.liberties[k] = -1;
+
+    memset (board->data.go.liberty_sets, 0,
+	    (board->data.go.string_ring_size * board->data.go.liberty_set_size
+	     * sizeof (uint64_t)));
   }
 
   if (forced_reset || board->data.go.position_mark != 0) {
@@ -122,8 +480,14 @@ go_reset_game_data (Board *board, int forced_reset)
   if (forced_reset || board->data.go.string_mark != 0) {
     board->data.go.string_mark = 0;
     memset (board->data.go.marked_strings, 0,
-	    sizeof board->data.go.marked_strings);
+	    board->data.go.string_ring_size * sizeof (unsigned int));
   }
+
+  if (board->engine == BOARD_ENGINE_BITBOARD)
+    rebuild_bitboards (board);
+
+  if (board->estimate_territory)
+    reset_territory_estimate (board);
 }
 
 
@@ -216,16 +580,85 @@ go_is_legal_move (const Board *board, BoardRuleSet rule_set,
 }
 
 
+/* Generate all legal moves except pass.  Points with an empty
+ * neighbor can never be suicides, so only the others need a full
+ * check.  With bitboard engine, such points are found for a whole row
+ * at once.
+ */
+void
+go_generate_legal_moves (const Board *board, BoardRuleSet rule_set,
+			 int color, BoardMoveList *moves)
+{
+  const char *grid = board->grid;
+  int ko_position = (board->data.go.ko_master == OTHER_COLOR (color)
+		     ? board->data.go.ko_position : NULL_POSITION);
+  int *positions;
+  int num_moves = 0;
+
+  assert (rule_set < NUM_GO_RULE_SETS);
+  UNUSED (rule_set);
+
+  moves->positions_per_move = 1;
+  board_move_list_reserve (moves, board->width * board->height);
+  positions = moves->positions;
+
+  if (board->engine == BOARD_ENGINE_BITBOARD) {
+    uint64_t empty[GO_BITBOARD_NUM_ROWS];
+    int y;
+
+    compute_empty_bitboard (board, empty);
+
+    for (y = 0; y < board->height; y++) {
+      int row = BITBOARD_ROW (y);
+      uint64_t candidates = empty[row];
+      uint64_t safe = (candidates
+		       & (empty[row - 1] | empty[row + 1]
+			  | (empty[row] << 1) | (empty[row] >> 1)));
+      int x;
+      int pos;
+
+      for (x = 0, pos = POSITION (0, y); candidates;
+	   candidates >>= 1, safe >>= 1, x++, pos++) {
+	if ((candidates & 1) && pos != ko_position
+	    && ((safe & 1)
+		|| !bitboard_move_is_suicide (board, color, x, y)))
+	  positions[num_moves++] = pos;
+      }
+    }
+  }
+  else {
+    int pos;
+
+    for (pos = POSITION (0, 0); ON_GRID (grid, pos);
+	 pos += (BOARD_MAX_WIDTH + 1) - board->width) {
+      for (; ON_GRID (grid, pos); pos++) {
+	if (grid[pos] == EMPTY && pos != ko_position
+	    && !is_suicide (board, color, pos))
+	  positions[num_moves++] = pos;
+      }
+    }
+  }
+
+  moves->num_moves = num_moves;
+}
+
+
 void
 go_play_move (Board *board, int color, va_list move)
 {
-  GoMoveStackEntry *stack_entry;
   int x = va_arg (move, int);
   int y = va_arg (move, int);
-  int pos = POSITION (x, y);
 
+  go_play_move_at (board, color, POSITION (x, y));
+}
+
+
+/* Same as go_play_move(), but the move is given as a position. */
+void
+go_play_move_at (Board *board, int color, int pos)
+{
   if (pos != PASS_MOVE) {
-    assert (ON_BOARD (board, x, y));
+    assert (ON_BOARD (board, POSITION_X (pos), POSITION_Y (pos)));
 
     if (board->grid[pos] == EMPTY)
       do_play_move (board, color, pos);
@@ -233,18 +666,12 @@ go_play_move (Board *board, int color, va_list move)
       do_play_over_own_stone (board, pos);
     else
       do_play_over_enemy_stone (board, pos);
-  }
-  else {
-    stack_entry			       = ALLOCATE_GO_MOVE_STACK_ENTRY (board);
-    stack_entry->type		       = PASS_MOVE;
-    stack_entry->suicide_or_pass_color = color;
 
-    stack_entry->ko_master	       = board->data.go.ko_master;
-    stack_entry->ko_position	       = board->data.go.ko_position;
-    board->data.go.ko_master	       = EMPTY;
-
-    stack_entry->common.move_number    = board->move_number++;
+    if (board->estimate_territory)
+      update_territory_estimate (board, pos);
   }
+  else
+    do_play_pass (board, color);
 }
 
 
@@ -261,7 +688,27 @@ go_apply_changes (Board *board, int num_changes)
 
   board->data.go.ko_master = EMPTY;
 
-  rebuild_strings (board);
+  if (board->engine == BOARD_ENGINE_BITBOARD)
+    rebuild_bitboards (board);
+  else if (REBUILD_ALL_STRINGS (board, num_changes))
+    rebuild_strings (board);
+  else {
+    const BoardChangeStackEntry *changes
+      = board->change_stack_pointer - num_changes;
+    int k;
+
+    /* If a point is changed several times, its first entry holds the
+     * original contents.  Later entries are ignored, because the
+     * point's string number is forgotten by then.
+     */
+    for (k = 0; k < num_changes; k++)
+      forget_changed_point (board, changes[k].position, changes[k].contents);
+
+    update_changed_strings (board, changes, num_changes);
+  }
+
+  if (board->estimate_territory)
+    reset_territory_estimate (board);
 }
 
 
@@ -280,9 +727,71 @@ go_add_dummy_move_entry (Board *board)
 }
 
 
+/* Update symmetry keys for the last move on `board', which must not
+ * be undone yet.  Removed stones are found the way go_undo() finds
+ * them: a captured string has no liberties but the move, so it is
+ * exactly the empty area grown from a CAPTURE neighbor.  After a
+ * suicide, the empty area around the move is its own string.
+ */
+void
+go_update_symmetry_keys (Board *board)
+{
+  const GoMoveStackEntry *stack_entry
+    = (const GoMoveStackEntry *) board->move_stack_pointer - 1;
+
+  if (stack_entry->type == NORMAL_MOVE) {
+    const char *grid = board->grid;
+    int pos = stack_entry->position;
+    int color = grid[pos];
+    int removed_color;
+    int *queue = board->data.go.queue;
+    int queue_start = 0;
+    int queue_end = 0;
+    int k;
+
+    board_toggle_symmetry_keys (board, pos, stack_entry->contents, color);
+
+    board->data.go.position_mark++;
+    MARK_POSITION (board, pos);
+
+    if (color != EMPTY) {
+      removed_color = OTHER_COLOR (color);
+
+      for (k = 0; k < 4; k++) {
+	if (stack_entry->status[k] == CAPTURE) {
+	  queue[queue_end++] = pos + delta[k];
+	  MARK_POSITION (board, pos + delta[k]);
+	}
+      }
+    }
+    else {
+      removed_color = stack_entry->suicide_or_pass_color;
+      queue[queue_end++] = pos;
+    }
+
+    while (queue_start < queue_end) {
+      int stone = queue[queue_start++];
+
+      if (stone != pos)
+	board_toggle_symmetry_keys (board, stone, removed_color, EMPTY);
+
+      for (k = 0; k < 4; k++) {
+	int neighbor = stone + delta[k];
+
+	if (grid[neighbor] == EMPTY && UNMARKED_POSITION (board, neighbor)) {
+	  queue[queue_end++] = neighbor;
+	  MARK_POSITION (board, neighbor);
+	}
+      }
+    }
+  }
+}
+
+
 
-/* Rebuild all board strings from scratch.  Used after complex
- * position changes that are not handled incrementally.
+/* Rebuild all board strings from scratch.  Used after position
+ * changes that touch too large part of the board to bother with
+ * update_changed_strings().
  */
 static void
 rebuild_strings (Board *board)
@@ -300,6 +809,8 @@ rebuild_strings (Board *board)
        pos += (BOARD_MAX_WIDTH + 1) - board->width) {
     for (; ON_GRID (board->grid, pos); pos++) {
       if (board->grid[pos] != EMPTY && STRING_NUMBER (board, pos) == -1) {
+	CLEAR_LIBERTY_SET (board, string_number);
+
 	board->data.go.position_mark++;
 	board->data.go.liberties[string_number]
 	  = change_string_number (board, pos, string_number);
@@ -310,8 +821,10 @@ rebuild_strings (Board *board)
   }
 
   board->data.go.last_string_number = string_number - 1;
-  while (string_number < GO_STRING_RING_SIZE)
-    board->data.go.liberties[string_number++] = -1;
+  while (string_number < board->data.go.string_ring_size) {
+    FREE_STRING (board, string_number);
+    string_number++;
+  }
 
 #if BOARD_VALIDATION_LEVEL > 0
   go_validate_board (board);
@@ -319,44 +832,133 @@ rebuild_strings (Board *board)
 }
 
 
-/* Do the real job of go_play_move() when the move position is empty
- * (most of the cases).
+/* Forget string number of a changed point.  If the point used to hold
+ * a stone, its string is freed.  Must be called for all changed points
+ * before update_changed_strings().
  */
 static void
-do_play_move (Board *board, int color, int pos)
+forget_changed_point (Board *board, int pos, int old_contents)
 {
-  char *grid = board->grid;
-  int k;
-  int direct_liberties = 0;
-  int move_is_suicide = 1;
-  int allies[4];
-  int num_allies = 0;
-  int captures[4];
-  int num_captures = 0;
-  GoMoveStackEntry *stack_entry = ALLOCATE_GO_MOVE_STACK_ENTRY (board);
+  if (IS_STONE (old_contents) && STRING_NUMBER (board, pos) != -1)
+    FREE_STRING (board, STRING_NUMBER (board, pos));
 
-  stack_entry->type		      = NORMAL_MOVE;
-  stack_entry->contents		      = EMPTY;
-  stack_entry->position		      = pos;
-  stack_entry->ko_master	      = board->data.go.ko_master;
-  stack_entry->ko_position	      = board->data.go.ko_position;
-  stack_entry->prisoners[BLACK_INDEX] = board->data.go.prisoners[BLACK_INDEX];
-  stack_entry->prisoners[WHITE_INDEX] = board->data.go.prisoners[WHITE_INDEX];
-  stack_entry->common.move_number     = board->move_number++;
+  STRING_NUMBER (board, pos) = -1;
+}
+
+
+/* Update strings after a few points have changed, without touching
+ * strings far from the changes.  Only strings containing a changed
+ * point or adjacent to one can be split, merged or have their
+ * liberties changed.  Each part of a split string is adjacent to a
+ * changed point, so all of them are found too.
+ *
+ * This is done in two passes.  The first frees all affected strings,
+ * so that no stone keeps a string number that could be reused.  The
+ * second builds new strings in their place.
+ */
+static void
+update_changed_strings (Board *board, const BoardChangeStackEntry *changes,
+			int num_changes)
+{
+  const char *grid = board->grid;
+  int *queue = board->data.go.queue;
+  int k;
+  int i;
 
   board->data.go.position_mark++;
-  board->data.go.string_mark++;
 
-  for (k = 0; k < 4; k++) {
-    int neighbor = pos + delta[k];
+  for (k = 0; k < num_changes; k++) {
+    for (i = -1; i < 4; i++) {
+      int pos = changes[k].position + (i < 0 ? 0 : delta[i]);
+      int queue_start = 0;
+      int queue_end = 1;
 
-    stack_entry->status[k] = EMPTY;
-    if (LIBERTY (grid, neighbor)) {
-      direct_liberties++;
-      MARK_POSITION (board, neighbor);
-    }
-    else if (ON_GRID (grid, neighbor) && UNMARKED_STRING (board, neighbor)) {
-      if (grid[neighbor] == color) {
+      if (!IS_STONE (grid[pos]) || !UNMARKED_POSITION (board, pos))
+	continue;
+
+      queue[0] = pos;
+      MARK_POSITION (board, pos);
+
+      do {
+	int stone = queue[queue_start++];
+	int j;
+
+	if (STRING_NUMBER (board, stone) != -1) {
+	  FREE_STRING (board, STRING_NUMBER (board, stone));
+	  STRING_NUMBER (board, stone) = -1;
+	}
+
+	for (j = 0; j < 4; j++) {
+	  int neighbor = stone + delta[j];
+
+	  if (grid[neighbor] == grid[pos]
+	      && UNMARKED_POSITION (board, neighbor)) {
+	    MARK_POSITION (board, neighbor);
+	    queue[queue_end++] = neighbor;
+	  }
+	}
+      } while (queue_start < queue_end);
+    }
+  }
+
+  for (k = 0; k < num_changes; k++) {
+    for (i = -1; i < 4; i++) {
+      int pos = changes[k].position + (i < 0 ? 0 : delta[i]);
+
+      if (IS_STONE (grid[pos]) && STRING_NUMBER (board, pos) == -1) {
+	int string_number = allocate_string (board);
+
+	board->data.go.position_mark++;
+	board->data.go.liberties[string_number]
+	  = change_string_number (board, pos, string_number);
+      }
+    }
+  }
+
+#if BOARD_VALIDATION_LEVEL > 0
+  go_validate_board (board);
+#endif
+}
+
+
+/* Do the real job of go_play_move() when the move position is empty
+ * (most of the cases).
+ */
+static void
+do_play_move (Board *board, int color, int pos)
+{
+  char *grid = board->grid;
+  int k;
+  int direct_liberties = 0;
+  int move_is_suicide = 1;
+  int allies[4];
+  int num_allies = 0;
+  int captures[4];
+  int num_captures = 0;
+  GoMoveStackEntry *stack_entry = ALLOCATE_GO_MOVE_STACK_ENTRY (board);
+
+  stack_entry->type		      = NORMAL_MOVE;
+  stack_entry->contents		      = EMPTY;
+  stack_entry->position		      = pos;
+  stack_entry->ko_master	      = board->data.go.ko_master;
+  stack_entry->ko_position	      = board->data.go.ko_position;
+  stack_entry->prisoners[BLACK_INDEX] = board->data.go.prisoners[BLACK_INDEX];
+  stack_entry->prisoners[WHITE_INDEX] = board->data.go.prisoners[WHITE_INDEX];
+  stack_entry->common.move_number     = board->move_number++;
+
+  board->data.go.position_mark++;
+  board->data.go.string_mark++;
+
+  for (k = 0; k < 4; k++) {
+    int neighbor = pos + delta[k];
+
+    stack_entry->status[k] = EMPTY;
+    if (LIBERTY (grid, neighbor)) {
+      direct_liberties++;
+      MARK_POSITION (board, neighbor);
+    }
+    else if (ON_GRID (grid, neighbor) && UNMARKED_STRING (board, neighbor)) {
+      if (grid[neighbor] == color) {
 	stack_entry->status[k] = ALLY;
 	allies[num_allies++] = neighbor;
 	if (LIBERTIES (board, neighbor) > 1)
@@ -366,6 +968,7 @@ do_play_move (Board *board, int color, int pos)
 	if (LIBERTIES (board, neighbor) > 1) {
 	  stack_entry->status[k] = OPPONENT;
 	  LIBERTIES (board, neighbor)--;
+	  REMOVE_LIBERTY (board, STRING_NUMBER (board, neighbor), pos);
 	}
 	else {
 	  stack_entry->status[k] = CAPTURE;
@@ -383,7 +986,8 @@ do_play_move (Board *board, int color, int pos)
 
     stack_entry->num.liberties = join_strings (board, color, pos,
 					       direct_liberties,
-					       allies, num_allies);
+					       allies, num_allies,
+					       stack_entry->status);
 
     for (k = 0; k < num_captures; k++)
       captured_stones += remove_string (board, captures[k]);
@@ -405,8 +1009,10 @@ do_play_move (Board *board, int color, int pos)
     board->data.go.ko_master = EMPTY;
 
     for (k = 0; k < 4; k++) {
-      if (stack_entry->status[k] == OPPONENT)
+      if (stack_entry->status[k] == OPPONENT) {
 	LIBERTIES (board, pos + delta[k])++;
+	ADD_LIBERTY (board, STRING_NUMBER (board, pos + delta[k]), pos);
+      }
     }
 
     board->data.go.prisoners[COLOR_INDEX (other)]++;
@@ -486,11 +1092,12 @@ do_play_over_enemy_stone (Board *board, int pos)
     }
     else if (grid[neighbor] == color && UNMARKED_STRING (board, neighbor)) {
       LIBERTIES (board, neighbor)++;
+      ADD_LIBERTY (board, STRING_NUMBER (board, neighbor), pos);
       MARK_STRING (board, neighbor);
     }
   }
 
-  LIBERTIES (board, pos) = -1;
+  FREE_STRING (board, string_number);
 
   do_play_move (board, color, pos);
   ((GoMoveStackEntry *) board->move_stack_pointer - 1)->contents = other;
@@ -506,55 +1113,73 @@ do_play_over_enemy_stone (Board *board, int pos)
  * the caller of this function.  It also actually plays the move given
  * by `color' and `pos' parameters on the board.
  *
+ * Liberty set of the resulting string is the union of joined strings'
+ * sets (change_string_number() adds those not marked yet) and empty
+ * neighbors of `pos', which must be marked by the caller.
+ *
+ * `status' is NULL if the move is being undone rather than played.
+ * Otherwise, with exactly one ally, empty neighbors that were not
+ * liberties of the ally before are marked NEW_LIBERTY in it.  With
+ * several allies, the liberty set of the first one is saved for
+ * go_undo().
+ *
  * Return the number of liberties the resulting string has had before.
  * This information is used when undoing moves.
  */
 static int
 join_strings (Board *board, int color, int pos, int new_liberties,
-	      int *allies, int num_allies)
+	      int *allies, int num_allies, char status[4])
 {
   char *grid = board->grid;
   int liberties;
   int string_number;
+  int k;
 
   if (num_allies == 0) {
     string_number = allocate_string (board);
     liberties = -1;
+
+    for (k = 0; k < 4; k++) {
+      if (LIBERTY (grid, pos + delta[k]))
+	ADD_LIBERTY (board, string_number, pos + delta[k]);
+    }
   }
   else {
-    int k;
-
     string_number = STRING_NUMBER (board, allies[0]);
     liberties = LIBERTIES (board, allies[0]);
 
     if (num_allies == 1) {
       new_liberties = liberties - 1;
       for (k = 0; k < 4; k++) {
-	int neighbor = pos + delta[k];
+	if (LIBERTY (grid, pos + delta[k])
+	    && !HAS_LIBERTY (board, string_number, pos + delta[k])) {
+	  ADD_LIBERTY (board, string_number, pos + delta[k]);
+	  new_liberties++;
 
-	if (LIBERTY (grid, neighbor)) {
-	  int i;
-
-	  for (i = 0; i < 4; i++) {
-	    if (grid[neighbor + delta[i]] == color
-		&& STRING_NUMBER (board, neighbor + delta[i]) == string_number)
-	      break;
-	  }
-
-	  if (i == 4)
-	    new_liberties++;
+	  if (status)
+	    status[k] = NEW_LIBERTY;
 	}
       }
     }
     else {
+      if (status && !board->no_undo)
+	save_liberty_set (board, string_number);
+
       MARK_POSITION (board, pos);
       new_liberties += change_string_number (board, allies[0], string_number);
       for (k = 1; k < num_allies; k++) {
-	LIBERTIES (board, allies[k]) = -1;
+	FREE_STRING (board, STRING_NUMBER (board, allies[k]));
 	new_liberties += change_string_number (board, allies[k],
 					       string_number);
       }
+
+      for (k = 0; k < 4; k++) {
+	if (LIBERTY (grid, pos + delta[k]))
+	  ADD_LIBERTY (board, string_number, pos + delta[k]);
+      }
     }
+
+    REMOVE_LIBERTY (board, string_number, pos);
   }
 
   grid[pos] = color;
@@ -575,7 +1200,7 @@ remove_string (Board *board, int pos)
   char *grid = board->grid;
   int color = grid[pos];
   int other = OTHER_COLOR (color);
-  int queue[BOARD_MAX_POSITIONS];
+  int *queue = board->data.go.queue;
   int queue_start = 0;
   int queue_end = 1;
 
@@ -593,6 +1218,7 @@ remove_string (Board *board, int pos)
       if (grid[neighbor] == other) {
 	if (UNMARKED_STRING (board, neighbor)) {
 	  LIBERTIES (board, neighbor)++;
+	  ADD_LIBERTY (board, STRING_NUMBER (board, neighbor), stone);
 	  MARK_STRING (board, neighbor);
 	}
       }
@@ -603,21 +1229,22 @@ remove_string (Board *board, int pos)
     }
   } while (queue_start < queue_end);
 
-  LIBERTIES (board, pos) = -1;
+  FREE_STRING (board, STRING_NUMBER (board, pos));
 
   return queue_end;
 }
 
 
 /* Change the number of given string and return the number of its
- * unmarked liberties.
+ * unmarked liberties.  The liberties are also added to the string's
+ * liberty set.
  */
 static int
 change_string_number (Board *board, int pos, int string_number)
 {
   const char *grid = board->grid;
   int color = grid[pos];
-  int queue[BOARD_MAX_POSITIONS];
+  int *queue = board->data.go.queue;
   int queue_start = 0;
   int queue_end = 1;
   int unmarked_liberties = 0;
@@ -637,8 +1264,10 @@ change_string_number (Board *board, int pos, int string_number)
     if (UNMARKED_POSITION (board, SOUTH (stone))) {
       if (grid[SOUTH (stone)] == color)
 	queue[queue_end++] = SOUTH (stone);
-      else if (LIBERTY (grid, SOUTH (stone)))
+      else if (LIBERTY (grid, SOUTH (stone))) {
 	unmarked_liberties++;
+	ADD_LIBERTY (board, string_number, SOUTH (stone));
+      }
 
       MARK_POSITION (board, SOUTH (stone));
     }
@@ -646,8 +1275,10 @@ change_string_number (Board *board, int pos, int string_number)
     if (UNMARKED_POSITION (board, WEST (stone))) {
       if (grid[WEST (stone)] == color)
 	queue[queue_end++] = WEST (stone);
-      else if (LIBERTY (grid, WEST (stone)))
+      else if (LIBERTY (grid, WEST (stone))) {
 	unmarked_liberties++;
+	ADD_LIBERTY (board, string_number, WEST (stone));
+      }
 
       MARK_POSITION (board, WEST (stone));
     }
@@ -655,8 +1286,10 @@ change_string_number (Board *board, int pos, int string_number)
     if (UNMARKED_POSITION (board, NORTH (stone))) {
       if (grid[NORTH (stone)] == color)
 	queue[queue_end++] = NORTH (stone);
-      else if (LIBERTY (grid, NORTH (stone)))
+      else if (LIBERTY (grid, NORTH (stone))) {
 	unmarked_liberties++;
+	ADD_LIBERTY (board, string_number, NORTH (stone));
+      }
 
       MARK_POSITION (board, NORTH (stone));
     }
@@ -664,8 +1297,10 @@ change_string_number (Board *board, int pos, int string_number)
     if (UNMARKED_POSITION (board, EAST (stone))) {
       if (grid[EAST (stone)] == color)
 	queue[queue_end++] = EAST (stone);
-      else if (LIBERTY (grid, EAST (stone)))
+      else if (LIBERTY (grid, EAST (stone))) {
 	unmarked_liberties++;
+	ADD_LIBERTY (board, string_number, EAST (stone));
+      }
 
       MARK_POSITION (board, EAST (stone));
     }
@@ -687,14 +1322,15 @@ go_undo (Board *board)
     int color = grid[pos];
 
     if (color != EMPTY) {
-      int first_ally = 1;
-      int single_liberty = (stack_entry->contents != color ? 1 : 0);
+      int first_ally = NULL_POSITION;
+      int num_allies = 0;
+      int liberty = (stack_entry->contents != color ? pos : NULL_POSITION);
 
       grid[pos] = EMPTY;
       for (k = 0; k < 4; k++) {
 	if (stack_entry->status[k] == ALLY) {
-	  if (first_ally)
-	    first_ally = 0;
+	  if (num_allies++ == 0)
+	    first_ally = pos + delta[k];
 	  else {
 	    int string_number = allocate_string (board);
 
@@ -703,19 +1339,63 @@ go_undo (Board *board)
 	      = change_string_number (board, pos + delta[k], string_number);
 	  }
 	}
-	else if (stack_entry->status[k] == OPPONENT)
+	else if (stack_entry->status[k] == OPPONENT) {
 	  LIBERTIES (board, pos + delta[k])++;
+	  ADD_LIBERTY (board, STRING_NUMBER (board, pos + delta[k]), pos);
+	}
       }
 
+      if (num_allies > 1)
+	restore_liberty_set (board, STRING_NUMBER (board, first_ally));
+
       grid[pos] = OFF_GRID;
       for (k = 0; k < 4; k++) {
 	if (stack_entry->status[k] == CAPTURE) {
 	  reconstruct_string (board, OTHER_COLOR (color), pos + delta[k],
-			      single_liberty);
+			      liberty);
+	}
+      }
+
+      if (num_allies == 1) {
+	/* Captured stones next to `pos' are not removed from liberties
+	 * of the ally string by reconstruct_string(), since `pos' is
+	 * off grid.
+	 */
+	int string_number = STRING_NUMBER (board, first_ally);
+	uint64_t *liberty_set = LIBERTY_SET (board, string_number);
+
+	ADD_LIBERTY (board, string_number, pos);
+
+	/* Without branches, since the condition is hard to predict.
+	 * Off-grid neighbors never satisfy it.
+	 */
+	for (k = 0; k < 4; k++) {
+	  unsigned int bit = LIBERTY_BIT (board, pos + delta[k]);
+	  uint64_t remove = ((stack_entry->status[k] == NEW_LIBERTY)
+			     | (grid[pos + delta[k]] == OTHER_COLOR (color)));
+
+	  liberty_set[bit / 64] &= ~(remove << (bit % 64));
+	}
+      }
+
+      if (stack_entry->contents == color) {
+	/* Since `pos' is off grid, reconstruct_string() doesn't remove
+	 * stones next to it from liberties of its string.
+	 */
+	for (k = 0; k < 4; k++) {
+	  if (grid[pos + delta[k]] == OTHER_COLOR (color)) {
+	    REMOVE_LIBERTY (board, STRING_NUMBER (board, pos),
+			    pos + delta[k]);
+	  }
 	}
       }
 
       LIBERTIES (board, pos) = stack_entry->num.liberties;
+      if (stack_entry->num.liberties == -1) {
+	/* The string of the single stone at `pos' is freed. */
+	CLEAR_LIBERTY_SET (board, STRING_NUMBER (board, pos));
+      }
+
       grid[pos] = stack_entry->contents;
     }
     else {
@@ -724,13 +1404,13 @@ go_undo (Board *board)
 	grid[pos] = OFF_GRID;
 	for (k = 0; k < 4; k++) {
 	  if (stack_entry->status[k] == ALLY)
-	    reconstruct_string (board, color, pos + delta[k], 1);
+	    reconstruct_string (board, color, pos + delta[k], pos);
 	}
 
 	grid[pos] = stack_entry->contents;
       }
       else
-	reconstruct_string (board, color, pos, 0);
+	reconstruct_string (board, color, pos, NULL_POSITION);
     }
 
     if (stack_entry->contents == OTHER_COLOR (color)) {
@@ -750,8 +1430,10 @@ go_undo (Board *board)
 	}
 	else if (ON_GRID (grid, neighbor)
 		 && UNMARKED_STRING (board, neighbor)) {
-	  if (grid[neighbor] == color)
+	  if (grid[neighbor] == color) {
 	    LIBERTIES (board, neighbor)--;
+	    REMOVE_LIBERTY (board, STRING_NUMBER (board, neighbor), pos);
+	  }
 	  else
 	    allies[num_allies++] = neighbor;
 
@@ -760,86 +1442,684 @@ go_undo (Board *board)
       }
 
       join_strings (board, stack_entry->contents, pos, direct_liberties,
-		    allies, num_allies);
+		    allies, num_allies, NULL);
+    }
+
+    board->data.go.prisoners[BLACK_INDEX]
+      = stack_entry->prisoners[BLACK_INDEX];
+    board->data.go.prisoners[WHITE_INDEX]
+      = stack_entry->prisoners[WHITE_INDEX];
+
+    if (board->estimate_territory)
+      update_territory_estimate (board, pos);
+  }
+  else if (stack_entry->type == POSITION_CHANGE) {
+    int num_changes = stack_entry->num.changes;
+
+    if (REBUILD_ALL_STRINGS (board, num_changes)) {
+      board_undo_changes (board, num_changes);
+      rebuild_strings (board);
+    }
+    else {
+      const BoardChangeStackEntry *changes
+	= board->change_stack_pointer - num_changes;
+      int k;
+
+      for (k = 0; k < num_changes; k++) {
+	forget_changed_point (board, changes[k].position,
+			      board->grid[changes[k].position]);
+      }
+
+      /* Popped entries are left intact, so `changes' is still valid. */
+      board_undo_changes (board, num_changes);
+      update_changed_strings (board, changes, num_changes);
+    }
+
+    if (board->estimate_territory)
+      reset_territory_estimate (board);
+  }
+
+  board->data.go.ko_master   = stack_entry->ko_master;
+  board->data.go.ko_position = stack_entry->ko_position;
+  board->move_number	     = stack_entry->common.move_number;
+}
+
+
+/* Reconstruct a string of given color at given position.  It takes
+ * all empty intersections linked with `pos' and makes a string in
+ * their place.  Liberties of neighbors are properly adjusted.  The
+ * string gets `liberty' as its only liberty, or none at all if it is
+ * NULL_POSITION.
+ */
+static void
+reconstruct_string (Board *board, int color, int pos, int liberty)
+{
+  char *grid = board->grid;
+  int other = OTHER_COLOR (color);
+  int string_number = allocate_string (board);
+  int *queue = board->data.go.queue;
+  int queue_start = 0;
+  int queue_end = 1;
+
+  grid[pos] = color;
+  STRING_NUMBER (board, pos) = string_number;
+  queue[0] = pos;
+
+  do {
+    int k;
+    int stone = queue[queue_start++];
+
+    board->data.go.string_mark++;
+    for (k = 0; k < 4; k++) {
+      int neighbor = stone + delta[k];
+
+      if (grid[neighbor] == other) {
+	if (UNMARKED_STRING (board, neighbor)) {
+	  LIBERTIES (board, neighbor)--;
+	  REMOVE_LIBERTY (board, STRING_NUMBER (board, neighbor), stone);
+	  MARK_STRING (board, neighbor);
+	}
+      }
+      else if (LIBERTY (grid, neighbor)) {
+	grid[neighbor] = color;
+	STRING_NUMBER (board, neighbor) = string_number;
+	queue[queue_end++] = neighbor;
+      }
+    }
+  } while (queue_start < queue_end);
+
+  if (liberty != NULL_POSITION) {
+    LIBERTIES (board, pos) = 1;
+    ADD_LIBERTY (board, string_number, liberty);
+  }
+  else
+    LIBERTIES (board, pos) = 0;
+}
+
+
+/* Push liberty set of the given string on the stack of saved sets. */
+static void
+save_liberty_set (Board *board, int string_number)
+{
+  GoBoardData *data = &board->data.go;
+
+  if (data->num_saved_liberty_sets == data->max_saved_liberty_sets) {
+    data->max_saved_liberty_sets = (data->max_saved_liberty_sets
+				    ? 2 * data->max_saved_liberty_sets : 16);
+    data->saved_liberty_sets
+      = utils_realloc (data->saved_liberty_sets,
+		       (data->max_saved_liberty_sets * data->liberty_set_size
+			* sizeof (uint64_t)));
+  }
+
+  memcpy (data->saved_liberty_sets
+	  + data->num_saved_liberty_sets * data->liberty_set_size,
+	  LIBERTY_SET (board, string_number),
+	  data->liberty_set_size * sizeof (uint64_t));
+  data->num_saved_liberty_sets++;
+}
+
+
+/* Pop the last saved liberty set and make it the set of the given
+ * string.
+ */
+static void
+restore_liberty_set (Board *board, int string_number)
+{
+  GoBoardData *data = &board->data.go;
+
+  assert (data->num_saved_liberty_sets > 0);
+
+  data->num_saved_liberty_sets--;
+  memcpy (LIBERTY_SET (board, string_number),
+	  data->saved_liberty_sets
+	  + data->num_saved_liberty_sets * data->liberty_set_size,
+	  data->liberty_set_size * sizeof (uint64_t));
+}
+
+
+/* Allocate a string on the board.  Finds the first free string in the
+ * ring and returns its number.  Liberty set of the string is empty.
+ */
+static int
+allocate_string (Board *board)
+{
+  int string_number = board->data.go.last_string_number;
+
+  do {
+    if (string_number < board->data.go.string_ring_size - 1)
+      string_number++;
+    else
+      string_number = 0;
+  } while (board->data.go.liberties[string_number] != -1);
+
+  board->data.go.last_string_number = string_number;
+  return string_number;
+}
+
+
+static void
+do_play_pass (Board *board, int color)
+{
+  GoMoveStackEntry *stack_entry = ALLOCATE_GO_MOVE_STACK_ENTRY (board);
+
+  stack_entry->type		     = PASS_MOVE;
+  stack_entry->suicide_or_pass_color = color;
+
+  stack_entry->ko_master	     = board->data.go.ko_master;
+  stack_entry->ko_position	     = board->data.go.ko_position;
+  board->data.go.ko_master	     = EMPTY;
+
+  stack_entry->common.move_number    = board->move_number++;
+}
+
+
+
+/* Bitboard engine.  Instead of maintaining strings and their
+ * liberties incrementally, it keeps a bitboard of stones for each
+ * color and traces strings when needed with bitwise operations on
+ * whole rows.  Since most strings touch an empty point within a few
+ * steps, tracing usually stops very early.
+ *
+ * Stack entries are the same as for the default engine, so that
+ * go_is_game_over() works unchanged.  Stones removed by a move are
+ * saved on the change stack and their number is stored in the
+ * `num.changes' field of the move's entry.
+ */
+
+int
+go_bitboard_is_legal_move (const Board *board, BoardRuleSet rule_set,
+			   int color, va_list move)
+{
+  int x = va_arg (move, int);
+  int y = va_arg (move, int);
+  int pos = POSITION (x, y);
+
+  assert (rule_set < NUM_GO_RULE_SETS);
+
+  if (rule_set == GO_RULE_SET_SGF)
+    return 1;
+
+  if (pos != PASS_MOVE) {
+    assert (ON_BOARD (board, x, y));
+
+    return (board->grid[pos] == EMPTY
+	    && (color != OTHER_COLOR (board->data.go.ko_master)
+		|| pos != board->data.go.ko_position)
+	    && !bitboard_move_is_suicide (board, color, x, y));
+  }
+
+  return 1;
+}
+
+
+void
+go_bitboard_play_move (Board *board, int color, va_list move)
+{
+  int x = va_arg (move, int);
+  int y = va_arg (move, int);
+
+  if (!IS_PASS (x, y)) {
+    assert (ON_BOARD (board, x, y));
+    do_play_bitboard_move (board, color, x, y);
+
+    if (board->estimate_territory)
+      update_territory_estimate (board, POSITION (x, y));
+  }
+  else
+    do_play_pass (board, color);
+}
+
+
+void
+go_bitboard_play_move_at (Board *board, int color, int pos)
+{
+  if (pos != PASS_MOVE) {
+    assert (ON_BOARD (board, POSITION_X (pos), POSITION_Y (pos)));
+    do_play_bitboard_move (board, color, POSITION_X (pos), POSITION_Y (pos));
+
+    if (board->estimate_territory)
+      update_territory_estimate (board, pos);
+  }
+  else
+    do_play_pass (board, color);
+}
+
+
+void
+go_bitboard_undo (Board *board)
+{
+  GoMoveStackEntry *stack_entry = POP_GO_MOVE_STACK_ENTRY (board);
+
+  if (stack_entry->type == NORMAL_MOVE) {
+    int k;
+
+    for (k = 0; k < stack_entry->num.changes; k++) {
+      board->change_stack_pointer--;
+      set_bitboard_point (board, board->change_stack_pointer->position,
+			  board->change_stack_pointer->contents);
     }
 
+    set_bitboard_point (board, stack_entry->position, stack_entry->contents);
+
     board->data.go.prisoners[BLACK_INDEX]
       = stack_entry->prisoners[BLACK_INDEX];
     board->data.go.prisoners[WHITE_INDEX]
       = stack_entry->prisoners[WHITE_INDEX];
+
+    if (board->estimate_territory)
+      update_territory_estimate (board, stack_entry->position);
   }
   else if (stack_entry->type == POSITION_CHANGE) {
     board_undo_changes (board, stack_entry->num.changes);
-    rebuild_strings (board);
+    rebuild_bitboards (board);
+
+    if (board->estimate_territory)
+      reset_territory_estimate (board);
   }
 
-  board->data.go.ko_master   = stack_entry->ko_master;
-  board->data.go.ko_position = stack_entry->ko_position;
-  board->move_number	     = stack_entry->common.move_number;
+  board->data.go.ko_master   = stack_entry->ko_master;
+  board->data.go.ko_position = stack_entry->ko_position;
+  board->move_number	     = stack_entry->common.move_number;
+}
+
+
+/* Recompute bitboards from board grid. */
+static void
+rebuild_bitboards (Board *board)
+{
+  GoBitboard *stones = board->data.go.stones;
+  int x;
+  int y;
+  int pos;
+
+  memset (stones, 0, sizeof board->data.go.stones);
+  memset (&board->data.go.on_board, 0, sizeof (GoBitboard));
+
+  for (y = 0, pos = POSITION (0, 0); y < board->height; y++) {
+    board->data.go.on_board.rows[BITBOARD_ROW (y)]
+      = BITBOARD_BIT (board->width) - 1;
+
+    for (x = 0; x < board->width; x++, pos++) {
+      if (IS_STONE (board->grid[pos])) {
+	stones[COLOR_INDEX (board->grid[pos])].rows[BITBOARD_ROW (y)]
+	  |= BITBOARD_BIT (x);
+      }
+    }
+
+    pos += BOARD_MAX_WIDTH + 1 - board->width;
+  }
+}
+
+
+static void
+compute_empty_bitboard (const Board *board,
+			uint64_t empty[GO_BITBOARD_NUM_ROWS])
+{
+  const uint64_t *black_stones = board->data.go.stones[BLACK_INDEX].rows;
+  const uint64_t *white_stones = board->data.go.stones[WHITE_INDEX].rows;
+  const uint64_t *on_board     = board->data.go.on_board.rows;
+  int k;
+
+  for (k = 0; k < GO_BITBOARD_NUM_ROWS; k++)
+    empty[k] = on_board[k] & ~(black_stones[k] | white_stones[k]);
+}
+
+
+/* Same as is_suicide(), but using bitboards.  The move position must
+ * be empty.
+ */
+static int
+bitboard_move_is_suicide (const Board *board, int color, int x, int y)
+{
+  const uint64_t *own_stones = board->data.go.stones[COLOR_INDEX (color)].rows;
+  const uint64_t *other_stones
+    = board->data.go.stones[OTHER_INDEX (COLOR_INDEX (color))].rows;
+  uint64_t empty[GO_BITBOARD_NUM_ROWS];
+  uint64_t string[GO_BITBOARD_NUM_ROWS];
+  int rows[4];
+  uint64_t bits[4];
+  int num_neighbors = 0;
+  int top;
+  int bottom;
+  int k;
+
+  if (y > 0) {
+    rows[num_neighbors]	  = BITBOARD_ROW (y - 1);
+    bits[num_neighbors++] = BITBOARD_BIT (x);
+  }
+
+  if (y < board->height - 1) {
+    rows[num_neighbors]	  = BITBOARD_ROW (y + 1);
+    bits[num_neighbors++] = BITBOARD_BIT (x);
+  }
+
+  if (x > 0) {
+    rows[num_neighbors]	  = BITBOARD_ROW (y);
+    bits[num_neighbors++] = BITBOARD_BIT (x - 1);
+  }
+
+  if (x < board->width - 1) {
+    rows[num_neighbors]	  = BITBOARD_ROW (y);
+    bits[num_neighbors++] = BITBOARD_BIT (x + 1);
+  }
+
+  compute_empty_bitboard (board, empty);
+
+  for (k = 0; k < num_neighbors; k++) {
+    if (empty[rows[k]] & bits[k])
+      return 0;
+  }
+
+  /* The move position is not a liberty of any neighbor string after
+   * the move is played.
+   */
+  empty[BITBOARD_ROW (y)] &= ~BITBOARD_BIT (x);
+
+  for (k = 0; k < num_neighbors; k++) {
+    if (own_stones[rows[k]] & bits[k]) {
+      /* Connecting to a string with another liberty. */
+      if (trace_bitboard_string (own_stones, empty, rows[k], bits[k],
+				 string, &top, &bottom))
+	return 0;
+    }
+    else {
+      /* Capturing an enemy string. */
+      if (!trace_bitboard_string (other_stones, empty, rows[k], bits[k],
+				  string, &top, &bottom))
+	return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/* Bitboard counterpart of do_play_move(), do_play_over_own_stone()
+ * and do_play_over_enemy_stone().  Results, including prisoners and
+ * ko state, are identical.
+ */
+static void
+do_play_bitboard_move (Board *board, int color, int x, int y)
+{
+  char *grid = board->grid;
+  int other = OTHER_COLOR (color);
+  int pos = POSITION (x, y);
+  int contents = grid[pos];
+  int row = BITBOARD_ROW (y);
+  uint64_t bit = BITBOARD_BIT (x);
+  uint64_t *own_stones = board->data.go.stones[COLOR_INDEX (color)].rows;
+  uint64_t *other_stones = board->data.go.stones[COLOR_INDEX (other)].rows;
+  uint64_t empty[GO_BITBOARD_NUM_ROWS];
+  uint64_t string[GO_BITBOARD_NUM_ROWS];
+  int neighbors[4];
+  int rows[4];
+  uint64_t bits[4];
+  int num_neighbors = 0;
+  int have_direct_liberties = 0;
+  int have_allies = 0;
+  int captured_stones = 0;
+  int captured_position = NULL_POSITION;
+  int top;
+  int bottom;
+  int k;
+  int num_changes;
+  GoMoveStackEntry *stack_entry = ALLOCATE_GO_MOVE_STACK_ENTRY (board);
+
+  stack_entry->type		      = NORMAL_MOVE;
+  stack_entry->contents		      = contents;
+  stack_entry->position		      = pos;
+  memset (stack_entry->status, EMPTY, sizeof stack_entry->status);
+  stack_entry->ko_master	      = board->data.go.ko_master;
+  stack_entry->ko_position	      = board->data.go.ko_position;
+  stack_entry->prisoners[BLACK_INDEX] = board->data.go.prisoners[BLACK_INDEX];
+  stack_entry->prisoners[WHITE_INDEX] = board->data.go.prisoners[WHITE_INDEX];
+  stack_entry->common.move_number     = board->move_number++;
+
+  grid[pos]	     = color;
+  own_stones[row]   |= bit;
+  other_stones[row] &= ~bit;
+
+  if (y > 0) {
+    neighbors[num_neighbors] = NORTH (pos);
+    rows[num_neighbors]	     = row - 1;
+    bits[num_neighbors++]    = bit;
+  }
+
+  if (y < board->height - 1) {
+    neighbors[num_neighbors] = SOUTH (pos);
+    rows[num_neighbors]	     = row + 1;
+    bits[num_neighbors++]    = bit;
+  }
+
+  if (x > 0) {
+    neighbors[num_neighbors] = WEST (pos);
+    rows[num_neighbors]	     = row;
+    bits[num_neighbors++]    = bit >> 1;
+  }
+
+  if (x < board->width - 1) {
+    neighbors[num_neighbors] = EAST (pos);
+    rows[num_neighbors]	     = row;
+    bits[num_neighbors++]    = bit << 1;
+  }
+
+  for (k = 0; k < num_neighbors; k++) {
+    if (grid[neighbors[k]] == EMPTY)
+      have_direct_liberties = 1;
+    else if (grid[neighbors[k]] == color)
+      have_allies = 1;
+  }
+
+  compute_empty_bitboard (board, empty);
+
+  for (k = 0; k < num_neighbors; k++) {
+    if (grid[neighbors[k]] == other
+	&& !trace_bitboard_string (other_stones, empty, rows[k], bits[k],
+				   string, &top, &bottom)) {
+      int direction;
+
+      captured_stones += remove_bitboard_string (board, other, string,
+						 top, bottom, empty);
+      captured_position = neighbors[k];
+
+      /* For go_update_symmetry_keys(). */
+      for (direction = 0; pos + delta[direction] != neighbors[k];
+	   direction++)
+	;
+      stack_entry->status[direction] = CAPTURE;
+    }
+  }
+
+  num_changes = captured_stones;
+
+  if (have_direct_liberties || captured_stones > 0
+      || trace_bitboard_string (own_stones, empty, row, bit,
+				string, &top, &bottom)) {
+    if (captured_stones == 1 && !have_direct_liberties && !have_allies
+	&& contents != color) {
+      board->data.go.ko_master	 = color;
+      board->data.go.ko_position = captured_position;
+    }
+    else
+      board->data.go.ko_master = EMPTY;
+
+    board->data.go.prisoners[COLOR_INDEX (color)] += captured_stones;
+  }
+  else {
+    /* Suicide. */
+    int removed_stones = remove_bitboard_string (board, color, string,
+						 top, bottom, NULL);
+
+    stack_entry->suicide_or_pass_color = color;
+
+    board->data.go.ko_master = EMPTY;
+    board->data.go.prisoners[COLOR_INDEX (other)] += removed_stones;
+    num_changes += removed_stones;
+  }
+
+  stack_entry->num.changes = num_changes;
+}
+
+
+/* Trace the string of `stones' that includes point `bit' in bitboard
+ * row `row'.  If `empty' is not NULL and the string turns out to have
+ * a liberty in it, stop and return nonzero.  Otherwise, store the
+ * string in `string', its first and last rows in `top' and `bottom'
+ * and return zero.
+ */
+static int
+trace_bitboard_string (const uint64_t *stones, const uint64_t *empty,
+		       int row, uint64_t bit, uint64_t *string,
+		       int *top, int *bottom)
+{
+  int first_row = row;
+  int last_row = row;
+  int changed;
+
+  if (empty && BITBOARD_ROW_TOUCHES (empty, row, bit))
+    return 1;
+
+  memset (string, 0, GO_BITBOARD_NUM_ROWS * sizeof (uint64_t));
+  string[row] = bit;
+
+  if (grow_bitboard_string_row (stones, empty, string, row) < 0)
+    return 1;
+
+  /* Alternate downward and upward sweeps until the string stops
+   * growing.  For typical shapes, one or two iterations suffice.
+   */
+  do {
+    int k;
+
+    changed = 0;
+
+    for (k = (first_row > 1 ? first_row - 1 : 1);
+	 k <= last_row + 1 && k < GO_BITBOARD_NUM_ROWS - 1; k++) {
+      int result = grow_bitboard_string_row (stones, empty, string, k);
+
+      if (result) {
+	if (result < 0)
+	  return 1;
+
+	changed = 1;
+	if (k < first_row)
+	  first_row = k;
+	if (k > last_row)
+	  last_row = k;
+      }
+    }
+
+    for (k = (last_row < GO_BITBOARD_NUM_ROWS - 2 ? last_row + 1 : last_row);
+	 k >= first_row - 1 && k >= 1; k--) {
+      int result = grow_bitboard_string_row (stones, empty, string, k);
+
+      if (result) {
+	if (result < 0)
+	  return 1;
+
+	changed = 1;
+	if (k < first_row)
+	  first_row = k;
+	if (k > last_row)
+	  last_row = k;
+      }
+    }
+  } while (changed);
+
+  *top	  = first_row;
+  *bottom = last_row;
+
+  return 0;
+}
+
+
+/* Extend row `k' of `string' with all stones connected to it in the
+ * same row or adjacent rows.  Return zero if the row has not changed,
+ * -1 if it touches an `empty' point (if `empty' is not NULL) and 1
+ * otherwise.
+ */
+static inline int
+grow_bitboard_string_row (const uint64_t *stones, const uint64_t *empty,
+			  uint64_t *string, int k)
+{
+  uint64_t row = (string[k] | string[k - 1] | string[k + 1]) & stones[k];
+  uint64_t grown;
+
+  while ((grown = (row | (row << 1) | (row >> 1)) & stones[k]) != row)
+    row = grown;
+
+  if (row == string[k])
+    return 0;
+
+  string[k] = row;
+
+  return (empty && BITBOARD_ROW_TOUCHES (empty, k, row) ? -1 : 1);
 }
 
 
-/* Reconstruct a string of given color at given position.  It takes
- * all empty intersections linked with `pos' and makes a string in
- * their place.  Liberties of neighbors are properly adjusted.
+/* Remove the `string' of `color' from the board, saving its stones on
+ * the change stack unless the board is in no-undo mode.  If `empty'
+ * is not NULL, add the removed stones to it.  Return the number of
+ * removed stones.
  */
-static void
-reconstruct_string (Board *board, int color, int pos, int single_liberty)
+static int
+remove_bitboard_string (Board *board, int color, const uint64_t *string,
+			int top, int bottom, uint64_t *empty)
 {
-  char *grid = board->grid;
-  int other = OTHER_COLOR (color);
-  int string_number = allocate_string (board);
-  int queue[BOARD_MAX_POSITIONS];
-  int queue_start = 0;
-  int queue_end = 1;
+  uint64_t *stones = board->data.go.stones[COLOR_INDEX (color)].rows;
+  int save_changes = !board->no_undo;
+  int num_stones = 0;
+  int k;
 
-  grid[pos] = color;
-  STRING_NUMBER (board, pos) = string_number;
-  queue[0] = pos;
+  for (k = top; k <= bottom; k++) {
+    uint64_t row;
 
-  do {
-    int k;
-    int stone = queue[queue_start++];
+    for (row = string[k]; row; row &= row - 1)
+      num_stones++;
+  }
 
-    board->data.go.string_mark++;
-    for (k = 0; k < 4; k++) {
-      int neighbor = stone + delta[k];
+  if (save_changes)
+    board_ensure_change_stack_space (board, num_stones);
 
-      if (grid[neighbor] == other) {
-	if (UNMARKED_STRING (board, neighbor)) {
-	  LIBERTIES (board, neighbor)--;
-	  MARK_STRING (board, neighbor);
+  for (k = top; k <= bottom; k++) {
+    uint64_t row = string[k];
+    int pos = POSITION (0, k - 1);
+
+    stones[k] &= ~row;
+    if (empty)
+      empty[k] |= row;
+
+    for (; row; row >>= 1, pos++) {
+      if (row & 1) {
+	board->grid[pos] = EMPTY;
+
+	if (save_changes) {
+	  board->change_stack_pointer->position = pos;
+	  board->change_stack_pointer->contents = color;
+	  board->change_stack_pointer++;
 	}
       }
-      else if (LIBERTY (grid, neighbor)) {
-	grid[neighbor] = color;
-	STRING_NUMBER (board, neighbor) = string_number;
-	queue[queue_end++] = neighbor;
-      }
     }
-  } while (queue_start < queue_end);
+  }
 
-  LIBERTIES (board, pos) = single_liberty;
+  return num_stones;
 }
 
 
-/* Allocate a string on the board.  Finds the first free string in the
- * ring and returns its number.
- */
-static int
-allocate_string (Board *board)
+static void
+set_bitboard_point (Board *board, int pos, int contents)
 {
-  int string_number = board->data.go.last_string_number;
+  int row = BITBOARD_ROW (POSITION_Y (pos));
+  uint64_t bit = BITBOARD_BIT (POSITION_X (pos));
 
-  do {
-    if (string_number < GO_STRING_RING_SIZE - 1)
-      string_number++;
-    else
-      string_number = 0;
-  } while (board->data.go.liberties[string_number] != -1);
+  if (IS_STONE (board->grid[pos]))
+    board->data.go.stones[COLOR_INDEX (board->grid[pos])].rows[row] &= ~bit;
 
-  board->data.go.last_string_number = string_number;
-  return string_number;
+  board->grid[pos] = contents;
+
+  if (IS_STONE (contents))
+    board->data.go.stones[COLOR_INDEX (contents)].rows[row] |= bit;
 }
 
 
@@ -885,6 +2165,43 @@ go_validate_board (const Board *board)
   int present_strings[GO_STRING_RING_SIZE];
   int liberties[GO_STRING_RING_SIZE];
 
+  if (board->estimate_territory) {
+    int influence[BOARD_GRID_SIZE];
+    int territory[NUM_COLORS];
+
+    compute_influence (board, influence, territory);
+
+    for (k = BLACK_INDEX; k <= WHITE_INDEX; k++)
+      assert (board->data.go.estimated_territory[k] == territory[k]);
+
+    for (y = 0; y < board->height; y++) {
+      for (x = 0; x < board->width; x++) {
+	int pos = POSITION (x, y);
+
+	assert (board->data.go.estimated_grid[pos] == grid[pos]);
+	assert (board->data.go.influence[pos] == influence[pos]);
+      }
+    }
+  }
+
+  if (board->engine == BOARD_ENGINE_BITBOARD) {
+    for (y = 0; y < board->height; y++) {
+      for (x = 0; x < board->width; x++) {
+	int contents = grid[POSITION (x, y)];
+
+	assert (contents == EMPTY || IS_STONE (contents));
+
+	for (k = BLACK_INDEX; k <= WHITE_INDEX; k++) {
+	  assert (!(board->data.go.stones[k].rows[BITBOARD_ROW (y)]
+		    & BITBOARD_BIT (x))
+		  == (contents != FIRST_COLOR + k));
+	}
+      }
+    }
+
+    return;
+  }
+
   memset (present_strings, 0, sizeof present_strings);
   memset (liberties, 0, sizeof liberties);
 
@@ -924,17 +2241,37 @@ go_validate_board (const Board *board)
 	      liberties[string]++;
 	      neighbor_strings[num_neighbor_strings++] = string;
 	    }
+
+	    assert (HAS_LIBERTY (board, string, pos));
 	  }
 	}
       }
     }
   }
 
-  for (k = 0; k < GO_STRING_RING_SIZE; k++) {
-    if (present_strings[k])
+  for (k = 0; k < board->data.go.string_ring_size; k++) {
+    if (present_strings[k]) {
+      int num_set_liberties = 0;
+      int i;
+
       assert (board->data.go.liberties[k] == liberties[k]);
-    else
+
+      /* All liberties are in the set (see above), so it is enough to
+       * check there are no extra ones.
+       */
+      for (i = 0; i < board->data.go.liberty_set_size; i++)
+	num_set_liberties += count_bits (LIBERTY_SET (board, k)[i]);
+
+      assert (num_set_liberties == liberties[k]);
+    }
+    else {
+      int i;
+
       assert (board->data.go.liberties[k] == -1);
+
+      for (i = 0; i < board->data.go.liberty_set_size; i++)
+	assert (LIBERTY_SET (board, k)[i] == 0);
+    }
   }
 }
 
@@ -965,6 +2302,193 @@ go_dump_board (const Board *board)
 }
 
 
+
+/* Territory estimate.  Each stone spreads influence to points within
+ * `INFLUENCE_RADIUS', decreasing with distance: positive for black
+ * stones, negative for white.  Empty points where one color's
+ * influence is strong enough are counted as its territory.  Dead
+ * stones are not detected, so the estimate is only good for a quick
+ * look at the balance, not for scoring.
+ *
+ * Since influence is a plain sum over stones, it can be updated
+ * incrementally: after a move or an undo, only points that changed
+ * (the move itself and captured or restored strings) are processed,
+ * each one affecting only points within influence radius.  Changed
+ * points are found by comparing the grid with `estimated_grid', which
+ * holds contents the influence corresponds to.
+ */
+
+
+/* Compute influence and territory sizes from scratch. */
+static void
+compute_influence (const Board *board, int influence[BOARD_GRID_SIZE],
+		   int territory[NUM_COLORS])
+{
+  int x;
+  int y;
+
+  int_grid_fill (influence, board->width, board->height, 0);
+
+  for (y = 0; y < board->height; y++) {
+    for (x = 0; x < board->width; x++) {
+      int pos = POSITION (x, y);
+
+      if (IS_STONE (board->grid[pos])) {
+	spread_influence (influence, NULL, NULL, board->width, board->height,
+			  pos, board->grid[pos] == BLACK ? 1 : -1);
+      }
+    }
+  }
+
+  territory[BLACK_INDEX] = 0;
+  territory[WHITE_INDEX] = 0;
+
+  for (y = 0; y < board->height; y++) {
+    for (x = 0; x < board->width; x++) {
+      int pos = POSITION (x, y);
+      int owner = INFLUENCE_OWNER (influence[pos]);
+
+      if (board->grid[pos] == EMPTY && owner != EMPTY)
+	territory[COLOR_INDEX (owner)]++;
+    }
+  }
+}
+
+
+static void
+reset_territory_estimate (Board *board)
+{
+  compute_influence (board, board->data.go.influence,
+		     board->data.go.estimated_territory);
+  grid_copy (board->data.go.estimated_grid, board->grid,
+	     board->width, board->height);
+}
+
+
+/* Update territory estimate after a move at `pos' has been played or
+ * undone.  All points changed by a move form one connected region
+ * together with `pos' and its neighbors, so flooding from there over
+ * changed points finds them all.
+ */
+static void
+update_territory_estimate (Board *board, int pos)
+{
+  const char *grid = board->grid;
+  const char *estimated_grid = board->data.go.estimated_grid;
+  int *queue = board->data.go.queue;
+  int queue_start = 0;
+  int queue_end = 1;
+  int k;
+
+  /* A suicide leaves `pos' itself unchanged, but its neighbors still
+   * need to be checked.
+   */
+  queue[0] = pos;
+  if (grid[pos] != estimated_grid[pos])
+    update_estimated_point (board, pos);
+
+  while (queue_start < queue_end) {
+    pos = queue[queue_start++];
+
+    for (k = 0; k < 4; k++) {
+      int neighbor = pos + delta[k];
+
+      if (ON_GRID (grid, neighbor)
+	  && grid[neighbor] != estimated_grid[neighbor]) {
+	update_estimated_point (board, neighbor);
+	queue[queue_end++] = neighbor;
+      }
+    }
+  }
+}
+
+
+/* Bring estimate in accordance with current contents of point `pos'.
+ * Territory counts are kept consistent with `estimated_grid' at each
+ * step, so points can be updated in any order.
+ */
+static void
+update_estimated_point (Board *board, int pos)
+{
+  GoBoardData *data = &board->data.go;
+  int old_contents = data->estimated_grid[pos];
+  int new_contents = board->grid[pos];
+  int owner;
+
+  if (old_contents != EMPTY) {
+    spread_influence (data->influence, data->estimated_grid,
+		      data->estimated_territory, board->width, board->height,
+		      pos, old_contents == BLACK ? -1 : 1);
+  }
+  else {
+    owner = INFLUENCE_OWNER (data->influence[pos]);
+    if (owner != EMPTY)
+      data->estimated_territory[COLOR_INDEX (owner)]--;
+  }
+
+  data->estimated_grid[pos] = new_contents;
+
+  if (new_contents != EMPTY) {
+    spread_influence (data->influence, data->estimated_grid,
+		      data->estimated_territory, board->width, board->height,
+		      pos, new_contents == BLACK ? 1 : -1);
+  }
+  else {
+    owner = INFLUENCE_OWNER (data->influence[pos]);
+    if (owner != EMPTY)
+      data->estimated_territory[COLOR_INDEX (owner)]++;
+  }
+}
+
+
+/* Add influence of a stone at `pos' multiplied by `sign', which is 1
+ * to add a black stone or remove a white one and -1 otherwise.  If
+ * `territory' is not NULL, adjust territory counts for points that
+ * are empty in `estimated_grid'.
+ */
+static void
+spread_influence (int *influence, const char *estimated_grid,
+		  int *territory, int width, int height, int pos, int sign)
+{
+  int x = POSITION_X (pos);
+  int y = POSITION_Y (pos);
+  int dx;
+  int dy;
+
+  for (dy = -INFLUENCE_RADIUS; dy <= INFLUENCE_RADIUS; dy++) {
+    int range = INFLUENCE_RADIUS - abs (dy);
+
+    if (y + dy < 0 || y + dy >= height)
+      continue;
+
+    for (dx = -range; dx <= range; dx++) {
+      int point;
+      int weight;
+
+      if (x + dx < 0 || x + dx >= width || (dx == 0 && dy == 0))
+	continue;
+
+      point  = POSITION (x + dx, y + dy);
+      weight = sign * influence_weights[abs (dx) + abs (dy)];
+
+      if (territory && estimated_grid[point] == EMPTY) {
+	int old_owner = INFLUENCE_OWNER (influence[point]);
+	int new_owner = INFLUENCE_OWNER (influence[point] + weight);
+
+	if (old_owner != new_owner) {
+	  if (old_owner != EMPTY)
+	    territory[COLOR_INDEX (old_owner)]--;
+	  if (new_owner != EMPTY)
+	    territory[COLOR_INDEX (new_owner)]++;
+	}
+      }
+
+      influence[point] += weight;
+    }
+  }
+}
+
+
 
 /* Go-specific functions. */
 
@@ -1122,9 +2646,14 @@ go_is_same_string (Board *board, int _x1, int _y1, int _x2, int _y2)
     if (pos1 == pos2)
       return 1;
 
+    if (board->engine == BOARD_ENGINE_DEFAULT) {
+      return (grid[pos1] == grid[pos2]
+	      && STRING_NUMBER (board, pos1) == STRING_NUMBER (board, pos2));
+    }
+
     if (grid[pos1] == grid[pos2]) {
       int color = grid[pos1];
-      int queue[BOARD_MAX_POSITIONS];
+      int *queue = board->data.go.queue;
       int queue_start = 0;
       int queue_end   = 1;
 
@@ -1169,7 +2698,7 @@ go_get_string_stones (Board *board, int x, int y)
     BoardPositionList *position_list;
     const char *grid = board->grid;
     int color = grid[pos];
-    int stones[BOARD_MAX_POSITIONS];
+    int *stones = board->data.go.queue;
     int queue_start = 0;
     int queue_end = 1;
 
@@ -1202,6 +2731,82 @@ go_get_string_stones (Board *board, int x, int y)
 }
 
 
+/* Get a sorted list of liberties of the string at given position, or
+ * NULL if there is no stone there.  With the default engine, this
+ * takes no board scanning, since liberty sets are maintained for all
+ * strings.
+ */
+BoardPositionList *
+go_get_string_liberties (Board *board, int x, int y)
+{
+  int pos = POSITION (x, y);
+  const char *grid = board->grid;
+  int *liberties = board->data.go.queue;
+  int num_liberties = 0;
+
+  assert (board);
+  assert (board->game == GAME_GO);
+  assert (ON_BOARD (board, x, y));
+
+  if (!IS_STONE (grid[pos]))
+    return NULL;
+
+  if (board->engine == BOARD_ENGINE_DEFAULT) {
+    const uint64_t *liberty_set = LIBERTY_SET (board, STRING_NUMBER (board,
+								     pos));
+    int k;
+
+    for (k = 0; k < board->data.go.liberty_set_size; k++) {
+      uint64_t word;
+
+      for (word = liberty_set[k]; word; word &= word - 1)
+	liberties[num_liberties++] = LIBERTY_POSITION (board,
+						       (k * 64
+							+ lowest_bit_index (word)));
+    }
+
+    return board_position_list_new (liberties, num_liberties);
+  }
+  else {
+    BoardPositionList *position_list;
+    int color = grid[pos];
+    int *stones = utils_malloc (board->width * board->height * sizeof (int));
+    int queue_start = 0;
+    int queue_end = 1;
+
+    board->data.go.position_mark++;
+
+    stones[0] = pos;
+    MARK_POSITION (board, pos);
+
+    do {
+      int k;
+      int stone = stones[queue_start++];
+
+      for (k = 0; k < 4; k++) {
+	int neighbor = stone + delta[k];
+
+	if (UNMARKED_POSITION (board, neighbor)) {
+	  if (grid[neighbor] == color)
+	    stones[queue_end++] = neighbor;
+	  else if (grid[neighbor] == EMPTY)
+	    liberties[num_liberties++] = neighbor;
+
+	  MARK_POSITION (board, neighbor);
+	}
+      }
+    } while (queue_start < queue_end);
+
+    utils_free (stones);
+
+    position_list = board_position_list_new (liberties, num_liberties);
+    board_position_list_sort (position_list);
+
+    return position_list;
+  }
+}
+
+
 /* Find all stones that shold be logically dead if the stone at given
  * position is dead and the game is finished.  At present, all strings
  * that are connectable over empty vertecies are included (i.e. a
@@ -1221,8 +2826,9 @@ go_get_logically_dead_stones (Board *board, int x, int y)
     BoardPositionList *position_list;
     const char *grid = board->grid;
     int color = grid[pos];
-    int stones[BOARD_MAX_POSITIONS];
-    int empty_vertices[BOARD_MAX_POSITIONS];
+    int *stones = board->data.go.queue;
+    int *empty_vertices = utils_malloc (board->width * board->height
+					* sizeof (int));
     int stones_queue_start = 0;
     int stones_queue_end = 1;
     int empty_vertices_queue_start = 0;
@@ -1256,6 +2862,8 @@ go_get_logically_dead_stones (Board *board, int x, int y)
     } while (stones_queue_start < stones_queue_end
 	     || empty_vertices_queue_start < empty_vertices_queue_end);
 
+    utils_free (empty_vertices);
+
     position_list = board_position_list_new (stones, stones_queue_end);
     board_position_list_sort (position_list);
 
@@ -1266,6 +2874,63 @@ go_get_logically_dead_stones (Board *board, int x, int y)
 }
 
 
+/* Turn incremental territory estimation on or off.  When it is on,
+ * go_get_territory_estimate() can be called at any time and costs
+ * nothing for territory sizes alone, while moves and undos become a
+ * little slower.
+ */
+void
+go_set_territory_estimation (Board *board, int enable)
+{
+  assert (board);
+  assert (board->game == GAME_GO);
+
+  board->estimate_territory = (enable != 0);
+  if (board->estimate_territory)
+    reset_territory_estimate (board);
+}
+
+
+/* Get the territory estimate maintained on `board', which must have
+ * estimation turned on with go_set_territory_estimation().  If
+ * `territory' is not NULL, points of black and white territory are
+ * set to BLACK and WHITE, respectively; other points are not touched.
+ * If `black_territory' or `white_territory' are not NULL, they
+ * receive the number of points in territories.
+ *
+ * This is a rough influence-based estimate, dead stones are not taken
+ * into account.  Use go_score_game() for actual scoring.
+ */
+void
+go_get_territory_estimate (const Board *board, char *territory,
+			   int *black_territory, int *white_territory)
+{
+  assert (board);
+  assert (board->game == GAME_GO);
+  assert (board->estimate_territory);
+
+  if (territory) {
+    int x;
+    int y;
+
+    for (y = 0; y < board->height; y++) {
+      for (x = 0; x < board->width; x++) {
+	int pos = POSITION (x, y);
+	int owner = INFLUENCE_OWNER (board->data.go.influence[pos]);
+
+	if (board->grid[pos] == EMPTY && owner != EMPTY)
+	  territory[pos] = owner;
+      }
+    }
+  }
+
+  if (black_territory)
+    *black_territory = board->data.go.estimated_territory[BLACK_INDEX];
+  if (white_territory)
+    *white_territory = board->data.go.estimated_territory[WHITE_INDEX];
+}
+
+
 void
 go_score_game (Board *board, const char *dead_stones, double komi,
 	       double *score, StringBuffer *detailed_score,
@@ -1274,7 +2939,7 @@ go_score_game (Board *board, const char *dead_stones, double komi,
 {
   char territory[BOARD_GRID_SIZE];
   int num_territory_positions[NUM_COLORS] = { 0, 0 };
-  int territory_positions[NUM_COLORS][BOARD_MAX_POSITIONS];
+  int *territory_positions[NUM_COLORS];
   int num_prisoners[NUM_COLORS];
   int x;
   int y;
@@ -1288,6 +2953,11 @@ go_score_game (Board *board, const char *dead_stones, double komi,
   num_prisoners[BLACK_INDEX] = board->data.go.prisoners[BLACK_INDEX];
   num_prisoners[WHITE_INDEX] = board->data.go.prisoners[WHITE_INDEX];
 
+  territory_positions[BLACK_INDEX]
+    = utils_malloc (2 * board->width * board->height * sizeof (int));
+  territory_positions[WHITE_INDEX]
+    = territory_positions[BLACK_INDEX] + board->width * board->height;
+
   board_fill_grid (board, territory, EMPTY);
   go_mark_territory_on_grid (board, territory, dead_stones, BLACK, WHITE);
 
@@ -1385,6 +3055,8 @@ go_score_game (Board *board, const char *dead_stones, double komi,
       = board_position_list_new (territory_positions[WHITE_INDEX],
 				 num_territory_positions[WHITE_INDEX]);
   }
+
+  utils_free (territory_positions[BLACK_INDEX]);
 }
 
 
@@ -1411,7 +3083,7 @@ go_mark_territory_on_grid (Board *board, char *grid, const char *dead_stones,
   int pos;
   char territory[BOARD_GRID_SIZE];
   char false_eyes[BOARD_GRID_SIZE];
-  int queue[BOARD_MAX_POSITIONS];
+  int *queue = board->data.go.queue;
 
   assert (board);
   assert (board->game == GAME_GO);
@@ -1577,7 +3249,7 @@ go_guess_dead_stones (Board *board, char *dead_stones,
 		      const BoardPositionList *white_territory)
 {
   const char *grid = board->grid;
-  int queue[BOARD_MAX_POSITIONS];
+  int *queue = board->data.go.queue;
   int queue_start = 0;
   int queue_end   = 0;
   int k;
@@ -38,6 +38,31 @@
   POP_MOVE_STACK_ENTRY ((board), GoMoveStackEntry)
 
 
+/* Read-only access to string data of the default engine. */
+
+#define LIBERTY(grid, pos)	((grid) [pos] == EMPTY)
+
+#define STRING_NUMBER(board, pos)					\
+  ((board)->data.go.string_number[pos])
+
+#define LIBERTIES(board, pos)						\
+  ((board)->data.go.liberties[STRING_NUMBER ((board), (pos))])
+
+#define LIBERTY_SET(board, string_number)				\
+  ((board)->data.go.liberty_sets					\
+   + (string_number) * (board)->data.go.liberty_set_size)
+
+#define LIBERTY_BIT(board, pos)						\
+  ((board)->data.go.liberty_bits[pos])
+#define LIBERTY_POSITION(board, bit)					\
+  ((board)->data.go.liberty_positions[bit])
+
+#define HAS_LIBERTY(board, string_number, pos)				\
+  ((LIBERTY_SET ((board), (string_number))[LIBERTY_BIT ((board), (pos))	\
+					   / 64]			\
+    >> (LIBERTY_BIT ((board), (pos)) % 64)) & 1)
+
+
 typedef struct _GoMoveStackEntry	GoMoveStackEntry;
 
 struct _GoMoveStackEntry {
@@ -60,19 +85,40 @@ struct _GoMoveStackEntry {
 };
 
 
+void		go_allocate_game_data (Board *board);
+void		go_free_game_data (Board *board);
+void		go_copy_game_data (Board *destination, const Board *source);
 void		go_reset_game_data (Board *board, int forced_reset);
 
+int		go_get_snapshot_data_size (const Board *board);
+void		go_take_snapshot_data (const Board *board, char *data);
+void		go_restore_snapshot_data (Board *board, const char *data);
+
 int		go_is_game_over (const Board *board, BoardRuleSet rule_set,
 				 int color_to_play);
 
 int		go_is_legal_move (const Board *board, BoardRuleSet rule_set,
 				  int color, va_list move);
 
+void		go_generate_legal_moves (const Board *board,
+					 BoardRuleSet rule_set, int color,
+					 BoardMoveList *moves);
+
 void		go_play_move (Board *board, int color, va_list move);
+void		go_play_move_at (Board *board, int color, int pos);
 void		go_undo (Board *board);
 
+int		go_bitboard_is_legal_move (const Board *board,
+					   BoardRuleSet rule_set,
+					   int color, va_list move);
+void		go_bitboard_play_move (Board *board, int color,
+				       va_list move);
+void		go_bitboard_play_move_at (Board *board, int color, int pos);
+void		go_bitboard_undo (Board *board);
+
 void		go_apply_changes (Board *board, int num_changes);
 void		go_add_dummy_move_entry (Board *board);
+void		go_update_symmetry_keys (Board *board);
 
 void		go_format_move (int board_width, int board_height,
 				StringBuffer *buffer, va_list move);
@@ -86,6 +86,7 @@ game_list_parse_game2 (StringBuffer *c_file_arrays,
   const char *is_legal_move_function;
   const char *play_move_function;
   const char *undo_function;
+  const char *generate_legal_moves_function;
   const char *apply_changes_function;
   const char *add_dummy_move_entry_function;
   const char *format_move_function;
@@ -114,7 +115,7 @@ game_list_parse_game2 (StringBuffer *c_file_arrays,
     string_buffer_cat_string (c_file_arrays,
 			      ("0, NULL, EMPTY, NULL,\n"
 			       "    NULL,\n    NULL, 0,\n    NULL, NULL,\n"
-			       "    NULL, NULL, NULL,\n    NULL, NULL,\n"
+			       "    NULL, NULL, NULL,\n    NULL,\n    NULL, NULL,\n"
 			       "    NULL, NULL,\n    NULL, NULL,\n"
 			       "    0, 0.0 }"));
 
@@ -181,6 +182,8 @@ game_list_parse_game2 (StringBuffer *c_file_arrays,
   PARSE_IDENTIFIER (is_legal_move_function, line, "is_legal_move function");
   PARSE_IDENTIFIER (play_move_function, line, "play_move function");
   PARSE_IDENTIFIER (undo_function, line, "undo function");
+  PARSE_IDENTIFIER (generate_legal_moves_function, line,
+		    "generate_legal_moves function");
   PARSE_IDENTIFIER (apply_changes_function, line, "apply_changes function");
   PARSE_IDENTIFIER (add_dummy_move_entry_function, line,
 		    "add_dummy_move_entry function");
@@ -197,7 +200,7 @@ game_list_parse_game2 (StringBuffer *c_file_arrays,
 			 (CAPITALIZATION_HINT
 			  "  { N_(%s), %s, %s, %s, %s,\n    %s,\n"
 			  "    \"%s\", %d,\n    %s, %s,\n    %s, %s, %s,\n"
-			  "    %s, %s,\n    %s, %s,\n    %s, %s,\n"
+			  "    %s,\n    %s, %s,\n    %s, %s,\n    %s, %s,\n"
 			  "    sizeof (%s), %s }"),
 			 game_full_name, default_board_size,
 			 standard_board_sizes.string, color_to_play_first,
@@ -206,7 +209,7 @@ game_list_parse_game2 (StringBuffer *c_file_arrays,
 			 reversed_vertical_coordinates_flag,
 			 get_default_setup_function, reset_game_data_function,
 			 is_legal_move_function, play_move_function,
-			 undo_function,
+			 undo_function, generate_legal_moves_function,
 			 apply_changes_function, add_dummy_move_entry_function,
 			 format_move_function, parse_move_function,
 			 validate_board_function, dump_board_function,
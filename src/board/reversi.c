@@ -31,9 +31,65 @@
 #endif
 
 
+/* Boards up to 8x8 (all standard boards) are handled with 64-bit
+ * bitboards kept in `board->data.reversi'.  Larger boards use the grid
+ * and, for move generation, row masks built from it.
+ */
+#define USES_BITBOARDS(board)	((board)->width <= 8 && (board)->height <= 8)
+
+#define POSITION_BIT(pos)						\
+  ((uint64_t) 1 << (8 * POSITION_Y (pos) + POSITION_X (pos)))
+#define BIT_INDEX_POSITION(bit_index)					\
+  POSITION ((bit_index) & 7, (bit_index) >> 3)
+
+#define SHIFT_BITBOARD(bits, shift)					\
+  ((shift) > 0 ? (bits) << (shift) : (bits) >> -(shift))
+
+
+/* Row masks have an empty row on each side of the board, so that
+ * vertical neighbors of any board row can be accessed unconditionally.
+ */
+#define NUM_MASK_ROWS		(BOARD_MAX_HEIGHT + 2)
+
+#define SHIFT_MASK_ROW(row, delta_x)					\
+  ((delta_x) > 0 ? (row) << 1 : ((delta_x) < 0 ? (row) >> 1 : (row)))
+
+
 static inline int  is_legal_move (const char grid[BOARD_FULL_GRID_SIZE],
 				  BoardRuleSet rule_set, int color, int pos);
 
+static void	   compute_legal_move_masks (const Board *board, int color,
+					     uint64_t legal_moves
+					       [NUM_MASK_ROWS]);
+
+static void	   rebuild_bitboards (Board *board);
+static inline uint64_t
+		   fill_bitboard (uint64_t generator, uint64_t propagator,
+				  int direction);
+static uint64_t	   compute_bitboard_moves (const Board *board, int color);
+static uint64_t	   compute_bitboard_flips (const Board *board, int color,
+					   uint64_t move);
+static void	   set_bitboard_points (char grid[BOARD_FULL_GRID_SIZE],
+					uint64_t bits, int value);
+
+
+/* Bitboard shifts for the eight directions, starting with north and
+ * going clockwise.  Positive values are left shifts.  Bits shifted
+ * horizontally across board edge end up in the first or the last
+ * column, so they are masked out.
+ */
+static const int      bitboard_shifts[8] = { -8, -7, 1, 9, 8, 7, -1, -9 };
+static const uint64_t bitboard_wrap_masks[8] = {
+  ~(uint64_t) 0,
+  ~(uint64_t) 0x0101010101010101ULL,
+  ~(uint64_t) 0x0101010101010101ULL,
+  ~(uint64_t) 0x0101010101010101ULL,
+  ~(uint64_t) 0,
+  ~(uint64_t) 0x8080808080808080ULL,
+  ~(uint64_t) 0x8080808080808080ULL,
+  ~(uint64_t) 0x8080808080808080ULL
+};
+
 
 int
 reversi_adjust_color_to_play (const Board *board, BoardRuleSet rule_set,
@@ -47,6 +103,15 @@ reversi_adjust_color_to_play (const Board *board, BoardRuleSet rule_set,
 
   assert (rule_set < NUM_REVERSI_RULE_SETS);
 
+  if (USES_BITBOARDS (board)) {
+    if (compute_bitboard_moves (board, color))
+      return color;
+    if (compute_bitboard_moves (board, OTHER_COLOR (color)))
+      return OTHER_COLOR (color);
+
+    return EMPTY;
+  }
+
   do {
     for (pos = POSITION (0, 0); ON_GRID (board->grid, pos);
 	 pos += (BOARD_MAX_WIDTH + 1) - board->width) {
@@ -92,6 +157,15 @@ reversi_get_default_setup (int width, int height,
 }
 
 
+void
+reversi_reset_game_data (Board *board, int forced_reset)
+{
+  UNUSED (forced_reset);
+
+  rebuild_bitboards (board);
+}
+
+
 /* Determine if a move is legal according to specified rule set. */
 int
 reversi_is_legal_move (const Board *board, BoardRuleSet rule_set,
@@ -105,8 +179,12 @@ reversi_is_legal_move (const Board *board, BoardRuleSet rule_set,
   assert (ON_BOARD (board, x, y));
 
   if (rule_set != REVERSI_RULE_SET_SGF) {
-    if (board->grid[pos] == EMPTY)
+    if (board->grid[pos] == EMPTY) {
+      if (USES_BITBOARDS (board))
+	return compute_bitboard_flips (board, color, POSITION_BIT (pos)) != 0;
+
       return is_legal_move (board->grid, rule_set, color, pos);
+    }
 
     return 0;
   }
@@ -141,38 +219,181 @@ is_legal_move (const char grid[BOARD_FULL_GRID_SIZE], BoardRuleSet rule_set,
 }
 
 
+/* Generate all legal moves.  Legal moves are first computed as a
+ * bitboard or, on larger boards, as bit masks of all board rows (see
+ * compute_legal_move_masks()).
+ */
+void
+reversi_generate_legal_moves (const Board *board, BoardRuleSet rule_set,
+			      int color, BoardMoveList *moves)
+{
+  uint64_t legal_moves[NUM_MASK_ROWS];
+  int *positions;
+  int num_moves = 0;
+  int y;
+
+  assert (rule_set < NUM_REVERSI_RULE_SETS);
+  UNUSED (rule_set);
+
+  moves->positions_per_move = 1;
+  board_move_list_reserve (moves, board->width * board->height);
+  positions = moves->positions;
+
+  if (USES_BITBOARDS (board)) {
+    uint64_t bits;
+
+    for (bits = compute_bitboard_moves (board, color); bits;
+	 bits &= bits - 1)
+      positions[num_moves++] = BIT_INDEX_POSITION (lowest_bit_index (bits));
+
+    moves->num_moves = num_moves;
+    return;
+  }
+
+  compute_legal_move_masks (board, color, legal_moves);
+
+  for (y = 0; y < board->height; y++) {
+    uint64_t row;
+    int pos;
+
+    for (row = legal_moves[y + 1], pos = POSITION (0, y); row;
+	 row >>= 1, pos++) {
+      if (row & 1)
+	positions[num_moves++] = pos;
+    }
+  }
+
+  moves->num_moves = num_moves;
+}
+
+
+/* Compute masks of legal moves for each board row: bit `x' of element
+ * `y + 1' is set if (x, y) is a legal move.  For each of the eight
+ * directions, runs of opponent disks adjacent to own disks are grown
+ * in that direction a whole row at a time.  Empty points right after
+ * such runs are legal moves.
+ */
+static void
+compute_legal_move_masks (const Board *board, int color,
+			  uint64_t legal_moves[NUM_MASK_ROWS])
+{
+  static const int delta_x[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+  static const int delta_y[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+
+  const char *grid = board->grid;
+  uint64_t own[NUM_MASK_ROWS];
+  uint64_t other[NUM_MASK_ROWS];
+  uint64_t empty[NUM_MASK_ROWS];
+  int height = board->height;
+  int k;
+  int x;
+  int y;
+
+  for (y = 0; y < height + 2; y++) {
+    own[y]	   = 0;
+    other[y]	   = 0;
+    empty[y]	   = 0;
+    legal_moves[y] = 0;
+  }
+
+  for (y = 0; y < height; y++) {
+    const char *grid_row = grid + POSITION (0, y);
+
+    for (x = 0; x < board->width; x++) {
+      if (grid_row[x] == color)
+	own[y + 1] |= (uint64_t) 1 << x;
+      else if (grid_row[x] == OTHER_COLOR (color))
+	other[y + 1] |= (uint64_t) 1 << x;
+      else if (grid_row[x] == EMPTY)
+	empty[y + 1] |= (uint64_t) 1 << x;
+    }
+  }
+
+  for (k = 0; k < 8; k++) {
+    int dx = delta_x[k];
+    int dy = delta_y[k];
+    uint64_t runs[NUM_MASK_ROWS];
+    int changed;
+
+    runs[0]	     = 0;
+    runs[height + 1] = 0;
+
+    for (y = 1; y <= height; y++)
+      runs[y] = SHIFT_MASK_ROW (own[y - dy], dx) & other[y];
+
+    do {
+      changed = 0;
+
+      for (y = 1; y <= height; y++) {
+	uint64_t grown_run = (runs[y]
+			      | (SHIFT_MASK_ROW (runs[y - dy], dx) & other[y]));
+
+	if (grown_run != runs[y]) {
+	  runs[y] = grown_run;
+	  changed = 1;
+	}
+      }
+    } while (changed);
+
+    for (y = 1; y <= height; y++)
+      legal_moves[y] |= SHIFT_MASK_ROW (runs[y - dy], dx) & empty[y];
+  }
+}
+
+
 void
 reversi_play_move (Board *board, int color, va_list move)
+{
+  int x = va_arg (move, int);
+  int y = va_arg (move, int);
+
+  reversi_play_move_at (board, color, POSITION (x, y));
+}
+
+
+/* Same as reversi_play_move(), but the move is given as a position. */
+void
+reversi_play_move_at (Board *board, int color, int pos)
 {
   char *grid = board->grid;
   int k;
   int other = OTHER_COLOR (color);
-  int x = va_arg (move, int);
-  int y = va_arg (move, int);
-  int pos = POSITION (x, y);
   ReversiMoveStackEntry *stack_entry
     = ALLOCATE_REVERSI_MOVE_STACK_ENTRY (board);
 
-  assert (ON_BOARD (board, x, y));
+  assert (ON_BOARD (board, POSITION_X (pos), POSITION_Y (pos)));
 
-  memset (stack_entry->num.flips, 0, sizeof stack_entry->num.flips);
+  if (USES_BITBOARDS (board)) {
+    uint64_t *disks = board->data.reversi.disks;
+    uint64_t move = POSITION_BIT (pos);
+    uint64_t flips = compute_bitboard_flips (board, color, move);
 
-  for (k = 0; k < 8; k++) {
-    int beam = pos + delta[k];
+    disks[COLOR_INDEX (color)] |= flips | move;
+    disks[COLOR_INDEX (other)] &= ~(flips | move);
+    set_bitboard_points (grid, flips, color);
 
-    if (grid[beam] == other) {
-      do
-	beam += delta[k];
-      while (grid[beam] == other);
+    stack_entry->num.flip_mask = flips;
+  }
+  else {
+    memset (stack_entry->num.flips, 0, sizeof stack_entry->num.flips);
 
-      if (grid[beam] == color) {
-	beam -= delta[k];
+    for (k = 0; k < 8; k++) {
+      int beam = pos + delta[k];
+
+      if (grid[beam] == other) {
+	do
+	  beam += delta[k];
+	while (grid[beam] == other);
 
-	do {
-	  grid[beam] = color;
-	  stack_entry->num.flips[k]++;
+	if (grid[beam] == color) {
 	  beam -= delta[k];
-	} while (beam != pos);
+
+	  do {
+	    grid[beam] = color;
+	    stack_entry->num.flips[k]++;
+	    beam -= delta[k];
+	  } while (beam != pos);
+	}
       }
     }
   }
@@ -193,24 +414,41 @@ reversi_undo (Board *board)
   if (stack_entry->position != NULL_POSITION) {
     int k;
     int pos = stack_entry->position;
-    int other = OTHER_COLOR (board->grid[pos]);
+    int color = board->grid[pos];
+    int other = OTHER_COLOR (color);
 
-    for (k = 0; k < 8; k++) {
-      if (stack_entry->num.flips[k]) {
-	int flips = 0;
-	int beam = pos;
+    if (USES_BITBOARDS (board)) {
+      uint64_t *disks = board->data.reversi.disks;
+      uint64_t move = POSITION_BIT (pos);
+      uint64_t flips = stack_entry->num.flip_mask;
 
-	do {
-	  beam += delta[k];
-	  board->grid[beam] = other;
-	} while (++flips < stack_entry->num.flips[k]);
+      disks[COLOR_INDEX (color)] &= ~(flips | move);
+      disks[COLOR_INDEX (other)] |= flips;
+      if (IS_STONE (stack_entry->contents))
+	disks[COLOR_INDEX (stack_entry->contents)] |= move;
+
+      set_bitboard_points (board->grid, flips, other);
+    }
+    else {
+      for (k = 0; k < 8; k++) {
+	if (stack_entry->num.flips[k]) {
+	  int flips = 0;
+	  int beam = pos;
+
+	  do {
+	    beam += delta[k];
+	    board->grid[beam] = other;
+	  } while (++flips < stack_entry->num.flips[k]);
+	}
       }
     }
 
     board->grid[pos] = stack_entry->contents;
   }
-  else if (stack_entry->num.changes > 0)
+  else if (stack_entry->num.changes > 0) {
     board_undo_changes (board, stack_entry->num.changes);
+    rebuild_bitboards (board);
+  }
 
   board->move_number = stack_entry->common.move_number;
 }
@@ -225,6 +463,9 @@ reversi_apply_changes (Board *board, int num_changes)
   stack_entry->position		  = NULL_POSITION;
   stack_entry->num.changes	  = num_changes;
   stack_entry->common.move_number = board->move_number;
+
+  if (num_changes > 0)
+    rebuild_bitboards (board);
 }
 
 
@@ -235,6 +476,48 @@ reversi_add_dummy_move_entry (Board *board)
 }
 
 
+/* Update symmetry keys for the last move on `board', which must not
+ * be undone yet.
+ */
+void
+reversi_update_symmetry_keys (Board *board)
+{
+  const ReversiMoveStackEntry *stack_entry
+    = (const ReversiMoveStackEntry *) board->move_stack_pointer - 1;
+
+  if (stack_entry->position != NULL_POSITION) {
+    int k;
+    int pos = stack_entry->position;
+    int color = board->grid[pos];
+    int other = OTHER_COLOR (color);
+
+    board_toggle_symmetry_keys (board, pos, stack_entry->contents, color);
+
+    if (USES_BITBOARDS (board)) {
+      uint64_t flips;
+
+      for (flips = stack_entry->num.flip_mask; flips; flips &= flips - 1) {
+	board_toggle_symmetry_keys (board,
+				    BIT_INDEX_POSITION (lowest_bit_index
+							(flips)),
+				    other, color);
+      }
+    }
+    else {
+      for (k = 0; k < 8; k++) {
+	int flips;
+	int beam = pos;
+
+	for (flips = 0; flips < stack_entry->num.flips[k]; flips++) {
+	  beam += delta[k];
+	  board_toggle_symmetry_keys (board, beam, other, color);
+	}
+      }
+    }
+  }
+}
+
+
 void
 reversi_format_move (int board_width, int board_height,
 		     StringBuffer *buffer, va_list move)
@@ -260,7 +543,24 @@ reversi_parse_move (int board_width, int board_height, const char *move_string,
 void
 reversi_validate_board (const Board *board)
 {
-  UNUSED (board);
+  if (USES_BITBOARDS (board)) {
+    const uint64_t *disks = board->data.reversi.disks;
+    int x;
+    int y;
+
+    assert (!(disks[BLACK_INDEX] & disks[WHITE_INDEX]));
+
+    for (y = 0; y < 8; y++) {
+      for (x = 0; x < 8; x++) {
+	uint64_t bit = (uint64_t) 1 << (8 * y + x);
+	int contents = (x < board->width && y < board->height
+			? board->grid[POSITION (x, y)] : EMPTY);
+
+	assert (!(disks[BLACK_INDEX] & bit) == (contents != BLACK));
+	assert (!(disks[WHITE_INDEX] & bit) == (contents != WHITE));
+      }
+    }
+  }
 }
 
 
@@ -289,6 +589,127 @@ reversi_dump_board (const Board *board)
 }
 
 
+
+/* Recompute bitboards from board grid.  Does nothing for boards larger
+ * than 8x8.
+ */
+static void
+rebuild_bitboards (Board *board)
+{
+  uint64_t *disks = board->data.reversi.disks;
+  int x;
+  int y;
+
+  disks[BLACK_INDEX] = 0;
+  disks[WHITE_INDEX] = 0;
+
+  if (!USES_BITBOARDS (board))
+    return;
+
+  for (y = 0; y < board->height; y++) {
+    for (x = 0; x < board->width; x++) {
+      int contents = board->grid[POSITION (x, y)];
+
+      if (IS_STONE (contents))
+	disks[COLOR_INDEX (contents)] |= (uint64_t) 1 << (8 * y + x);
+    }
+  }
+}
+
+
+/* Extend `generator' bits over `propagator' bits in given direction
+ * (Kogge-Stone fill).  Runs of up to seven points, the most an 8x8
+ * board can have, are filled in three doubling steps.
+ */
+static inline uint64_t
+fill_bitboard (uint64_t generator, uint64_t propagator, int direction)
+{
+  int shift = bitboard_shifts[direction];
+
+  propagator &= bitboard_wrap_masks[direction];
+
+  generator  |= propagator & SHIFT_BITBOARD (generator, shift);
+  propagator &= SHIFT_BITBOARD (propagator, shift);
+  generator  |= propagator & SHIFT_BITBOARD (generator, 2 * shift);
+  propagator &= SHIFT_BITBOARD (propagator, 2 * shift);
+  generator  |= propagator & SHIFT_BITBOARD (generator, 4 * shift);
+
+  return generator;
+}
+
+
+/* Compute the bitboard of all legal moves for `color'.  In each
+ * direction, opponent disks are filled from own ones and empty points
+ * right past the filled runs are legal moves.
+ */
+static uint64_t
+compute_bitboard_moves (const Board *board, int color)
+{
+  uint64_t own	 = board->data.reversi.disks[COLOR_INDEX (color)];
+  uint64_t other = board->data.reversi.disks[OTHER_INDEX (COLOR_INDEX (color))];
+  uint64_t empty = ~(own | other);
+  uint64_t moves = 0;
+  int k;
+
+  /* Points outside of smaller boards are never considered empty. */
+  if (board->width < 8 || board->height < 8) {
+    uint64_t row_mask = ((uint64_t) 1 << board->width) - 1;
+    uint64_t on_board = 0;
+    int y;
+
+    for (y = 0; y < board->height; y++)
+      on_board |= row_mask << (8 * y);
+
+    empty &= on_board;
+  }
+
+  for (k = 0; k < 8; k++) {
+    uint64_t runs = fill_bitboard (own, other, k) & other;
+
+    moves |= (SHIFT_BITBOARD (runs, bitboard_shifts[k])
+	      & bitboard_wrap_masks[k] & empty);
+  }
+
+  return moves;
+}
+
+
+/* Compute the bitboard of disks flipped by a move of `color' at the
+ * point given by `move' bit.  This is zero if the move is illegal.
+ */
+static uint64_t
+compute_bitboard_flips (const Board *board, int color, uint64_t move)
+{
+  uint64_t own	 = board->data.reversi.disks[COLOR_INDEX (color)];
+  uint64_t other = board->data.reversi.disks[OTHER_INDEX (COLOR_INDEX (color))];
+  uint64_t flips = 0;
+  int k;
+
+  for (k = 0; k < 8; k++) {
+    uint64_t line = fill_bitboard (move, other, k);
+
+    /* The run is flipped only if it ends with an own disk.  If there
+     * is no run, `line' is just the move and nothing is flipped.
+     */
+    if (SHIFT_BITBOARD (line, bitboard_shifts[k])
+	& bitboard_wrap_masks[k] & own)
+      flips |= line & ~move;
+  }
+
+  return flips;
+}
+
+
+/* Set grid points corresponding to `bits' to `value'. */
+static void
+set_bitboard_points (char grid[BOARD_FULL_GRID_SIZE], uint64_t bits,
+		     int value)
+{
+  for (; bits; bits &= bits - 1)
+    grid[BIT_INDEX_POSITION (lowest_bit_index (bits))] = value;
+}
+
+
 
 /* Reversi-specific function. */
 
@@ -302,6 +723,13 @@ reversi_count_disks (const Board *board,
   assert (board->game == GAME_REVERSI);
   assert (num_black_disks && num_white_disks);
 
+  if (USES_BITBOARDS (board)) {
+    *num_black_disks = count_bits (board->data.reversi.disks[BLACK_INDEX]);
+    *num_white_disks = count_bits (board->data.reversi.disks[WHITE_INDEX]);
+
+    return;
+  }
+
   *num_black_disks = 0;
   *num_white_disks = 0;
 
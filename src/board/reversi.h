@@ -46,8 +46,12 @@ struct _ReversiMoveStackEntry {
   int		   position;
   char		   contents;
 
+  /* Boards up to 8x8 store a bitboard of flipped disks, larger ones
+   * store the number of disks flipped in each direction.
+   */
   union {
     char	   flips[8];
+    uint64_t	   flip_mask;
     int		   changes;
   } num;
 };
@@ -64,15 +68,24 @@ int		reversi_get_default_setup (int width, int height,
 					   BoardPositionList **black_stones,
 					   BoardPositionList **white_stones);
 
+void		reversi_reset_game_data (Board *board, int forced_reset);
+
 int		reversi_is_legal_move (const Board *board,
 				       BoardRuleSet rule_set,
 				       int color, va_list move);
 
+void		reversi_generate_legal_moves (const Board *board,
+					      BoardRuleSet rule_set,
+					      int color,
+					      BoardMoveList *moves);
+
 void		reversi_play_move (Board *board, int color, va_list move);
+void		reversi_play_move_at (Board *board, int color, int pos);
 void		reversi_undo (Board *board);
 
 void		reversi_apply_changes (Board *board, int num_changes);
 void		reversi_add_dummy_move_entry (Board *board);
+void		reversi_update_symmetry_keys (Board *board);
 
 void		reversi_format_move (int board_width, int board_height,
 				     StringBuffer *buffer, va_list move);
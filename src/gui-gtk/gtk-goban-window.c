@@ -57,6 +57,7 @@
 #include "gtk-resume-game-dialog.h"
 #include "gtk-sgf-tree-signal-proxy.h"
 #include "gtk-sgf-tree-view.h"
+#include "gtk-thread-interface.h"
 #include "gtk-utils.h"
 #include "quarry-find-dialog.h"
 #include "quarry-marshal.h"
@@ -82,6 +83,13 @@
 
 #define NAVIGATE_FAST_NUM_MOVES	10
 
+/* Limits of tactical reading behind `View/Tactical Marks'.  The node
+ * budget is per string, so even hopeless positions are analyzed in a
+ * fraction of a second.
+ */
+#define TACTICAL_READING_NODE_BUDGET	2000
+#define TACTICAL_READING_CACHE_SIZE	0x4000
+
 #define IS_DISPLAYING_GAME_NODE(goban_window)				\
   ((goban_window)->game_position.board_state				\
    == &(goban_window)->sgf_board_state)
@@ -170,6 +178,21 @@ struct _SgfCopyData {
 };
 
 
+struct _GtkGobanWindowAnalysisJob {
+  GtkGobanWindow	     *goban_window;
+  GoReader		     *go_reader;
+  Board			     *board;
+  int			      color_to_play;
+  guint			      generation;
+
+  /* Written by the main thread and polled by the analyzing one.
+   * Access only with g_atomic_int_*().
+   */
+  volatile gint		      cancellation_flag;
+  GoTacticalAnalysis	      analysis;
+};
+
+
 static void	 gtk_goban_window_class_init (GtkGobanWindowClass *class);
 static void	 gtk_goban_window_init (GtkGobanWindow *goban_window);
 
@@ -231,6 +254,19 @@ static void	 recenter_sgf_tree_view (GtkGobanWindow *goban_window);
 static void	 show_sgf_tree_view_automatically
 		   (GtkGobanWindow *goban_window, const SgfNode *sgf_node);
 
+static void	 show_or_hide_tactical_marks (GtkGobanWindow *goban_window);
+static void	 request_tactical_analysis (GtkGobanWindow *goban_window);
+static void	 set_tactical_marks (GtkGobanWindow *goban_window,
+				     GoTacticalAnalysis *analysis);
+
+#if THREADS_SUPPORTED
+
+static void	 start_tactical_analysis (GtkGobanWindow *goban_window);
+static gpointer	 analyze_position_in_thread (GtkGobanWindowAnalysisJob *job);
+static void	 tactical_analysis_completed (void *result);
+
+#endif
+
 #ifdef GTK_TYPE_GO_TO_NAMED_NODE_DIALOG
 static void	 show_go_to_named_node_dialog (GtkGobanWindow *goban_window);
 #endif
@@ -824,6 +860,11 @@ gtk_goban_window_init (GtkGobanWindow *goban_window)
       "<Item>" },
     { N_("/View/"), NULL, NULL, 0, "<Separator>" },
 
+    { N_("/View/T_actical Marks"),	NULL,
+      show_or_hide_tactical_marks,	0,
+      "<CheckItem>" },
+    { N_("/View/"), NULL, NULL, 0, "<Separator>" },
+
     { N_("/View/_Control Center"),	NULL,
       gtk_control_center_present,	0,
       "<Item>" },
@@ -1395,6 +1436,10 @@ gtk_goban_window_new (SgfCollection *sgf_collection, const char *filename)
 
   goban_window->board = NULL;
 
+  goban_window->black_variations = NULL;
+  goban_window->white_variations = NULL;
+  goban_window->sgf_markup	 = NULL;
+
   goban_window->dead_stones_list = NULL;
 
   goban_window->sgf_collection = sgf_collection;
@@ -1432,6 +1477,17 @@ gtk_goban_window_destroy (GtkObject *object)
       (gtk_widget_get_parent (GTK_WIDGET (goban_window->sgf_tree_view)));
   }
 
+  /* A running analysis holds a reference to the window, so it is
+   * finalized only after the thread has finished.
+   */
+  goban_window->show_tactical_analysis = FALSE;
+  request_tactical_analysis (goban_window);
+
+  if (goban_window->tactical_analysis_job) {
+    g_atomic_int_set (&goban_window->tactical_analysis_job->cancellation_flag,
+		      1);
+  }
+
   GTK_OBJECT_CLASS (parent_class)->destroy (object);
 }
 
@@ -1507,6 +1563,10 @@ gtk_goban_window_finalize (GObject *object)
   if (goban_window->board)
     board_delete (goban_window->board);
 
+  g_free (goban_window->black_variations);
+  g_free (goban_window->white_variations);
+  g_free (goban_window->sgf_markup);
+
   if (goban_window->players[BLACK_INDEX])
     gtk_schedule_gtp_client_deletion (goban_window->players[BLACK_INDEX]);
   if (goban_window->players[WHITE_INDEX])
@@ -1528,6 +1588,9 @@ gtk_goban_window_finalize (GObject *object)
   if (goban_window->find_dialog)
     gtk_widget_destroy (GTK_WIDGET (goban_window->find_dialog));
 
+  if (goban_window->go_reader)
+    go_reader_delete (goban_window->go_reader);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -2451,6 +2514,176 @@ show_sgf_tree_view_automatically (GtkGobanWindow *goban_window,
 }
 
 
+
+static void
+show_or_hide_tactical_marks (GtkGobanWindow *goban_window)
+{
+  GtkWidget *menu_item
+    = gtk_item_factory_get_widget (goban_window->item_factory,
+				   "/View/Tactical Marks");
+
+  goban_window->show_tactical_analysis
+    = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (menu_item));
+
+  if (goban_window->show_tactical_analysis)
+    request_tactical_analysis (goban_window);
+  else {
+    /* Discards results of any analysis still running. */
+    request_tactical_analysis (goban_window);
+    set_tactical_marks (goban_window, NULL);
+  }
+}
+
+
+/* Analyze the displayed position, if it is a Go position and the
+ * marks are wanted.  Marks are never shown in game mode, since they
+ * would be hints for the human player.
+ *
+ * With threads, reading is done in background, one analysis at a
+ * time.  If the user navigates while an analysis is running, it is
+ * cancelled and the newest position is analyzed once it stops.
+ */
+static void
+request_tactical_analysis (GtkGobanWindow *goban_window)
+{
+  goban_window->tactical_analysis_pending = FALSE;
+  goban_window->tactical_analysis_generation++;
+
+  if (!goban_window->show_tactical_analysis
+      || goban_window->board->game != GAME_GO
+      || goban_window->in_game_mode
+      || goban_window->sgf_board_state.color_to_play == EMPTY)
+    return;
+
+  if (!goban_window->go_reader) {
+    goban_window->go_reader = go_reader_new (TACTICAL_READING_NODE_BUDGET,
+					     TACTICAL_READING_CACHE_SIZE);
+  }
+
+#if THREADS_SUPPORTED
+
+  if (goban_window->tactical_analysis_job) {
+    g_atomic_int_set (&goban_window->tactical_analysis_job->cancellation_flag,
+		      1);
+    goban_window->tactical_analysis_pending = TRUE;
+  }
+  else
+    start_tactical_analysis (goban_window);
+
+#else /* not THREADS_SUPPORTED */
+
+  {
+    GoTacticalAnalysis analysis;
+
+    go_reader_analyze (goban_window->go_reader, goban_window->board,
+		       goban_window->sgf_board_state.color_to_play,
+		       &analysis, NULL);
+    set_tactical_marks (goban_window, &analysis);
+    go_tactical_analysis_dispose (&analysis);
+  }
+
+#endif /* not THREADS_SUPPORTED */
+}
+
+
+/* Show marks for `analysis' on the goban, or remove them if it is
+ * NULL.  Position lists are taken over by the goban.
+ */
+static void
+set_tactical_marks (GtkGobanWindow *goban_window,
+		    GoTacticalAnalysis *analysis)
+{
+  gtk_goban_set_overlay_data (goban_window->goban, 0,
+			      analysis ? analysis->stones_in_atari : NULL,
+			      GOBAN_TILE_DONT_CHANGE, TILE_NONE,
+			      SGF_PSEUDO_MARKUP_ATARI);
+  gtk_goban_set_overlay_data (goban_window->goban, 1,
+			      analysis ? analysis->ladder_captures : NULL,
+			      GOBAN_TILE_DONT_CHANGE, TILE_NONE,
+			      SGF_PSEUDO_MARKUP_LADDER);
+  gtk_goban_set_overlay_data (goban_window->goban, 2,
+			      analysis ? analysis->lost_semeai : NULL,
+			      GOBAN_TILE_DONT_CHANGE, TILE_NONE,
+			      SGF_PSEUDO_MARKUP_SEMEAI);
+
+  if (analysis) {
+    analysis->stones_in_atari = NULL;
+    analysis->ladder_captures = NULL;
+    analysis->lost_semeai     = NULL;
+  }
+}
+
+
+#if THREADS_SUPPORTED
+
+
+static void
+start_tactical_analysis (GtkGobanWindow *goban_window)
+{
+  GtkGobanWindowAnalysisJob *job
+    = g_malloc (sizeof (GtkGobanWindowAnalysisJob));
+
+  job->goban_window	 = goban_window;
+  job->go_reader	 = goban_window->go_reader;
+  job->board		 = board_duplicate_without_stacks (goban_window->board);
+  job->color_to_play	 = goban_window->sgf_board_state.color_to_play;
+  job->generation	 = goban_window->tactical_analysis_generation;
+
+  g_atomic_int_set (&job->cancellation_flag, 0);
+
+  g_object_ref (goban_window);
+  goban_window->tactical_analysis_job	  = job;
+  goban_window->tactical_analysis_pending = FALSE;
+
+  g_thread_create ((GThreadFunc) analyze_position_in_thread, job, FALSE, NULL);
+}
+
+
+static gpointer
+analyze_position_in_thread (GtkGobanWindowAnalysisJob *job)
+{
+  ThreadEventData *event_data;
+
+  go_reader_analyze (job->go_reader, job->board, job->color_to_play,
+		     &job->analysis, &job->cancellation_flag);
+
+  event_data = g_malloc (sizeof (ThreadEventData));
+  event_data->callback = tactical_analysis_completed;
+  event_data->result   = job;
+
+  g_async_queue_push (thread_events_queue, event_data);
+  g_main_context_wakeup (NULL);
+
+  return NULL;
+}
+
+
+static void
+tactical_analysis_completed (void *result)
+{
+  GtkGobanWindowAnalysisJob *job = (GtkGobanWindowAnalysisJob *) result;
+  GtkGobanWindow *goban_window = job->goban_window;
+
+  goban_window->tactical_analysis_job = NULL;
+
+  if (job->generation == goban_window->tactical_analysis_generation
+      && !g_atomic_int_get (&job->cancellation_flag))
+    set_tactical_marks (goban_window, &job->analysis);
+
+  go_tactical_analysis_dispose (&job->analysis);
+  board_delete (job->board);
+  g_free (job);
+
+  if (goban_window->tactical_analysis_pending)
+    start_tactical_analysis (goban_window);
+
+  g_object_unref (goban_window);
+}
+
+
+#endif /* THREADS_SUPPORTED */
+
+
 #ifdef GTK_TYPE_GO_TO_NAMED_NODE_DIALOG
 
 
@@ -2790,11 +3023,21 @@ set_current_tree (GtkGobanWindow *goban_window, SgfGameTree *sgf_tree)
 {
   if (!goban_window->board && GAME_IS_SUPPORTED (sgf_tree->game)) {
     GtkLabel **game_specific_info = goban_window->game_specific_info;
+    int grid_size = BOARD_GRID_SIZE_FOR (sgf_tree->board_width,
+					 sgf_tree->board_height);
 
     goban_window->board = board_new (sgf_tree->game,
 				     sgf_tree->board_width,
 				     sgf_tree->board_height);
 
+    goban_window->black_variations = g_malloc (grid_size * sizeof (int));
+    goban_window->white_variations = g_malloc (grid_size * sizeof (int));
+    goban_window->sgf_markup	   = g_malloc (grid_size * sizeof (char));
+
+    /* Cheap to keep up to date, so show it on every move. */
+    if (goban_window->board->game == GAME_GO)
+      go_set_territory_estimation (goban_window->board, 1);
+
     gtk_utils_set_widgets_visible (goban_window->board->game != GAME_AMAZONS,
 				   game_specific_info[BLACK_INDEX],
 				   game_specific_info[WHITE_INDEX], NULL);
@@ -4026,6 +4269,9 @@ update_children_for_new_node (GtkGobanWindow *goban_window, gboolean forced,
   goban_window->switching_y = NULL_Y;
 
   goban_window->last_displayed_node = current_node;
+
+  /* The goban has just dropped all overlays, including old marks. */
+  request_tactical_analysis (goban_window);
 }
 
 
@@ -4223,6 +4469,31 @@ update_game_specific_information (const GtkGobanWindow *goban_window)
       g_free (white_string);
       white_string = full_white_string;
     }
+
+    if (board->estimate_territory) {
+      int black_territory;
+      int white_territory;
+      gchar *full_string;
+
+      go_get_territory_estimate (board, NULL,
+				 &black_territory, &white_territory);
+
+      full_string
+	= g_strdup_printf (ngettext ("%s\nabout %d point of territory",
+				     "%s\nabout %d points of territory",
+				     black_territory),
+			   black_string, black_territory);
+      g_free (black_string);
+      black_string = full_string;
+
+      full_string
+	= g_strdup_printf (ngettext ("%s\nabout %d point of territory",
+				     "%s\nabout %d points of territory",
+				     white_territory),
+			   white_string, white_territory);
+      g_free (white_string);
+      white_string = full_string;
+    }
   }
   else if (board->game == GAME_REVERSI) {
     int num_black_disks;
@@ -5446,7 +5717,9 @@ move_has_been_played (GtkGobanWindow *goban_window)
       {
 	int player;
 
-	goban_window->dead_stones = g_malloc (BOARD_GRID_SIZE * sizeof (char));
+	goban_window->dead_stones = g_malloc (BOARD_GRID_SIZE_FOR (board->width,
+								   board->height)
+					      * sizeof (char));
 	board_fill_grid (board, goban_window->dead_stones, 0);
 
 	goban_window->scoring_engine_player = -1;
@@ -6012,7 +6285,10 @@ activate_scoring_tool (GtkGobanWindow *goban_window, guint callback_action,
 
       g_assert (!goban_window->dead_stones);
 
-      goban_window->dead_stones = g_malloc (BOARD_GRID_SIZE * sizeof (char));
+      goban_window->dead_stones
+	= g_malloc (BOARD_GRID_SIZE_FOR (goban_window->board->width,
+					 goban_window->board->height)
+		    * sizeof (char));
       board_fill_grid (goban_window->board, goban_window->dead_stones, 0);
 
       go_guess_dead_stones (goban_window->board, goban_window->dead_stones,
@@ -68,6 +68,9 @@ enum {
 typedef struct _GtkGobanWindow		GtkGobanWindow;
 typedef struct _GtkGobanWindowClass	GtkGobanWindowClass;
 
+/* Private to `gtk-goban-window.c'. */
+typedef struct _GtkGobanWindowAnalysisJob GtkGobanWindowAnalysisJob;
+
 struct _GtkGobanWindow {
   GtkWindow		   window;
 
@@ -124,9 +127,10 @@ struct _GtkGobanWindow {
   gchar			  *next_sgf_label;
   gint			   labels_mode;
 
-  int			   black_variations[BOARD_GRID_SIZE];
-  int			   white_variations[BOARD_GRID_SIZE];
-  char			   sgf_markup[BOARD_GRID_SIZE];
+  /* Allocated along with `board', for its dimensions. */
+  int			  *black_variations;
+  int			  *white_variations;
+  char			  *sgf_markup;
 
   char			  *dead_stones;
   BoardPositionList	  *dead_stones_list;
@@ -163,6 +167,12 @@ struct _GtkGobanWindow {
 
   GtkGameInfoDialog	  *game_info_dialog;
   GtkProgressDialog	  *scoring_progress_dialog;
+
+  gboolean		   show_tactical_analysis;
+  GoReader		  *go_reader;
+  GtkGobanWindowAnalysisJob *tactical_analysis_job;
+  gboolean		   tactical_analysis_pending;
+  guint			   tactical_analysis_generation;
 };
 
 struct _GtkGobanWindowClass {
@@ -643,8 +643,6 @@ gtk_goban_expose (GtkWidget *widget, GdkEventExpose *event)
       || clip_bottom_margin > goban->bottom_margin) {
     PangoLayout *coordinate_layout = gtk_widget_create_pango_layout (widget,
 								     NULL);
-    const char *horizontal_coordinates
-      = game_info[goban->base.game].horizontal_coordinates;
 
     pango_layout_set_font_description (coordinate_layout,
 				       goban->base.font_description);
@@ -698,8 +696,10 @@ gtk_goban_expose (GtkWidget *widget, GdkEventExpose *event)
 			       / cell_size)));
 
       for (k = lower_limit; k < upper_limit; k++) {
-	pango_layout_set_text (coordinate_layout,
-			       horizontal_coordinates + k, 1);
+	char coordinate[3];
+
+	game_get_horizontal_coordinate (goban->base.game, k, coordinate);
+	pango_layout_set_text (coordinate_layout, coordinate, -1);
 
 	if (clip_top_margin < goban->top_margin) {
 	  gdk_draw_layout (widget->window, gc,
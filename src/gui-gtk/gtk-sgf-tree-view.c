@@ -30,6 +30,7 @@
 #include "gtk-configuration.h"
 #include "gtk-goban-base.h"
 #include "gtk-sgf-tree-signal-proxy.h"
+#include "gtk-thread-interface.h"
 #include "gtk-tile-set.h"
 #include "gtk-utils.h"
 #include "gui-back-end.h"
@@ -51,6 +52,16 @@
 #define DEFAULT_CELL_SIZE	24
 
 
+/* Number of nodes to lay out in one step of background map layout.
+ * If the first step doesn't complete the map, the rest is done in
+ * background.
+ */
+#define MAP_LAYOUT_STEP_SIZE		0x10000
+
+/* How often (in milliseconds) to show map layout progress. */
+#define MAP_LAYOUT_PROGRESS_INTERVAL	150
+
+
 #define PADDING_WIDTH(cell_size)					\
   ((gint) (((cell_size) + 6) / 12))
 
@@ -127,6 +138,18 @@ static gboolean	 update_view_port_and_maybe_move_or_resize_window
 		    gint original_hadjustment_value,
 		    gint original_vadjustment_value);
 
+static void	 start_map_layout (GtkSgfTreeView *view);
+static void	 stop_map_layout (GtkSgfTreeView *view,
+				  gboolean complete_synchronously);
+static gboolean	 update_map_layout_progress (GtkSgfTreeView *view);
+static void	 lock_map (GtkSgfTreeView *view);
+static void	 unlock_map (GtkSgfTreeView *view);
+static void	 sgf_tree_deleted (GtkSgfTreeView *view, GObject *proxy);
+
+#if THREADS_SUPPORTED
+static gpointer	 lay_out_map_in_thread (GtkSgfTreeView *view);
+#endif
+
 static void	 about_to_modify_map (GtkSgfTreeView *view);
 static void	 about_to_change_current_node (GtkSgfTreeView *view);
 static void	 current_node_changed (GtkSgfTreeView *view);
@@ -242,6 +265,15 @@ gtk_sgf_tree_view_init (GtkSgfTreeView *view)
   view->map_height		  = 1;
 
   view->last_tooltips_node	  = NULL;
+
+  view->map_layout_source_id	  = 0;
+  view->map_layout_thread	  = NULL;
+
+#if THREADS_SUPPORTED
+  view->map_layout_mutex	  = g_mutex_new ();
+#else
+  view->map_layout_mutex	  = NULL;
+#endif
 }
 
 
@@ -268,8 +300,12 @@ gtk_sgf_tree_view_realize (GtkWidget *widget)
     gtk_sgf_tree_view_set_scroll_adjustments (view, NULL, NULL);
 
   if (view->current_tree) {
+    start_map_layout (view);
+
+    lock_map (view);
     sgf_game_tree_get_map_dimensions (view->current_tree,
 				      &view->map_width, &view->map_height);
+    unlock_map (view);
 
     update_view_port (view);
   }
@@ -429,7 +465,8 @@ gtk_sgf_tree_view_expose (GtkWidget *widget, GdkEventExpose *event)
 
     g_return_val_if_fail (view->current_tree, FALSE);
     g_return_val_if_fail (view->view_port_nodes, FALSE);
-    g_return_val_if_fail (view->view_port_lines, FALSE);
+    g_return_val_if_fail (view->view_port_lines || !view->num_view_port_lines,
+			  FALSE);
     g_return_val_if_fail (view->tile_map, FALSE);
     g_return_val_if_fail (view->sgf_markup_tile_map, FALSE);
 
@@ -698,6 +735,8 @@ gtk_sgf_tree_view_unrealize (GtkWidget *widget)
 {
   GtkSgfTreeView *view = GTK_SGF_TREE_VIEW (widget);
 
+  stop_map_layout (view, TRUE);
+
   gdk_window_set_user_data (view->output_window, NULL);
   gdk_window_destroy (view->output_window);
 
@@ -720,6 +759,14 @@ gtk_sgf_tree_view_destroy (GtkObject *object)
 {
   GtkSgfTreeView *view = GTK_SGF_TREE_VIEW (object);
 
+  stop_map_layout (view, TRUE);
+
+  if (view->current_tree) {
+    g_object_weak_unref (GET_SIGNAL_PROXY (view->current_tree),
+			 (GWeakNotify) sgf_tree_deleted, view);
+    view->current_tree = NULL;
+  }
+
   disconnect_adjustment (view, view->hadjustment);
   disconnect_adjustment (view, view->vadjustment);
 
@@ -740,6 +787,10 @@ gtk_sgf_tree_view_finalize (GObject *object)
 			  NULL, NULL);
   }
 
+#if THREADS_SUPPORTED
+  g_mutex_free (view->map_layout_mutex);
+#endif
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -757,6 +808,9 @@ gtk_sgf_tree_view_set_sgf_tree (GtkSgfTreeView *view, SgfGameTree *sgf_tree)
   if (view->current_tree) {
     GObject *old_proxy = GET_SIGNAL_PROXY (view->current_tree);
 
+    stop_map_layout (view, TRUE);
+    g_object_weak_unref (old_proxy, (GWeakNotify) sgf_tree_deleted, view);
+
     g_signal_handlers_disconnect_by_func (old_proxy,
 					  about_to_modify_map, view);
     g_signal_handlers_disconnect_by_func (old_proxy,
@@ -779,6 +833,11 @@ gtk_sgf_tree_view_set_sgf_tree (GtkSgfTreeView *view, SgfGameTree *sgf_tree)
   g_signal_connect_swapped (proxy, "map-modified",
 			    G_CALLBACK (map_modified), view);
 
+  g_object_weak_ref (proxy, (GWeakNotify) sgf_tree_deleted, view);
+
+  if (GTK_WIDGET_REALIZED (view))
+    start_map_layout (view);
+
   gtk_goban_base_set_game (GTK_GOBAN_BASE (view), sgf_tree->game);
 
   if (!view->hadjustment || !view->vadjustment)
@@ -940,17 +999,22 @@ track_current_node (GtkSgfTreeView *view)
   gint full_cell_size = FULL_CELL_SIZE (view);
   gint current_node_x;
   gint current_node_y;
+  gint node_is_in_map;
 
   if (!view->current_tree) {
     /* No tree to begin with, so nothing to track. */
     return;
   }
 
-  if (!sgf_game_tree_get_node_coordinates (view->current_tree,
-					   view->current_tree->current_node,
-					   &current_node_x, &current_node_y)) {
-    /* This means the current node is in a collapsed subtree.  Nothing
-     * to track, return now.
+  lock_map (view);
+  node_is_in_map = sgf_game_tree_get_node_coordinates
+		     (view->current_tree, view->current_tree->current_node,
+		      &current_node_x, &current_node_y);
+  unlock_map (view);
+
+  if (!node_is_in_map) {
+    /* This means the current node is in a collapsed subtree (or not
+     * layed out yet.)  Nothing to track, return now.
      */
     return;
   }
@@ -1042,12 +1106,17 @@ center_on_current_node (GtkSgfTreeView *view)
 {
   gint current_node_x;
   gint current_node_y;
+  gint node_is_in_map = 0;
+
+  if (view->current_tree) {
+    lock_map (view);
+    node_is_in_map = sgf_game_tree_get_node_coordinates
+		       (view->current_tree, view->current_tree->current_node,
+			&current_node_x, &current_node_y);
+    unlock_map (view);
+  }
 
-  if (view->current_tree
-      && sgf_game_tree_get_node_coordinates (view->current_tree,
-					     view->current_tree->current_node,
-					     &current_node_x,
-					     &current_node_y)) {
+  if (node_is_in_map) {
     gint view_width     = GTK_WIDGET (view)->allocation.width;
     gint view_height    = GTK_WIDGET (view)->allocation.height;
     gint full_cell_size = FULL_CELL_SIZE (view);
@@ -1092,6 +1161,8 @@ update_view_port (GtkSgfTreeView *view)
   utils_free (view->sgf_markup_tile_map);
 
   if (view->current_tree) {
+    lock_map (view);
+
     sgf_game_tree_fill_map_view_port (view->current_tree,
 				      view->view_port_x0, view->view_port_y0,
 				      view->view_port_x1, view->view_port_y1,
@@ -1104,6 +1175,8 @@ update_view_port (GtkSgfTreeView *view)
 						view->view_port_y0,
 						view->view_port_x1,
 						view->view_port_y1);
+
+    unlock_map (view);
   }
   else {
     view->view_port_nodes = utils_malloc0 (((view->view_port_x1
@@ -1172,8 +1245,10 @@ update_view_port_and_maybe_move_or_resize_window
   gboolean need_to_move_window;
 
   if (view->current_tree) {
+    lock_map (view);
     sgf_game_tree_get_map_dimensions (view->current_tree,
 				      &view->map_width, &view->map_height);
+    unlock_map (view);
   }
   else {
     view->map_width  = 1;
@@ -1233,9 +1308,180 @@ update_view_port_and_maybe_move_or_resize_window
 }
 
 
+/* Lay out the map of the current tree.  If the first step doesn't
+ * complete it, the rest is done by a worker thread (or, without thread
+ * support, in idle steps) and the view shows the map progressively.
+ *
+ * The worker only reads the tree.  It is stopped before any map
+ * modification and restarted from where it paused afterwards, so the
+ * tree needs no other protection.  All map queries done while it runs
+ * must be guarded with lock_map() and unlock_map().
+ */
+static void
+start_map_layout (GtkSgfTreeView *view)
+{
+  SgfGameTree *sgf_tree = view->current_tree;
+
+  if (!sgf_tree || view->map_layout_source_id)
+    return;
+
+  if (sgf_game_tree_update_map_partially (sgf_tree, MAP_LAYOUT_STEP_SIZE)) {
+    sgf_game_tree_set_map_layout_deferred (sgf_tree, 0);
+    return;
+  }
+
+  sgf_game_tree_set_map_layout_deferred (sgf_tree, 1);
+
+#if THREADS_SUPPORTED
+
+  view->map_layout_cancellation_flag = 0;
+  view->map_layout_thread
+    = g_thread_create ((GThreadFunc) lay_out_map_in_thread, view, TRUE, NULL);
+
+  view->map_layout_source_id
+    = g_timeout_add (MAP_LAYOUT_PROGRESS_INTERVAL,
+		     (GSourceFunc) update_map_layout_progress, view);
+
+#else /* not THREADS_SUPPORTED */
+
+  view->map_layout_source_id
+    = g_idle_add ((GSourceFunc) update_map_layout_progress, view);
+
+#endif /* not THREADS_SUPPORTED */
+}
+
+
+/* Stop background map layout, if any.  If `complete_synchronously'
+ * is set, tree's map leaves deferred mode, so that the next query
+ * lays out the rest of it at once.  Otherwise, the layout is supposed
+ * to be restarted with start_map_layout() soon.
+ */
+static void
+stop_map_layout (GtkSgfTreeView *view, gboolean complete_synchronously)
+{
+  if (!view->map_layout_source_id)
+    return;
+
+#if THREADS_SUPPORTED
+  g_mutex_lock (view->map_layout_mutex);
+  view->map_layout_cancellation_flag = 1;
+  g_mutex_unlock (view->map_layout_mutex);
+
+  g_thread_join (view->map_layout_thread);
+  view->map_layout_thread = NULL;
+#endif
+
+  g_source_remove (view->map_layout_source_id);
+  view->map_layout_source_id = 0;
+
+  if (complete_synchronously)
+    sgf_game_tree_set_map_layout_deferred (view->current_tree, 0);
+}
+
+
+static gboolean
+update_map_layout_progress (GtkSgfTreeView *view)
+{
+  SgfGameTree *sgf_tree = view->current_tree;
+  gint view_x = (gint) view->hadjustment->value;
+  gint view_y = (gint) view->vadjustment->value;
+  gboolean map_is_complete;
+
+#if THREADS_SUPPORTED
+  lock_map (view);
+  map_is_complete = sgf_tree->map_is_valid;
+  unlock_map (view);
+#else
+  map_is_complete = sgf_game_tree_update_map_partially (sgf_tree,
+							MAP_LAYOUT_STEP_SIZE);
+#endif
+
+  if (map_is_complete) {
+    /* The thread has finished or is just about to.  This source is
+     * removed when we return.
+     */
+#if THREADS_SUPPORTED
+    g_thread_join (view->map_layout_thread);
+    view->map_layout_thread = NULL;
+#endif
+
+    view->map_layout_source_id = 0;
+    sgf_game_tree_set_map_layout_deferred (sgf_tree, 0);
+  }
+
+  if (!update_view_port_and_maybe_move_or_resize_window (view,
+							 view_x, view_y)) {
+    /* FIXME: Suboptimal. */
+    gtk_widget_queue_draw (GTK_WIDGET (view));
+  }
+
+  return !map_is_complete;
+}
+
+
+static void
+lock_map (GtkSgfTreeView *view)
+{
+  if (view->map_layout_thread)
+    g_mutex_lock (view->map_layout_mutex);
+}
+
+
+static void
+unlock_map (GtkSgfTreeView *view)
+{
+  if (view->map_layout_thread)
+    g_mutex_unlock (view->map_layout_mutex);
+}
+
+
+#if THREADS_SUPPORTED
+
+
+static gpointer
+lay_out_map_in_thread (GtkSgfTreeView *view)
+{
+  SgfGameTree *sgf_tree = view->current_tree;
+  int map_is_complete = 0;
+  int cancelled;
+
+  do {
+    g_mutex_lock (view->map_layout_mutex);
+
+    cancelled = view->map_layout_cancellation_flag;
+    if (!cancelled) {
+      map_is_complete
+	= sgf_game_tree_update_map_partially (sgf_tree, MAP_LAYOUT_STEP_SIZE);
+    }
+
+    g_mutex_unlock (view->map_layout_mutex);
+  } while (!map_is_complete && !cancelled);
+
+  return NULL;
+}
+
+
+#endif /* THREADS_SUPPORTED */
+
+
+/* Called when the signal proxy of our tree is finalized, which only
+ * happens when the tree is being deleted.
+ */
+static void
+sgf_tree_deleted (GtkSgfTreeView *view, GObject *proxy)
+{
+  UNUSED (proxy);
+
+  stop_map_layout (view, FALSE);
+  view->current_tree = NULL;
+}
+
+
 static void
 about_to_modify_map (GtkSgfTreeView *view)
 {
+  stop_map_layout (view, FALSE);
+
   if (GTK_WIDGET_REALIZED (view)) {
     view->expect_map_modification = TRUE;
     view->do_track_current_node	  = SHOULD_TRACK_CURRENT_NODE (view);
@@ -1246,8 +1492,11 @@ about_to_modify_map (GtkSgfTreeView *view)
 static void
 about_to_change_current_node (GtkSgfTreeView *view)
 {
-  if (GTK_WIDGET_REALIZED (view) && !view->expect_map_modification)
+  if (GTK_WIDGET_REALIZED (view) && !view->expect_map_modification) {
+    lock_map (view);
     view->do_track_current_node = SHOULD_TRACK_CURRENT_NODE (view);
+    unlock_map (view);
+  }
 }
 
 
@@ -1287,6 +1536,11 @@ map_modified (GtkSgfTreeView *view)
     gint view_x = (gint) view->hadjustment->value;
     gint view_y = (gint) view->vadjustment->value;
 
+    /* Usually completes immediately, since only modified chunks of
+     * the map are layed out anew.
+     */
+    start_map_layout (view);
+
     if (view->do_track_current_node)
       track_current_node (view);
 
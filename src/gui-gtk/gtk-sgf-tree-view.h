@@ -89,6 +89,14 @@ struct _GtkSgfTreeView {
   gint			press_y;
 
   const SgfNode	       *last_tooltips_node;
+
+  /* Huge trees are layed out in background, see start_map_layout().
+   * The cancellation flag is protected by the mutex.
+   */
+  guint			map_layout_source_id;
+  GThread	       *map_layout_thread;
+  GMutex	       *map_layout_mutex;
+  int			map_layout_cancellation_flag;
 };
 
 struct _GtkSgfTreeViewClass {
@@ -29,8 +29,12 @@
 #include <glib.h>
 
 
+/* Cancellation flags shared with worker threads are accessed with
+ * g_atomic_int_get() and g_atomic_int_set(), which need GLib 2.10.
+ */
 #define THREADS_SUPPORTED	(defined(G_THREADS_ENABLED)		\
-				 && !defined(G_THREADS_IMPL_NONE))
+				 && !defined(G_THREADS_IMPL_NONE)	\
+				 && GLIB_CHECK_VERSION (2, 10, 0))
 
 #if THREADS_SUPPORTED
 
@@ -339,7 +339,8 @@ gtk_sgf_markup_tile_set_create (const GtkSgfMarkupTileSetKey *key)
 {
   /* NOTE: Keep in the order defined in `sgf.h'! */
   static const gchar *svg_file_base_names[NUM_ALL_SGF_MARKUPS]
-    = { "cross", "circle", "square", "triangle", "selected", "last-move" };
+    = { "cross", "circle", "square", "triangle", "selected", "last-move",
+	"atari", "ladder", "semeai" };
 
   GtkSgfMarkupTileSet *tile_set = g_malloc (sizeof (GtkSgfMarkupTileSet));
   gint tile_size = key->tile_size;
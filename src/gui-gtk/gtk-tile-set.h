@@ -35,10 +35,15 @@
 #define NUM_SGF_MARKUP_BACKGROUNDS	(MAX (BLACK, WHITE) + 1)
 
 /* We consider ``last move markup'' a pseudo-SGF markup in the GTK+
- * GUI.  So, we need to tweak things a little here.
+ * GUI.  So, we need to tweak things a little here.  Marks of tactical
+ * analysis are pseudo-markups too, so that they never look like the
+ * markup stored in the game record.
  */
 #define SGF_PSEUDO_MARKUP_LAST_MOVE	NUM_SGF_MARKUPS
-#define NUM_ALL_SGF_MARKUPS		(SGF_PSEUDO_MARKUP_LAST_MOVE + 1)
+#define SGF_PSEUDO_MARKUP_ATARI		(SGF_PSEUDO_MARKUP_LAST_MOVE + 1)
+#define SGF_PSEUDO_MARKUP_LADDER	(SGF_PSEUDO_MARKUP_ATARI + 1)
+#define SGF_PSEUDO_MARKUP_SEMEAI	(SGF_PSEUDO_MARKUP_LADDER + 1)
+#define NUM_ALL_SGF_MARKUPS		(SGF_PSEUDO_MARKUP_SEMEAI + 1)
 
 #define SGF_MARKUP_OPAQUE		0
 #define SGF_MARKUP_25_TRANSPARENT	NUM_ALL_SGF_MARKUPS
@@ -84,6 +84,11 @@ struct _BufferPositionStorage {
   } while (0)
 
 
+/* Offset in file of the character right after the current token. */
+#define CURRENT_OFFSET_IN_FILE(data)					\
+  ((data)->buffer_offset_in_file + ((data)->buffer_pointer - (data)->buffer))
+
+
 #define STORE_ERROR_POSITION(data, storage)				\
   do {									\
     (storage).line   = (data)->line;					\
@@ -0,0 +1,1351 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This file is part of Quarry.                                    *
+ *                                                                 *
+ * Copyright (C) 2006 Paul Pogonyshev.                             *
+ *                                                                 *
+ * This program is free software; you can redistribute it and/or   *
+ * modify it under the terms of the GNU General Public License as  *
+ * published by the Free Software Foundation; either version 2 of  *
+ * the License, or (at your option) any later version.             *
+ *                                                                 *
+ * This program is distributed in the hope that it will be useful, *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of  *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the   *
+ * GNU General Public License for more details.                    *
+ *                                                                 *
+ * You should have received a copy of the GNU General Public       *
+ * License along with this program; if not, write to the Free      *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,     *
+ * Boston, MA 02110-1301, USA.                                     *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* A simple benchmark program for SGF module.  It is only useful for
+ * developers, to measure effect of optimizations.  Each benchmark
+ * either parses given SGF files or generates a synthetic collection
+ * of game records and then times some operation on it.
+ */
+
+
+#include "sgf.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+#define DEFAULT_NUM_SYNTHETIC_GAMES	50000
+#define DEFAULT_NUM_DIFFED_GAMES	5000
+#define DEFAULT_EDIT_PERCENTAGE		40
+#define DEFAULT_NUM_TREE_NODES		50000
+#define DEFAULT_NUM_TREE_EDITS		1000
+#define DEFAULT_NUM_MAP_NODES		500000
+#define DEFAULT_NUM_MAP_EDITS		200
+#define DEFAULT_NUM_VIEW_PORT_QUERIES	10000
+#define VIEW_PORT_WIDTH			40
+#define VIEW_PORT_HEIGHT		30
+#define DEFAULT_NUM_REALS		1000000
+#define NUM_REPETITIONS			5
+#define NUM_PERFT_GAMES			4
+#define NUM_TERRITORY_POSITIONS		1000
+#define MAX_TERRITORY_POSITION_MOVES	80
+
+
+typedef struct _SgfBenchmark	SgfBenchmark;
+
+struct _SgfBenchmark {
+  const char	 *name;
+  const char	 *arguments;
+  int (* run) (int argc, char **argv);
+};
+
+
+typedef struct _PerftGame	PerftGame;
+
+struct _PerftGame {
+  Game		  game;
+  const char	 *name;
+  int		  board_size;
+  int		  color_to_play_first;
+  int		  default_depth;
+};
+
+
+static int	      benchmark_write (int argc, char **argv);
+static int	      benchmark_real_output (int argc, char **argv);
+static int	      benchmark_diff (int argc, char **argv);
+static int	      benchmark_transaction (int argc, char **argv);
+static int	      benchmark_map_edit (int argc, char **argv);
+static int	      benchmark_map_view_port (int argc, char **argv);
+static int	      benchmark_board_replay (int argc, char **argv);
+static int	      benchmark_board_perft (int argc, char **argv);
+static int	      benchmark_amazons_territory (int argc, char **argv);
+
+static SgfCollection *
+		      get_benchmark_collection (int argc, char **argv);
+static SgfCollection *
+		      parse_synthetic_sgf (StringBuffer *buffer);
+static void	      add_synthetic_game (StringBuffer *buffer,
+					  int game, int is_modified);
+static SgfGameTree *  create_random_game_tree (int num_nodes,
+					       SgfNode ***nodes);
+static double	      time_replay (const SgfCollection *collection,
+				   BoardEngine engine, int no_undo,
+				   int *num_moves);
+static int	      replay_main_line (Board *board, const SgfGameTree *tree);
+static int	      go_boards_are_equal (const Board *first_board,
+					   const Board *second_board);
+static void	      apply_default_setup (Board *board);
+static long	      perft (Board *board, int color, int depth,
+			     BoardMoveList **move_lists);
+static double	      time_tree_edits (int num_nodes, int num_edits,
+				       int use_transaction,
+				       int *num_map_updates);
+static double	      time_map_edits (int num_nodes, int num_edits,
+				      int relayout_whole_map);
+static void	      update_map_on_notification
+			(SgfGameTree *tree,
+			 SgfGameTreeNotificationCode notification_code,
+			 void *user_data);
+static char *	      format_real (double number, int use_printf);
+static unsigned int   next_random_number (void);
+
+static double	      get_time (void);
+
+
+static const SgfBenchmark benchmarks[] = {
+  { "write",	"[NUM-GAMES | FILE...]",	benchmark_write },
+  { "real-output", "[NUM-NUMBERS]",		benchmark_real_output },
+  { "diff",	"[NUM-GAMES [EDIT-PERCENTAGE]]",	benchmark_diff },
+  { "transaction", "[NUM-NODES [NUM-EDITS]]",	benchmark_transaction },
+  { "map-edit",	"[NUM-NODES [NUM-EDITS]]",	benchmark_map_edit },
+  { "map-view-port", "[NUM-NODES [NUM-QUERIES]]", benchmark_map_view_port },
+  { "board-replay", "[NUM-GAMES | FILE...]",	benchmark_board_replay },
+  { "board-perft", "[GAME [DEPTH]]",		benchmark_board_perft },
+  { "amazons-territory", "[NUM-POSITIONS]",	benchmark_amazons_territory }
+};
+
+#define NUM_BENCHMARKS	(sizeof benchmarks / sizeof (SgfBenchmark))
+
+
+static const PerftGame perft_games[NUM_PERFT_GAMES] = {
+  { GAME_GO,	  "Go",	       9, BLACK, 4 },
+  { GAME_REVERSI, "Reversi",   8, BLACK, 9 },
+  { GAME_REVERSI, "Reversi",  10, BLACK, 8 },
+  { GAME_AMAZONS, "Amazons",  10, WHITE, 2 }
+};
+
+
+static unsigned int   random_seed = 1;
+
+
+int
+main (int argc, char *argv[])
+{
+  int result = 255;
+  int k;
+
+  utils_remember_program_name (argv[0]);
+
+  for (k = 0; k < NUM_BENCHMARKS; k++) {
+    if (argc >= 2 && strcmp (argv[1], benchmarks[k].name) == 0) {
+      result = benchmarks[k].run (argc - 2, argv + 2);
+      break;
+    }
+  }
+
+  if (k == NUM_BENCHMARKS) {
+    fprintf (stderr, "Usage: %s BENCHMARK [ARGUMENTS]\n\n", argv[0]);
+    fprintf (stderr, "Available benchmarks:\n");
+
+    for (k = 0; k < NUM_BENCHMARKS; k++)
+      fprintf (stderr, "  %s %s\n", benchmarks[k].name, benchmarks[k].arguments);
+  }
+
+  utils_free_program_name_strings ();
+
+#if ENABLE_MEMORY_PROFILING
+  utils_print_memory_profiling_info ();
+#endif
+
+  return result;
+}
+
+
+/* Write the collection to `/dev/null' several times and report the
+ * best time.  This measures pure serialization speed.
+ */
+static int
+benchmark_write (int argc, char **argv)
+{
+  SgfCollection *collection = get_benchmark_collection (argc, argv);
+  char *sgf;
+  int sgf_length;
+  double best_time = 0.0;
+  int k;
+
+  if (!collection)
+    return 1;
+
+  sgf = sgf_write_in_memory (collection, 0, &sgf_length);
+  utils_free (sgf);
+
+  for (k = 0; k < NUM_REPETITIONS; k++) {
+    double start_time = get_time ();
+    char *error = sgf_write_file ("/dev/null", collection, 0);
+    double time;
+
+    if (error) {
+      fprintf (stderr, "%s: %s\n", short_program_name, error);
+      utils_free (error);
+      sgf_collection_delete (collection);
+
+      return 1;
+    }
+
+    time = get_time () - start_time;
+    if (k == 0 || time < best_time)
+      best_time = time;
+  }
+
+  printf ("Wrote %d game trees (%d bytes) in %.3f s: %.0f trees/s, %.1f MB/s\n",
+	  collection->num_trees, sgf_length, best_time,
+	  collection->num_trees / best_time,
+	  sgf_length / best_time / (1024.0 * 1024.0));
+
+  sgf_collection_delete (collection);
+
+  return 0;
+}
+
+
+/* Check that buffered_writer_add_real() gives the same text as "%.f"
+ * conversion it replaces in the SGF writer, both on edge values and on
+ * random numbers with up to nine fractional digits, then time both.
+ * Returns nonzero if any output differs.
+ */
+static int
+benchmark_real_output (int argc, char **argv)
+{
+  static const double edge_values[] = {
+    0.0, -0.0, 0.5, -0.5, 1.5, 2.5, 6.5, -7.5, 0.25, 0.1, 0.3,
+    0.0000005, -0.0000005, 0.0000015, 0.0000001, 1e-7, 123456.5,
+    9.999999, 999999.999999, 99999999.999999, 99999999.5, 1e8,
+    999999999.999999, 1e12, -1e12, 1e12 + 0.5, 4294967296.5, 1e20,
+    12.345, 0.1 + 0.2, 6.4999999, 0.0000005000001, -1e-10, 1e-10
+  };
+  int num_numbers = (argc >= 1 ? atoi (argv[0]) : DEFAULT_NUM_REALS);
+  double *numbers;
+  int num_mismatches = 0;
+  int k;
+
+  numbers = utils_malloc (num_numbers * sizeof (double));
+  for (k = 0; k < num_numbers; k++) {
+    static const double fraction_scales[] = {
+      1.0, 10.0, 100.0, 1000.0, 1000000.0, 1000000000.0
+    };
+    double integral_part = (k % 8 == 0
+			    ? (double) next_random_number () * 32768.0
+			    : next_random_number () % 400);
+
+    numbers[k] = (integral_part
+		  + (next_random_number () % 1000
+		     / fraction_scales[next_random_number () % 6]));
+    if (next_random_number () % 2)
+      numbers[k] = -numbers[k];
+  }
+
+  for (k = 0; k < (int) (sizeof edge_values / sizeof (double)) + num_numbers;
+       k++) {
+    double number = (k < (int) (sizeof edge_values / sizeof (double))
+		     ? edge_values[k]
+		     : numbers[k - sizeof edge_values / sizeof (double)]);
+    char *fixed_point_text = format_real (number, 0);
+    char *printf_text = format_real (number, 1);
+
+    if (strcmp (fixed_point_text, printf_text) != 0) {
+      if (num_mismatches++ < 10) {
+	fprintf (stderr, "%.17g: `%s' instead of `%s'\n",
+		 number, fixed_point_text, printf_text);
+      }
+    }
+
+    utils_free (fixed_point_text);
+    utils_free (printf_text);
+  }
+
+  if (num_mismatches == 0) {
+    int use_printf;
+
+    for (use_printf = 0; use_printf <= 1; use_printf++) {
+      BufferedWriter writer;
+      double start_time = get_time ();
+      int length;
+
+      buffered_writer_init_memory (&writer, 0x10000);
+      for (k = 0; k < num_numbers; k++) {
+	if (use_printf)
+	  buffered_writer_cprintf (&writer, "%.f", numbers[k]);
+	else
+	  buffered_writer_add_real (&writer, numbers[k]);
+      }
+
+      utils_free (buffered_writer_dispose_memory (&writer, &length));
+
+      printf ("%s: %d numbers in %.3f s\n",
+	      use_printf ? "%.f conversion" : "buffered_writer_add_real()",
+	      num_numbers, get_time () - start_time);
+    }
+  }
+  else
+    printf ("%d numbers formatted differently\n", num_mismatches);
+
+  utils_free (numbers);
+
+  return num_mismatches != 0;
+}
+
+
+/* Generate two synthetic collections, the second being an edited copy
+ * of the first, and time sgf_diff() on them.  Approximately given
+ * percentage of games is deleted, inserted or modified.  Since every
+ * synthetic game has a distinct root node, the edit script between
+ * the collections is long and the algorithm does a lot of work.
+ */
+static int
+benchmark_diff (int argc, char **argv)
+{
+  int num_games = (argc >= 1 ? atoi (argv[0]) : DEFAULT_NUM_DIFFED_GAMES);
+  int edit_percentage = (argc >= 2 ? atoi (argv[1]) : DEFAULT_EDIT_PERCENTAGE);
+  int next_inserted_game = num_games;
+  StringBuffer from_buffer;
+  StringBuffer to_buffer;
+  SgfCollection *from_collection;
+  SgfCollection *to_collection;
+  SgfCollection *difference;
+  struct rusage usage;
+  double start_time;
+  double time;
+  int game;
+
+  string_buffer_init (&from_buffer, 0x10000, 0x10000);
+  string_buffer_init (&to_buffer, 0x10000, 0x10000);
+
+  for (game = 0; game < num_games; game++) {
+    int edit = next_random_number () % 300;
+
+    add_synthetic_game (&from_buffer, game, 0);
+
+    if (edit >= 3 * edit_percentage)
+      add_synthetic_game (&to_buffer, game, 0);
+    else if (edit >= 2 * edit_percentage)
+      add_synthetic_game (&to_buffer, game, 1);
+    else if (edit >= edit_percentage) {
+      add_synthetic_game (&to_buffer, next_inserted_game++, 0);
+      add_synthetic_game (&to_buffer, game, 0);
+    }
+  }
+
+  from_collection = parse_synthetic_sgf (&from_buffer);
+  to_collection	  = parse_synthetic_sgf (&to_buffer);
+
+  if (!from_collection || !to_collection) {
+    if (from_collection)
+      sgf_collection_delete (from_collection);
+    if (to_collection)
+      sgf_collection_delete (to_collection);
+
+    return 1;
+  }
+
+  start_time = get_time ();
+  difference = sgf_diff (from_collection, to_collection, &sgf_diff_defaults);
+  time	     = get_time () - start_time;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  printf ("Compared %d and %d game trees in %.3f s, maximum RSS %ld KB\n",
+	  from_collection->num_trees, to_collection->num_trees, time,
+	  usage.ru_maxrss);
+
+  if (difference)
+    sgf_collection_delete (difference);
+
+  sgf_collection_delete (from_collection);
+  sgf_collection_delete (to_collection);
+
+  return 0;
+}
+
+
+/* Append variations to random nodes of a large game tree, first as
+ * separate actions and then inside one transaction.  A notification
+ * callback recomputes map dimensions after each map modification,
+ * like a tree view does.
+ */
+static int
+benchmark_transaction (int argc, char **argv)
+{
+  int num_nodes = (argc >= 1 ? atoi (argv[0]) : DEFAULT_NUM_TREE_NODES);
+  int num_edits = (argc >= 2 ? atoi (argv[1]) : DEFAULT_NUM_TREE_EDITS);
+  int num_separate_updates;
+  int num_transaction_updates;
+  double separate_time;
+  double transaction_time;
+
+  if (num_nodes < 1 || num_edits < 1) {
+    fprintf (stderr, "%s: invalid number of nodes or edits\n",
+	     short_program_name);
+    return 1;
+  }
+
+  separate_time	   = time_tree_edits (num_nodes, num_edits, 0,
+				      &num_separate_updates);
+  transaction_time = time_tree_edits (num_nodes, num_edits, 1,
+				      &num_transaction_updates);
+
+  printf ("Appended %d variations to a tree of %d nodes:\n", num_edits,
+	  num_nodes);
+  printf ("  separate actions: %.3f s, %d map updates\n",
+	  separate_time, num_separate_updates);
+  printf ("  one transaction:  %.3f s, %d map updates\n",
+	  transaction_time, num_transaction_updates);
+
+  return 0;
+}
+
+
+
+/* Append variations close to the root of a large tree, each time
+ * fetching the map dimensions and a view port around the new node,
+ * like a tree view scrolled to the current node does.  The same edits
+ * are then repeated with the whole map invalidated after each, which
+ * is what a non-incremental layout would have to do.
+ */
+static int
+benchmark_map_edit (int argc, char **argv)
+{
+  int num_nodes = (argc >= 1 ? atoi (argv[0]) : DEFAULT_NUM_MAP_NODES);
+  int num_edits = (argc >= 2 ? atoi (argv[1]) : DEFAULT_NUM_MAP_EDITS);
+  double incremental_time;
+  double relayout_time;
+
+  if (num_nodes < 1 || num_edits < 1) {
+    fprintf (stderr, "%s: invalid number of nodes or edits\n",
+	     short_program_name);
+    return 1;
+  }
+
+  incremental_time = time_map_edits (num_nodes, num_edits, 0);
+  relayout_time	   = time_map_edits (num_nodes, num_edits, 1);
+
+  printf ("Appended %d variations near the root of a tree of %d nodes:\n",
+	  num_edits, num_nodes);
+  printf ("  incremental layout: %.3f ms per edit\n",
+	  incremental_time * 1000.0 / num_edits);
+  printf ("  full relayout:      %.3f ms per edit\n",
+	  relayout_time * 1000.0 / num_edits);
+
+  return 0;
+}
+
+
+/* Fill view ports at random map positions and while scrolling down
+ * one row at a time, then look up coordinates of random nodes.  This
+ * is what a tree view does on exposure and on current node changes.
+ * The map is layed out before timing starts.
+ */
+static int
+benchmark_map_view_port (int argc, char **argv)
+{
+  int num_nodes	  = (argc >= 1 ? atoi (argv[0]) : DEFAULT_NUM_MAP_NODES);
+  int num_queries = (argc >= 2 ? atoi (argv[1])
+		     : DEFAULT_NUM_VIEW_PORT_QUERIES);
+  SgfGameTree *tree;
+  SgfNode **nodes;
+  SgfNode **view_port_nodes;
+  SgfGameTreeMapLine *view_port_lines;
+  int num_view_port_lines;
+  int map_width;
+  int map_height;
+  double start_time;
+  double random_time;
+  double scrolling_time;
+  double coordinates_time;
+  int k;
+
+  if (num_nodes < 1 || num_queries < 1) {
+    fprintf (stderr, "%s: invalid number of nodes or queries\n",
+	     short_program_name);
+    return 1;
+  }
+
+  tree = create_random_game_tree (num_nodes, &nodes);
+  sgf_game_tree_get_map_dimensions (tree, &map_width, &map_height);
+
+  start_time = get_time ();
+
+  for (k = 0; k < num_queries; k++) {
+    int x0 = next_random_number () % map_width;
+    int y0 = next_random_number () % map_height;
+
+    sgf_game_tree_fill_map_view_port (tree, x0, y0,
+				      x0 + VIEW_PORT_WIDTH,
+				      y0 + VIEW_PORT_HEIGHT,
+				      &view_port_nodes, &view_port_lines,
+				      &num_view_port_lines);
+    utils_free (view_port_nodes);
+    utils_free (view_port_lines);
+  }
+
+  random_time = get_time () - start_time;
+  start_time  = get_time ();
+
+  for (k = 0; k < num_queries; k++) {
+    int x0 = map_width / 2;
+    int y0 = k % map_height;
+
+    sgf_game_tree_fill_map_view_port (tree, x0, y0,
+				      x0 + VIEW_PORT_WIDTH,
+				      y0 + VIEW_PORT_HEIGHT,
+				      &view_port_nodes, &view_port_lines,
+				      &num_view_port_lines);
+    utils_free (view_port_nodes);
+    utils_free (view_port_lines);
+  }
+
+  scrolling_time = get_time () - start_time;
+  start_time	 = get_time ();
+
+  for (k = 0; k < num_queries; k++) {
+    int node_x;
+    int node_y;
+
+    sgf_game_tree_get_node_coordinates (tree,
+					nodes[next_random_number ()
+					      % num_nodes],
+					&node_x, &node_y);
+  }
+
+  coordinates_time = get_time () - start_time;
+
+  printf ("Queried a %dx%d map of a tree of %d nodes:\n",
+	  map_width, map_height, num_nodes);
+  printf ("  random view ports:    %.3f ms per query\n",
+	  random_time * 1000.0 / num_queries);
+  printf ("  scrolling view ports: %.3f ms per query\n",
+	  scrolling_time * 1000.0 / num_queries);
+  printf ("  node coordinates:     %.3f ms per query\n",
+	  coordinates_time * 1000.0 / num_queries);
+
+  sgf_game_tree_delete (tree);
+  utils_free (nodes);
+
+  return 0;
+}
+
+
+/* Replay main lines of all Go games in a collection with each board
+ * engine, first undoing all the moves afterwards, then in no-undo
+ * mode.  Final positions of each game are compared between all the
+ * configurations.
+ */
+static int
+benchmark_board_replay (int argc, char **argv)
+{
+  static const char *engine_names[] = { "default engine: ",
+					"bitboard engine:" };
+
+  SgfCollection *collection = get_benchmark_collection (argc, argv);
+  Board *boards[4];
+  const SgfGameTree *tree;
+  double times[4];
+  int num_moves;
+  int result = 0;
+  int k;
+
+  if (!collection)
+    return 1;
+
+  /* Boards with odd indices use bitboard engine, the last two are in
+   * no-undo mode.
+   */
+  for (k = 0; k < 4; k++) {
+    boards[k] = board_new_with_engine (GAME_GO, 19, 19,
+				       (k % 2
+					? BOARD_ENGINE_BITBOARD
+					: BOARD_ENGINE_DEFAULT));
+    board_set_no_undo_mode (boards[k], k >= 2);
+  }
+
+  for (tree = collection->first_tree; tree && !result; tree = tree->next) {
+    if (tree->game == GAME_GO) {
+      for (k = 0; k < 4; k++)
+	replay_main_line (boards[k], tree);
+
+      for (k = 1; k < 4; k++) {
+	if (!go_boards_are_equal (boards[0], boards[k])) {
+	  fprintf (stderr, "%s: board configurations disagree\n",
+		   short_program_name);
+	  result = 1;
+	  break;
+	}
+      }
+    }
+  }
+
+  for (k = 0; k < 4; k++)
+    board_delete (boards[k]);
+
+  if (result == 0) {
+    for (k = 0; k < 4; k++) {
+      times[k] = time_replay (collection,
+			      (k % 2
+			       ? BOARD_ENGINE_BITBOARD : BOARD_ENGINE_DEFAULT),
+			      k >= 2, &num_moves);
+    }
+
+    for (k = 0; k < 4; k++) {
+      if (k == 0)
+	printf ("Replayed and undid %d moves:\n", num_moves);
+      else if (k == 2)
+	printf ("Replayed %d moves in no-undo mode:\n", num_moves);
+
+      printf ("  %s %.3f s, %.0f moves/s\n",
+	      engine_names[k % 2], times[k], num_moves / times[k]);
+    }
+  }
+
+  sgf_collection_delete (collection);
+
+  return result;
+}
+
+
+static double
+time_replay (const SgfCollection *collection, BoardEngine engine,
+	     int no_undo, int *num_moves)
+{
+  Board *board = board_new_with_engine (GAME_GO, 19, 19, engine);
+  double best_time = 0.0;
+  int k;
+
+  board_set_no_undo_mode (board, no_undo);
+
+  for (k = 0; k < NUM_REPETITIONS; k++) {
+    const SgfGameTree *tree;
+    double start_time = get_time ();
+    double time;
+
+    *num_moves = 0;
+
+    for (tree = collection->first_tree; tree; tree = tree->next) {
+      if (tree->game == GAME_GO) {
+	int num_played_moves = replay_main_line (board, tree);
+
+	if (!no_undo)
+	  board_undo (board, num_played_moves);
+
+	*num_moves += num_played_moves;
+      }
+    }
+
+    time = get_time () - start_time;
+    if (k == 0 || time < best_time)
+      best_time = time;
+  }
+
+  board_delete (board);
+
+  return best_time;
+}
+
+
+/* Count positions reachable in the given number of moves (`perft')
+ * from the initial position of each game, or only the specified one.
+ * This measures speed of legal move generation, playing and undoing.
+ */
+static int
+benchmark_board_perft (int argc, char **argv)
+{
+  Game game = GAME_INVALID;
+  int depth = 0;
+  int k;
+
+  if (argc >= 1) {
+    game = game_from_game_name (argv[0], 0);
+    for (k = 0; k < NUM_PERFT_GAMES; k++) {
+      if (perft_games[k].game == game)
+	break;
+    }
+
+    if (k == NUM_PERFT_GAMES) {
+      fprintf (stderr, "%s: unsupported game `%s'\n",
+	       short_program_name, argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc >= 2) {
+    depth = atoi (argv[1]);
+    if (depth < 1) {
+      fprintf (stderr, "%s: invalid depth\n", short_program_name);
+      return 1;
+    }
+  }
+
+  for (k = 0; k < NUM_PERFT_GAMES; k++) {
+    const PerftGame *perft_game = perft_games + k;
+    int board_size = perft_game->board_size;
+    int max_depth = (depth > 0 ? depth : perft_game->default_depth);
+    Board *board;
+    BoardMoveList **move_lists;
+    int i;
+
+    if (game != GAME_INVALID && perft_game->game != game)
+      continue;
+
+    board = board_new (perft_game->game, board_size, board_size);
+    apply_default_setup (board);
+
+    /* One list per depth, since a list must stay intact while moves
+     * from it are being explored.
+     */
+    move_lists = utils_malloc ((max_depth + 1) * sizeof (BoardMoveList *));
+    for (i = 0; i <= max_depth; i++)
+      move_lists[i] = board_move_list_new ();
+
+    printf ("%s, %dx%d:\n", perft_game->name, board_size, board_size);
+
+    for (i = 1; i <= max_depth; i++) {
+      double start_time = get_time ();
+      long num_positions = perft (board, perft_game->color_to_play_first, i,
+				  move_lists);
+      double time = get_time () - start_time;
+
+      printf ("  depth %d: %12ld positions, %.3f s", i, num_positions, time);
+      if (time > 0.0)
+	printf (", %.0f positions/s", num_positions / time);
+      printf ("\n");
+    }
+
+    for (i = 0; i <= max_depth; i++)
+      board_move_list_delete (move_lists[i]);
+
+    utils_free (move_lists);
+    board_delete (board);
+  }
+
+  return 0;
+}
+
+
+/* Estimate territory in random 10x10 Amazons positions, from opening
+ * to late middle game, using both distance measures.
+ */
+static int
+benchmark_amazons_territory (int argc, char **argv)
+{
+  static const char *distance_names[] = { "queen distance:",
+					  "king distance: " };
+
+  int num_positions = NUM_TERRITORY_POSITIONS;
+  Board **boards;
+  BoardMoveList *moves = board_move_list_new ();
+  int k;
+
+  if (argc >= 1) {
+    num_positions = atoi (argv[0]);
+    if (num_positions < 1) {
+      fprintf (stderr, "%s: invalid number of positions\n",
+	       short_program_name);
+      return 1;
+    }
+  }
+
+  boards = utils_malloc (num_positions * sizeof (Board *));
+
+  for (k = 0; k < num_positions; k++) {
+    int num_moves = (next_random_number ()
+		     % (MAX_TERRITORY_POSITION_MOVES + 1));
+    int color = WHITE;
+    int i;
+
+    boards[k] = board_new (GAME_AMAZONS, 10, 10);
+    board_set_no_undo_mode (boards[k], 1);
+    apply_default_setup (boards[k]);
+
+    for (i = 0; i < num_moves; i++) {
+      const int *move;
+
+      if (board_generate_legal_moves (boards[k], RULE_SET_DEFAULT, color,
+				      moves) == 0)
+	break;
+
+      move = (moves->positions
+	      + (next_random_number () % moves->num_moves) * 3);
+      board_play_amazons_move_fast (boards[k], color,
+				    move[0], move[1], move[2]);
+
+      color = OTHER_COLOR (color);
+    }
+  }
+
+  printf ("Estimated territory in %d positions:\n", num_positions);
+
+  for (k = 0; k < 2; k++) {
+    AmazonsDistance distance = (k == 0
+				? AMAZONS_QUEEN_DISTANCE
+				: AMAZONS_KING_DISTANCE);
+    double best_time = 0.0;
+    long total_difference = 0;
+    int i;
+
+    for (i = 0; i < NUM_REPETITIONS; i++) {
+      double start_time = get_time ();
+      double time;
+      int j;
+
+      total_difference = 0;
+
+      for (j = 0; j < num_positions; j++) {
+	int black_territory;
+	int white_territory;
+
+	amazons_estimate_territory (boards[j], distance, NULL,
+				    &black_territory, &white_territory);
+	total_difference += black_territory - white_territory;
+      }
+
+      time = get_time () - start_time;
+      if (i == 0 || time < best_time)
+	best_time = time;
+    }
+
+    printf ("  %s %.3f s, %.0f positions/s, average difference %+.2f\n",
+	    distance_names[k], best_time, num_positions / best_time,
+	    (double) total_difference / num_positions);
+  }
+
+  for (k = 0; k < num_positions; k++)
+    board_delete (boards[k]);
+
+  utils_free (boards);
+  board_move_list_delete (moves);
+
+  return 0;
+}
+
+
+/* Count positions after `depth' moves.  Moves on the last level are
+ * only counted, not played.  Passes are not counted for Go.  In
+ * Reversi, a player who cannot move passes, which counts as a move
+ * even after the game is over.  This matches published Reversi perft
+ * numbers.
+ */
+static long
+perft (Board *board, int color, int depth, BoardMoveList **move_lists)
+{
+  BoardMoveList *moves = move_lists[depth];
+  int num_moves = board_generate_legal_moves (board, RULE_SET_DEFAULT,
+					      color, moves);
+  long num_positions = 0;
+  int k;
+
+  if (num_moves == 0) {
+    if (board->game == GAME_REVERSI) {
+      return (depth == 1
+	      ? 1 : perft (board, OTHER_COLOR (color), depth - 1, move_lists));
+    }
+
+    return 0;
+  }
+
+  if (depth == 1)
+    return num_moves;
+
+  for (k = 0; k < num_moves; k++) {
+    const int *move = moves->positions + k * moves->positions_per_move;
+
+    if (board->game == GAME_GO)
+      board_play_go_move_fast (board, color, move[0]);
+    else if (board->game == GAME_REVERSI)
+      board_play_reversi_move_fast (board, color, move[0]);
+    else
+      board_play_amazons_move_fast (board, color, move[0], move[1], move[2]);
+
+    num_positions += perft (board, OTHER_COLOR (color), depth - 1, move_lists);
+    board_undo (board, 1);
+  }
+
+  return num_positions;
+}
+
+
+/* Put the default setup of board's game, if any, on the board. */
+static void
+apply_default_setup (Board *board)
+{
+  BoardPositionList *black_stones;
+  BoardPositionList *white_stones;
+
+  if (game_get_default_setup (board->game, board->width, board->height,
+			      &black_stones, &white_stones)) {
+    const BoardPositionList *change_lists[NUM_ON_GRID_VALUES];
+
+    change_lists[EMPTY]			= NULL;
+    change_lists[BLACK]			= black_stones;
+    change_lists[WHITE]			= white_stones;
+    change_lists[SPECIAL_ON_GRID_VALUE] = NULL;
+
+    board_apply_changes (board, change_lists);
+
+    board_position_list_delete (black_stones);
+    board_position_list_delete (white_stones);
+  }
+}
+
+
+/* Clear the board and replay the main line of the tree on it,
+ * including setup stones.  On boards in no-undo mode, moves are
+ * played with board_play_go_move_fast().  Return the number of moves
+ * and position changes played.
+ */
+static int
+replay_main_line (Board *board, const SgfGameTree *tree)
+{
+  const SgfNode *node;
+  int num_moves = 0;
+
+  board_set_parameters (board, GAME_GO,
+			tree->board_width, tree->board_height);
+
+  for (node = tree->root; node; node = node->child) {
+    const BoardPositionList *change_lists[NUM_ON_GRID_VALUES];
+
+    change_lists[EMPTY]
+      = sgf_node_get_list_of_point_property_value (node, SGF_ADD_EMPTY);
+    change_lists[BLACK]
+      = sgf_node_get_list_of_point_property_value (node, SGF_ADD_BLACK);
+    change_lists[WHITE]
+      = sgf_node_get_list_of_point_property_value (node, SGF_ADD_WHITE);
+    change_lists[SPECIAL_ON_GRID_VALUE] = NULL;
+
+    if (change_lists[EMPTY] || change_lists[BLACK] || change_lists[WHITE]) {
+      board_apply_changes (board, change_lists);
+      num_moves++;
+    }
+
+    if (IS_STONE (node->move_color)) {
+      if (board->no_undo) {
+	board_play_go_move_fast (board, node->move_color,
+				 POINT_TO_POSITION (node->move_point));
+      }
+      else {
+	board_play_move (board, node->move_color,
+			 node->move_point.x, node->move_point.y);
+      }
+
+      num_moves++;
+    }
+  }
+
+  return num_moves;
+}
+
+
+static int
+go_boards_are_equal (const Board *first_board, const Board *second_board)
+{
+  int x;
+  int y;
+
+  for (y = 0; y < first_board->height; y++) {
+    for (x = 0; x < first_board->width; x++) {
+      if (first_board->grid[POSITION (x, y)]
+	  != second_board->grid[POSITION (x, y)])
+	return 0;
+    }
+  }
+
+  return (first_board->data.go.prisoners[BLACK_INDEX]
+	  == second_board->data.go.prisoners[BLACK_INDEX]
+	  && (first_board->data.go.prisoners[WHITE_INDEX]
+	      == second_board->data.go.prisoners[WHITE_INDEX]));
+}
+
+
+/* Create a Go game tree with `num_nodes' move-less nodes.  Most nodes
+ * continue the previous one, but every fiftieth or so starts a
+ * variation at a random earlier node.  All nodes are stored in the
+ * `nodes' array, in creation order.
+ */
+static SgfGameTree *
+create_random_game_tree (int num_nodes, SgfNode ***nodes)
+{
+  SgfGameTree *tree = sgf_game_tree_new_with_root (GAME_GO, 19, 19, 0);
+  int k;
+
+  *nodes      = utils_malloc (num_nodes * sizeof (SgfNode *));
+  (*nodes)[0] = tree->root;
+
+  for (k = 1; k < num_nodes; k++) {
+    SgfNode *parent = (next_random_number () % 50
+		       ? (*nodes)[k - 1]
+		       : (*nodes)[next_random_number () % k]);
+    SgfNode *node   = sgf_node_new (tree, parent);
+
+    node->next	  = parent->child;
+    parent->child = node;
+    (*nodes)[k]	  = node;
+  }
+
+  return tree;
+}
+
+
+/* Time `num_edits' sgf_utils_append_variation() calls on a random
+ * tree, optionally wrapped in a transaction.  The tree is the same
+ * for both modes, as is the sequence of edited nodes.
+ */
+static double
+time_tree_edits (int num_nodes, int num_edits, int use_transaction,
+		 int *num_map_updates)
+{
+  unsigned int saved_random_seed = random_seed;
+  SgfCollection *collection = sgf_collection_new ();
+  SgfGameTree *tree;
+  SgfNode **nodes;
+  Board *board = board_new (GAME_GO, 19, 19);
+  SgfBoardState board_state;
+  double start_time;
+  double time;
+  int k;
+
+  random_seed = 1;
+
+  tree = create_random_game_tree (num_nodes, &nodes);
+  sgf_collection_add_game_tree (collection, tree);
+  sgf_utils_enter_tree (tree, board, &board_state);
+  sgf_game_tree_get_map_dimensions (tree, NULL, NULL);
+
+  *num_map_updates = 0;
+  sgf_game_tree_set_notification_callback (tree, update_map_on_notification,
+					   num_map_updates);
+
+  start_time = get_time ();
+
+  if (use_transaction)
+    sgf_utils_begin_transaction (tree);
+
+  for (k = 0; k < num_edits; k++) {
+    sgf_utils_switch_to_given_node (tree,
+				    nodes[next_random_number () % num_nodes]);
+    sgf_utils_append_variation (tree, EMPTY);
+  }
+
+  if (use_transaction)
+    sgf_utils_commit_transaction (tree);
+
+  time = get_time () - start_time;
+
+  sgf_collection_delete (collection);
+  board_delete (board);
+  utils_free (nodes);
+
+  random_seed = saved_random_seed;
+
+  return time;
+}
+
+
+/* Time `num_edits' variation appends at depths below 30, each
+ * followed by a map query.  If `relayout_whole_map' is set, the whole
+ * map is invalidated before each query.
+ */
+static double
+time_map_edits (int num_nodes, int num_edits, int relayout_whole_map)
+{
+  unsigned int saved_random_seed = random_seed;
+  SgfCollection *collection = sgf_collection_new ();
+  SgfGameTree *tree;
+  SgfNode **nodes;
+  Board *board = board_new (GAME_GO, 19, 19);
+  SgfBoardState board_state;
+  double start_time;
+  double time;
+  int k;
+
+  random_seed = 1;
+
+  tree = create_random_game_tree (num_nodes, &nodes);
+  sgf_collection_add_game_tree (collection, tree);
+  sgf_utils_enter_tree (tree, board, &board_state);
+  sgf_game_tree_get_map_dimensions (tree, NULL, NULL);
+
+  start_time = get_time ();
+
+  for (k = 0; k < num_edits; k++) {
+    SgfNode *node = tree->root;
+    int depth = next_random_number () % 30;
+    SgfNode **view_port_nodes;
+    SgfGameTreeMapLine *view_port_lines;
+    int num_view_port_lines;
+    int map_width;
+    int x;
+    int y;
+
+    while (depth-- > 0 && node->child)
+      node = node->child;
+
+    sgf_utils_switch_to_given_node (tree, node);
+    sgf_utils_append_variation (tree, EMPTY);
+
+    if (relayout_whole_map)
+      sgf_game_tree_invalidate_map (tree, NULL);
+
+    sgf_game_tree_get_map_dimensions (tree, &map_width, NULL);
+    sgf_game_tree_get_node_coordinates (tree, tree->current_node, &x, &y);
+    sgf_game_tree_fill_map_view_port (tree, x, y, x + 30, y + 20,
+				      &view_port_nodes, &view_port_lines,
+				      &num_view_port_lines);
+
+    utils_free (view_port_nodes);
+    utils_free (view_port_lines);
+  }
+
+  time = get_time () - start_time;
+
+  sgf_collection_delete (collection);
+  board_delete (board);
+  utils_free (nodes);
+
+  random_seed = saved_random_seed;
+
+  return time;
+}
+
+
+static void
+update_map_on_notification (SgfGameTree *tree,
+			    SgfGameTreeNotificationCode notification_code,
+			    void *user_data)
+{
+  if (notification_code == SGF_MAP_MODIFIED) {
+    int map_width;
+
+    sgf_game_tree_get_map_dimensions (tree, &map_width, NULL);
+    (* (int *) user_data)++;
+  }
+}
+
+
+
+/* Parse SGF files given as arguments and merge them into a single
+ * collection.  If there are no arguments or the only argument is a
+ * number, generate a synthetic collection of that many games instead.
+ */
+static SgfCollection *
+get_benchmark_collection (int argc, char **argv)
+{
+  SgfCollection *collection;
+  SgfErrorList *error_list;
+  int num_games = DEFAULT_NUM_SYNTHETIC_GAMES;
+  int k;
+
+  if (argc == 1 && argv[0][0] >= '0' && argv[0][0] <= '9') {
+    num_games = atoi (argv[0]);
+    argc = 0;
+  }
+
+  if (argc == 0) {
+    StringBuffer buffer;
+    int game;
+
+    string_buffer_init (&buffer, 0x10000, 0x10000);
+    for (game = 0; game < num_games; game++)
+      add_synthetic_game (&buffer, game, 0);
+
+    return parse_synthetic_sgf (&buffer);
+  }
+
+  collection = sgf_collection_new ();
+
+  for (k = 0; k < argc; k++) {
+    SgfCollection *file_collection;
+
+    if (sgf_parse_file (argv[k], &file_collection, &error_list,
+			&sgf_parser_defaults, NULL, NULL, NULL)
+	!= SGF_PARSED) {
+      fprintf (stderr, "%s: cannot parse file `%s'\n",
+	       short_program_name, argv[k]);
+      sgf_collection_delete (collection);
+
+      return NULL;
+    }
+
+    if (error_list)
+      string_list_delete (error_list);
+
+    while (file_collection->first_tree) {
+      SgfGameTree *tree = file_collection->first_tree;
+
+      file_collection->first_tree = tree->next;
+      sgf_collection_add_game_tree (collection, tree);
+    }
+
+    file_collection->last_tree = NULL;
+    sgf_collection_delete (file_collection);
+  }
+
+  return collection;
+}
+
+
+/* Parse synthetic SGF accumulated in the `buffer' and dispose the
+ * buffer.
+ */
+static SgfCollection *
+parse_synthetic_sgf (StringBuffer *buffer)
+{
+  SgfCollection *collection;
+  SgfErrorList *error_list;
+  int result = sgf_parse_buffer (buffer->string, buffer->length,
+				 &collection, &error_list,
+				 &sgf_parser_defaults, NULL, NULL);
+
+  string_buffer_dispose (buffer);
+
+  if (result != SGF_PARSED) {
+    fprintf (stderr, "%s: cannot parse synthetic collection\n",
+	     short_program_name);
+    return NULL;
+  }
+
+  if (error_list)
+    string_list_delete (error_list);
+
+  return collection;
+}
+
+
+/* Add a 19x19 Go game with random moves, a few variations, comments
+ * and markup to the `buffer'.  Results are reproducible, since a
+ * private pseudo-random generator is used and reseeded from the game
+ * number.  If `is_modified' is set, one move in the middle of the
+ * game is different.
+ */
+static void
+add_synthetic_game (StringBuffer *buffer, int game, int is_modified)
+{
+  unsigned int saved_random_seed = random_seed;
+  int num_moves;
+  int modified_move;
+  int num_open_variations = 0;
+  int move;
+
+  random_seed	= game + 1;
+  num_moves	= 50 + next_random_number () % 250;
+  modified_move = (is_modified ? num_moves / 2 : -1);
+
+  string_buffer_printf (buffer,
+			"(;GM[1]FF[4]SZ[19]KM[6.5]PB[Black %d]PW[White %d]"
+			"RE[B+%d.5]C[Synthetic game number %d.]\n",
+			game, game, next_random_number () % 30, game);
+
+  /* Setup stones encode the game number, since sgf_diff() matches game
+   * trees by their root nodes.
+   */
+  string_buffer_printf (buffer, "AB[%c%c]AW[%c%c]\n",
+			'a' + game % 19, 'a' + game / 19 % 9,
+			'a' + game / 171 % 19, 'k' + game / 3249 % 9);
+
+  for (move = 0; move < num_moves; move++) {
+    int x = next_random_number () % 19;
+    int y = next_random_number () % 19;
+
+    if (move == modified_move)
+      x = (x + 1) % 19;
+
+    string_buffer_printf (buffer, ";%c[%c%c]",
+			  move % 2 ? 'W' : 'B', 'a' + x, 'a' + y);
+
+    if (next_random_number () % 20 == 0) {
+      string_buffer_cat_string (buffer,
+				"C[A somewhat longer comment, which"
+				" needs wrapping and escaping of \\] and"
+				" \\\\ characters.  It is long enough"
+				" to span several lines.]");
+    }
+
+    if (next_random_number () % 50 == 0)
+      string_buffer_cat_string (buffer, "LB[cc:A][dd:B]TR[ee][ff]CR[gg]");
+
+    if (next_random_number () % 100 == 0 && move + 3 < num_moves) {
+      string_buffer_cat_string (buffer,
+				"(;B[aa];W[bb]BL[123.25]WL[98.5])(;B[cc]");
+      num_open_variations++;
+    }
+  }
+
+  for (; num_open_variations > 0; num_open_variations--)
+    string_buffer_cat_string (buffer, ")");
+
+  string_buffer_cat_string (buffer, ")\n");
+
+  random_seed = saved_random_seed;
+}
+
+
+static char *
+format_real (double number, int use_printf)
+{
+  BufferedWriter writer;
+  char *text;
+  int length;
+
+  buffered_writer_init_memory (&writer, 0x100);
+
+  if (use_printf)
+    buffered_writer_cprintf (&writer, "%.f", number);
+  else
+    buffered_writer_add_real (&writer, number);
+
+  text = buffered_writer_dispose_memory (&writer, &length);
+  text = utils_realloc (text, length + 1);
+  text[length] = 0;
+
+  return text;
+}
+
+
+/* Simple linear congruential generator (the one from ANSI C
+ * standard.)  We don't use rand() so that the numbers don't depend on
+ * C library.
+ */
+static unsigned int
+next_random_number (void)
+{
+  random_seed = random_seed * 1103515245 + 12345;
+  return (random_seed / 65536) % 32768;
+}
+
+
+static double
+get_time (void)
+{
+  struct timeval time;
+
+  gettimeofday (&time, NULL);
+  return time.tv_sec + time.tv_usec / 1000000.0;
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -29,8 +29,9 @@
 #include <string.h>
 #include <stdio.h>
 
-
-#define OUT_OF_GRAPH		INT_MAX
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
 
 
 #define NUM_CONTEXT_TREES		1
@@ -41,49 +42,124 @@
 
 #define NUM_TEXT_CONTEXT_LINES		3
 
+/* Histogram algorithm falls back to Myers' one if every common token
+ * occurs more times than this.
+ */
+#define MAX_HISTOGRAM_CHAIN_LENGTH	64
 
-typedef struct _TextLine		TextLine;
 
-struct _TextLine {
-  const char	     *string;
-  int		      length;
-};
+#if HAVE_STDINT_H
+typedef uint64_t		Fingerprint;
+#else
+typedef unsigned long long	Fingerprint;
+#endif
 
-typedef struct _TextDiffData		TextDiffData;
+#define FINGERPRINT_MULTIPLIER	((Fingerprint) 0x9e3779b97f4a7c15ULL)
 
-struct _TextDiffData {
-  int		      hunk_first_line_in_original;
-  int		      hunk_first_line_in_modified;
-  char		     *current_hunk;
-};
 
-typedef struct _EditGraphDiagonal	EditGraphDiagonal;
-typedef struct _EditGraphLayer		EditGraphLayer;
+typedef int (* ComparisonFunction) (const void *first_element,
+				    const void *second_element);
+typedef const void * (* GetNextElementFunction) (const void *element);
+typedef Fingerprint (* FingerprintFunction) (const void *element);
+
+
+typedef struct _EditGraphPathStep	EditGraphPathStep;
 typedef struct _EditGraph		EditGraph;
+typedef struct _EditGraphSearchData	EditGraphSearchData;
 
-struct _EditGraphDiagonal {
-  const void	     *from_trace_element;
-  const void	     *to_trace_element;
+/* A step along the minimal path through the edit graph: an insertion
+ * or a deletion (except for the very first step) followed by a
+ * (possibly empty) snake of equal elements.  `trace_x' is the index
+ * of the first ``from'' element after the snake.
+ */
+struct _EditGraphPathStep {
+  int		      is_insertion;
   int		      trace_x;
 };
 
-struct _EditGraphLayer {
-  EditGraphLayer     *next;
-  EditGraphLayer     *previous;
+/* Edit graph is never stored as a whole.  Only the minimal path
+ * through it is, which takes `full_distance + 1' steps.
+ */
+struct _EditGraph {
+  int		      full_distance;
+  EditGraphPathStep  *path;
+};
 
-  int		      path_diagonal;
-  EditGraphDiagonal   diagonals[1];
+struct _EditGraphSearchData {
+  const void	    **from_elements;
+  const void	    **to_elements;
+  ComparisonFunction  are_equal;
+
+  /* Fingerprints of elements.  Elements with different fingerprints
+   * are never equal, so `are_equal' is only called on fingerprint
+   * matches.  If `are_equal' is NULL, fingerprints are exact, i.e.
+   * elements with equal fingerprints are equal.
+   */
+  Fingerprint	     *from_fingerprints;
+  Fingerprint	     *to_fingerprints;
+
+  char		     *is_deleted;
+  char		     *is_inserted;
+
+  /* Furthest reaching x coordinates on diagonals, for forward and
+   * backward searches.  See find_middle_snake().
+   */
+  int		     *forward_trace_x;
+  int		     *backward_trace_x;
+  int		      trace_offset;
 };
 
-struct _EditGraph {
-  int		      full_distance;
-  EditGraphLayer     *last_layer;
+
+typedef struct _TreeFingerprints	TreeFingerprints;
+typedef struct _NodeLayerDiffData	NodeLayerDiffData;
+
+/* Fingerprints and sizes of all subtrees of a game tree, indexed by
+ * preorder number of subtree root.  The root node is number zero,
+ * first child of node number `n' is `n + 1', next sibling is `n +
+ * subtree_sizes[n]'.  `children_fingerprints' are fingerprints of
+ * subtrees without their root nodes, i.e. of the layers of children.
+ */
+struct _TreeFingerprints {
+  Fingerprint	     *subtree_fingerprints;
+  Fingerprint	     *children_fingerprints;
+  int		     *subtree_sizes;
 };
 
 
-typedef int (* ComparisonFunction) (const void *first_element,
-				    const void *second_element);
-typedef const void * (* GetNextElementFunction) (const void *element);
+typedef struct _TextToken		TextToken;
+typedef struct _TextDiffData		TextDiffData;
+
+/* A line or a word of text, depending on diff mode. */
+struct _TextToken {
+  const char	     *string;
+  int		      length;
+};
+
+/* The edit graph search data of a text diff.  Token fingerprints are
+ * exact and dense: they are identifiers in range [0,
+ * num_unique_tokens).  The arrays indexed by identifiers are kept
+ * zeroed between uses.
+ */
+struct _TextDiffData {
+  EditGraphSearchData edit_graph_data;
+  int		      num_unique_tokens;
+
+  int		     *from_counts;
+  int		     *to_counts;
+  int		     *positions;
+  int		     *next_positions;
+};
+
+struct _NodeLayerDiffData {
+  SgfGameTree	     *tree;
+  const SgfDiffParameters *parameters;
+
+  ComparisonFunction  nodes_are_equal;
+  FingerprintFunction get_node_fingerprint;
+
+  TreeFingerprints    from_fingerprints;
+  TreeFingerprints    to_fingerprints;
+};
 
 
 static void	   build_abstract_edit_graph (EditGraph *edit_graph,
@@ -91,13 +167,34 @@ static void	   build_abstract_edit_graph (EditGraph *edit_graph,
 					      const void *to_sequence,
 					      int num_skipped_elements,
 					      ComparisonFunction are_equal,
+					      FingerprintFunction
+					        get_fingerprint,
 					      GetNextElementFunction get_next);
-static const EditGraphLayer *
-		   reconstruct_minimal_path (const EditGraph *edit_graph);
+static const void **
+		   sequence_to_array (const void *sequence,
+				      GetNextElementFunction get_next,
+				      int *num_elements);
+static Fingerprint *
+		   get_fingerprints (const void **elements, int num_elements,
+				     FingerprintFunction get_fingerprint);
+inline static int  elements_are_equal (const EditGraphSearchData *data,
+				       int x, int y);
+static void	   find_shortest_edit_script (EditGraphSearchData *data,
+					      int from_begin, int from_end,
+					      int to_begin, int to_end);
+static void	   find_middle_snake (EditGraphSearchData *data,
+				      int from_begin, int from_end,
+				      int to_begin, int to_end,
+				      int *middle_x, int *middle_y);
+static void	   edit_graph_search_data_init (EditGraphSearchData *data,
+						int num_from_elements,
+						int num_to_elements);
+static void	   edit_graph_search_data_dispose (EditGraphSearchData *data);
 static void	   edit_graph_dispose (EditGraph *edit_graph);
 
 static int	   game_trees_are_equal (const SgfGameTree *first_tree,
 					 const SgfGameTree *second_tree);
+static Fingerprint get_game_tree_fingerprint (const SgfGameTree *tree);
 static const SgfGameTree *
 		   get_next_game_tree (const SgfGameTree *tree);
 
@@ -105,14 +202,29 @@ static void	   generate_sgf_collection_diff
 		     (const EditGraph *edit_graph,
 		      const SgfCollection *from_collection,
 		      const SgfCollection *to_collection,
-		      SgfCollection *difference);
+		      SgfCollection *difference,
+		      const SgfDiffParameters *parameters);
 static void	   add_context_game_trees
 		     (const SgfGameTree *context_subsequence, int num_trees,
 		      SgfCollection *difference);
 
-static void	   build_node_layer_diff (const SgfNode *from_node_layer,
+static void	   build_game_tree_diff (const SgfGameTree *from_tree,
+					 const SgfGameTree *to_tree,
+					 SgfGameTree *tree_difference,
+					 const SgfDiffParameters *parameters);
+static void	   build_node_layer_diff (const NodeLayerDiffData *data,
+					  const SgfNode *from_node_layer,
+					  int from_index,
 					  const SgfNode *to_node_layer,
-					  SgfGameTree *tree, SgfNode *parent);
+					  int to_index,
+					  SgfNode *parent);
+static int	   node_layers_are_equal (const NodeLayerDiffData *data,
+					  const SgfNode *first_node_layer,
+					  const SgfNode *second_node_layer);
+static int	   node_comments_are_equal (const SgfNode *first_node,
+					    const SgfNode *second_node);
+static const char *
+		   get_node_comment (const SgfNode *node);
 
 static int	   generic_nodes_are_equal (const SgfNode *first_node,
 					    const SgfNode *second_node);
@@ -121,40 +233,77 @@ static int	   amazons_nodes_are_equal (const SgfNode *first_node,
 static int	   node_position_lists_are_equal (const SgfNode *first_node,
 						  const SgfNode *second_node,
 						  SgfType type);
+
+static Fingerprint get_generic_node_fingerprint (const SgfNode *node);
+static Fingerprint get_amazons_node_fingerprint (const SgfNode *node);
+static Fingerprint mix_node_position_list (Fingerprint fingerprint,
+					   const SgfNode *node, SgfType type);
+inline static Fingerprint
+		   mix_fingerprint (Fingerprint fingerprint,
+				    unsigned int value);
+
+static void	   compute_tree_fingerprints (const NodeLayerDiffData *data,
+					      const SgfGameTree *tree,
+					      TreeFingerprints *fingerprints);
+static void	   tree_fingerprints_dispose (TreeFingerprints *fingerprints);
 static const SgfNode *
 		   get_next_node (const SgfNode *node);
 
 static void	   generate_sgf_node_layer_diff
-		     (const EditGraph *edit_graph,
-		      const SgfNode *from_node_layer,
-		      const SgfNode *to_node_layer,
-		      SgfGameTree *tree, SgfNode *parent);
-
-#if 0
-
-static TextLine *  chop_text_into_lines (const char *text);
-static int	   text_lines_are_equal (const TextLine *first_text_line,
-					 const TextLine *second_text_line);
-static const TextLine *
-		   get_next_text_line (const TextLine *text_line);
-
-static char *	   do_generate_text_diff (const EditGraphLayer *layer,
-					  int layer_distance,
-					  int layer_diagonal,
-					  int is_last_layer,
-					  const TextLine *from_lines_sequence,
-					  const TextLine *to_lines_sequence,
-					  TextDiffData *data);
-static char *	   generate_text_diff (const EditGraph *edit_graph,
-				       const TextLine *from_lines_sequence,
-				       const TextLine *to_lines_sequence);
-
-#endif
+		     (const NodeLayerDiffData *data,
+		      const EditGraph *edit_graph,
+		      const SgfNode *from_node_layer, int from_index,
+		      const SgfNode *to_node_layer, int to_index,
+		      SgfNode *parent);
+
+static TextToken *  chop_text_into_tokens (const char *text, int into_words,
+					  int *num_tokens);
+static void	   identify_text_tokens (const TextToken *from_tokens,
+					 int num_from_tokens,
+					 const TextToken *to_tokens,
+					 int num_to_tokens,
+					 TextDiffData *data);
+static unsigned int
+		   get_text_token_hash (const TextToken *token);
+
+static void	   find_patience_edit_script (TextDiffData *data,
+					      int from_begin, int from_end,
+					      int to_begin, int to_end);
+static void	   find_histogram_edit_script (TextDiffData *data,
+					       int from_begin, int from_end,
+					       int to_begin, int to_end);
+static int	   strip_common_tokens (TextDiffData *data,
+					int *from_begin, int *from_end,
+					int *to_begin, int *to_end);
+
+static void	   generate_unified_text_diff (StringBuffer *buffer,
+					       const TextToken *from_lines,
+					       int num_from_lines,
+					       const TextToken *to_lines,
+					       int num_to_lines,
+					       const char *is_deleted,
+					       const char *is_inserted);
+static void	   add_text_lines (StringBuffer *buffer, char prefix,
+				   const TextToken *lines,
+				   int first_line, int last_line);
+static void	   generate_word_text_diff (StringBuffer *buffer,
+					    const TextToken *from_words,
+					    int num_from_words,
+					    const TextToken *to_words,
+					    int num_to_words,
+					    const char *is_deleted,
+					    const char *is_inserted);
+
+
+const SgfDiffParameters sgf_diff_defaults = {
+  0, SGF_TEXT_DIFF_MYERS, 0
+};
 
 
 SgfCollection *
 sgf_diff (const SgfCollection *from_collection,
-	  const SgfCollection *to_collection)
+	  const SgfCollection *to_collection,
+	  const SgfDiffParameters *parameters)
 {
   EditGraph edit_graph;
   SgfCollection *difference = sgf_collection_new ();
@@ -164,6 +313,7 @@ sgf_diff (const SgfCollection *from_collection,
 
   assert (from_collection);
   assert (to_collection);
+  assert (parameters);
 
   from_tree_subsequence = from_collection->first_tree;
   to_tree_subsequence = to_collection->first_tree;
@@ -180,10 +330,11 @@ sgf_diff (const SgfCollection *from_collection,
 			     from_tree_subsequence, to_tree_subsequence,
 			     num_skipped_trees,
 			     (ComparisonFunction) game_trees_are_equal,
+			     (FingerprintFunction) get_game_tree_fingerprint,
 			     (GetNextElementFunction) get_next_game_tree);
 
   generate_sgf_collection_diff (&edit_graph, from_collection, to_collection,
-				difference);
+				difference, parameters);
 
   edit_graph_dispose (&edit_graph);
 
@@ -196,152 +347,374 @@ sgf_diff (const SgfCollection *from_collection,
 
 
 
+/* Find the minimal path through the edit graph of two sequences,
+ * i.e. the shortest script of insertions and deletions that turns
+ * `from_sequence' into `to_sequence'.  `num_skipped_elements' is the
+ * length of common prefix of the sequences, already skipped by the
+ * caller.
+ *
+ * This is the linear space refinement of Myers' O(ND) algorithm (see
+ * Eugene W. Myers, ``An O(ND) Difference Algorithm and Its
+ * Variations'').  Instead of keeping all D layers of the edit graph
+ * around, which takes O(D^2) memory, it finds a ``middle snake'' of
+ * the path searching from both ends at once, and then recursively
+ * processes the two halves.  Memory used is O(N + M).
+ *
+ * Elements are first compared by their fingerprints, which are
+ * computed once for each element with `get_fingerprint'.
+ * `are_equal' is only used to confirm fingerprint matches.
+ */
 static void
 build_abstract_edit_graph (EditGraph *edit_graph,
 			   const void *from_sequence, const void *to_sequence,
 			   int num_skipped_elements,
 			   ComparisonFunction are_equal,
+			   FingerprintFunction get_fingerprint,
 			   GetNextElementFunction get_next)
 {
-  EditGraphLayer *current_layer;
-  int current_distance = 0;
-
-  current_layer = utils_malloc (sizeof (EditGraphLayer));
-  current_layer->previous			 = NULL;
-  current_layer->diagonals[0].from_trace_element = from_sequence;
-  current_layer->diagonals[0].to_trace_element	 = to_sequence;
-  current_layer->diagonals[0].trace_x		 = num_skipped_elements;
+  EditGraphSearchData data;
+  EditGraphPathStep *step;
+  int num_from_elements;
+  int num_to_elements;
+  int x;
+  int y;
+
+  data.from_elements = sequence_to_array (from_sequence, get_next,
+					  &num_from_elements);
+  data.to_elements   = sequence_to_array (to_sequence, get_next,
+					  &num_to_elements);
+  data.are_equal     = are_equal;
+
+  data.from_fingerprints = get_fingerprints (data.from_elements,
+					     num_from_elements,
+					     get_fingerprint);
+  data.to_fingerprints   = get_fingerprints (data.to_elements,
+					     num_to_elements,
+					     get_fingerprint);
+
+  edit_graph_search_data_init (&data, num_from_elements, num_to_elements);
+
+  find_shortest_edit_script (&data, 0, num_from_elements,
+			     0, num_to_elements);
+
+  /* Convert edit script into the path.  Deletions are made before
+   * insertions in each block of changes.
+   */
+  edit_graph->full_distance = 0;
+  for (x = 0; x < num_from_elements; x++)
+    edit_graph->full_distance += data.is_deleted[x];
+  for (y = 0; y < num_to_elements; y++)
+    edit_graph->full_distance += data.is_inserted[y];
+
+  edit_graph->path = utils_malloc ((edit_graph->full_distance + 1)
+				   * sizeof (EditGraphPathStep));
+
+  for (step = edit_graph->path, x = 0, y = 0; ; step++) {
+    if (step != edit_graph->path) {
+      if (x < num_from_elements && data.is_deleted[x]) {
+	step->is_insertion = 0;
+	x++;
+      }
+      else {
+	step->is_insertion = 1;
+	y++;
+      }
+    }
 
-  if (!from_sequence && !to_sequence) {
-    current_layer->next = NULL;
-    current_layer->path_diagonal = 0;
+    while (x < num_from_elements && y < num_to_elements
+	   && !data.is_deleted[x] && !data.is_inserted[y]) {
+      x++;
+      y++;
+    }
 
-    edit_graph->full_distance = 0;
-    edit_graph->last_layer = current_layer;
+    step->trace_x = num_skipped_elements + x;
 
-    return;
+    if (x == num_from_elements && y == num_to_elements)
+      break;
   }
 
-  while (1) {
-    int k;
-    EditGraphLayer *previous_layer = current_layer;
+  assert (step - edit_graph->path == edit_graph->full_distance);
 
-    current_distance++;
-    current_layer = utils_malloc (sizeof (EditGraphLayer)
-				  + (current_distance
-				     * sizeof (EditGraphDiagonal)));
-    current_layer->previous = previous_layer;
+  edit_graph_search_data_dispose (&data);
 
-    previous_layer->next = current_layer;
+  utils_free (data.from_elements);
+  utils_free (data.to_elements);
+  utils_free (data.from_fingerprints);
+  utils_free (data.to_fingerprints);
+}
 
-    for (k = 0; k <= current_distance; k++) {
-      const void *from_element;
-      const void *to_element;
-      int x;
 
-      if (k == 0
-	  || (k != current_distance
-	      && (previous_layer->diagonals[k].trace_x
-		  > previous_layer->diagonals[k - 1].trace_x))) {
-	if (!previous_layer->diagonals[k].to_trace_element) {
-	  current_layer->diagonals[k].from_trace_element = NULL;
-	  current_layer->diagonals[k].to_trace_element	 = NULL;
-	  current_layer->diagonals[k].trace_x		 = OUT_OF_GRAPH;
+/* Allocate edit script marks and trace arrays big enough for given
+ * sequence lengths.  Elements and fingerprints are set by the caller.
+ */
+static void
+edit_graph_search_data_init (EditGraphSearchData *data,
+			     int num_from_elements, int num_to_elements)
+{
+  /* Diagonals span from `-max_distance' to `max_distance', plus one
+   * extra on each side.
+   */
+  int max_distance = (num_from_elements + num_to_elements + 1) / 2;
 
-	  continue;
-	}
+  data->is_deleted  = utils_malloc0 (num_from_elements + 1);
+  data->is_inserted = utils_malloc0 (num_to_elements + 1);
 
-	from_element = previous_layer->diagonals[k].from_trace_element;
-	to_element = get_next (previous_layer->diagonals[k].to_trace_element);
+  data->forward_trace_x	 = utils_malloc ((2 * max_distance + 3) * sizeof (int));
+  data->backward_trace_x = utils_malloc ((2 * max_distance + 3) * sizeof (int));
+  data->forward_trace_x	 += max_distance + 1;
+  data->backward_trace_x += max_distance + 1;
 
-	x = previous_layer->diagonals[k].trace_x;
-      }
-      else {
-	if (!previous_layer->diagonals[k - 1].from_trace_element) {
-	  current_layer->diagonals[k].from_trace_element = NULL;
-	  current_layer->diagonals[k].to_trace_element	 = NULL;
-	  current_layer->diagonals[k].trace_x		 = OUT_OF_GRAPH;
+  data->trace_offset = max_distance + 1;
+}
 
-	  continue;
-	}
 
-	from_element
-	  = get_next (previous_layer->diagonals[k - 1].from_trace_element);
-	to_element = previous_layer->diagonals[k - 1].to_trace_element;
+static void
+edit_graph_search_data_dispose (EditGraphSearchData *data)
+{
+  utils_free (data->is_deleted);
+  utils_free (data->is_inserted);
 
-	x = previous_layer->diagonals[k - 1].trace_x + 1;
-      }
+  utils_free (data->forward_trace_x - data->trace_offset);
+  utils_free (data->backward_trace_x - data->trace_offset);
+}
 
-      while (from_element && to_element) {
-	if (are_equal (from_element, to_element)) {
-	  from_element = get_next (from_element);
-	  to_element = get_next (to_element);
-	  x++;
-	}
-	else
-	  break;
-      }
 
-      current_layer->diagonals[k].from_trace_element = from_element;
-      current_layer->diagonals[k].to_trace_element   = to_element;
-      current_layer->diagonals[k].trace_x	     = x;
+static const void **
+sequence_to_array (const void *sequence, GetNextElementFunction get_next,
+		   int *num_elements)
+{
+  const void **elements;
+  const void *element;
+  int k;
 
-      if (!from_element && !to_element) {
-	current_layer->next = NULL;
-	current_layer->path_diagonal = k;
+  for (element = sequence, *num_elements = 0; element;
+       element = get_next (element))
+    (*num_elements)++;
 
-	edit_graph->full_distance = current_distance;
-	edit_graph->last_layer = current_layer;
+  elements = utils_malloc ((*num_elements + 1) * sizeof (const void *));
+  for (element = sequence, k = 0; element; element = get_next (element))
+    elements[k++] = element;
 
-	return;
-      }
+  return elements;
+}
+
+
+static Fingerprint *
+get_fingerprints (const void **elements, int num_elements,
+		  FingerprintFunction get_fingerprint)
+{
+  Fingerprint *fingerprints = utils_malloc ((num_elements + 1)
+					    * sizeof (Fingerprint));
+  int k;
+
+  for (k = 0; k < num_elements; k++)
+    fingerprints[k] = get_fingerprint (elements[k]);
+
+  return fingerprints;
+}
+
+
+inline static int
+elements_are_equal (const EditGraphSearchData *data, int x, int y)
+{
+  return (data->from_fingerprints[x] == data->to_fingerprints[y]
+	  && (!data->are_equal
+	      || data->are_equal (data->from_elements[x],
+				  data->to_elements[y])));
+}
+
+
+/* Mark deleted and inserted elements of the shortest edit script
+ * turning ``from'' elements in range [from_begin, from_end) into
+ * ``to'' elements in range [to_begin, to_end).
+ */
+static void
+find_shortest_edit_script (EditGraphSearchData *data,
+			   int from_begin, int from_end,
+			   int to_begin, int to_end)
+{
+  while (1) {
+    int middle_x;
+    int middle_y;
+
+    /* Strip common prefix and suffix. */
+    while (from_begin < from_end && to_begin < to_end
+	   && elements_are_equal (data, from_begin, to_begin)) {
+      from_begin++;
+      to_begin++;
     }
+
+    while (from_begin < from_end && to_begin < to_end
+	   && elements_are_equal (data, from_end - 1, to_end - 1)) {
+      from_end--;
+      to_end--;
+    }
+
+    if (from_begin == from_end) {
+      while (to_begin < to_end)
+	data->is_inserted[to_begin++] = 1;
+
+      return;
+    }
+
+    if (to_begin == to_end) {
+      while (from_begin < from_end)
+	data->is_deleted[from_begin++] = 1;
+
+      return;
+    }
+
+    find_middle_snake (data, from_begin, from_end, to_begin, to_end,
+		       &middle_x, &middle_y);
+
+    /* Recurse into the first half, iterate on the second. */
+    find_shortest_edit_script (data, from_begin, middle_x,
+			       to_begin, middle_y);
+
+    from_begin = middle_x;
+    to_begin   = middle_y;
   }
 }
 
 
-static const EditGraphLayer *
-reconstruct_minimal_path (const EditGraph *edit_graph)
+/* Find a point on a minimal path through the edit graph of given
+ * subsequences that splits the path in two halves of (almost) equal
+ * edit distance.  The subsequences must differ both in their first
+ * and last elements, so the point is never at either end (unless
+ * the subsequences have nothing in common).
+ *
+ * Forward search proceeds from the top left corner of the graph and
+ * stores furthest reaching x on each diagonal k = x - y.  Backward
+ * search does the same in reversed coordinates, i.e. starting from
+ * the bottom right corner.  Diagonals that have left the graph are
+ * excluded from further search.  When the searches overlap on a
+ * diagonal, the furthest forward reaching point on it lies on a
+ * minimal path.
+ */
+static void
+find_middle_snake (EditGraphSearchData *data,
+		   int from_begin, int from_end, int to_begin, int to_end,
+		   int *middle_x, int *middle_y)
 {
-  const EditGraphLayer *layer = edit_graph->last_layer;
-  int layer_distance = edit_graph->full_distance;
+  int *forward_trace_x	= data->forward_trace_x;
+  int *backward_trace_x = data->backward_trace_x;
+  int width		= from_end - from_begin;
+  int height		= to_end - to_begin;
+  int delta		= width - height;
+  int max_distance	= (width + height + 1) / 2;
+  int forward_k_begin	= 0;
+  int forward_k_end	= 0;
+  int backward_k_begin	= 0;
+  int backward_k_end	= 0;
+  int distance;
+  int k;
+
+  for (k = -max_distance; k <= max_distance; k++) {
+    forward_trace_x[k]	= -1;
+    backward_trace_x[k] = -1;
+  }
 
-  while (layer_distance > 0) {
-    EditGraphLayer *previous_layer = layer->previous;
-    int path_diagonal = layer->path_diagonal;
+  forward_trace_x[1]  = 0;
+  backward_trace_x[1] = 0;
 
-    if (path_diagonal == 0
-	|| (path_diagonal != layer_distance
-	    && (previous_layer->diagonals[path_diagonal].trace_x
-		> previous_layer->diagonals[path_diagonal - 1].trace_x)))
-      previous_layer->path_diagonal = path_diagonal;
-    else
-      previous_layer->path_diagonal = path_diagonal - 1;
+  for (distance = 0; distance < max_distance; distance++) {
+    for (k = -distance + forward_k_begin; k <= distance - forward_k_end;
+	 k += 2) {
+      int x;
+      int y;
+
+      if (k == -distance
+	  || (k != distance && forward_trace_x[k - 1] < forward_trace_x[k + 1]))
+	x = forward_trace_x[k + 1];
+      else
+	x = forward_trace_x[k - 1] + 1;
+
+      y = x - k;
+
+      while (x < width && y < height
+	     && elements_are_equal (data, from_begin + x, to_begin + y)) {
+	x++;
+	y++;
+      }
+
+      forward_trace_x[k] = x;
+
+      if (x > width)
+	forward_k_end += 2;
+      else if (y > height)
+	forward_k_begin += 2;
+      else if (delta & 1) {
+	int backward_k = delta - k;
 
-    layer = previous_layer;
-    layer_distance--;
+	if (-max_distance <= backward_k && backward_k <= max_distance
+	    && backward_trace_x[backward_k] != -1
+	    && x >= width - backward_trace_x[backward_k]) {
+	  *middle_x = from_begin + x;
+	  *middle_y = to_begin + y;
+
+	  return;
+	}
+      }
+    }
+
+    for (k = -distance + backward_k_begin; k <= distance - backward_k_end;
+	 k += 2) {
+      int x;
+      int y;
+
+      if (k == -distance
+	  || (k != distance
+	      && backward_trace_x[k - 1] < backward_trace_x[k + 1]))
+	x = backward_trace_x[k + 1];
+      else
+	x = backward_trace_x[k - 1] + 1;
+
+      y = x - k;
+
+      while (x < width && y < height
+	     && elements_are_equal (data, from_end - x - 1, to_end - y - 1)) {
+	x++;
+	y++;
+      }
+
+      backward_trace_x[k] = x;
+
+      if (x > width)
+	backward_k_end += 2;
+      else if (y > height)
+	backward_k_begin += 2;
+      else if (!(delta & 1)) {
+	int forward_k = delta - k;
+
+	if (-max_distance <= forward_k && forward_k <= max_distance
+	    && forward_trace_x[forward_k] != -1
+	    && forward_trace_x[forward_k] >= width - x) {
+	  *middle_x = from_begin + forward_trace_x[forward_k];
+	  *middle_y = to_begin + forward_trace_x[forward_k] - forward_k;
+
+	  return;
+	}
+      }
+    }
   }
 
-  return layer;
+  /* The searches can only fail to overlap if the subsequences have no
+   * common elements at all.  Then just delete everything, then insert
+   * everything.
+   */
+  *middle_x = from_end;
+  *middle_y = to_begin;
 }
 
 
 static void
 edit_graph_dispose (EditGraph *edit_graph)
 {
-  EditGraphLayer *this_layer;
-  EditGraphLayer *previous_layer;
-
-  for (this_layer = edit_graph->last_layer; this_layer;
-       this_layer = previous_layer) {
-    previous_layer = this_layer->previous;
-
-    utils_free (this_layer);
-  }
+  utils_free (edit_graph->path);
 }
 
 
-
+
 /* FIXME: This function is way too forgiving.  Make it stricter. */
 static int
 game_trees_are_equal (const SgfGameTree *first_tree,
@@ -358,6 +731,19 @@ game_trees_are_equal (const SgfGameTree *first_tree,
 }
 
 
+static Fingerprint
+get_game_tree_fingerprint (const SgfGameTree *tree)
+{
+  Fingerprint fingerprint = (tree->game != GAME_AMAZONS
+			     ? get_generic_node_fingerprint (tree->root)
+			     : get_amazons_node_fingerprint (tree->root));
+
+  fingerprint = mix_fingerprint (fingerprint, tree->game);
+  fingerprint = mix_fingerprint (fingerprint, tree->board_width);
+  return mix_fingerprint (fingerprint, tree->board_height);
+}
+
+
 static const SgfGameTree *
 get_next_game_tree (const SgfGameTree *tree)
 {
@@ -370,28 +756,28 @@ static void
 generate_sgf_collection_diff (const EditGraph *edit_graph,
 			      const SgfCollection *from_collection,
 			      const SgfCollection *to_collection,
-			      SgfCollection *difference)
+			      SgfCollection *difference,
+			      const SgfDiffParameters *parameters)
 {
   const SgfGameTree *from_tree_subsequence = from_collection->first_tree;
   const SgfGameTree *to_tree_subsequence = to_collection->first_tree;
   const SgfGameTree *leading_context_subsequence = NULL;
-  const EditGraphLayer *zero_layer = reconstruct_minimal_path (edit_graph);
-  const EditGraphLayer *layer;
-  int layer_distance;
+  const EditGraphPathStep *step;
+  int distance;
   int x = 0;
   int num_leading_context_trees = 0;
   int num_traling_context_trees;
 
-  for (layer = zero_layer, layer_distance = 0; layer;
-       layer = layer->next, layer_distance++) {
-    int trace_x = layer->diagonals[layer->path_diagonal].trace_x;
+  for (step = edit_graph->path, distance = 0;
+       distance <= edit_graph->full_distance; step++, distance++) {
+    int trace_x = step->trace_x;
 
-    if (layer_distance > 0) {
+    if (distance > 0) {
       add_context_game_trees (leading_context_subsequence,
 			      num_leading_context_trees,
 			      difference);
 
-      if (layer->path_diagonal == layer->previous->path_diagonal) {
+      if (step->is_insertion) {
 	/* A game tree got added. */
 	SgfGameTree *added_tree
 	  = sgf_game_tree_duplicate_with_nodes (to_tree_subsequence);
@@ -428,9 +814,8 @@ generate_sgf_collection_diff (const EditGraph *edit_graph,
       SgfGameTree *tree_difference
 	= sgf_game_tree_duplicate (from_tree_subsequence);
 
-      build_node_layer_diff (from_tree_subsequence->root,
-			     to_tree_subsequence->root,
-			     tree_difference, NULL);
+      build_game_tree_diff (from_tree_subsequence, to_tree_subsequence,
+			    tree_difference, parameters);
 
       if (tree_difference->root) {
 	add_context_game_trees (leading_context_subsequence,
@@ -486,23 +871,65 @@ add_context_game_trees (const SgfGameTree *context_subsequence, int num_trees,
 
 
 
+/* Build difference of two game trees with equal roots, storing it in
+ * `tree_difference'.  Identical trees, which are the most common case
+ * in large collections, are detected with a single pass over them.
+ * Otherwise, subtree fingerprints are computed, so that identical
+ * subtrees can be skipped without building edit graphs for them.
+ */
+static void
+build_game_tree_diff (const SgfGameTree *from_tree,
+		      const SgfGameTree *to_tree,
+		      SgfGameTree *tree_difference,
+		      const SgfDiffParameters *parameters)
+{
+  NodeLayerDiffData data;
+
+  data.tree	  = tree_difference;
+  data.parameters = parameters;
+
+  if (tree_difference->game != GAME_AMAZONS) {
+    data.nodes_are_equal = (ComparisonFunction) generic_nodes_are_equal;
+    data.get_node_fingerprint
+      = (FingerprintFunction) get_generic_node_fingerprint;
+  }
+  else {
+    data.nodes_are_equal = (ComparisonFunction) amazons_nodes_are_equal;
+    data.get_node_fingerprint
+      = (FingerprintFunction) get_amazons_node_fingerprint;
+  }
+
+  if (node_layers_are_equal (&data, from_tree->root, to_tree->root))
+    return;
+
+  compute_tree_fingerprints (&data, from_tree, &data.from_fingerprints);
+  compute_tree_fingerprints (&data, to_tree, &data.to_fingerprints);
+
+  build_node_layer_diff (&data, from_tree->root, 0, to_tree->root, 0, NULL);
+
+  tree_fingerprints_dispose (&data.from_fingerprints);
+  tree_fingerprints_dispose (&data.to_fingerprints);
+}
+
+
+/* `from_index' and `to_index' are preorder numbers of the first nodes
+ * of the layers (see `TreeFingerprints'.)
+ */
 static void
-build_node_layer_diff (const SgfNode *from_node_layer,
-		       const SgfNode *to_node_layer,
-		       SgfGameTree *tree, SgfNode *parent)
+build_node_layer_diff (const NodeLayerDiffData *data,
+		       const SgfNode *from_node_layer, int from_index,
+		       const SgfNode *to_node_layer, int to_index,
+		       SgfNode *parent)
 {
   EditGraph edit_graph;
-  const ComparisonFunction nodes_are_equal
-    = (ComparisonFunction) (tree->game != GAME_AMAZONS
-			    ? generic_nodes_are_equal
-			    : amazons_nodes_are_equal);
   const SgfNode *from_node_subsequence = from_node_layer;
   const SgfNode *to_node_subsequence = to_node_layer;
   int num_skipped_nodes;
 
   for (num_skipped_nodes = 0;
        (from_node_subsequence && to_node_subsequence
-	&& nodes_are_equal (from_node_subsequence, to_node_subsequence));
+	&& data->nodes_are_equal (from_node_subsequence,
+				  to_node_subsequence));
        num_skipped_nodes++) {
     from_node_subsequence = from_node_subsequence->next;
     to_node_subsequence = to_node_subsequence->next;
@@ -511,16 +938,63 @@ build_node_layer_diff (const SgfNode *from_node_layer,
   build_abstract_edit_graph (&edit_graph,
 			     from_node_subsequence, to_node_subsequence,
 			     num_skipped_nodes,
-			     nodes_are_equal,
+			     data->nodes_are_equal,
+			     data->get_node_fingerprint,
 			     (GetNextElementFunction) get_next_node);
 
-  generate_sgf_node_layer_diff (&edit_graph, from_node_layer, to_node_layer,
-				tree, parent);
+  generate_sgf_node_layer_diff (data, &edit_graph,
+				from_node_layer, from_index,
+				to_node_layer, to_index, parent);
 
   edit_graph_dispose (&edit_graph);
 }
 
 
+/* Determine if two node layers are equal, i.e. consist of pairwise
+ * equal nodes with recursively equal children layers.  Comments are
+ * compared too, if requested by diff parameters.
+ */
+static int
+node_layers_are_equal (const NodeLayerDiffData *data,
+		       const SgfNode *first_node_layer,
+		       const SgfNode *second_node_layer)
+{
+  while (first_node_layer && second_node_layer) {
+    if (!data->nodes_are_equal (first_node_layer, second_node_layer)
+	|| (data->parameters->compare_comments
+	    && !node_comments_are_equal (first_node_layer,
+					 second_node_layer))
+	|| !node_layers_are_equal (data, first_node_layer->child,
+				   second_node_layer->child))
+      return 0;
+
+    first_node_layer  = first_node_layer->next;
+    second_node_layer = second_node_layer->next;
+  }
+
+  return first_node_layer == NULL && second_node_layer == NULL;
+}
+
+
+static int
+node_comments_are_equal (const SgfNode *first_node,
+			 const SgfNode *second_node)
+{
+  return strcmp (get_node_comment (first_node),
+		 get_node_comment (second_node)) == 0;
+}
+
+
+/* Missing comment is the same as empty one for diffing purposes. */
+static const char *
+get_node_comment (const SgfNode *node)
+{
+  const char *comment = sgf_node_get_text_property_value (node, SGF_COMMENT);
+
+  return comment ? comment : "";
+}
+
+
 static int
 generic_nodes_are_equal (const SgfNode *first_node, const SgfNode *second_node)
 {
@@ -601,27 +1075,177 @@ get_next_node (const SgfNode *node)
 }
 
 
+
+/* Node fingerprinting functions must give equal fingerprints for
+ * nodes that generic_nodes_are_equal() and amazons_nodes_are_equal()
+ * consider equal.  Therefore, they look at exactly the same data.
+ */
+static Fingerprint
+get_generic_node_fingerprint (const SgfNode *node)
+{
+  Fingerprint fingerprint = mix_fingerprint (0, node->move_color);
+
+  if (IS_STONE (node->move_color)) {
+    fingerprint = mix_fingerprint (fingerprint, node->move_point.x);
+    fingerprint = mix_fingerprint (fingerprint, node->move_point.y);
+  }
+  else if (node->move_color == SETUP_NODE) {
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_BLACK);
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_WHITE);
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_EMPTY);
+  }
+
+  return fingerprint;
+}
+
+
+static Fingerprint
+get_amazons_node_fingerprint (const SgfNode *node)
+{
+  Fingerprint fingerprint = mix_fingerprint (0, node->move_color);
+
+  if (IS_STONE (node->move_color)) {
+    fingerprint = mix_fingerprint (fingerprint, node->data.amazons.from.x);
+    fingerprint = mix_fingerprint (fingerprint, node->data.amazons.from.y);
+    fingerprint = mix_fingerprint (fingerprint, node->move_point.x);
+    fingerprint = mix_fingerprint (fingerprint, node->move_point.y);
+    fingerprint = mix_fingerprint (fingerprint,
+				   node->data.amazons.shoot_arrow_to.x);
+    fingerprint = mix_fingerprint (fingerprint,
+				   node->data.amazons.shoot_arrow_to.y);
+  }
+  else if (node->move_color == SETUP_NODE) {
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_BLACK);
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_WHITE);
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_EMPTY);
+    fingerprint = mix_node_position_list (fingerprint, node, SGF_ADD_ARROWS);
+  }
+
+  return fingerprint;
+}
+
+
+static Fingerprint
+mix_node_position_list (Fingerprint fingerprint,
+			const SgfNode *node, SgfType type)
+{
+  const BoardPositionList *position_list
+    = sgf_node_get_list_of_point_property_value (node, type);
+  int k;
+
+  if (!position_list)
+    return mix_fingerprint (fingerprint, UINT_MAX);
+
+  fingerprint = mix_fingerprint (fingerprint, position_list->num_positions);
+  for (k = 0; k < position_list->num_positions; k++)
+    fingerprint = mix_fingerprint (fingerprint, position_list->positions[k]);
+
+  return fingerprint;
+}
+
+
+inline static Fingerprint
+mix_fingerprint (Fingerprint fingerprint, unsigned int value)
+{
+  fingerprint = (fingerprint + value + 1) * FINGERPRINT_MULTIPLIER;
+  return fingerprint ^ (fingerprint >> 29);
+}
+
+
+/* Compute fingerprints of all subtrees of given game tree.  Subtree
+ * fingerprint is a combination of its root node fingerprint (with
+ * comment, if comments are compared) and fingerprints of all its
+ * child subtrees in order.
+ */
+static void
+compute_tree_fingerprints (const NodeLayerDiffData *data,
+			   const SgfGameTree *tree,
+			   TreeFingerprints *fingerprints)
+{
+  const SgfNode **nodes;
+  const SgfNode *node;
+  int num_nodes;
+  int k;
+
+  for (node = tree->root, num_nodes = 0; node;
+       node = sgf_node_traverse_forward (node))
+    num_nodes++;
+
+  nodes = utils_malloc (num_nodes * sizeof (const SgfNode *));
+  fingerprints->subtree_fingerprints
+    = utils_malloc (num_nodes * sizeof (Fingerprint));
+  fingerprints->children_fingerprints
+    = utils_malloc (num_nodes * sizeof (Fingerprint));
+  fingerprints->subtree_sizes = utils_malloc (num_nodes * sizeof (int));
+
+  for (node = tree->root, k = 0; node; node = sgf_node_traverse_forward (node))
+    nodes[k++] = node;
+
+  /* In reversed preorder all descendants of a node are visited before
+   * the node itself.
+   */
+  for (k = num_nodes; --k >= 0;) {
+    Fingerprint fingerprint = data->get_node_fingerprint (nodes[k]);
+    Fingerprint children_fingerprint = 0;
+    int subtree_size = 1;
+
+    if (data->parameters->compare_comments) {
+      const char *comment;
+
+      for (comment = get_node_comment (nodes[k]); *comment; comment++)
+	fingerprint = mix_fingerprint (fingerprint, *comment);
+    }
+
+    for (node = nodes[k]->child; node; node = node->next) {
+      children_fingerprint
+	= ((children_fingerprint * FINGERPRINT_MULTIPLIER)
+	   ^ fingerprints->subtree_fingerprints[k + subtree_size]);
+      subtree_size += fingerprints->subtree_sizes[k + subtree_size];
+    }
+
+    fingerprints->subtree_fingerprints[k]
+      = mix_fingerprint (fingerprint ^ children_fingerprint, subtree_size);
+    fingerprints->children_fingerprints[k] = children_fingerprint;
+    fingerprints->subtree_sizes[k]	   = subtree_size;
+  }
+
+  utils_free (nodes);
+}
+
+
 static void
-generate_sgf_node_layer_diff (const EditGraph *edit_graph,
-			      const SgfNode *from_node_layer,
-			      const SgfNode *to_node_layer,
-			      SgfGameTree *tree, SgfNode *parent)
+tree_fingerprints_dispose (TreeFingerprints *fingerprints)
 {
+  utils_free (fingerprints->subtree_fingerprints);
+  utils_free (fingerprints->children_fingerprints);
+  utils_free (fingerprints->subtree_sizes);
+}
+
+
+static void
+generate_sgf_node_layer_diff (const NodeLayerDiffData *data,
+			      const EditGraph *edit_graph,
+			      const SgfNode *from_node_layer, int from_index,
+			      const SgfNode *to_node_layer, int to_index,
+			      SgfNode *parent)
+{
+  const int *from_subtree_sizes = data->from_fingerprints.subtree_sizes;
+  const int *to_subtree_sizes = data->to_fingerprints.subtree_sizes;
+  SgfGameTree *tree = data->tree;
   SgfNode **link = (parent ? &parent->child : &tree->root);
   const SgfNode *leading_context_subsequence = NULL;
-  const EditGraphLayer *zero_layer = reconstruct_minimal_path (edit_graph);
-  const EditGraphLayer *layer;
-  int layer_distance;
+  const EditGraphPathStep *step;
+  int distance;
   int x = 0;
   int num_leading_context_nodes = 0;
   int num_traling_context_nodes;
 
-  for (layer = zero_layer, layer_distance = 0; layer;
-       layer = layer->next, layer_distance++) {
+  for (step = edit_graph->path, distance = 0;
+       distance <= edit_graph->full_distance; step++, distance++) {
     int k;
-    int trace_x = layer->diagonals[layer->path_diagonal].trace_x;
+    int trace_x = step->trace_x;
 
-    if (layer_distance > 0) {
+    if (distance > 0) {
       for (k = 0; k < num_leading_context_nodes; k++) {
 	*link = sgf_node_duplicate_to_given_depth (leading_context_subsequence,
 						   tree, parent,
@@ -631,7 +1255,7 @@ generate_sgf_node_layer_diff (const EditGraph *edit_graph,
 	leading_context_subsequence = leading_context_subsequence->next;
       }
 
-      if (layer->path_diagonal == layer->previous->path_diagonal) {
+      if (step->is_insertion) {
 	/* A node got added.
 	 *
 	 * FIXME: Add SGF property that shows that the node got added
@@ -639,6 +1263,7 @@ generate_sgf_node_layer_diff (const EditGraph *edit_graph,
 	 */
 	*link = sgf_node_duplicate_recursively (to_node_layer, tree, parent);
 
+	to_index += to_subtree_sizes[to_index];
 	to_node_layer = to_node_layer->next;
       }
       else {
@@ -649,6 +1274,7 @@ generate_sgf_node_layer_diff (const EditGraph *edit_graph,
 	 */
 	*link = sgf_node_duplicate_recursively (from_node_layer, tree, parent);
 
+	from_index += from_subtree_sizes[from_index];
 	from_node_layer = from_node_layer->next;
 	x++;
       }
@@ -662,15 +1288,42 @@ generate_sgf_node_layer_diff (const EditGraph *edit_graph,
 
     while (x < trace_x) {
       int is_context_node = 1;
-
-      if (from_node_layer->child || to_node_layer->child) {
+      int comments_differ = (data->parameters->compare_comments
+			     && !node_comments_are_equal (from_node_layer,
+							  to_node_layer));
+
+      /* Nodes are equal, so if fingerprints of their children match
+       * too, the children subtrees are almost certainly identical.
+       * Verify that and skip them.
+       */
+      int children_differ
+	= ((from_node_layer->child || to_node_layer->child)
+	   && (data->from_fingerprints.children_fingerprints[from_index]
+	       != data->to_fingerprints.children_fingerprints[to_index]
+	       || !node_layers_are_equal (data, from_node_layer->child,
+					  to_node_layer->child)));
+
+      if (comments_differ || children_differ) {
 	SgfNode *node_difference = sgf_node_duplicate (from_node_layer,
 						       tree, parent);
 
-	build_node_layer_diff (from_node_layer->child, to_node_layer->child,
-			       tree, node_difference);
+	if (comments_differ) {
+	  sgf_node_add_text_property
+	    (node_difference, tree, SGF_COMMENT,
+	     sgf_diff_text (get_node_comment (from_node_layer),
+			    get_node_comment (to_node_layer),
+			    data->parameters),
+	     1);
+	}
+
+	if (children_differ) {
+	  build_node_layer_diff (data,
+				 from_node_layer->child, from_index + 1,
+				 to_node_layer->child, to_index + 1,
+				 node_difference);
+	}
 
-	if (node_difference->child) {
+	if (comments_differ || node_difference->child) {
 	  for (k = 0; k < num_leading_context_nodes; k++) {
 	    *link
 	      = sgf_node_duplicate_to_given_depth (leading_context_subsequence,
@@ -712,6 +1365,9 @@ generate_sgf_node_layer_diff (const EditGraph *edit_graph,
 	}
       }
 
+      from_index += from_subtree_sizes[from_index];
+      to_index += to_subtree_sizes[to_index];
+
       from_node_layer = from_node_layer->next;
       to_node_layer = to_node_layer->next;
       x++;
@@ -721,218 +1377,667 @@ generate_sgf_node_layer_diff (const EditGraph *edit_graph,
 
 
 
-#if 0
 
 
-static TextLine *
-chop_text_into_lines (const char *text)
+
+/* Generate text difference between `from_text' and `to_text'.  The
+ * texts are diffed either line by line, yielding a unified diff
+ * without file headers, or word by word.  In the latter case the
+ * result is `to_text' with deleted words inserted as `[-word-]' and
+ * inserted words marked as `{+word+}'.
+ *
+ * Returned string must be freed by the caller.  If the texts are
+ * equal, an empty string is returned.
+ */
+char *
+sgf_diff_text (const char *from_text, const char *to_text,
+	       const SgfDiffParameters *parameters)
 {
-  TextLine *lines = NULL;
-  int num_allocated_lines = 0;
-  int num_lines = 0;
+  TextDiffData data;
+  StringBuffer buffer;
+  TextToken *from_tokens;
+  TextToken *to_tokens;
+  int num_from_tokens;
+  int num_to_tokens;
+
+  assert (from_text);
+  assert (to_text);
+  assert (parameters);
+
+  from_tokens = chop_text_into_tokens (from_text, parameters->diff_text_words,
+				       &num_from_tokens);
+  to_tokens   = chop_text_into_tokens (to_text, parameters->diff_text_words,
+				       &num_to_tokens);
+
+  identify_text_tokens (from_tokens, num_from_tokens,
+			to_tokens, num_to_tokens, &data);
+
+  data.edit_graph_data.from_elements = NULL;
+  data.edit_graph_data.to_elements   = NULL;
+  data.edit_graph_data.are_equal     = NULL;
+  edit_graph_search_data_init (&data.edit_graph_data,
+			       num_from_tokens, num_to_tokens);
+
+  switch (parameters->text_diff_algorithm) {
+  case SGF_TEXT_DIFF_MYERS:
+    find_shortest_edit_script (&data.edit_graph_data, 0, num_from_tokens,
+			       0, num_to_tokens);
+    break;
+
+  case SGF_TEXT_DIFF_PATIENCE:
+  case SGF_TEXT_DIFF_HISTOGRAM:
+    data.from_counts	= utils_malloc0 ((data.num_unique_tokens + 1)
+				     * sizeof (int));
+    data.to_counts	= utils_malloc0 ((data.num_unique_tokens + 1)
+				     * sizeof (int));
+    data.positions	= utils_malloc0 ((data.num_unique_tokens + 1)
+				     * sizeof (int));
+    data.next_positions = utils_malloc ((num_from_tokens + 1) * sizeof (int));
+
+    if (parameters->text_diff_algorithm == SGF_TEXT_DIFF_PATIENCE) {
+      find_patience_edit_script (&data, 0, num_from_tokens,
+				 0, num_to_tokens);
+    }
+    else {
+      find_histogram_edit_script (&data, 0, num_from_tokens,
+				  0, num_to_tokens);
+    }
 
-  while (1) {
-    const char *line_end = strchr (text, '\n');
+    utils_free (data.from_counts);
+    utils_free (data.to_counts);
+    utils_free (data.positions);
+    utils_free (data.next_positions);
 
-    if (num_lines + 2 > num_allocated_lines) {
-      num_allocated_lines += 20;
-      lines = utils_realloc (lines, num_allocated_lines * sizeof (TextLine));
-    }
+    break;
+
+  default:
+    assert (0);
+  }
+
+  string_buffer_init (&buffer, 0x400, 0x1000);
+
+  if (parameters->diff_text_words) {
+    generate_word_text_diff (&buffer,
+			     from_tokens, num_from_tokens,
+			     to_tokens, num_to_tokens,
+			     data.edit_graph_data.is_deleted,
+			     data.edit_graph_data.is_inserted);
+  }
+  else {
+    generate_unified_text_diff (&buffer,
+				from_tokens, num_from_tokens,
+				to_tokens, num_to_tokens,
+				data.edit_graph_data.is_deleted,
+				data.edit_graph_data.is_inserted);
+  }
+
+  edit_graph_search_data_dispose (&data.edit_graph_data);
+
+  utils_free (data.edit_graph_data.from_fingerprints);
+  utils_free (data.edit_graph_data.to_fingerprints);
+  utils_free (from_tokens);
+  utils_free (to_tokens);
+
+  return string_buffer_steal_string (&buffer);
+}
+
+
+/* Split text into lines or, if `into_words' is set, into words and
+ * whitespace runs between them.  Lines don't include their
+ * terminating newlines, so whether the text ends with a newline or
+ * not doesn't matter.  Words and whitespace runs, on the other hand,
+ * include every character of the text.
+ */
+static TextToken *
+chop_text_into_tokens (const char *text, int into_words, int *num_tokens)
+{
+  TextToken *tokens = NULL;
+  int num_allocated_tokens = 0;
+
+  *num_tokens = 0;
+
+  while (*text) {
+    const char *token_end;
 
-    lines[num_lines].string = text;
+    if (*num_tokens == num_allocated_tokens) {
+      num_allocated_tokens += (num_allocated_tokens / 2 + 16);
+      tokens = utils_realloc (tokens,
+			      num_allocated_tokens * sizeof (TextToken));
+    }
 
-    if (line_end) {
-      lines[num_lines++].length = line_end - text;
-      text = line_end + 1;
+    if (!into_words) {
+      token_end = strchr (text, '\n');
+      if (!token_end)
+	token_end = text + strlen (text);
     }
     else {
-      lines[num_lines++].length = strlen (text);
-      break;
+      int is_whitespace = (*text == ' ' || *text == '\t' || *text == '\n');
+
+      for (token_end = text + 1; *token_end; token_end++) {
+	if ((*token_end == ' ' || *token_end == '\t' || *token_end == '\n')
+	    != is_whitespace)
+	  break;
+      }
     }
+
+    tokens[*num_tokens].string = text;
+    tokens[(*num_tokens)++].length = token_end - text;
+
+    text = (!into_words && *token_end ? token_end + 1 : token_end);
   }
 
-  lines[num_lines].string = NULL;
-  return lines;
+  return tokens;
 }
 
 
-static int
-text_lines_are_equal (const TextLine *first_text_line,
-		      const TextLine *second_text_line)
+/* Assign each distinct token an identifier, using a hash table, and
+ * store identifiers as exact fingerprints of the tokens.  After this,
+ * tokens are only compared as integers.
+ */
+static void
+identify_text_tokens (const TextToken *from_tokens, int num_from_tokens,
+		      const TextToken *to_tokens, int num_to_tokens,
+		      TextDiffData *data)
 {
-  return (first_text_line->length == second_text_line->length
-	  && (strncmp (first_text_line->string, second_text_line->string,
-		       first_text_line->length)
-	      == 0));
+  const TextToken **unique_tokens;
+  int *buckets;
+  int num_buckets;
+  int pass;
+
+  for (num_buckets = 16; num_buckets < 2 * (num_from_tokens + num_to_tokens);)
+    num_buckets *= 2;
+
+  /* A bucket stores identifier plus one, zero marks an empty bucket. */
+  buckets	= utils_malloc0 (num_buckets * sizeof (int));
+  unique_tokens = utils_malloc ((num_from_tokens + num_to_tokens + 1)
+				* sizeof (const TextToken *));
+
+  data->num_unique_tokens = 0;
+
+  for (pass = 0; pass < 2; pass++) {
+    const TextToken *tokens = (pass == 0 ? from_tokens : to_tokens);
+    int num_tokens = (pass == 0 ? num_from_tokens : num_to_tokens);
+    Fingerprint *identifiers = utils_malloc ((num_tokens + 1)
+					     * sizeof (Fingerprint));
+    int k;
+
+    for (k = 0; k < num_tokens; k++) {
+      const TextToken *token = tokens + k;
+      int bucket = get_text_token_hash (token) & (num_buckets - 1);
+
+      while (buckets[bucket]) {
+	const TextToken *unique_token = unique_tokens[buckets[bucket] - 1];
+
+	if (unique_token->length == token->length
+	    && memcmp (unique_token->string, token->string, token->length) == 0)
+	  break;
+
+	bucket = (bucket + 1) & (num_buckets - 1);
+      }
+
+      if (!buckets[bucket]) {
+	unique_tokens[data->num_unique_tokens++] = token;
+	buckets[bucket] = data->num_unique_tokens;
+      }
+
+      identifiers[k] = buckets[bucket] - 1;
+    }
+
+    if (pass == 0)
+      data->edit_graph_data.from_fingerprints = identifiers;
+    else
+      data->edit_graph_data.to_fingerprints = identifiers;
+  }
+
+  utils_free (buckets);
+  utils_free (unique_tokens);
 }
 
 
-static const TextLine *
-get_next_text_line (const TextLine *text_line)
+/* FNV-1a hash function. */
+static unsigned int
+get_text_token_hash (const TextToken *token)
 {
-  if ((text_line + 1)->string != NULL)
-    return text_line + 1;
+  unsigned int hash = 2166136261u;
+  int k;
 
-  return NULL;
+  for (k = 0; k < token->length; k++)
+    hash = (hash ^ (unsigned char) token->string[k]) * 16777619u;
+
+  return hash;
 }
 
 
-static char *
-generate_text_diff (const EditGraph *edit_graph,
-		    const TextLine *from_lines_sequence,
-		    const TextLine *to_lines_sequence)
+/* Patience diff: find tokens that occur exactly once in both ranges,
+ * take the longest sequence of them that appears in the same order
+ * in both, and use it to split the ranges.  Then recurse between the
+ * split points.  This tends to give more readable results than
+ * Myers' algorithm, because it never matches frequent, meaningless
+ * lines (like empty ones) across unrelated changes.  Ranges without
+ * unique common tokens are diffed with Myers' algorithm.
+ */
+static void
+find_patience_edit_script (TextDiffData *data,
+			   int from_begin, int from_end,
+			   int to_begin, int to_end)
 {
-  TextDiffData data;
+  const Fingerprint *from_tokens = data->edit_graph_data.from_fingerprints;
+  const Fingerprint *to_tokens	 = data->edit_graph_data.to_fingerprints;
+
+  while (strip_common_tokens (data, &from_begin, &from_end,
+			      &to_begin, &to_end)) {
+    int num_candidates = 0;
+    int num_piles = 0;
+    int *candidate_x;
+    int *candidate_y;
+    int *previous_candidates;
+    int *piles;
+    int candidate;
+    int x;
+    int y;
+
+    for (x = from_begin; x < from_end; x++) {
+      data->from_counts[from_tokens[x]]++;
+      data->positions[from_tokens[x]] = x;
+    }
+
+    for (y = to_begin; y < to_end; y++)
+      data->to_counts[to_tokens[y]]++;
+
+    candidate_x		= utils_malloc (4 * (to_end - to_begin) * sizeof (int));
+    candidate_y		= candidate_x + (to_end - to_begin);
+    previous_candidates = candidate_y + (to_end - to_begin);
+    piles		= previous_candidates + (to_end - to_begin);
+
+    /* Patience sorting of unique common tokens' ``from'' positions
+     * in ``to'' order.  Top of each pile is the last candidate in
+     * it, and the piles have increasing tops.  Each candidate links
+     * to the top of the previous pile, so the longest increasing
+     * subsequence can be read backwards from the top of the last
+     * pile.
+     */
+    for (y = to_begin; y < to_end; y++) {
+      int token = to_tokens[y];
+
+      if (data->from_counts[token] == 1 && data->to_counts[token] == 1) {
+	int low = 0;
+	int high = num_piles;
+
+	x = data->positions[token];
+
+	while (low < high) {
+	  int middle = (low + high) / 2;
+
+	  if (candidate_x[piles[middle]] < x)
+	    low = middle + 1;
+	  else
+	    high = middle;
+	}
+
+	candidate_x[num_candidates]	    = x;
+	candidate_y[num_candidates]	    = y;
+	previous_candidates[num_candidates] = (low > 0 ? piles[low - 1] : -1);
+
+	piles[low] = num_candidates++;
+	if (low == num_piles)
+	  num_piles++;
+      }
+    }
+
+    for (x = from_begin; x < from_end; x++)
+      data->from_counts[from_tokens[x]] = 0;
+    for (y = to_begin; y < to_end; y++)
+      data->to_counts[to_tokens[y]] = 0;
+
+    if (num_piles == 0) {
+      utils_free (candidate_x);
+      find_shortest_edit_script (&data->edit_graph_data,
+				 from_begin, from_end, to_begin, to_end);
+      return;
+    }
+
+    /* Reverse the links, so that the subsequence can be walked
+     * forward.  `piles' is no longer needed and is reused.
+     */
+    for (candidate = piles[num_piles - 1], num_piles = 0; candidate != -1;
+	 candidate = previous_candidates[candidate])
+      piles[num_piles++] = candidate;
+
+    while (--num_piles >= 0) {
+      candidate = piles[num_piles];
+
+      find_patience_edit_script (data, from_begin, candidate_x[candidate],
+				 to_begin, candidate_y[candidate]);
+
+      from_begin = candidate_x[candidate] + 1;
+      to_begin	 = candidate_y[candidate] + 1;
+    }
 
-  return do_generate_text_diff (edit_graph->last_layer,
-				edit_graph->full_distance,
-				/* edit_graph->last_layer_diagonal */ 0, 1,
-				from_lines_sequence, to_lines_sequence,
-				&data);
+    utils_free (candidate_x);
+  }
 }
 
 
-/* Recursively generate unified text diff based on given edit graph
- * layer.
- *
- * FIXME: It doesn't work at all after the change of the EditGraph
- *	  structure (or rather generate_text_diff() does not).
- *
- * FIXME: Speed this function up by first calculating the diff size
- *	  and only then copying strings.
+/* Histogram diff: a generalization of patience diff.  Instead of
+ * only unique tokens, find the least frequent token of ``from'' range
+ * that also occurs in ``to'' range, extend its occurrences into the
+ * longest common region around it, split the ranges with the best
+ * region and recurse.  If all common tokens are too frequent, fall
+ * back to Myers' algorithm.
  */
-static char *
-do_generate_text_diff (const EditGraphLayer *layer,
-		       int layer_distance, int layer_diagonal, int last_layer,
-		       const TextLine *from_lines_sequence,
-		       const TextLine *to_lines_sequence,
-		       TextDiffData *data)
+static void
+find_histogram_edit_script (TextDiffData *data,
+			    int from_begin, int from_end,
+			    int to_begin, int to_end)
 {
-  int k;
-  int first_line_index;
-  int last_snake_line_index = layer->diagonals[layer_diagonal].trace_x;
-  char *difference;
-
-  if (layer_distance) {
-    const EditGraphLayer *previous_layer = layer->previous;
-    int first_snake_line_index;
-
-    if (layer_diagonal == 0
-	|| (layer_diagonal != layer_distance
-	    && (previous_layer->diagonals[layer_diagonal].trace_x
-		> previous_layer->diagonals[layer_diagonal - 1].trace_x))) {
-      int added_line_index = (previous_layer->diagonals[layer_diagonal].trace_x
-			      - (2 * layer_diagonal - layer_distance) - 1);
-
-      difference
-	= do_generate_text_diff (previous_layer,
-				 layer_distance - 1, layer_diagonal, 0,
-				 from_lines_sequence, to_lines_sequence, data);
-
-      data->current_hunk
-	= utils_cat_as_strings (data->current_hunk,
-				"+", 1,
-				to_lines_sequence[added_line_index].string,
-				to_lines_sequence[added_line_index].length,
-				"\n", 1, NULL);
-      first_snake_line_index
-	= previous_layer->diagonals[layer_diagonal].trace_x;
+  const Fingerprint *from_tokens = data->edit_graph_data.from_fingerprints;
+  const Fingerprint *to_tokens	 = data->edit_graph_data.to_fingerprints;
+
+  while (strip_common_tokens (data, &from_begin, &from_end,
+			      &to_begin, &to_end)) {
+    int best_count = MAX_HISTOGRAM_CHAIN_LENGTH + 1;
+    int best_from_begin = -1;
+    int best_from_end = -1;
+    int best_to_begin = -1;
+    int best_to_end = -1;
+    int x;
+    int y;
+
+    /* Build the histogram: occurrence counts of ``from'' tokens and
+     * chains of their positions, in increasing order.  Positions are
+     * stored plus one, so that zero terminates the chains.
+     */
+    for (x = from_end; --x >= from_begin;) {
+      int token = from_tokens[x];
+
+      data->next_positions[x] = data->positions[token];
+      data->positions[token]  = x + 1;
+      data->from_counts[token]++;
     }
-    else {
-      int deleted_line_index
-	= previous_layer->diagonals[layer_diagonal - 1].trace_x;
-
-      difference
-	= do_generate_text_diff (previous_layer,
-				 layer_distance - 1, layer_diagonal - 1, 0,
-				 from_lines_sequence, to_lines_sequence, data);
-
-      data->current_hunk
-	= utils_cat_as_strings (data->current_hunk,
-				"-", 1,
-				from_lines_sequence[deleted_line_index].string,
-				from_lines_sequence[deleted_line_index].length,
-				"\n", 1, NULL);
-      first_snake_line_index = deleted_line_index + 1;
-    }
-
-    if ((last_snake_line_index - first_snake_line_index
-	 > 2 * NUM_TEXT_CONTEXT_LINES)
-	|| last_layer) {
-      char buffer[64];
-      int length;
-      int last_hunk_line_index = (first_snake_line_index
-				  + NUM_TEXT_CONTEXT_LINES);
-      int trace_y_adjustment = 2 * layer_diagonal - layer_distance;
-
-      if (last_hunk_line_index > last_snake_line_index)
-	last_hunk_line_index = last_snake_line_index;
-
-      length = utils_ncprintf (buffer, sizeof buffer, "@@ -%d,%d +%d,%d @@\n",
-			       data->hunk_first_line_in_original + 1,
-			       (last_hunk_line_index
-				- data->hunk_first_line_in_original),
-			       data->hunk_first_line_in_modified + 1,
-			       ((last_hunk_line_index - trace_y_adjustment)
-				- data->hunk_first_line_in_modified));
-
-      if (difference)
-	difference = utils_cat_as_string (difference, buffer, length);
-      else
-	difference = utils_duplicate_as_string (buffer, length);
-
-      difference = utils_cat_string (difference, data->current_hunk);
-      utils_free (data->current_hunk);
-
-      for (k = first_snake_line_index; k < last_hunk_line_index; k++) {
-	difference
-	  = utils_cat_as_strings (difference,
-				  " ", 1,
-				  from_lines_sequence[k].string,
-				  from_lines_sequence[k].length,
-				  "\n", 1, NULL);
+
+    for (y = to_begin; y < to_end;) {
+      int token = to_tokens[y];
+      int next_y = y + 1;
+      int position;
+
+      if (data->from_counts[token] == 0
+	  || data->from_counts[token] > best_count) {
+	y++;
+	continue;
+      }
+
+      for (position = data->positions[token]; position;
+	   position = data->next_positions[position - 1]) {
+	int region_from_begin = position - 1;
+	int region_from_end = position;
+	int region_to_begin = y;
+	int region_to_end = y + 1;
+	int region_count = data->from_counts[token];
+
+	while (region_from_begin > from_begin && region_to_begin > to_begin
+	       && (from_tokens[region_from_begin - 1]
+		   == to_tokens[region_to_begin - 1])) {
+	  region_from_begin--;
+	  region_to_begin--;
+	  region_count = MIN (region_count,
+			      data->from_counts[from_tokens
+						[region_from_begin]]);
+	}
+
+	while (region_from_end < from_end && region_to_end < to_end
+	       && from_tokens[region_from_end] == to_tokens[region_to_end]) {
+	  region_count = MIN (region_count,
+			      data->from_counts[from_tokens[region_from_end]]);
+	  region_from_end++;
+	  region_to_end++;
+	}
+
+	if (region_count < best_count
+	    || (region_count == best_count
+		&& (region_from_end - region_from_begin
+		    > best_from_end - best_from_begin))) {
+	  best_count	  = region_count;
+	  best_from_begin = region_from_begin;
+	  best_from_end	  = region_from_end;
+	  best_to_begin	  = region_to_begin;
+	  best_to_end	  = region_to_end;
+	}
+
+	/* No need to look for regions starting inside this one. */
+	if (region_to_end > next_y)
+	  next_y = region_to_end;
       }
 
-      if (last_layer)
-	return difference;
+      y = next_y;
+    }
 
-      first_line_index = last_snake_line_index - NUM_TEXT_CONTEXT_LINES;
+    for (x = from_begin; x < from_end; x++) {
+      data->from_counts[from_tokens[x]] = 0;
+      data->positions[from_tokens[x]]	= 0;
+    }
 
-      data->hunk_first_line_in_original = first_line_index;
-      data->hunk_first_line_in_modified = (first_line_index
-					   - trace_y_adjustment);
-      data->current_hunk = NULL;
+    if (best_from_begin == -1) {
+      find_shortest_edit_script (&data->edit_graph_data,
+				 from_begin, from_end, to_begin, to_end);
+      return;
     }
-    else
-      first_line_index = first_snake_line_index;
+
+    find_histogram_edit_script (data, from_begin, best_from_begin,
+				to_begin, best_to_begin);
+
+    from_begin = best_from_end;
+    to_begin   = best_to_end;
   }
-  else {
-    difference = NULL;
+}
+
 
-    first_line_index = last_snake_line_index - NUM_TEXT_CONTEXT_LINES;
+/* Strip common prefix and suffix of the ranges.  If after that one of
+ * the ranges is empty, mark the whole other range as deleted or
+ * inserted and return zero.  Otherwise return non-zero.
+ */
+static int
+strip_common_tokens (TextDiffData *data,
+		     int *from_begin, int *from_end, int *to_begin, int *to_end)
+{
+  EditGraphSearchData *edit_graph_data = &data->edit_graph_data;
 
-    if (first_line_index < 0)
-      first_line_index = 0;
+  while (*from_begin < *from_end && *to_begin < *to_end
+	 && elements_are_equal (edit_graph_data, *from_begin, *to_begin)) {
+    (*from_begin)++;
+    (*to_begin)++;
+  }
 
-    data->hunk_first_line_in_original = first_line_index;
-    data->hunk_first_line_in_modified = first_line_index;
-    data->current_hunk = NULL;
+  while (*from_begin < *from_end && *to_begin < *to_end
+	 && elements_are_equal (edit_graph_data, *from_end - 1, *to_end - 1)) {
+    (*from_end)--;
+    (*to_end)--;
   }
 
-  for (k = first_line_index; k < last_snake_line_index; k++) {
-    data->current_hunk
-      = utils_cat_as_strings (data->current_hunk,
-			      " ", 1,
-			      from_lines_sequence[k].string,
-			      from_lines_sequence[k].length,
-			      "\n", 1, NULL);
+  if (*from_begin == *from_end || *to_begin == *to_end) {
+    while (*from_begin < *from_end)
+      edit_graph_data->is_deleted[(*from_begin)++] = 1;
+    while (*to_begin < *to_end)
+      edit_graph_data->is_inserted[(*to_begin)++] = 1;
+
+    return 0;
   }
 
-  return difference;
+  return 1;
 }
 
 
-#endif
+/* Generate unified diff hunks with `NUM_TEXT_CONTEXT_LINES' lines of
+ * context from the edit script marks.  Blocks of changes separated
+ * by less than two contexts worth of lines are merged into one hunk.
+ */
+static void
+generate_unified_text_diff (StringBuffer *buffer,
+			    const TextToken *from_lines, int num_from_lines,
+			    const TextToken *to_lines, int num_to_lines,
+			    const char *is_deleted, const char *is_inserted)
+{
+  int x = 0;
+  int y = 0;
+
+  while (1) {
+    int hunk_from_begin;
+    int hunk_to_begin;
+    int hunk_end_x;
+    int hunk_end_y;
+    int context_end;
+    int num_hunk_from_lines;
+    int num_hunk_to_lines;
+
+    while (x < num_from_lines && y < num_to_lines
+	   && !is_deleted[x] && !is_inserted[y]) {
+      x++;
+      y++;
+    }
+
+    if (x == num_from_lines && y == num_to_lines)
+      break;
+
+    hunk_from_begin = MAX (x - NUM_TEXT_CONTEXT_LINES, 0);
+    hunk_to_begin   = y - (x - hunk_from_begin);
+
+    /* Find where the hunk ends: after the last change block that is
+     * close enough to the previous one.
+     */
+    hunk_end_x = x;
+    hunk_end_y = y;
+
+    while (1) {
+      int num_equal_lines = 0;
+
+      while (hunk_end_x < num_from_lines && is_deleted[hunk_end_x])
+	hunk_end_x++;
+      while (hunk_end_y < num_to_lines && is_inserted[hunk_end_y])
+	hunk_end_y++;
+
+      while (hunk_end_x + num_equal_lines < num_from_lines
+	     && hunk_end_y + num_equal_lines < num_to_lines
+	     && !is_deleted[hunk_end_x + num_equal_lines]
+	     && !is_inserted[hunk_end_y + num_equal_lines]
+	     && num_equal_lines <= 2 * NUM_TEXT_CONTEXT_LINES)
+	num_equal_lines++;
+
+      if (num_equal_lines > 2 * NUM_TEXT_CONTEXT_LINES
+	  || (hunk_end_x + num_equal_lines == num_from_lines
+	      && hunk_end_y + num_equal_lines == num_to_lines))
+	break;
+
+      hunk_end_x += num_equal_lines;
+      hunk_end_y += num_equal_lines;
+    }
+
+    context_end = MIN (hunk_end_x + NUM_TEXT_CONTEXT_LINES, num_from_lines);
+
+    /* Like in GNU diff, an empty range is denoted by the line before
+     * it.
+     */
+    num_hunk_from_lines = context_end - hunk_from_begin;
+    num_hunk_to_lines	= (hunk_end_y + (context_end - hunk_end_x)
+			   - hunk_to_begin);
+
+    string_buffer_printf (buffer, "@@ -%d,%d +%d,%d @@\n",
+			  hunk_from_begin + (num_hunk_from_lines > 0),
+			  num_hunk_from_lines,
+			  hunk_to_begin + (num_hunk_to_lines > 0),
+			  num_hunk_to_lines);
+
+    add_text_lines (buffer, ' ', from_lines, hunk_from_begin, x);
+
+    while (x < hunk_end_x || y < hunk_end_y) {
+      int block_begin_x = x;
+      int block_begin_y = y;
+
+      while (x < hunk_end_x && is_deleted[x])
+	x++;
+      while (y < hunk_end_y && is_inserted[y])
+	y++;
+
+      add_text_lines (buffer, '-', from_lines, block_begin_x, x);
+      add_text_lines (buffer, '+', to_lines, block_begin_y, y);
+
+      block_begin_x = x;
+      while (x < hunk_end_x && y < hunk_end_y
+	     && !is_deleted[x] && !is_inserted[y]) {
+	x++;
+	y++;
+      }
+
+      add_text_lines (buffer, ' ', from_lines, block_begin_x, x);
+    }
+
+    add_text_lines (buffer, ' ', from_lines, x, context_end);
+  }
+}
+
+
+static void
+add_text_lines (StringBuffer *buffer, char prefix,
+		const TextToken *lines, int first_line, int last_line)
+{
+  int k;
+
+  for (k = first_line; k < last_line; k++) {
+    string_buffer_add_character (buffer, prefix);
+    string_buffer_cat_as_string (buffer, lines[k].string, lines[k].length);
+    string_buffer_add_character (buffer, '\n');
+  }
+}
+
+
+static void
+generate_word_text_diff (StringBuffer *buffer,
+			 const TextToken *from_words, int num_from_words,
+			 const TextToken *to_words, int num_to_words,
+			 const char *is_deleted, const char *is_inserted)
+{
+  int x = 0;
+  int y = 0;
+
+  if (num_from_words == num_to_words) {
+    for (; x < num_from_words; x++) {
+      if (is_deleted[x])
+	break;
+    }
+
+    /* The texts are equal. */
+    if (x == num_from_words)
+      return;
+
+    x = 0;
+  }
+
+  while (x < num_from_words || y < num_to_words) {
+    if (x < num_from_words && is_deleted[x]) {
+      string_buffer_cat_string (buffer, "[-");
+      for (; x < num_from_words && is_deleted[x]; x++) {
+	string_buffer_cat_as_string (buffer,
+				     from_words[x].string,
+				     from_words[x].length);
+      }
+
+      string_buffer_cat_string (buffer, "-]");
+    }
+    else if (y < num_to_words && is_inserted[y]) {
+      string_buffer_cat_string (buffer, "{+");
+      for (; y < num_to_words && is_inserted[y]; y++) {
+	string_buffer_cat_as_string (buffer,
+				     to_words[y].string, to_words[y].length);
+      }
+
+      string_buffer_cat_string (buffer, "+}");
+    }
+    else {
+      string_buffer_cat_as_string (buffer,
+				   to_words[y].string, to_words[y].length);
+      x++;
+      y++;
+    }
+  }
+}
 
 
 /*
@@ -24,23 +24,102 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
+
+
+enum {
+  /* Options with no short equivalent. */
+  OPTION_HELP = UCHAR_MAX + 1
+};
+
+
+static const struct option sgf_diff_options[] = {
+  { "comments",		no_argument,	   NULL, 'c'		},
+  { "diff-algorithm",	required_argument, NULL, 'a'		},
+  { "words",		no_argument,	   NULL, 'w'		},
+
+  { "help",		no_argument,	   NULL, OPTION_HELP	},
+
+  {  NULL,		no_argument,	   NULL, 0		}
+};
+
+static const char *usage_string =
+  "Usage: %s [OPTION...] FROM-FILE TO-FILE\n";
+
+static const char *help_string =
+  "\n"
+  "  -c, --comments               also report changed comments, as text\n"
+  "                               differences\n"
+  "  -a, --diff-algorithm=NAME    algorithm for comment text: `myers'\n"
+  "                               (default), `patience' or `histogram';\n"
+  "                               implies `--comments'\n"
+  "  -w, --words                  diff comments word by word instead of\n"
+  "                               line by line; implies `--comments'\n"
+  "      --help                   display this help and exit\n";
 
 
 int
 main (int argc, char *argv[])
 {
   int result = 0;
+  SgfDiffParameters parameters = sgf_diff_defaults;
   SgfErrorList *error_list;
+  int option;
 
   utils_remember_program_name (argv[0]);
 
-  if (argc == 3) {
+  while ((option = getopt_long (argc, argv, "ca:w", sgf_diff_options, NULL))
+	 != -1) {
+    switch (option) {
+    case 'a':
+      if (strcmp (optarg, "myers") == 0)
+	parameters.text_diff_algorithm = SGF_TEXT_DIFF_MYERS;
+      else if (strcmp (optarg, "patience") == 0)
+	parameters.text_diff_algorithm = SGF_TEXT_DIFF_PATIENCE;
+      else if (strcmp (optarg, "histogram") == 0)
+	parameters.text_diff_algorithm = SGF_TEXT_DIFF_HISTOGRAM;
+      else {
+	fprintf (stderr, "%s: unknown diff algorithm `%s'\n",
+		 short_program_name, optarg);
+	result = 255;
+	goto exit_sgf_diff;
+      }
+
+      parameters.compare_comments = 1;
+      break;
+
+    case 'w':
+      parameters.diff_text_words = 1;
+
+      /* Fall through. */
+
+    case 'c':
+      parameters.compare_comments = 1;
+      break;
+
+    case OPTION_HELP:
+      printf (usage_string, full_program_name);
+      fputs (help_string, stdout);
+      goto exit_sgf_diff;
+
+    default:
+      result = 255;
+      break;
+    }
+
+    if (result)
+      break;
+  }
+
+  if (result == 0 && optind + 2 == argc) {
     SgfCollection *first_collection;
     SgfCollection *second_collection;
     SgfCollection *difference;
 
-    if (sgf_parse_file (argv[1], &first_collection, &error_list,
+    if (sgf_parse_file (argv[optind], &first_collection, &error_list,
 			&sgf_parser_defaults, NULL, NULL, NULL)
 	!= SGF_PARSED)
       assert (0);
@@ -48,7 +127,7 @@ main (int argc, char *argv[])
     if (error_list)
       string_list_delete (error_list);
 
-    if (sgf_parse_file (argv[2], &second_collection, &error_list,
+    if (sgf_parse_file (argv[optind + 1], &second_collection, &error_list,
 			&sgf_parser_defaults, NULL, NULL, NULL)
 	!= SGF_PARSED)
       assert (0);
@@ -57,7 +136,7 @@ main (int argc, char *argv[])
       string_list_delete (error_list);
 
 
-    difference = sgf_diff (first_collection, second_collection);
+    difference = sgf_diff (first_collection, second_collection, &parameters);
 
     sgf_collection_delete (first_collection);
     sgf_collection_delete (second_collection);
@@ -68,10 +147,13 @@ main (int argc, char *argv[])
     }
   }
   else {
-    fprintf (stderr, "Usage: %s FROM-FILE TO-FILE\n", argv[0]);
+    fprintf (stderr, usage_string, argv[0]);
+    fprintf (stderr, "Try `%s --help' for more information.\n", argv[0]);
     result = 255;
   }
 
+ exit_sgf_diff:
+
   utils_free_program_name_strings ();
 
 #if ENABLE_MEMORY_PROFILING
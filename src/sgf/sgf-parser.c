@@ -61,6 +61,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
@@ -77,7 +79,8 @@ static int	    parse_buffer (SgfParsingData *data,
 				  const SgfParserParameters *parameters,
 				  int *bytes_parsed,
 				  const int *cancellation_flag);
-static int	    parse_root (SgfParsingData *data);
+static int	    parse_root (SgfParsingData *data, off_t tree_offset);
+static void	    set_up_board (SgfParsingData *data);
 static SgfNode *    parse_node_tree (SgfParsingData *data, SgfNode *parent);
 static void	    parse_node_sequence (SgfParsingData *data, SgfNode *node);
 static void	    parse_property (SgfParsingData *data);
@@ -200,11 +203,11 @@ sgf_parse_file (const char *filename, SgfCollection **collection,
     if (fseek (file, 0, SEEK_END) != -1) {
       SgfParsingData parsing_data;
       int max_buffer_size = ROUND_UP (parameters->max_buffer_size, 4 * 1024);
-      int local_file_size;
+      off_t local_file_size;
       int buffer_size;
       char *buffer;
 
-      local_file_size = ftell (file);
+      local_file_size = ftello (file);
       if (local_file_size == 0) {
 	fclose (file);
 	return SGF_INVALID_FILE;
@@ -244,6 +247,17 @@ sgf_parse_file (const char *filename, SgfCollection **collection,
 
 	result = parse_buffer (&parsing_data, collection, error_list,
 			       parameters, bytes_parsed, cancellation_flag);
+
+	if (result == SGF_PARSED) {
+	  struct stat file_status;
+
+	  /* Remember the file for incremental saving. */
+	  if (fstat (fileno (file), &file_status) == 0
+	      && file_status.st_size == local_file_size) {
+	    sgf_collection_set_source_file (*collection, filename,
+					    &file_status);
+	  }
+	}
       }
 
      /* How is this a double free() ?
@@ -336,6 +350,7 @@ parse_buffer (SgfParsingData *data,
   data->zero_byte_error_position.line	  = 0;
 
   data->board = NULL;
+  data->common_marked_positions = NULL;
   data->error_list = *error_list;
 
   data->latin1_to_utf8 = iconv_open ("UTF-8", "ISO-8859-1");
@@ -344,8 +359,11 @@ parse_buffer (SgfParsingData *data,
   next_token (data);
 
   do {
+    off_t tree_offset;
+
     /* Skip any junk that might appear before game tree. */
     if (data->token == '(') {
+      tree_offset = CURRENT_OFFSET_IN_FILE (data) - 1;
       next_token (data);
       if (data->token != ';')
 	continue;
@@ -357,7 +375,7 @@ parse_buffer (SgfParsingData *data,
 
     /* Parse the tree. */
     data->tree = sgf_game_tree_new ();
-    if (parse_root (data))
+    if (parse_root (data, tree_offset))
       sgf_collection_add_game_tree (*collection, data->tree);
     else
       sgf_game_tree_delete (data->tree);
@@ -367,8 +385,10 @@ parse_buffer (SgfParsingData *data,
       iconv_close (data->tree_char_set_to_utf8);
   } while (data->token != SGF_END);
 
-  if (data->board)
+  if (data->board) {
     board_delete (data->board);
+    utils_free (data->common_marked_positions);
+  }
 
   iconv_close (data->latin1_to_utf8);
 
@@ -398,14 +418,19 @@ parse_buffer (SgfParsingData *data,
  * `GM' and `SZ' properties are crucial for property value validation.
  * The function does nothing but finding these properties (if they are
  * present at all).  Afterwards, root node is parsed as usually.
+ *
+ * `tree_offset' is the offset of the opening parenthesis of the tree
+ * in the file.  If the tree is parsed without any errors, its source
+ * byte range is stored, so that it can be copied verbatim on saving.
  */
 static int
-parse_root (SgfParsingData *data)
+parse_root (SgfParsingData *data, off_t tree_offset)
 {
   SgfGameTree *tree = data->tree;
   BufferPositionStorage storage;
 
-  data->tree_char_set_to_utf8 = data->latin1_to_utf8;
+  data->tree_char_set_to_utf8	 = data->latin1_to_utf8;
+  data->tree_differs_from_source = 0;
 
   STORE_BUFFER_POSITION (data, 1, storage);
 
@@ -525,26 +550,7 @@ parse_root (SgfParsingData *data)
       else
 	assert (0);
 
-      if (!data->board) {
-	data->board = board_new (data->game,
-				 data->board_width, data->board_height);
-      }
-      else {
-	board_set_parameters (data->board, data->game,
-			      data->board_width, data->board_height);
-      }
-
-      data->board_common_mark = 0;
-      data->board_change_mark = 0;
-      data->board_markup_mark = 0;
-      board_fill_uint_grid (data->board, data->common_marked_positions, 0);
-      board_fill_uint_grid (data->board, data->changed_positions, 0);
-      board_fill_uint_grid (data->board, data->marked_positions, 0);
-
-      if (data->game == GAME_GO) {
-	data->board_territory_mark = 0;
-	board_fill_uint_grid (data->board, data->territory_positions, 0);
-      }
+      set_up_board (data);
     }
   }
 
@@ -569,6 +575,11 @@ parse_root (SgfParsingData *data)
 
   if (data->token == SGF_END && !data->cancelled)
     add_error (data, SGF_CRITICAL_UNEXPECTED_END_OF_FILE);
+  else if (data->token == ')' && !data->tree_differs_from_source) {
+    tree->source_offset = tree_offset;
+    tree->source_length = CURRENT_OFFSET_IN_FILE (data) - tree_offset;
+  }
+
   next_token (data);
 
   if (tree->root) {
@@ -577,6 +588,8 @@ parse_root (SgfParsingData *data)
       SgfProperty **link;
       data->game_info_node = tree->root;
       if (!sgf_node_find_property (data->game_info_node, SGF_PLAYER_BLACK, &link)) {
+        /* The properties below are not in the file. */
+        tree->source_length = -1;
         *link = sgf_property_new (tree, SGF_PLAYER_BLACK, *link);
         (*link)->value.text = utils_cprintf("Unknown");
         *link = sgf_property_new (tree, SGF_PLAYER_WHITE, *link);
@@ -590,6 +603,50 @@ parse_root (SgfParsingData *data)
 }
 
 
+/* Create or resize `data->board' for the game and board dimensions of
+ * the tree being parsed.  Position grids are allocated for the same
+ * dimensions and reset.
+ */
+static void
+set_up_board (SgfParsingData *data)
+{
+  int grid_size = BOARD_GRID_SIZE_FOR (data->board_width,
+				       data->board_height);
+  int num_points = data->board_width * data->board_height;
+
+  if (!data->board) {
+    data->board = board_new (data->game,
+			     data->board_width, data->board_height);
+  }
+  else {
+    board_set_parameters (data->board, data->game,
+			  data->board_width, data->board_height);
+  }
+
+  data->common_marked_positions
+    = utils_realloc (data->common_marked_positions,
+		     (4 * grid_size * sizeof (unsigned int)
+		      + num_points * sizeof (int)));
+  data->changed_positions   = data->common_marked_positions + grid_size;
+  data->marked_positions    = data->changed_positions + grid_size;
+  data->territory_positions = data->marked_positions + grid_size;
+  data->board_positions	    = (int *) (data->territory_positions
+				       + grid_size);
+
+  data->board_common_mark = 0;
+  data->board_change_mark = 0;
+  data->board_markup_mark = 0;
+  board_fill_uint_grid (data->board, data->common_marked_positions, 0);
+  board_fill_uint_grid (data->board, data->changed_positions, 0);
+  board_fill_uint_grid (data->board, data->marked_positions, 0);
+
+  if (data->game == GAME_GO) {
+    data->board_territory_mark = 0;
+    board_fill_uint_grid (data->board, data->territory_positions, 0);
+  }
+}
+
+
 static SgfNode *
 parse_node_tree (SgfParsingData *data, SgfNode *parent)
 {
@@ -1056,22 +1113,40 @@ create_position_lists (SgfParsingData *data,
 		       const unsigned int marked_positions[BOARD_GRID_SIZE],
 		       unsigned int current_mark)
 {
-  int positions[NUM_SGF_MARKUPS][BOARD_MAX_POSITIONS];
+  int *positions = data->board_positions;
   int num_positions[NUM_SGF_MARKUPS];
+  int list_start[NUM_SGF_MARKUPS];
   int value;
   int x;
   int y;
+  int k;
 
   for (value = 0; value < num_properties; value++)
     num_positions[value] = 0;
 
+  /* Count positions with each value first, so that all the lists fit
+   * in one array with an entry per board point.
+   */
+  for (y = 0; y < data->board_height; y++) {
+    for (x = 0; x < data->board_width; x++) {
+      if (marked_positions[POSITION (x, y)] >= current_mark)
+	num_positions[marked_positions[POSITION (x, y)] - current_mark]++;
+    }
+  }
+
+  for (value = 0, k = 0; value < num_properties; value++) {
+    list_start[value] = k;
+    k += num_positions[value];
+    num_positions[value] = 0;
+  }
+
   for (y = 0; y < data->board_height; y++) {
     for (x = 0; x < data->board_width; x++) {
       int pos = POSITION (x, y);
 
       if (marked_positions[pos] >= current_mark) {
 	value = marked_positions[pos] - current_mark;
-	positions[value][num_positions[value]++] = pos;
+	positions[list_start[value] + num_positions[value]++] = pos;
       }
     }
   }
@@ -1079,7 +1154,8 @@ create_position_lists (SgfParsingData *data,
   for (value = 0; value < num_properties; value++) {
     if (num_positions[value] > 0) {
       BoardPositionList *position_list
-	= board_position_list_new (positions[value], num_positions[value]);
+	= board_position_list_new (positions + list_start[value],
+				   num_positions[value]);
 
       if (position_lists)
 	position_lists[value] = position_list;
@@ -2968,6 +3044,11 @@ insert_error_valist (SgfParsingData *data, SgfError error,
   SgfErrorListItem *error_item;
   StringBuffer buffer;
 
+  /* Parser has fixed something up, so the tree cannot be saved by
+   * copying its source.
+   */
+  data->tree_differs_from_source = 1;
+
   if (error != SGF_WARNING_ERROR_SUPPRESSED
       && data->times_error_reported[error] == MAX_TIMES_TO_REPORT_ERROR)
     return;
@@ -3274,6 +3355,8 @@ next_character (SgfParsingData *data)
 	  STORE_ERROR_POSITION (data, data->zero_byte_error_position);
 	}
 
+	data->tree_differs_from_source = 1;
+
 	while (data->buffer_pointer < data->buffer_end
 	       && *data->buffer_pointer == 0) {
 	  data->buffer_pointer++;
@@ -69,8 +69,8 @@ struct _SgfParsingData {
   iconv_t	       tree_char_set_to_utf8;
 
   FILE		      *file;
-  int		       file_bytes_remaining;
-  int		       buffer_offset_in_file;
+  off_t		       file_bytes_remaining;
+  off_t		       buffer_offset_in_file;
   int		      *bytes_parsed;
 
   int		       line;
@@ -79,6 +79,7 @@ struct _SgfParsingData {
   int		       first_column;
 
   int		       in_parse_root;
+  int		       tree_differs_from_source;
   SgfErrorList	      *error_list;
   char		       times_error_reported[SGF_NUM_ERRORS];
 
@@ -92,6 +93,12 @@ struct _SgfParsingData {
   int		       use_board;
   Board		      *board;
 
+  /* Scratch space for create_position_lists(), one entry per board
+   * point.  It is allocated for the dimensions of `board' in one block
+   * with the position grids below, see set_up_board().
+   */
+  int		      *board_positions;
+
   SgfNode	      *game_info_node;
 
   SgfGameTree	      *tree;
@@ -115,25 +122,25 @@ struct _SgfParsingData {
   SgfErrorPosition     zero_byte_error_position;
 
   unsigned int	       board_common_mark;
-  unsigned int	       common_marked_positions[BOARD_GRID_SIZE];
+  unsigned int	      *common_marked_positions;
 
   int		       has_any_setup_property;
   char		       has_setup_add_properties[NUM_ON_GRID_VALUES];
   int		       first_setup_add_property;
   unsigned int	       board_change_mark;
-  unsigned int	       changed_positions[BOARD_GRID_SIZE];
+  unsigned int	      *changed_positions;
 
   int		       has_any_markup_property;
   char		       has_markup_properties[NUM_SGF_MARKUPS];
   int		       first_markup_property;
   unsigned int	       board_markup_mark;
-  unsigned int	       marked_positions[BOARD_GRID_SIZE];
+  unsigned int	      *marked_positions;
 
   int		       has_any_territory_property;
   char		       has_territory_properties[NUM_COLORS];
   int		       first_territory_property;
   unsigned int	       board_territory_mark;
-  unsigned int	       territory_positions[BOARD_GRID_SIZE];
+  unsigned int	      *territory_positions;
 };
 
 
@@ -0,0 +1,362 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This file is part of Quarry.                                    *
+ *                                                                 *
+ * Copyright (C) 2006 Paul Pogonyshev.                             *
+ *                                                                 *
+ * This program is free software; you can redistribute it and/or   *
+ * modify it under the terms of the GNU General Public License as  *
+ * published by the Free Software Foundation; either version 2 of  *
+ * the License, or (at your option) any later version.             *
+ *                                                                 *
+ * This program is distributed in the hope that it will be useful, *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of  *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the   *
+ * GNU General Public License for more details.                    *
+ *                                                                 *
+ * You should have received a copy of the GNU General Public       *
+ * License along with this program; if not, write to the Free      *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,     *
+ * Boston, MA 02110-1301, USA.                                     *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Headless replaying of whole collections for gathering statistics.
+ * Unlike sgf_utils_descend_nodes(), this doesn't maintain board state
+ * or time control data and never modifies the trees, so trees are
+ * replayed in parallel, each worker thread owning one board.
+ */
+
+
+#include "sgf.h"
+#include "board.h"
+#include "game-info.h"
+#include "utils.h"
+
+#include <assert.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define REPLAY_THREADS_SUPPORTED	1
+#else
+#define REPLAY_THREADS_SUPPORTED	0
+#endif
+
+
+typedef struct _SgfReplayData	SgfReplayData;
+
+struct _SgfReplayData {
+  const SgfGameTree	    **trees;
+  int			      num_trees;
+
+  const SgfReplayParameters  *parameters;
+  SgfReplayCallback	      callback;
+  void			     *user_data;
+
+#if REPLAY_THREADS_SUPPORTED
+
+  /* All fields below are protected by the mutex. */
+  pthread_mutex_t	      mutex;
+
+  int			      next_tree_to_replay;
+  int			      num_nodes_replayed;
+
+#endif
+};
+
+
+static int	determine_num_threads (const SgfReplayParameters *parameters,
+				       int num_trees);
+
+#if REPLAY_THREADS_SUPPORTED
+
+static int	replay_trees_in_parallel (SgfReplayData *data,
+					  int num_threads);
+static void *	replay_game_trees_thread (void *replay_data);
+
+#endif
+
+static int	replay_game_tree (const SgfReplayData *data, Board **board,
+				  int tree_index);
+static void	play_node (Board *board, const SgfGameTree *tree,
+			   const SgfNode *node);
+
+
+const SgfReplayParameters sgf_replay_defaults = {
+  0,				/* Use as many threads as there are CPUs. */
+  0				/* Main lines only. */
+};
+
+
+/* Replay all game trees in `collection' and call `callback' for each
+ * node, right after the node's move or setup has been played on a
+ * board.  Trees of unsupported games are skipped.  Only main lines
+ * are replayed, unless `parameters->all_variations' is set, in which
+ * case nodes are visited in depth-first order, main variation first.
+ *
+ * Trees are replayed in parallel (if threads are supported), each one
+ * completely by one thread, but in no particular order.  Therefore,
+ * the callback must be reentrant.  The simplest way to collect
+ * statistics is to keep them per tree, indexed with
+ * `position->tree_index'.
+ *
+ * Return the total number of nodes replayed.
+ */
+int
+sgf_replay_collection (const SgfCollection *collection,
+		       const SgfReplayParameters *parameters,
+		       SgfReplayCallback callback, void *user_data)
+{
+  SgfReplayData data;
+  const SgfGameTree *tree;
+  int num_threads;
+  int num_nodes_replayed = 0;
+  int k;
+
+  assert (collection);
+  assert (parameters);
+  assert (callback);
+
+  data.num_trees  = collection->num_trees;
+  data.trees	  = utils_malloc (data.num_trees * sizeof (SgfGameTree *));
+  data.parameters = parameters;
+  data.callback	  = callback;
+  data.user_data  = user_data;
+
+  for (tree = collection->first_tree, k = 0; tree; tree = tree->next, k++)
+    data.trees[k] = tree;
+
+  num_threads = determine_num_threads (parameters, data.num_trees);
+
+#if REPLAY_THREADS_SUPPORTED
+
+  if (num_threads > 1)
+    num_nodes_replayed = replay_trees_in_parallel (&data, num_threads);
+
+#endif
+
+  if (num_threads <= 1) {
+    Board *board = NULL;
+
+    for (k = 0; k < data.num_trees; k++)
+      num_nodes_replayed += replay_game_tree (&data, &board, k);
+
+    if (board)
+      board_delete (board);
+  }
+
+  utils_free (data.trees);
+
+  return num_nodes_replayed;
+}
+
+
+static int
+determine_num_threads (const SgfReplayParameters *parameters, int num_trees)
+{
+#if REPLAY_THREADS_SUPPORTED
+
+  int num_threads = parameters->num_threads;
+
+  if (num_threads <= 0) {
+#if defined HAVE_UNISTD_H && defined _SC_NPROCESSORS_ONLN
+    num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+    num_threads = 1;
+#endif
+  }
+
+  return MAX (MIN (num_threads, num_trees), 1);
+
+#else
+
+  UNUSED (parameters);
+  UNUSED (num_trees);
+
+  return 1;
+
+#endif
+}
+
+
+#if REPLAY_THREADS_SUPPORTED
+
+
+/* Replay trees in `num_threads' worker threads, which take trees one
+ * at a time until there are none left.
+ */
+static int
+replay_trees_in_parallel (SgfReplayData *data, int num_threads)
+{
+  pthread_t *threads = utils_malloc (num_threads * sizeof (pthread_t));
+  int num_threads_started;
+  int k;
+
+  pthread_mutex_init (&data->mutex, NULL);
+
+  data->next_tree_to_replay = 0;
+  data->num_nodes_replayed  = 0;
+
+  for (num_threads_started = 0; num_threads_started < num_threads;
+       num_threads_started++) {
+    if (pthread_create (threads + num_threads_started, NULL,
+			replay_game_trees_thread, data) != 0)
+      break;
+  }
+
+  /* If no thread could be started, do all the work here. */
+  if (num_threads_started == 0)
+    replay_game_trees_thread (data);
+
+  for (k = 0; k < num_threads_started; k++)
+    pthread_join (threads[k], NULL);
+
+  pthread_mutex_destroy (&data->mutex);
+
+  utils_free (threads);
+
+  return data->num_nodes_replayed;
+}
+
+
+static void *
+replay_game_trees_thread (void *replay_data)
+{
+  SgfReplayData *data = (SgfReplayData *) replay_data;
+  Board *board = NULL;
+  int num_nodes_replayed = 0;
+
+  while (1) {
+    int tree_index;
+
+    pthread_mutex_lock (&data->mutex);
+    tree_index = data->next_tree_to_replay;
+    if (tree_index < data->num_trees)
+      data->next_tree_to_replay++;
+    pthread_mutex_unlock (&data->mutex);
+
+    if (tree_index == data->num_trees)
+      break;
+
+    num_nodes_replayed += replay_game_tree (data, &board, tree_index);
+  }
+
+  if (board)
+    board_delete (board);
+
+  pthread_mutex_lock (&data->mutex);
+  data->num_nodes_replayed += num_nodes_replayed;
+  pthread_mutex_unlock (&data->mutex);
+
+  return NULL;
+}
+
+
+#endif /* REPLAY_THREADS_SUPPORTED */
+
+
+/* Replay one tree on `*board', creating the board if it is NULL.
+ * Main lines are replayed in no-undo mode; for variations, moves are
+ * undone when going back up the tree.
+ */
+static int
+replay_game_tree (const SgfReplayData *data, Board **board, int tree_index)
+{
+  const SgfGameTree *tree = data->trees[tree_index];
+  int all_variations = data->parameters->all_variations;
+  SgfReplayPosition position;
+  const SgfNode *node;
+  int num_nodes = 0;
+
+  if (!GAME_IS_SUPPORTED (tree->game) || !tree->root)
+    return 0;
+
+  if (*board) {
+    board_set_parameters (*board, tree->game,
+			  tree->board_width, tree->board_height);
+  }
+  else
+    *board = board_new (tree->game, tree->board_width, tree->board_height);
+
+  board_set_no_undo_mode (*board, !all_variations);
+
+  position.tree	      = tree;
+  position.tree_index = tree_index;
+  position.board      = *board;
+  position.node_depth = 0;
+
+  node = tree->root;
+
+  while (1) {
+    play_node (*board, tree, node);
+    num_nodes++;
+
+    position.node = node;
+    data->callback (&position, data->user_data);
+
+    if (node->child) {
+      node = node->child;
+      position.node_depth++;
+      continue;
+    }
+
+    if (!all_variations)
+      break;
+
+    /* Go up until a node with an unvisited sibling is found. */
+    for (; node; node = node->parent, position.node_depth--) {
+      board_undo (*board, 1);
+      if (node->next)
+	break;
+    }
+
+    if (!node)
+      break;
+
+    node = node->next;
+  }
+
+  return num_nodes;
+}
+
+
+/* Play `node' on `board' the same way sgf_utils_descend_nodes() does.
+ * Each node pushes exactly one entry on the board's move stack.
+ */
+static void
+play_node (Board *board, const SgfGameTree *tree, const SgfNode *node)
+{
+  if (IS_STONE (node->move_color))
+    sgf_utils_play_node_move (node, board);
+  else if (node->move_color == SETUP_NODE) {
+    const BoardPositionList *position_lists[NUM_ON_GRID_VALUES];
+
+    position_lists[BLACK]
+      = sgf_node_get_list_of_point_property_value (node, SGF_ADD_BLACK);
+    position_lists[WHITE]
+      = sgf_node_get_list_of_point_property_value (node, SGF_ADD_WHITE);
+    position_lists[EMPTY]
+      = sgf_node_get_list_of_point_property_value (node, SGF_ADD_EMPTY);
+
+    if (tree->game == GAME_AMAZONS) {
+      position_lists[ARROW]
+	= sgf_node_get_list_of_point_property_value (node, SGF_ADD_ARROWS);
+    }
+    else
+      position_lists[ARROW] = NULL;
+
+    board_apply_changes (board, position_lists);
+  }
+  else
+    board_add_dummy_move_entry (board);
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,432 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This file is part of Quarry.                                    *
+ *                                                                 *
+ * Copyright (C) 2006 Paul Pogonyshev.                             *
+ *                                                                 *
+ * This program is free software; you can redistribute it and/or   *
+ * modify it under the terms of the GNU General Public License as  *
+ * published by the Free Software Foundation; either version 2 of  *
+ * the License, or (at your option) any later version.             *
+ *                                                                 *
+ * This program is distributed in the hope that it will be useful, *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of  *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the   *
+ * GNU General Public License for more details.                    *
+ *                                                                 *
+ * You should have received a copy of the GNU General Public       *
+ * License along with this program; if not, write to the Free      *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,     *
+ * Boston, MA 02110-1301, USA.                                     *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Replay all games in SGF files and dump statistics as CSV, either
+ * one line per game or one line per move.  What `black' and `white'
+ * counts mean depends on the game: prisoners in Go, disks on board in
+ * Reversi and estimated (queen distance) territory in Amazons.
+ */
+
+
+#include "sgf.h"
+#include "board.h"
+#include "game-info.h"
+#include "utils.h"
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+enum {
+  /* Options with no short equivalent. */
+  OPTION_HELP = UCHAR_MAX + 1
+};
+
+
+typedef struct _TreeStatistics	TreeStatistics;
+
+struct _TreeStatistics {
+  /* Totals over the main line only, even when all variations are
+   * replayed, so that they agree with the final counts.
+   */
+  int		    num_moves;
+  int		    num_captures[NUM_COLORS];
+  int		    num_kos;
+
+  /* Counts at the end of the main line.  Since variations are
+   * replayed depth first, main line nodes are exactly those replayed
+   * before its end is reached.
+   */
+  int		    final_counts[NUM_COLORS];
+  int		    reached_main_line_end;
+
+  /* Counts after each node on the path from the root to the current
+   * node, two per node.  Used to find per-move differences.
+   */
+  int		   *counts;
+  int		    num_counts_allocated;
+
+  /* CSV lines in per-move mode. */
+  StringBuffer	    move_lines;
+};
+
+
+typedef struct _StatisticsData	StatisticsData;
+
+struct _StatisticsData {
+  char		   *quoted_filename;
+  int		    per_move;
+  TreeStatistics   *trees;
+};
+
+
+static void	collect_node_statistics (const SgfReplayPosition *position,
+					 void *statistics_data);
+static void	get_counts (const Board *board, int counts[NUM_COLORS]);
+
+static void	print_statistics (const SgfCollection *collection,
+				  const StatisticsData *data);
+static char *	quote_csv_string (const char *string);
+
+
+static const struct option sgf_stats_options[] = {
+  { "all-variations",	no_argument,	   NULL, 'a'		},
+  { "moves",		no_argument,	   NULL, 'm'		},
+  { "threads",		required_argument, NULL, 'j'		},
+
+  { "help",		no_argument,	   NULL, OPTION_HELP	},
+
+  {  NULL,		no_argument,	   NULL, 0		}
+};
+
+static const char *usage_string =
+  "Usage: %s [OPTION...] FILE...\n";
+
+static const char *help_string =
+  "\n"
+  "  -a, --all-variations         replay all variations, not only main\n"
+  "                               lines\n"
+  "  -m, --moves                  output one line per move instead of\n"
+  "                               one line per game\n"
+  "  -j, --threads=NUMBER         number of threads to replay games in;\n"
+  "                               default is the number of processors\n"
+  "      --help                   display this help and exit\n"
+  "\n"
+  "Black and white counts are prisoners for Go, disks for Reversi and\n"
+  "estimated territory for Amazons.\n"
+  "\n"
+  "Columns in per-game mode (main line only, even with `--all-variations'):\n"
+  "  file, game                   file name and game number in it\n"
+  "  game_type, board_size        game and board size, e.g. `Go,19x19'\n"
+  "  moves                        number of moves (passes included)\n"
+  "  black_captures,              stones captured by black and white in\n"
+  "    white_captures             Go, disks flipped in Reversi; zero in\n"
+  "                               Amazons\n"
+  "  kos                          moves that took a ko (Go only)\n"
+  "  final_black, final_white     black and white counts at the end\n"
+  "\n"
+  "Columns in per-move mode (all replayed variations):\n"
+  "  file, game                   file name and game number in it\n"
+  "  depth                        node depth, zero for the root\n"
+  "  move_number                  move number on the board\n"
+  "  color, move                  `B' or `W' and the move played\n"
+  "  captures                     stones captured or disks flipped\n"
+  "  ko                           1 if the move took a ko, else 0\n"
+  "  black, white                 black and white counts after the move\n";
+
+
+int
+main (int argc, char *argv[])
+{
+  int result = 0;
+  SgfReplayParameters parameters = sgf_replay_defaults;
+  int per_move = 0;
+  int option;
+  int k;
+
+  utils_remember_program_name (argv[0]);
+
+  while ((option = getopt_long (argc, argv, "amj:", sgf_stats_options, NULL))
+	 != -1) {
+    switch (option) {
+    case 'a':
+      parameters.all_variations = 1;
+      break;
+
+    case 'm':
+      per_move = 1;
+      break;
+
+    case 'j':
+      parameters.num_threads = atoi (optarg);
+      if (parameters.num_threads < 1) {
+	fprintf (stderr, "%s: invalid number of threads `%s'\n",
+		 short_program_name, optarg);
+	result = 255;
+      }
+
+      break;
+
+    case OPTION_HELP:
+      printf (usage_string, full_program_name);
+      fputs (help_string, stdout);
+      goto exit_sgf_stats;
+
+    default:
+      result = 255;
+      break;
+    }
+
+    if (result)
+      break;
+  }
+
+  if (result == 0 && optind < argc) {
+    if (per_move) {
+      puts ("file,game,depth,move_number,color,move,captures,ko,"
+	    "black,white");
+    }
+    else {
+      puts ("file,game,game_type,board_size,moves,black_captures,"
+	    "white_captures,kos,final_black,final_white");
+    }
+
+    for (k = optind; k < argc; k++) {
+      SgfCollection *collection;
+      SgfErrorList *error_list;
+      StatisticsData data;
+      int i;
+
+      if (sgf_parse_file (argv[k], &collection, &error_list,
+			  &sgf_parser_defaults, NULL, NULL, NULL)
+	  != SGF_PARSED) {
+	fprintf (stderr, "%s: cannot parse `%s'\n",
+		 short_program_name, argv[k]);
+	result = 1;
+	continue;
+      }
+
+      if (error_list)
+	string_list_delete (error_list);
+
+      data.quoted_filename = quote_csv_string (argv[k]);
+      data.per_move	   = per_move;
+      data.trees	   = utils_malloc0 (collection->num_trees
+					    * sizeof (TreeStatistics));
+
+      for (i = 0; i < collection->num_trees; i++)
+	string_buffer_init (&data.trees[i].move_lines, 0x1000, 0x1000);
+
+      sgf_replay_collection (collection, &parameters,
+			     collect_node_statistics, &data);
+      print_statistics (collection, &data);
+
+      for (i = 0; i < collection->num_trees; i++) {
+	utils_free (data.trees[i].counts);
+	string_buffer_dispose (&data.trees[i].move_lines);
+      }
+
+      utils_free (data.trees);
+      utils_free (data.quoted_filename);
+
+      sgf_collection_delete (collection);
+    }
+  }
+  else if (result == 0) {
+    fprintf (stderr, usage_string, argv[0]);
+    fprintf (stderr, "Try `%s --help' for more information.\n", argv[0]);
+    result = 255;
+  }
+
+ exit_sgf_stats:
+
+  utils_free_program_name_strings ();
+
+#if ENABLE_MEMORY_PROFILING
+  utils_print_memory_profiling_info ();
+#endif
+
+  return result;
+}
+
+
+/* Replay callback.  Called from worker threads, but each tree is only
+ * replayed by one thread, so per-tree data needs no locking.
+ */
+static void
+collect_node_statistics (const SgfReplayPosition *position,
+			 void *statistics_data)
+{
+  const StatisticsData *data = (const StatisticsData *) statistics_data;
+  TreeStatistics *tree_statistics = data->trees + position->tree_index;
+  const SgfNode *node = position->node;
+  const Board *board = position->board;
+  int is_on_main_line = !tree_statistics->reached_main_line_end;
+  int *counts;
+
+  if (tree_statistics->num_counts_allocated
+      < 2 * (position->node_depth + 1)) {
+    tree_statistics->num_counts_allocated
+      = MAX (2 * tree_statistics->num_counts_allocated,
+	     2 * (position->node_depth + 1));
+    tree_statistics->counts
+      = utils_realloc (tree_statistics->counts,
+		       (tree_statistics->num_counts_allocated
+			* sizeof (int)));
+  }
+
+  counts = tree_statistics->counts + 2 * position->node_depth;
+  get_counts (board, counts);
+
+  if (IS_STONE (node->move_color) && position->node_depth > 0) {
+    const int *parent_counts = counts - 2;
+    int captures = 0;
+    int is_ko = 0;
+
+    if (board->game == GAME_GO) {
+      int k;
+
+      for (k = 0; k < NUM_COLORS; k++)
+	captures += counts[k] - parent_counts[k];
+
+      is_ko = (board->data.go.ko_master != EMPTY);
+    }
+    else if (board->game == GAME_REVERSI) {
+      int color_index = COLOR_INDEX (node->move_color);
+
+      /* Flipped disks, not counting the one just placed. */
+      captures = counts[color_index] - parent_counts[color_index] - 1;
+    }
+
+    if (is_on_main_line) {
+      tree_statistics->num_moves++;
+      tree_statistics->num_kos += is_ko;
+
+      if (board->game == GAME_GO) {
+	int k;
+
+	for (k = 0; k < NUM_COLORS; k++)
+	  tree_statistics->num_captures[k] += counts[k] - parent_counts[k];
+      }
+      else if (board->game == GAME_REVERSI)
+	tree_statistics->num_captures[COLOR_INDEX (node->move_color)]
+	  += captures;
+    }
+
+    if (data->per_move) {
+      StringBuffer *lines = &tree_statistics->move_lines;
+
+      string_buffer_printf (lines, "%s,%d,%d,%d,%c,",
+			    data->quoted_filename, position->tree_index + 1,
+			    position->node_depth, board->move_number,
+			    node->move_color == BLACK ? 'B' : 'W');
+      sgf_utils_format_node_move (position->tree, node, lines,
+				  NULL, NULL, "pass");
+      string_buffer_printf (lines, ",%d,%d,%d,%d\n",
+			    captures, is_ko, counts[BLACK_INDEX],
+			    counts[WHITE_INDEX]);
+    }
+  }
+
+  if (!node->child && is_on_main_line) {
+    tree_statistics->final_counts[BLACK_INDEX] = counts[BLACK_INDEX];
+    tree_statistics->final_counts[WHITE_INDEX] = counts[WHITE_INDEX];
+    tree_statistics->reached_main_line_end     = 1;
+  }
+}
+
+
+static void
+get_counts (const Board *board, int counts[NUM_COLORS])
+{
+  switch (board->game) {
+  case GAME_GO:
+    counts[BLACK_INDEX] = board->data.go.prisoners[BLACK_INDEX];
+    counts[WHITE_INDEX] = board->data.go.prisoners[WHITE_INDEX];
+    break;
+
+  case GAME_REVERSI:
+    reversi_count_disks (board, counts + BLACK_INDEX, counts + WHITE_INDEX);
+    break;
+
+  case GAME_AMAZONS:
+    amazons_estimate_territory (board, AMAZONS_QUEEN_DISTANCE, NULL,
+				counts + BLACK_INDEX, counts + WHITE_INDEX);
+    break;
+
+  default:
+    counts[BLACK_INDEX] = 0;
+    counts[WHITE_INDEX] = 0;
+  }
+}
+
+
+/* Print statistics in tree order, no matter in what order the trees
+ * have been replayed.
+ */
+static void
+print_statistics (const SgfCollection *collection,
+		  const StatisticsData *data)
+{
+  const SgfGameTree *tree;
+  int k;
+
+  for (tree = collection->first_tree, k = 0; tree; tree = tree->next, k++) {
+    const TreeStatistics *tree_statistics = data->trees + k;
+
+    if (!GAME_IS_SUPPORTED (tree->game))
+      continue;
+
+    if (data->per_move) {
+      fwrite (tree_statistics->move_lines.string, 1,
+	      tree_statistics->move_lines.length, stdout);
+    }
+    else {
+      printf ("%s,%d,%s,%dx%d,%d,%d,%d,%d,%d,%d\n",
+	      data->quoted_filename, k + 1, game_info[tree->game].name,
+	      tree->board_width, tree->board_height,
+	      tree_statistics->num_moves,
+	      tree_statistics->num_captures[BLACK_INDEX],
+	      tree_statistics->num_captures[WHITE_INDEX],
+	      tree_statistics->num_kos,
+	      tree_statistics->final_counts[BLACK_INDEX],
+	      tree_statistics->final_counts[WHITE_INDEX]);
+    }
+  }
+}
+
+
+/* Quote a string for CSV if it contains special characters.  Return a
+ * dynamically allocated string.
+ */
+static char *
+quote_csv_string (const char *string)
+{
+  StringBuffer buffer;
+  const char *scan;
+
+  if (!string[strcspn (string, ",\"\n\r")])
+    return utils_duplicate_string (string);
+
+  string_buffer_init (&buffer, 0x100, 0x100);
+  string_buffer_add_character (&buffer, '"');
+
+  for (scan = string; *scan; scan++) {
+    if (*scan == '"')
+      string_buffer_add_character (&buffer, '"');
+    string_buffer_add_character (&buffer, *scan);
+  }
+
+  string_buffer_add_character (&buffer, '"');
+
+  return string_buffer_steal_string (&buffer);
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -24,6 +24,12 @@
 #include "utils.h"
 
 #include <stdio.h>
+#include <string.h>
+
+
+static int	run_self_test (void);
+static int	set_comment_in_action (SgfGameTree *tree, const char *text);
+static int	comment_is (const SgfGameTree *tree, const char *text);
 
 
 int
@@ -36,7 +42,9 @@ main (int argc, char *argv[])
 
   utils_remember_program_name (argv[0]);
 
-  if (argc > 1) {
+  if (argc == 2 && strcmp (argv[1], "--self-test") == 0)
+    result = run_self_test ();
+  else if (argc > 1) {
     for (k = 1; k < argc; k++) {
       switch (sgf_parse_file (argv[k], &collection, &error_list,
 			      &sgf_parser_defaults, NULL, NULL, NULL)) {
@@ -80,7 +88,8 @@ main (int argc, char *argv[])
     }
   }
   else {
-    fprintf (stderr, "Usage: %s INFILE ...\n", argv[0]);
+    fprintf (stderr, "Usage: %s INFILE ...\n"
+	     "       %s --self-test\n", argv[0], argv[0]);
     result = 255;
   }
 
@@ -94,6 +103,91 @@ main (int argc, char *argv[])
 }
 
 
+/* Check undo history behaviour that parsing files doesn't exercise.
+ * Return zero on success.
+ */
+static int
+run_self_test (void)
+{
+  SgfCollection *collection = sgf_collection_new ();
+  SgfGameTree *tree = sgf_game_tree_new_with_root (GAME_GO, 19, 19, 0);
+  Board *board = board_new (GAME_GO, 19, 19);
+  SgfBoardState board_state;
+  int result = 0;
+
+  sgf_collection_add_game_tree (collection, tree);
+  sgf_utils_enter_tree (tree, board, &board_state);
+  tree->undo_history = sgf_undo_history_new (tree);
+
+  /* Typing a comment, the way the GUI does it.  Adding the comment is
+   * an undo step on its own, but the following single-change actions
+   * must be merged into one step, even though each of them nests an
+   * action inside sgf_utils_set_text_property().
+   */
+  if (!set_comment_in_action (tree, "a")
+      || !set_comment_in_action (tree, "ab")
+      || !set_comment_in_action (tree, "abc")) {
+    printf ("self-test: cannot set comment\n");
+    result = 1;
+  }
+  else {
+    sgf_utils_undo (tree);
+
+    if (!comment_is (tree, "a")) {
+      printf ("self-test: comment changes are not merged into one undo"
+	      " step\n");
+      result = 1;
+    }
+    else {
+      sgf_utils_redo (tree);
+
+      if (!comment_is (tree, "abc")) {
+	printf ("self-test: redoing merged comment changes failed\n");
+	result = 1;
+      }
+      else {
+	sgf_utils_undo (tree);
+	sgf_utils_undo (tree);
+
+	if (!comment_is (tree, NULL) || sgf_utils_can_undo (tree)) {
+	  printf ("self-test: undoing comment addition failed\n");
+	  result = 1;
+	}
+      }
+    }
+  }
+
+  sgf_collection_delete (collection);
+  board_delete (board);
+
+  return result;
+}
+
+
+static int
+set_comment_in_action (SgfGameTree *tree, const char *text)
+{
+  int result;
+
+  sgf_utils_begin_action (tree);
+  result = sgf_utils_set_text_property (tree->root, tree, SGF_COMMENT,
+					utils_duplicate_string (text), 0);
+  sgf_utils_end_action (tree);
+
+  return result;
+}
+
+
+static int
+comment_is (const SgfGameTree *tree, const char *text)
+{
+  const char *comment = sgf_node_get_text_property_value (tree->root,
+							   SGF_COMMENT);
+
+  return (text ? comment && strcmp (comment, text) == 0 : !comment);
+}
+
+
 /*
  * Local Variables:
  * tab-width: 8
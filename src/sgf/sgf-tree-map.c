@@ -29,9 +29,13 @@
  *   this data is later used to remap only necessary tree chunks
  *   instead of the whole tree.
  *
- * - update_internal_view_port() uses do_update_internal_view_port()
- *   to actually generate a rectangular piece of the map (view port),
- *   using the data previously stored by update_internal_map_data().
+ * - update_internal_view_port() generates a rectangular piece of the
+ *   map (view port) from spatial indices of the tree chunks it
+ *   overlaps.  A chunk's index is built by build_chunk_index() on
+ *   first query, using the data previously stored by
+ *   update_internal_map_data(), and is kept until the chunk is layed
+ *   out again.  Chunks that are only shifted by a map update keep
+ *   their indices.
  */
 
 
@@ -39,38 +43,37 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <limits.h>
 
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
 #endif
 
 
-/* Define to non-zero to make various functions report run times and
- * other performance information.
+/* Run times and layout counters of map functions that modify the
+ * tree are always accumulated in its `map_statistics'.  Define this
+ * to non-zero to make various functions also report run times and
+ * other performance information on each call.
  */
 #define REPORT_PERFORMANCE_STATISTICS	0
 
 
+#include <sys/time.h>
+
+
 #if REPORT_PERFORMANCE_STATISTICS
 
 
 #include <stdio.h>
-#include <sys/time.h>
 
 
-#define DECLARE_TIME_VARIABLES						\
-  struct timeval start_time;						\
-  struct timeval finish_time
+#define DECLARE_TIME_VARIABLES	double start_time
 
-#define STORE_STARTING_TIME	gettimeofday (&start_time, NULL)
+#define STORE_STARTING_TIME	start_time = get_current_time ()
 
 #define PRINT_RUN_TIME(function_name)					\
-  do {									\
-    gettimeofday (&finish_time, NULL);					\
-    fprintf (stderr, "Time spent in " #function_name "(): %f\n",	\
-	     ((finish_time.tv_usec - start_time.tv_usec) * 0.000001	\
-	      + (finish_time.tv_sec - start_time.tv_sec)));		\
-  } while (0)
+  fprintf (stderr, "Time spent in " #function_name "(): %f\n",		\
+	   get_current_time () - start_time)
 
 
 #else /* not REPORT_PERFORMANCE_STATISTICS */
@@ -82,7 +85,7 @@
 #endif /* not REPORT_PERFORMANCE_STATISTICS */
 
 
-#define MIN_NODES_PER_DATA_CHUNK	0x4000
+#define MIN_NODES_PER_DATA_CHUNK	0x1000
 
 
 #define Y_LEVEL_ARRAY_INITIAL_SIZE	0x400
@@ -91,6 +94,14 @@
 #define Y_LEVEL_ARRAY_SIZE_GRAIN	0x400
 
 
+/* Maximal width and height of a spatial index item.  Lines are split
+ * into pieces that fit into this size.
+ */
+#define MAP_INDEX_ITEM_EXTENT		0x20
+
+#define MAP_INDEX_INITIAL_NUM_ITEMS	0x100
+
+
 #define VIEW_PORT_NODE(tree, x, y)				\
   ((tree)->view_port_nodes					\
    + (((y) - (tree)->view_port_y0)				\
@@ -101,6 +112,45 @@
   (((tree)->view_port_x1 - (tree)->view_port_x0) - (width))
 
 
+typedef struct _SgfGameTreeMapIndexItem	SgfGameTreeMapIndexItem;
+
+/* An item is either a horizontal run of nodes, each being the first
+ * child of the previous one, from (`x0', `y0') to (`x3', `y0'), or a
+ * piece of a connection line (then `node' is NULL.)
+ */
+struct _SgfGameTreeMapIndexItem {
+  SgfGameTreeMapLine	    line;
+  SgfNode		   *node;
+};
+
+struct _SgfGameTreeMapIndex {
+  /* Sorted by row (`y0' divided by `MAP_INDEX_ITEM_EXTENT') and then
+   * by `x0'.
+   */
+  SgfGameTreeMapIndexItem  *items;
+  int			    num_items;
+
+  /* Items with nodes, sorted by node address. */
+  SgfGameTreeMapIndexItem **runs;
+  int			    num_runs;
+
+  /* Value of the chunk start's `y_level' at `chunk_lowest_x' at the
+   * time the index was built.
+   */
+  int			    y_base;
+};
+
+typedef struct _MapIndexBuilder	MapIndexBuilder;
+
+struct _MapIndexBuilder {
+  SgfGameTreeMapIndex	   *index;
+  int			    num_items_allocated;
+
+  int			    last_run;
+  const SgfNode		   *last_run_node;
+};
+
+
 static SgfGameTreeMapData *  find_intermediate_data_for_node
 			       (const SgfGameTree *tree, const SgfNode *node,
 				int strictly_before_node);
@@ -111,78 +161,133 @@ static int		     view_port_is_after_data_point
 static int		     view_port_is_before_data_point
 			       (const SgfGameTree *tree,
 				const SgfGameTreeMapData *intermediate_data);
+static int		     chunk_misses_view_port
+			       (const SgfGameTree *tree,
+				const SgfGameTreeMapData *chunk_start,
+				const SgfGameTreeMapData *chunk_end);
 
 static void		     free_map_data_point
 			       (SgfGameTreeMapData *data_point);
+static void		     free_map_data_points_in_subtree
+			       (SgfGameTree *tree, SgfNode *subtree_root);
+static SgfGameTreeMapData *  take_old_data_point
+			       (SgfGameTreeMapData **data_list,
+				SgfNode *node);
+
+static double		     get_current_time (void);
+
+static int		     node_is_layed_out (const SgfGameTree *tree,
+						const SgfNode *node);
 
-static void		     update_internal_map_data (SgfGameTree *tree);
+static int		     update_internal_map_data
+			       (SgfGameTree *tree, int max_nodes_to_lay_out);
 
 static void		     update_internal_view_port (SgfGameTree *tree,
 							int view_port_x0,
 							int view_port_y0,
 							int view_port_x1,
 							int view_port_y1);
-static SgfGameTreeMapLine *  do_update_internal_view_port
+static SgfGameTreeMapLine *  fill_view_port_from_index
+			       (SgfGameTree *tree,
+				SgfGameTreeMapData *intermediate_data,
+				SgfGameTreeMapLine *line_pointer,
+				int *num_lines_allocated);
+static int		     line_is_within_view_port
 			       (const SgfGameTree *tree,
-				const SgfGameTreeMapData *intermediate_data,
-				SgfGameTreeMapLine *line_pointer);
+				const SgfGameTreeMapLine *line, int y_shift);
 static int		     get_node_coordinates (SgfGameTree *tree,
 						   const SgfNode *node_to_find,
 						   int *node_x, int *node_y);
 
+static const SgfGameTreeMapIndex *
+			     get_chunk_index
+			       (SgfGameTree *tree,
+				SgfGameTreeMapData *intermediate_data);
+static int		     get_chunk_y_shift
+			       (const SgfGameTreeMapData *intermediate_data,
+				const SgfGameTreeMapIndex *index);
+static void		     free_chunk_index (SgfGameTreeMapIndex *index);
+
+static int		     map_index_item_is_before
+			       (const SgfGameTreeMapIndexItem *item,
+				int row, int x);
+static int		     compare_map_index_items (const void *first_item,
+						      const void *second_item);
+static int		     compare_map_index_runs (const void *first_run,
+						     const void *second_run);
+
+static SgfGameTreeMapIndexItem *
+			     add_index_item (MapIndexBuilder *builder);
+static void		     add_node_to_index (MapIndexBuilder *builder,
+						SgfNode *node, int x, int y);
+static void		     add_line_piece_to_index
+			       (MapIndexBuilder *builder,
+				int x0, int y0, int y1, int x2, int x3);
+static void		     add_line_to_index
+			       (MapIndexBuilder *builder,
+				const SgfGameTreeMapLine *line);
+static SgfGameTreeMapIndex * build_chunk_index
+			       (const SgfGameTree *tree,
+				const SgfGameTreeMapData *intermediate_data);
 
-/* Invalidate `tree's map or a portion of it.  If `node' is non-NULL,
- * assume that the map remains valid everywhere _before_ the node (in
- * sgf_node_traverse_backward() sense) and invalidate the rest.  If
- * `node' is NULL (or equals to `tree->root'), invalidate the entire
- * map.
+
+/* Invalidate `tree's map or a portion of it.  If `node' is NULL (or
+ * equals to `tree->root'), invalidate the entire map.  Otherwise,
+ * assume that only `node' and its subtree have changed.  When a node
+ * is about to be removed from the tree, this function must be called
+ * for it _before_ unlinking it.
+ *
+ * This only marks the map chunk containing `node' as modified and
+ * drops any chunk boundaries within `node's subtree.  Actual work is
+ * done when the map is next requested, see update_internal_map_data().
  *
  * Invalidating entire map always frees all allocated memory.
  */
 void
 sgf_game_tree_invalidate_map (SgfGameTree *tree, SgfNode *node)
 {
+  SgfGameTreeMapData *modified_chunk = NULL;
+
   assert (tree);
 
-  if (tree->map_data_list) {
-    SgfGameTreeMapData *last_valid_data_point
-      = (node ? find_intermediate_data_for_node (tree, node, 1) :NULL);
+  tree->map_is_valid	    = 0;
+  tree->map_layout_frontier = NULL;
 
-    if (last_valid_data_point) {
-      SgfGameTreeMapData *data_point;
-      int invalidate_view_port = 0;
-
-      if (last_valid_data_point != tree->last_valid_data_point) {
-	for (data_point = last_valid_data_point->next;
-	     data_point != tree->last_valid_data_point;
-	     data_point = data_point->next) {
-	  utils_free (data_point->y_level);
-	  data_point->y_level = NULL;
-	}
+  if (!node || node == tree->root) {
+    free_map_data_point (tree->map_data_list);
+    tree->map_data_list = NULL;
 
-	tree->last_valid_data_point = last_valid_data_point;
+    tree->map_first_chunk_is_modified = 1;
+  }
+  else if (tree->map_data_list) {
+    free_map_data_points_in_subtree (tree, node);
 
-	if (tree->view_port_nodes) {
-	  invalidate_view_port
-	    = !view_port_is_before_data_point (tree, last_valid_data_point);
-	}
-      }
+    modified_chunk = find_intermediate_data_for_node (tree, node, 1);
+    if (modified_chunk) {
+      modified_chunk->chunk_is_modified = 1;
 
-      if (!invalidate_view_port)
-	return;
-    }
-    else {
-      free_map_data_point (tree->map_data_list);
-      tree->map_data_list = NULL;
+      free_chunk_index (modified_chunk->chunk_index);
+      modified_chunk->chunk_index = NULL;
     }
+    else
+      tree->map_first_chunk_is_modified = 1;
   }
 
-  /* Invalidate the view port. */
-  utils_free (tree->view_port_nodes);
-  utils_free (tree->view_port_lines);
+  if (tree->map_first_chunk_is_modified) {
+    free_chunk_index (tree->map_first_chunk_index);
+    tree->map_first_chunk_index = NULL;
+  }
 
-  tree->view_port_nodes = NULL;
-  tree->view_port_lines = NULL;
+  if (!modified_chunk
+      || (tree->view_port_nodes
+	  && !view_port_is_before_data_point (tree, modified_chunk))) {
+    /* Invalidate the view port. */
+    utils_free (tree->view_port_nodes);
+    utils_free (tree->view_port_lines);
+
+    tree->view_port_nodes = NULL;
+    tree->view_port_lines = NULL;
+  }
 }
 
 
@@ -193,14 +298,84 @@ sgf_game_tree_get_map_dimensions (SgfGameTree *tree,
   assert (tree);
 
   if (map_width || map_height) {
-    update_internal_map_data (tree);
+    int width;
+    int height;
+
+    if (!tree->map_layout_is_deferred)
+      update_internal_map_data (tree, INT_MAX);
+
+    if (tree->map_is_valid) {
+      width  = tree->map_width;
+      height = tree->map_height;
+    }
+    else if (tree->map_layout_frontier) {
+      /* Dimensions of the layed out part.  Note that `map_width' and
+       * `map_height' must keep values of the last complete layout,
+       * since update_internal_map_data() may need them.
+       */
+      const SgfGameTreeMapData *frontier = tree->map_layout_frontier;
+
+      width  = frontier->largest_x_so_far + 1;
+      height = frontier->y_level[frontier->last_valid_y_level] + 1;
+    }
+    else {
+      /* Nothing is layed out yet. */
+      width  = 1;
+      height = 1;
+    }
 
     if (map_width)
-      *map_width = tree->map_width;
+      *map_width = width;
 
     if (map_height)
-      *map_height = tree->map_height;
+      *map_height = height;
+  }
+}
+
+
+/* Lay out `tree's map in small steps, so that a huge tree doesn't
+ * block the caller for long.  Each call continues from where the
+ * previous one stopped and lays out about `max_nodes_to_lay_out'
+ * nodes (a chunk is never split.)  Return non-zero once the map is
+ * complete.
+ *
+ * This is the only map function that may be called from a thread
+ * other than the one owning the tree.  The owner must then make sure
+ * that the tree is not modified and no other map function is called
+ * on it concurrently.
+ */
+int
+sgf_game_tree_update_map_partially (SgfGameTree *tree,
+				    int max_nodes_to_lay_out)
+{
+  assert (tree);
+  assert (max_nodes_to_lay_out > 0);
+
+  return update_internal_map_data (tree, max_nodes_to_lay_out);
+}
+
+
+/* Turn deferred map layout on or off.  While it is on, map functions
+ * never lay out the map themselves and, until the layout is complete,
+ * only present the part of it, already computed by
+ * sgf_game_tree_update_map_partially().  Map dimensions are those of
+ * that part, too.
+ */
+void
+sgf_game_tree_set_map_layout_deferred (SgfGameTree *tree, int is_deferred)
+{
+  assert (tree);
+
+  if (!is_deferred && tree->map_layout_is_deferred && !tree->map_is_valid) {
+    /* The view port is likely incomplete. */
+    utils_free (tree->view_port_nodes);
+    utils_free (tree->view_port_lines);
+
+    tree->view_port_nodes = NULL;
+    tree->view_port_lines = NULL;
   }
+
+  tree->map_layout_is_deferred = (is_deferred != 0);
 }
 
 
@@ -257,9 +432,16 @@ sgf_game_tree_fill_map_view_port (SgfGameTree *tree,
     }
   }
 
-  *view_port_lines = utils_duplicate_buffer (tree->view_port_lines,
-					     (tree->num_view_port_lines
-					      * sizeof (SgfGameTreeMapLine)));
+  if (tree->num_view_port_lines > 0) {
+    *view_port_lines = utils_duplicate_buffer (tree->view_port_lines,
+					       (tree->num_view_port_lines
+						* sizeof (SgfGameTreeMapLine)));
+  }
+  else {
+    /* Possible with a partially layed out map. */
+    *view_port_lines = NULL;
+  }
+
   *num_view_port_lines = tree->num_view_port_lines;
 }
 
@@ -358,28 +540,16 @@ sgf_game_tree_get_node_coordinates (SgfGameTree *tree, const SgfNode *node,
   assert (node_x);
   assert (node_y);
 
-  /* First try simple solution. */
-  if (tree->view_port_nodes
-      && sgf_game_tree_node_is_within_view_port (tree, node,
-						 tree->view_port_x0,
-						 tree->view_port_y0,
-						 tree->view_port_x1,
-						 tree->view_port_y1,
-						 node_x, node_y))
-    return 1;
-
   return get_node_coordinates (tree, node, node_x, node_y);
 }
 
 
 /* Check if the given `node' is within specified map view port and
  * return non-zero if it is.  If `node_x' and `node_y' are non-NULL,
- * `node's coordinates are stored in them.
+ * `node's coordinates are stored in them in this case.
  *
- * It is legal to call this function with a different from current
- * view port, but this is not very efficient, as it will force view
- * port update.  You should probably use
- * sgf_game_tree_get_node_coordinates() instead in such cases.
+ * This doesn't update the view port, so any view port can be checked
+ * at the cost of sgf_game_tree_get_node_coordinates().
  */
 int
 sgf_game_tree_node_is_within_view_port (SgfGameTree *tree, const SgfNode *node,
@@ -387,8 +557,6 @@ sgf_game_tree_node_is_within_view_port (SgfGameTree *tree, const SgfNode *node,
 					int view_port_x1, int view_port_y1,
 					int *node_x, int *node_y)
 {
-  const SgfNode *const *view_port_scan;
-  int view_port_width = view_port_x1 - view_port_x0;
   int x;
   int y;
 
@@ -397,34 +565,22 @@ sgf_game_tree_node_is_within_view_port (SgfGameTree *tree, const SgfNode *node,
   assert (0 <= view_port_x0 && view_port_x0 < view_port_x1);
   assert (0 <= view_port_y0 && view_port_y0 < view_port_y1);
 
-  update_internal_view_port (tree,
-			     view_port_x0, view_port_y0,
-			     view_port_x1, view_port_y1);
-
-  for (view_port_scan = ((const SgfNode *const *)
-			 VIEW_PORT_NODE (tree, view_port_x0, view_port_y0)),
-	 y = view_port_y0;
-       y < view_port_y1;
-       view_port_scan += VIEW_PORT_LINE_ADJUSTMENT (tree, view_port_width),
-	 y++) {
-    for (x = view_port_x0; x < view_port_x1; x++) {
-      if (*view_port_scan++ == node) {
-	if (node_x)
-	  *node_x = x;
+  if (!get_node_coordinates (tree, node, &x, &y)
+      || x < view_port_x0 || x >= view_port_x1
+      || y < view_port_y0 || y >= view_port_y1)
+    return 0;
 
-	if (node_y)
-	  *node_y = y;
+  if (node_x)
+    *node_x = x;
 
-	return 1;
-      }
-    }
-  }
+  if (node_y)
+    *node_y = y;
 
-  return 0;
+  return 1;
 }
 
 
-
+
 
 static SgfGameTreeMapData *
 find_intermediate_data_for_node (const SgfGameTree *tree, const SgfNode *node,
@@ -451,7 +607,7 @@ find_intermediate_data_for_node (const SgfGameTree *tree, const SgfNode *node,
       while (previous_child->next != node)
 	previous_child = previous_child->next;
 
-      for (node = previous_child; node->child; ) {
+      for (node = previous_child; node->child && !node->is_collapsed; ) {
 	node = node->child;
 	while (node->next)
 	  node = node->next;
@@ -460,14 +616,55 @@ find_intermediate_data_for_node (const SgfGameTree *tree, const SgfNode *node,
   }
 
   for (intermediate_data = tree->map_data_list;
-       (intermediate_data != tree->last_valid_data_point
-	&& intermediate_data->node != node);)
+       intermediate_data->node != node;)
     intermediate_data = intermediate_data->next;
 
   return intermediate_data;
 }
 
 
+static double
+get_current_time (void)
+{
+  struct timeval current_time;
+
+  gettimeofday (&current_time, NULL);
+  return current_time.tv_sec + current_time.tv_usec * 0.000001;
+}
+
+
+/* Determine if `node' is in the already layed out part of a partial
+ * map, i.e. before the chunk starting at `map_layout_frontier'.
+ */
+static int
+node_is_layed_out (const SgfGameTree *tree, const SgfNode *node)
+{
+  const SgfGameTreeMapData *intermediate_data;
+  const SgfGameTreeMapData *scan;
+
+  if (tree->map_is_valid)
+    return 1;
+
+  if (!tree->map_layout_frontier)
+    return 0;
+
+  intermediate_data = find_intermediate_data_for_node (tree, node, 0);
+  if (!intermediate_data)
+    return 1;
+
+  if (intermediate_data == tree->map_layout_frontier)
+    return node == intermediate_data->node;
+
+  for (scan = tree->map_data_list; scan != intermediate_data;
+       scan = scan->next) {
+    if (scan == tree->map_layout_frontier)
+      return 0;
+  }
+
+  return 1;
+}
+
+
 static int
 view_port_is_after_data_point (const SgfGameTree *tree,
 			       const SgfGameTreeMapData *intermediate_data)
@@ -490,6 +687,9 @@ view_port_is_after_data_point (const SgfGameTree *tree,
 }
 
 
+/* Note that nodes after the data point all lie below its `y_level',
+ * but connection lines to them may start right at `y_level' row.
+ */
 static int
 view_port_is_before_data_point (const SgfGameTree *tree,
 				const SgfGameTreeMapData *intermediate_data)
@@ -499,12 +699,33 @@ view_port_is_before_data_point (const SgfGameTree *tree,
 
   if (tree->view_port_x0 > last_valid_y_level) {
     return (tree->view_port_y1
-	    <= intermediate_data->y_level[last_valid_y_level] + 1);
+	    <= intermediate_data->y_level[last_valid_y_level]);
   }
 
   for (x = tree->view_port_x0;
        x < tree->view_port_x1 && x <= last_valid_y_level; x++) {
-    if (tree->view_port_y1 > intermediate_data->y_level[x] + 1)
+    if (tree->view_port_y1 > intermediate_data->y_level[x])
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/* Determine if the chunk between the two data points has no nodes or
+ * lines within the view port.  Any node layed out in a column raises
+ * `y_level' at that column, and `y_level' never decreases.
+ */
+static int
+chunk_misses_view_port (const SgfGameTree *tree,
+			const SgfGameTreeMapData *chunk_start,
+			const SgfGameTreeMapData *chunk_end)
+{
+  int x;
+
+  for (x = MAX (tree->view_port_x0 - 1, 0); x <= tree->view_port_x1; x++) {
+    if (chunk_start->y_level[MIN (x, chunk_start->last_valid_y_level)]
+	!= chunk_end->y_level[MIN (x, chunk_end->last_valid_y_level)])
       return 0;
   }
 
@@ -520,6 +741,7 @@ free_map_data_point (SgfGameTreeMapData *data_point)
 
     data_point->node->has_intermediate_map_data = 0;
 
+    free_chunk_index (data_point->chunk_index);
     utils_free (data_point->y_level);
     utils_free (data_point);
 
@@ -528,12 +750,97 @@ free_map_data_point (SgfGameTreeMapData *data_point)
 }
 
 
+/* Free data points of all visible nodes in `subtree_root's subtree,
+ * including the node itself.  Children of `subtree_root' are scanned
+ * even if it is collapsed, since this might have just happened.
+ */
+static void
+free_map_data_points_in_subtree (SgfGameTree *tree, SgfNode *subtree_root)
+{
+  SgfNode *node = subtree_root;
+
+  while (1) {
+    if (node->has_intermediate_map_data) {
+      SgfGameTreeMapData **link = &tree->map_data_list;
+      SgfGameTreeMapData *data_point;
+
+      while ((*link)->node != node)
+	link = & (*link)->next;
+
+      data_point       = *link;
+      *link	       = data_point->next;
+      data_point->next = NULL;
+
+      free_map_data_point (data_point);
+    }
+
+    if (node->child && (!node->is_collapsed || node == subtree_root))
+      node = node->child;
+    else {
+      while (node != subtree_root && !node->next)
+	node = node->parent;
+
+      if (node == subtree_root)
+	return;
+
+      node = node->next;
+    }
+  }
+}
+
+
+/* Find the data point for `node' in the `data_list' left from the
+ * previous map layout, remove it from the list and return.  All data
+ * points before it in the list are freed: their nodes are not leaves
+ * of the map anymore.  If there is no such data point, return NULL.
+ */
+static SgfGameTreeMapData *
+take_old_data_point (SgfGameTreeMapData **data_list, SgfNode *node)
+{
+  SgfGameTreeMapData *data_point;
+  SgfGameTreeMapData *previous_data_point = NULL;
+
+  for (data_point = *data_list; data_point; data_point = data_point->next) {
+    if (data_point->node == node) {
+      if (previous_data_point) {
+	previous_data_point->next = NULL;
+	free_map_data_point (*data_list);
+      }
+
+      *data_list = data_point->next;
+      return data_point;
+    }
+
+    previous_data_point = data_point;
+  }
+
+  node->has_intermediate_map_data = 0;
+  return NULL;
+}
+
+
 /* Recompute map width and height and, maybe, internal data, if the
  * tree is large enough.  The algorithm is explained in the comments
  * in the function.
+ *
+ * Data points left from the previous run split the tree into chunks.
+ * Layout of a chunk depends only on the chunk itself and on `y_level'
+ * array at the chunk's start.  So, if a chunk is not modified and the
+ * `y_level' elements it uses differ from the stored ones by a
+ * constant, the whole chunk is just shifted by that constant.  In
+ * this case we skip it, computing `y_level' at its end from the
+ * stored data.  Thus, after a local modification, we only lay out
+ * the modified chunk, plus one `y_level' update per following chunk.
+ *
+ * Once at least `max_nodes_to_lay_out' nodes are layed out, we stop at
+ * the next chunk boundary.  The data point there is stored as
+ * `map_layout_frontier' and marked modified, while the data points
+ * after it are kept.  Next run then skips all chunks up to the
+ * frontier as unmodified and continues from it.  Return non-zero if
+ * the map is complete.
  */
-static void
-update_internal_map_data (SgfGameTree *tree)
+static int
+update_internal_map_data (SgfGameTree *tree, int max_nodes_to_lay_out)
 {
   SgfNode *node;
   int node_count;
@@ -542,65 +849,89 @@ update_internal_map_data (SgfGameTree *tree)
   int *y_level;
   int y_level_array_size;
   int last_valid_y_level;
+  int chunk_lowest_x = INT_MAX;
+  int chunk_largest_x = 0;
+  SgfGameTreeMapData *old_data_list;
+  SgfGameTreeMapData *chunk_data = NULL;
+  SgfGameTreeMapData *data_point;
   SgfGameTreeMapData **intermediate_data_link;
-  DECLARE_TIME_VARIABLES;
+  int num_layed_out_nodes = 0;
+  int num_reused_chunks	  = 0;
+  double start_time;
+  double run_time;
 
-  STORE_STARTING_TIME;
-
-  if (tree->map_data_list && !tree->last_valid_data_point) {
+  if (tree->map_is_valid) {
     /* Nothing to update, everything is valid. */
-    return;
+    return 1;
+  }
+
+  start_time = get_current_time ();
+
+  if (tree->map_layout_is_deferred && tree->view_port_nodes) {
+    /* The view port was built from a partial map. */
+    utils_free (tree->view_port_nodes);
+    utils_free (tree->view_port_lines);
+
+    tree->view_port_nodes = NULL;
+    tree->view_port_lines = NULL;
   }
 
-  if (tree->map_data_list) {
-    /* We have at least some chunks of intermediate data left from a
-     * previous run.  Skip corresponding part of the tree.
+  tree->map_layout_frontier = NULL;
+
+  /* Build a new list of data points, reusing the old ones whenever
+   * the layout passes their nodes.
+   */
+  old_data_list		 = tree->map_data_list;
+  tree->map_data_list	 = NULL;
+  intermediate_data_link = &tree->map_data_list;
+
+  y_level_array_size = Y_LEVEL_ARRAY_INITIAL_SIZE;
+
+  if (old_data_list && !tree->map_first_chunk_is_modified) {
+    /* The first chunk hasn't changed, so we can start right at the
+     * first data point.
      */
-    last_valid_y_level = tree->last_valid_data_point->last_valid_y_level;
+    data_point	       = old_data_list;
+    old_data_list      = data_point->next;
+
+    last_valid_y_level = data_point->last_valid_y_level;
     y_level_array_size = ROUND_UP (last_valid_y_level + 1,
 				   Y_LEVEL_ARRAY_SIZE_GRAIN);
     y_level	       = utils_malloc (y_level_array_size * sizeof (int));
-    memcpy (y_level, tree->last_valid_data_point->y_level,
+    memcpy (y_level, data_point->y_level,
 	    (last_valid_y_level + 1) * sizeof (int));
 
-    node	       = tree->last_valid_data_point->node;
-    x		       = tree->last_valid_data_point->x;
-    largest_x_so_far   = tree->last_valid_data_point->largest_x_so_far;
-
+    node	       = data_point->node;
+    x		       = data_point->x;
+    largest_x_so_far   = data_point->largest_x_so_far;
     node_count	       = 0;
 
-    intermediate_data_link = &tree->last_valid_data_point->next;
-
-    /* Maybe there are leftovers of invalidated data. */
-    free_map_data_point (*intermediate_data_link);
+    goto reached_old_data_point;
   }
-  else {
-    /* We have no data left from the previous run or there was no
-     * previous run at all.  Start from scratch.
-     */
-    y_level_array_size = Y_LEVEL_ARRAY_INITIAL_SIZE;
-    y_level	       = utils_malloc (y_level_array_size * sizeof (int));
-    y_level[0]	       = 0;
-    last_valid_y_level = 0;
 
-    /* First scan the tree ``trunk'', i.e. the main variation.  It is
-     * a little different from all else variations in that starting
-     * `x' is zero.  So it is broken out of the main loop below.
-     */
-    node = tree->root;
-    x    = 0;
+  /* Start from scratch.  First scan the tree ``trunk'', i.e. the main
+   * variation.  It is a little different from all else variations in
+   * that starting `x' is zero.  So it is broken out of the main loop
+   * below.
+   */
+  y_level	     = utils_malloc (y_level_array_size * sizeof (int));
+  y_level[0]	     = 0;
+  last_valid_y_level = 0;
 
-    while (node->child && !node->is_collapsed) {
-      node = node->child;
-      x++;
-    }
+  free_chunk_index (tree->map_first_chunk_index);
+  tree->map_first_chunk_index = NULL;
 
-    largest_x_so_far = x;
-    node_count	     = x + 1;
+  node = tree->root;
+  x    = 0;
 
-    intermediate_data_link = &tree->map_data_list;
+  while (node->child && !node->is_collapsed) {
+    node = node->child;
+    x++;
   }
 
+  largest_x_so_far = x;
+  node_count	   = x + 1;
+
   while (1) {
     /* Find the next branch fork by ascending the last layed out
      * branch in the root direction.
@@ -618,6 +949,12 @@ update_internal_map_data (SgfGameTree *tree)
     node = node->next;
     node_count++;
 
+    /* Track the lowest `y_level' element this chunk depends on: the
+     * one at the branch attachment column or, if the branch starts
+     * beyond `last_valid_y_level', the latter.
+     */
+    chunk_lowest_x = MIN (chunk_lowest_x, MIN (x - 1, last_valid_y_level));
+
     if (x < last_valid_y_level) {
       /* This case is the most complicated.  The branch may bend with
        * its first part going diagonally, like that marked with '@'
@@ -748,11 +1085,11 @@ update_internal_map_data (SgfGameTree *tree)
 	 *   `last_valid_y_level'
 	 */
 
-	if (x > y_level_array_size) {
+	if (x >= y_level_array_size) {
 	  /* The only case when we need to increase the `y_level'
 	   * array size.
 	   */
-	  y_level_array_size = ROUND_UP (x, Y_LEVEL_ARRAY_SIZE_GRAIN);
+	  y_level_array_size = ROUND_UP (x + 1, Y_LEVEL_ARRAY_SIZE_GRAIN);
 	  y_level	     = utils_realloc (y_level,
 					      (y_level_array_size
 					       * sizeof (int)));
@@ -789,43 +1126,205 @@ update_internal_map_data (SgfGameTree *tree)
     /* Maybe this branch'es leaf is beyond the known tree width? */
     if (x > largest_x_so_far)
       largest_x_so_far = x;
+    if (x > chunk_largest_x)
+      chunk_largest_x = x;
+
+    if (node->has_intermediate_map_data) {
+      data_point = take_old_data_point (&old_data_list, node);
+      if (data_point)
+	goto reached_old_data_point;
+    }
 
     if (node_count >= MIN_NODES_PER_DATA_CHUNK) {
-      SgfGameTreeMapData *intermediate_data
-	= utils_malloc (sizeof (SgfGameTreeMapData));
+      data_point = utils_malloc (sizeof (SgfGameTreeMapData));
 
-      intermediate_data->node		    = node;
-      intermediate_data->x		    = x;
-      intermediate_data->y_level
+      data_point->node		     = node;
+      data_point->x		     = x;
+      data_point->y_level
 	= utils_duplicate_buffer (y_level,
 				  (last_valid_y_level + 1) * sizeof (int));
-      intermediate_data->last_valid_y_level = last_valid_y_level;
-
-      intermediate_data->largest_x_so_far   = largest_x_so_far;
+      data_point->last_valid_y_level = last_valid_y_level;
 
-      *intermediate_data_link = intermediate_data;
-      intermediate_data_link  = &intermediate_data->next;
+      data_point->largest_x_so_far   = largest_x_so_far;
+      data_point->chunk_index	     = NULL;
 
       node->has_intermediate_map_data = 1;
 
-      node_count = 0;
+      goto start_new_chunk;
+    }
+
+    continue;
+
+  reached_old_data_point:
+    /* We have reached a data point from the previous run.  Update it
+     * with current data and skip as many unmodified chunks after it
+     * as possible.
+     */
+    if (chunk_data) {
+      chunk_data->chunk_lowest_x  = chunk_lowest_x;
+      chunk_data->chunk_largest_x = chunk_largest_x;
+      chunk_data		  = NULL;
+    }
+
+    while (1) {
+      SgfGameTreeMapData *next_data_point = old_data_list;
+      int can_reuse_chunk = (!data_point->chunk_is_modified
+			     && data_point->x == x
+			     && (data_point->last_valid_y_level
+				 == last_valid_y_level));
+      int y_shift = 0;
+      int x_scan;
+
+      if (can_reuse_chunk && data_point->chunk_lowest_x != INT_MAX) {
+	y_shift = (y_level[data_point->chunk_lowest_x]
+		   - data_point->y_level[data_point->chunk_lowest_x]);
+
+	for (x_scan = data_point->chunk_lowest_x + 1;
+	     x_scan <= last_valid_y_level; x_scan++) {
+	  if (y_level[x_scan] - data_point->y_level[x_scan] != y_shift) {
+	    can_reuse_chunk = 0;
+	    break;
+	  }
+	}
+      }
+
+      if (data_point->last_valid_y_level != last_valid_y_level) {
+	utils_free (data_point->y_level);
+	data_point->y_level = utils_malloc ((last_valid_y_level + 1)
+					    * sizeof (int));
+      }
+
+      memcpy (data_point->y_level, y_level,
+	      (last_valid_y_level + 1) * sizeof (int));
+      data_point->last_valid_y_level = last_valid_y_level;
+      data_point->largest_x_so_far   = largest_x_so_far;
+      data_point->chunk_is_modified  = 0;
+
+      if (!can_reuse_chunk)
+	break;
+
+      num_reused_chunks++;
+
+      *intermediate_data_link = data_point;
+      intermediate_data_link  = &data_point->next;
+
+      if (data_point->chunk_largest_x > largest_x_so_far)
+	largest_x_so_far = data_point->chunk_largest_x;
+
+      if (!next_data_point) {
+	/* This was the last chunk.  Unless it is empty, its lowest
+	 * point has shifted just like everything else.
+	 */
+	tree->map_height = (data_point->chunk_lowest_x != INT_MAX
+			    ? tree->map_height + y_shift
+			    : y_level[last_valid_y_level] + 1);
+	goto finished_reusing_chunks;
+      }
+
+      /* Compute `y_level' at the start of the next chunk.  Elements
+       * below `chunk_lowest_x' are not touched by the chunk.
+       */
+      old_data_list	 = next_data_point->next;
+      last_valid_y_level = next_data_point->last_valid_y_level;
+
+      if (last_valid_y_level >= y_level_array_size) {
+	y_level_array_size = ROUND_UP (last_valid_y_level + 1,
+				       Y_LEVEL_ARRAY_SIZE_GRAIN);
+	y_level		   = utils_realloc (y_level,
+					    y_level_array_size * sizeof (int));
+      }
+
+      for (x_scan = data_point->chunk_lowest_x;
+	   x_scan <= last_valid_y_level; x_scan++)
+	y_level[x_scan] = next_data_point->y_level[x_scan] + y_shift;
+
+      node	 = next_data_point->node;
+      x		 = next_data_point->x;
+      data_point = next_data_point;
+    }
+
+    node = data_point->node;
+
+  start_new_chunk:
+    num_layed_out_nodes += node_count;
+
+    if (chunk_data) {
+      chunk_data->chunk_lowest_x  = chunk_lowest_x;
+      chunk_data->chunk_largest_x = chunk_largest_x;
+    }
+
+    data_point->chunk_is_modified = 0;
+
+    free_chunk_index (data_point->chunk_index);
+    data_point->chunk_index = NULL;
+
+    *intermediate_data_link = data_point;
+    intermediate_data_link  = &data_point->next;
+
+    chunk_data	    = data_point;
+    chunk_lowest_x  = INT_MAX;
+    chunk_largest_x = 0;
+    node_count	    = 0;
+
+    if (num_layed_out_nodes >= max_nodes_to_lay_out) {
+      /* Pause here.  Keep the rest of old data points for the next
+       * run.  It will lay out the chunk we are at from scratch.
+       */
+      data_point->chunk_is_modified = 1;
+      *intermediate_data_link	    = old_data_list;
+
+      tree->map_layout_frontier		= data_point;
+      tree->map_first_chunk_is_modified = 0;
+
+      utils_free (y_level);
+
+      goto finished_run;
     }
   }
 
  finished:
-  /* Fix map width by adding missing 1.  Write map height. */
-  tree->map_width  = largest_x_so_far + 1;
+  num_layed_out_nodes += node_count;
+
+  if (chunk_data) {
+    chunk_data->chunk_lowest_x	= chunk_lowest_x;
+    chunk_data->chunk_largest_x = chunk_largest_x;
+  }
+
   tree->map_height = y_level[last_valid_y_level] + 1;
 
-  /* All intermediate data is valid. */
-  tree->last_valid_data_point = NULL;
+ finished_reusing_chunks:
+  /* Fix map width by adding missing 1. */
+  tree->map_width = largest_x_so_far + 1;
 
-  /* Terminate the list. */
+  /* Terminate the list.  Data points we haven't passed are of no use
+   * anymore.
+   */
   *intermediate_data_link = NULL;
+  free_map_data_point (old_data_list);
+
+  tree->map_is_valid		    = 1;
+  tree->map_first_chunk_is_modified = 0;
 
   utils_free (y_level);
 
-  PRINT_RUN_TIME (update_internal_map_data);
+ finished_run:
+  run_time = get_current_time () - start_time;
+
+  tree->map_statistics.num_map_updates++;
+  tree->map_statistics.num_layed_out_nodes += num_layed_out_nodes;
+  tree->map_statistics.num_reused_chunks   += num_reused_chunks;
+  tree->map_statistics.map_update_time	   += run_time;
+
+#if REPORT_PERFORMANCE_STATISTICS
+
+  fprintf (stderr, "Time spent in update_internal_map_data(): %f\n", run_time);
+  fprintf (stderr,
+	   "update_internal_map_data(): Layed out %d nodes, reused %d chunks\n",
+	   num_layed_out_nodes, num_reused_chunks);
+
+#endif
+
+  return tree->map_is_valid;
 }
 
 
@@ -837,20 +1336,13 @@ update_internal_view_port (SgfGameTree *tree,
   int view_port_width  = view_port_x1 - view_port_x0;
   int view_port_height = view_port_y1 - view_port_y0;
   SgfGameTreeMapLine *line_pointer;
-  DECLARE_TIME_VARIABLES;
-
-#if REPORT_PERFORMANCE_STATISTICS
-
+  int num_lines_allocated;
+  const SgfGameTreeMapData *frontier;
   int num_total_tree_chunks;
   int num_skipped_tree_chunks = 0;
   const SgfGameTreeMapData *intermediate_data_scan;
-
-  for (intermediate_data_scan = tree->map_data_list, num_total_tree_chunks = 1;
-       intermediate_data_scan;
-       intermediate_data_scan = intermediate_data_scan->next)
-    num_total_tree_chunks++;
-
-#endif /* not REPORT_PERFORMANCE_STATISTICS */
+  double start_time;
+  double run_time;
 
   if (tree->view_port_nodes
       && tree->view_port_x0 <= view_port_x0
@@ -866,9 +1358,20 @@ update_internal_view_port (SgfGameTree *tree,
   tree->view_port_x1 = view_port_x1;
   tree->view_port_y1 = view_port_y1;
 
-  update_internal_map_data (tree);
+  if (!tree->map_layout_is_deferred)
+    update_internal_map_data (tree, INT_MAX);
+
+  start_time = get_current_time ();
 
-  STORE_STARTING_TIME;
+  /* With a partial map, only chunks before the frontier are layed
+   * out.  When there is no frontier, nothing is.
+   */
+  frontier = tree->map_layout_frontier;
+
+  for (intermediate_data_scan = tree->map_data_list, num_total_tree_chunks = 1;
+       intermediate_data_scan && intermediate_data_scan != frontier;
+       intermediate_data_scan = intermediate_data_scan->next)
+    num_total_tree_chunks++;
 
   utils_free (tree->view_port_nodes);
   utils_free (tree->view_port_lines);
@@ -876,14 +1379,16 @@ update_internal_view_port (SgfGameTree *tree,
   tree->view_port_nodes = utils_malloc0 (view_port_width * view_port_height
 					 * sizeof (SgfNode *));
 
-  tree->view_port_lines = utils_malloc ((3 * view_port_width * view_port_height
-					 + 1)
+  num_lines_allocated	= view_port_width * view_port_height + 1;
+  tree->view_port_lines = utils_malloc (num_lines_allocated
 					* sizeof (SgfGameTreeMapLine));
   line_pointer		= tree->view_port_lines;
 
-  if (tree->map_data_list) {
-    const SgfGameTreeMapData *intermediate_data	     = NULL;
-    const SgfGameTreeMapData *next_intermediate_data = tree->map_data_list;
+  if (!tree->map_is_valid && !frontier)
+    num_total_tree_chunks = 0;
+  else if (tree->map_data_list) {
+    SgfGameTreeMapData *intermediate_data	     = NULL;
+    SgfGameTreeMapData *next_intermediate_data = tree->map_data_list;
 
     /* FIXME: There is probably still space for improvement here.
      *	      This code performs well in near-leaves parts of the
@@ -893,33 +1398,28 @@ update_internal_view_port (SgfGameTree *tree,
       intermediate_data	     = next_intermediate_data;
       next_intermediate_data = intermediate_data->next;
 
-#if REPORT_PERFORMANCE_STATISTICS
       num_skipped_tree_chunks++;
-#endif
 
-      if (!next_intermediate_data)
+      if (!next_intermediate_data || intermediate_data == frontier)
 	break;
     }
 
-    while (1) {
-      /* Skip chunks that lie completely to the right of the view
-       * port.  This can sometimes give large advantage when browsing
-       * near the root of the tree.  We add 1 to `view_port_x1' here
-       * to avoid losing certain lines.
+    while (intermediate_data != frontier || !frontier) {
+      /* Skip chunks that don't change `y_level' in the columns of
+       * the view port.  Nodes and connection lines within the view
+       * port would have raised it.  We also check the columns just
+       * outside the view port to avoid losing certain lines.
        */
       if (!intermediate_data
 	  || !next_intermediate_data
-	  || intermediate_data->last_valid_y_level < view_port_x1 + 1
-	  || next_intermediate_data->last_valid_y_level < view_port_x1 + 1
-	  || (intermediate_data->y_level[view_port_x1 + 1]
-	      < next_intermediate_data->y_level[view_port_x1 + 1])) {
-	line_pointer = do_update_internal_view_port (tree, intermediate_data,
-						     line_pointer);
+	  || !chunk_misses_view_port (tree, intermediate_data,
+				      next_intermediate_data)) {
+	line_pointer = fill_view_port_from_index (tree, intermediate_data,
+						  line_pointer,
+						  &num_lines_allocated);
       }
-#if REPORT_PERFORMANCE_STATISTICS
       else
 	num_skipped_tree_chunks++;
-#endif
 
       intermediate_data = next_intermediate_data;
       if (!intermediate_data
@@ -929,27 +1429,32 @@ update_internal_view_port (SgfGameTree *tree,
       next_intermediate_data = intermediate_data->next;
     }
 
-#if REPORT_PERFORMANCE_STATISTICS
-
-    while (intermediate_data) {
+    while (intermediate_data && intermediate_data != frontier) {
       num_skipped_tree_chunks++;
       intermediate_data = intermediate_data->next;
     }
-
-#endif
   }
-  else
-    line_pointer = do_update_internal_view_port (tree, NULL, line_pointer);
+  else {
+    line_pointer = fill_view_port_from_index (tree, NULL, line_pointer,
+					      &num_lines_allocated);
+  }
 
   tree->num_view_port_lines = (line_pointer - tree->view_port_lines);
   tree->view_port_lines
     = utils_realloc (tree->view_port_lines,
 		     (char *) line_pointer - (char *) tree->view_port_lines);
 
-  PRINT_RUN_TIME (update_internal_view_port);
+  run_time = get_current_time () - start_time;
+
+  tree->map_statistics.num_view_port_updates++;
+  tree->map_statistics.num_view_port_chunks	    += num_total_tree_chunks;
+  tree->map_statistics.num_skipped_view_port_chunks += num_skipped_tree_chunks;
+  tree->map_statistics.view_port_update_time	    += run_time;
 
 #if REPORT_PERFORMANCE_STATISTICS
 
+  fprintf (stderr, "Time spent in update_internal_view_port(): %f\n",
+	   run_time);
   fprintf (stderr,
 	   "update_internal_view_port(): Skipped %d of %d tree chunks\n",
 	   num_skipped_tree_chunks, num_total_tree_chunks);
@@ -958,10 +1463,6 @@ update_internal_view_port (SgfGameTree *tree,
 }
 
 
-#define IS_WITHIN_VIEW_PORT(x, y)					\
-  (view_port_x0 <= (x) && (x) < view_port_x1				\
-   && view_port_y0 <= (y) && (y) < view_port_y1)
-
 #define WRITE_VIEW_PORT_NODE(x, y, node)				\
   do {									\
     * (tree->view_port_nodes +						\
@@ -970,31 +1471,446 @@ update_internal_view_port (SgfGameTree *tree,
   } while (0)
 
 
-/* Lay out a part of the `tree' specified by `intermediate_data' (NULL
- * means the part starting at the tree root.)  Algorithm is
- * essentially the same as used in update_internal_map_data(), but
- * this function has to watch if layed out nodes are within the
- * requested view ports and track connection lines.
+/* Write nodes and lines of the chunk specified by `intermediate_data'
+ * (NULL means the chunk starting at the tree root) that are within
+ * the current view port.  Only items from the rows of the chunk's
+ * index overlapping the view port are looked at.  Lines are appended
+ * at `line_pointer', growing the `tree's line array as needed.
  */
 static SgfGameTreeMapLine *
-do_update_internal_view_port (const SgfGameTree *tree,
-			      const SgfGameTreeMapData *intermediate_data,
-			      SgfGameTreeMapLine *line_pointer)
+fill_view_port_from_index (SgfGameTree *tree,
+			   SgfGameTreeMapData *intermediate_data,
+			   SgfGameTreeMapLine *line_pointer,
+			   int *num_lines_allocated)
 {
   int view_port_x0    = tree->view_port_x0;
   int view_port_y0    = tree->view_port_y0;
   int view_port_x1    = tree->view_port_x1;
   int view_port_y1    = tree->view_port_y1;
   int view_port_width = view_port_x1 - view_port_x0;
+  const SgfGameTreeMapIndex *index;
+  int y_shift;
+  int row;
+  int last_row;
+
+  index	  = get_chunk_index (tree, intermediate_data);
+  y_shift = get_chunk_y_shift (intermediate_data, index);
+
+  if (view_port_y1 - 1 - y_shift < 0)
+    return line_pointer;
+
+  /* Items span at most `MAP_INDEX_ITEM_EXTENT' in both directions, so
+   * we need to look that much above and to the left of the view port.
+   */
+  row	   = (MAX (view_port_y0 - y_shift - MAP_INDEX_ITEM_EXTENT, 0)
+	      / MAP_INDEX_ITEM_EXTENT);
+  last_row = (view_port_y1 - 1 - y_shift) / MAP_INDEX_ITEM_EXTENT;
+
+  for (; row <= last_row; row++) {
+    const SgfGameTreeMapIndexItem *item;
+    const SgfGameTreeMapIndexItem *items_end = index->items + index->num_items;
+    int low  = 0;
+    int high = index->num_items;
+
+    /* Binary search for the first item of the row that can reach the
+     * view port horizontally.
+     */
+    while (low < high) {
+      int middle = (low + high) / 2;
+
+      if (map_index_item_is_before (index->items + middle, row,
+				    view_port_x0 - MAP_INDEX_ITEM_EXTENT))
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+    for (item = index->items + low;
+	 (item < items_end
+	  && item->line.y0 / MAP_INDEX_ITEM_EXTENT == row
+	  && item->line.x0 < view_port_x1);
+	 item++) {
+      int y = item->line.y0 + y_shift;
+
+      if (item->line.x3 < view_port_x0 || y >= view_port_y1)
+	continue;
+
+      if (item->node) {
+	SgfNode *node = item->node;
+	int x;
+
+	if (y < view_port_y0)
+	  continue;
+
+	for (x = item->line.x0; x <= item->line.x3; x++, node = node->child) {
+	  if (view_port_x0 <= x && x < view_port_x1)
+	    WRITE_VIEW_PORT_NODE (x, y, node);
+	}
+      }
+      else {
+	if (!line_is_within_view_port (tree, &item->line, y_shift))
+	  continue;
+
+	if (line_pointer - tree->view_port_lines == *num_lines_allocated) {
+	  *num_lines_allocated *= 2;
+	  tree->view_port_lines
+	    = utils_realloc (tree->view_port_lines,
+			     (*num_lines_allocated
+			      * sizeof (SgfGameTreeMapLine)));
+	  line_pointer = tree->view_port_lines + *num_lines_allocated / 2;
+	}
+
+	*line_pointer	  = item->line;
+	line_pointer->y0 += y_shift;
+	line_pointer->y1 += y_shift;
+
+	line_pointer++;
+      }
+    }
+  }
+
+  return line_pointer;
+}
+
+
+/* Determine if any part of the `line', shifted by `y_shift', is drawn
+ * within the `tree's view port, i.e. if any of the points it passes
+ * through is inside it.
+ */
+static int
+line_is_within_view_port (const SgfGameTree *tree,
+			  const SgfGameTreeMapLine *line, int y_shift)
+{
+  int view_port_x0 = tree->view_port_x0;
+  int view_port_y0 = tree->view_port_y0;
+  int view_port_x1 = tree->view_port_x1;
+  int view_port_y1 = tree->view_port_y1;
+  int y0	   = line->y0 + y_shift;
+  int y1	   = line->y1 + y_shift;
+  int y2	   = y1 + (line->x2 - line->x0);
+
+  /* Vertical part, or the only point of a degenerate line. */
+  if (view_port_x0 <= line->x0 && line->x0 < view_port_x1
+      && y0 < view_port_y1 && y1 >= view_port_y0)
+    return 1;
+
+  /* Diagonal part. */
+  if (line->x2 > line->x0) {
+    int from = MAX (MAX (view_port_x0 - line->x0, view_port_y0 - y1), 0);
+    int to   = MIN (MIN (view_port_x1 - line->x0, view_port_y1 - y1),
+		    line->x2 - line->x0 + 1);
+
+    if (from < to)
+      return 1;
+  }
+
+  /* Horizontal part. */
+  return (view_port_y0 <= y2 && y2 < view_port_y1
+	  && line->x2 < view_port_x1 && line->x3 >= view_port_x0);
+}
+
+
+/* Get `node_to_find's coordinates in the `tree's map.  Nodes of a
+ * chunk's horizontal runs are found by walking up to the run start
+ * and looking it up in the chunk's index.
+ */
+static int
+get_node_coordinates (SgfGameTree *tree, const SgfNode *node_to_find,
+		      int *node_x, int *node_y)
+{
+  SgfGameTreeMapData *intermediate_data;
+  const SgfGameTreeMapIndex *index;
+  const SgfNode *node;
+  int distance;
+  int y_shift;
+
+  if (!tree->map_layout_is_deferred)
+    update_internal_map_data (tree, INT_MAX);
+  else if (!node_is_layed_out (tree, node_to_find))
+    return 0;
+
+  if (node_to_find->has_intermediate_map_data) {
+    /* The node is a chunk boundary, its coordinates are stored. */
+    intermediate_data = find_intermediate_data_for_node (tree, node_to_find,
+							 0);
+
+    *node_x = intermediate_data->x;
+    *node_y = intermediate_data->y_level[MIN (intermediate_data->x,
+					      (intermediate_data
+					       ->last_valid_y_level))];
+
+    return 1;
+  }
+
+  intermediate_data = find_intermediate_data_for_node (tree, node_to_find, 0);
+  index		    = get_chunk_index (tree, intermediate_data);
+  y_shift	    = get_chunk_y_shift (intermediate_data, index);
+
+  for (node = node_to_find, distance = 0; distance < MAP_INDEX_ITEM_EXTENT;
+       node = node->parent, distance++) {
+    int low  = 0;
+    int high = index->num_runs;
+
+    while (low < high) {
+      int middle = (low + high) / 2;
+
+      if ((const SgfNode *) index->runs[middle]->node < node)
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+    if (low < index->num_runs && index->runs[low]->node == node) {
+      const SgfGameTreeMapIndexItem *run = index->runs[low];
+
+      if (distance > run->line.x3 - run->line.x0)
+	break;
+
+      *node_x = run->line.x0 + distance;
+      *node_y = run->line.y0 + y_shift;
+
+      return 1;
+    }
+
+    /* Only first children continue their parent's run. */
+    if (!node->parent || node->parent->child != node)
+      break;
+  }
+
+  /* Can happen if the requested node is within a collapsed subtree or
+   * if the call is seriously f*cked up with a non-existant node, for
+   * instance.
+   */
+  return 0;
+}
+
+
+/* Return the index of the chunk starting at `intermediate_data' (NULL
+ * for the first chunk), building it if needed.
+ */
+static const SgfGameTreeMapIndex *
+get_chunk_index (SgfGameTree *tree, SgfGameTreeMapData *intermediate_data)
+{
+  SgfGameTreeMapIndex **index_link = (intermediate_data
+				      ? &intermediate_data->chunk_index
+				      : &tree->map_first_chunk_index);
+
+  if (!*index_link) {
+    DECLARE_TIME_VARIABLES;
+
+    STORE_STARTING_TIME;
+
+    *index_link = build_chunk_index (tree, intermediate_data);
+
+    PRINT_RUN_TIME (build_chunk_index);
+  }
+
+  return *index_link;
+}
+
+
+/* Chunks that are reused by update_internal_map_data() are shifted
+ * as a whole since their indices have been built.  The shift is the
+ * same for all `y_level' elements the chunk depends on.
+ */
+static int
+get_chunk_y_shift (const SgfGameTreeMapData *intermediate_data,
+		   const SgfGameTreeMapIndex *index)
+{
+  if (!intermediate_data)
+    return 0;
+
+  return (intermediate_data->y_level[MIN (intermediate_data->chunk_lowest_x,
+					  intermediate_data->last_valid_y_level)]
+	  - index->y_base);
+}
+
+
+static void
+free_chunk_index (SgfGameTreeMapIndex *index)
+{
+  if (index) {
+    utils_free (index->items);
+    utils_free (index->runs);
+    utils_free (index);
+  }
+}
+
+
+static int
+map_index_item_is_before (const SgfGameTreeMapIndexItem *item,
+			  int row, int x)
+{
+  int item_row = item->line.y0 / MAP_INDEX_ITEM_EXTENT;
+
+  return item_row < row || (item_row == row && item->line.x0 < x);
+}
+
+
+static int
+compare_map_index_items (const void *first_item, const void *second_item)
+{
+  const SgfGameTreeMapLine *first_line
+    = & ((const SgfGameTreeMapIndexItem *) first_item)->line;
+  const SgfGameTreeMapLine *second_line
+    = & ((const SgfGameTreeMapIndexItem *) second_item)->line;
+  int first_row	 = first_line->y0 / MAP_INDEX_ITEM_EXTENT;
+  int second_row = second_line->y0 / MAP_INDEX_ITEM_EXTENT;
+
+  if (first_row != second_row)
+    return first_row - second_row;
+
+  return first_line->x0 - second_line->x0;
+}
+
+
+static int
+compare_map_index_runs (const void *first_run, const void *second_run)
+{
+  const SgfNode *first_node
+    = (* (const SgfGameTreeMapIndexItem *const *) first_run)->node;
+  const SgfNode *second_node
+    = (* (const SgfGameTreeMapIndexItem *const *) second_run)->node;
+
+  return (first_node < second_node ? -1 : first_node > second_node);
+}
+
+
+static SgfGameTreeMapIndexItem *
+add_index_item (MapIndexBuilder *builder)
+{
+  SgfGameTreeMapIndex *index = builder->index;
+
+  if (index->num_items == builder->num_items_allocated) {
+    builder->num_items_allocated *= 2;
+    index->items = utils_realloc (index->items,
+				  (builder->num_items_allocated
+				   * sizeof (SgfGameTreeMapIndexItem)));
+  }
+
+  return index->items + index->num_items++;
+}
+
+
+/* Add `node' at (`x', `y') to the index, extending the last run if
+ * `node' is its last node's child placed right after it.
+ */
+static void
+add_node_to_index (MapIndexBuilder *builder, SgfNode *node, int x, int y)
+{
+  SgfGameTreeMapIndexItem *item;
+
+  if (builder->last_run_node
+      && builder->last_run_node->child == node) {
+    item = builder->index->items + builder->last_run;
+
+    if (item->line.y0 == y && item->line.x3 == x - 1
+	&& x - item->line.x0 < MAP_INDEX_ITEM_EXTENT) {
+      item->line.x3	     = x;
+      builder->last_run_node = node;
+
+      return;
+    }
+  }
+
+  item = add_index_item (builder);
+
+  item->line.x0 = x;
+  item->line.y0 = y;
+  item->line.y1 = y;
+  item->line.x2 = x;
+  item->line.x3 = x;
+  item->node	= node;
+
+  builder->last_run	 = item - builder->index->items;
+  builder->last_run_node = node;
+}
+
+
+static void
+add_line_piece_to_index (MapIndexBuilder *builder,
+			 int x0, int y0, int y1, int x2, int x3)
+{
+  SgfGameTreeMapIndexItem *item = add_index_item (builder);
+
+  item->line.x0 = x0;
+  item->line.y0 = y0;
+  item->line.y1 = y1;
+  item->line.x2 = x2;
+  item->line.x3 = x3;
+  item->node	= NULL;
+}
+
+
+/* Add a connection `line' to the index.  Long lines are split into
+ * pieces of at most `MAP_INDEX_ITEM_EXTENT' in each direction, so
+ * that view port queries need to look only at a few index rows.
+ */
+static void
+add_line_to_index (MapIndexBuilder *builder, const SgfGameTreeMapLine *line)
+{
+  int y2 = line->y1 + (line->x2 - line->x0);
+  int from;
+  int to;
+
+  if (line->x3 - line->x0 <= MAP_INDEX_ITEM_EXTENT
+      && y2 - line->y0 <= MAP_INDEX_ITEM_EXTENT) {
+    add_line_piece_to_index (builder, line->x0, line->y0, line->y1,
+			     line->x2, line->x3);
+    return;
+  }
+
+  for (from = line->y0; from < line->y1; from = to) {
+    to = MIN (from + MAP_INDEX_ITEM_EXTENT, line->y1);
+    add_line_piece_to_index (builder, line->x0, from, to, line->x0, line->x0);
+  }
+
+  for (from = line->x0; from < line->x2; from = to) {
+    int y = line->y1 + (from - line->x0);
+
+    to = MIN (from + MAP_INDEX_ITEM_EXTENT, line->x2);
+    add_line_piece_to_index (builder, from, y, y, to, to);
+  }
+
+  for (from = line->x2; from < line->x3; from = to) {
+    to = MIN (from + MAP_INDEX_ITEM_EXTENT, line->x3);
+    add_line_piece_to_index (builder, from, y2, y2, from, to);
+  }
+}
+
+
+/* Lay out a part of the `tree' specified by `intermediate_data' (NULL
+ * means the part starting at the tree root) and build its spatial
+ * index: horizontal runs of nodes and connection line pieces, sorted
+ * by index row and `x'.  Algorithm is essentially the same as used in
+ * update_internal_map_data(), but this function has to track
+ * connection lines.
+ */
+static SgfGameTreeMapIndex *
+build_chunk_index (const SgfGameTree *tree,
+		   const SgfGameTreeMapData *intermediate_data)
+{
+  MapIndexBuilder builder;
+  SgfGameTreeMapIndex *index;
+  SgfGameTreeMapLine line;
   SgfNode *node;
   int x;
   int y;
   int *y_level;
   int y_level_array_size;
   int last_valid_y_level;
-  DECLARE_TIME_VARIABLES;
+  int k;
 
-  STORE_STARTING_TIME;
+  index = utils_malloc (sizeof (SgfGameTreeMapIndex));
+
+  builder.index		      = index;
+  builder.num_items_allocated = MAP_INDEX_INITIAL_NUM_ITEMS;
+  builder.last_run	      = -1;
+  builder.last_run_node	      = NULL;
+
+  index->items	   = utils_malloc (builder.num_items_allocated
+				   * sizeof (SgfGameTreeMapIndexItem));
+  index->num_items = 0;
 
   if (intermediate_data) {
     last_valid_y_level = intermediate_data->last_valid_y_level;
@@ -1006,6 +1922,9 @@ do_update_internal_view_port (const SgfGameTree *tree,
 
     node	       = intermediate_data->node;
     x		       = intermediate_data->x;
+
+    index->y_base      = y_level[MIN (intermediate_data->chunk_lowest_x,
+				      last_valid_y_level)];
   }
   else {
     y_level_array_size = Y_LEVEL_ARRAY_INITIAL_SIZE;
@@ -1013,9 +1932,10 @@ do_update_internal_view_port (const SgfGameTree *tree,
     y_level[0]	       = 0;
     last_valid_y_level = 0;
 
+    index->y_base      = 0;
+
     for (node = tree->root, x = 0; ; ) {
-      if (IS_WITHIN_VIEW_PORT (x, 0))
-	WRITE_VIEW_PORT_NODE (x, 0, node);
+      add_node_to_index (&builder, node, x, 0);
 
       if (!node->child || node->is_collapsed)
 	break;
@@ -1024,15 +1944,13 @@ do_update_internal_view_port (const SgfGameTree *tree,
       node = node->child;
     }
 
-    if (view_port_y0 == 0 && view_port_x0 <= x) {
-      line_pointer->x0 = 0;
-      line_pointer->y0 = 0;
-      line_pointer->y1 = 0;
-      line_pointer->x2 = 0;
-      line_pointer->x3 = x;
+    line.x0 = 0;
+    line.y0 = 0;
+    line.y1 = 0;
+    line.x2 = 0;
+    line.x3 = x;
 
-      line_pointer++;
-    }
+    add_line_to_index (&builder, &line);
   }
 
   do {
@@ -1052,7 +1970,6 @@ do_update_internal_view_port (const SgfGameTree *tree,
 	int branch_scan_delta;
 	int branch_leaf_x = x + 1;
 	int branch_leaf_y;
-	int have_node_within_view_port = 0;
 
 	while (branch_scan_node->child && !branch_scan_node->is_collapsed) {
 	  branch_scan_node = branch_scan_node->child;
@@ -1065,26 +1982,19 @@ do_update_internal_view_port (const SgfGameTree *tree,
 	     branch_scan_delta < branch_leaf_y - y; branch_scan_delta++)
 	  y = MAX (y, y_level[x + branch_scan_delta] + 1 - branch_scan_delta);
 
-	line_pointer->x0 = x - 1;
-	line_pointer->y0 = y_level[x - 1];
+	line.x0 = x - 1;
+	line.y0 = y_level[x - 1];
 
 	y_level[x - 1] = y - 1;
 
 	for (; y < branch_leaf_y; x++, y++, node = node->child) {
 	  y_level[x] = y;
-
-	  if (IS_WITHIN_VIEW_PORT (x, y)) {
-	    WRITE_VIEW_PORT_NODE (x, y, node);
-	    have_node_within_view_port = 1;
-	  }
+	  add_node_to_index (&builder, node, x, y);
 	}
 
-	if (IS_WITHIN_VIEW_PORT (x, y)) {
-	  WRITE_VIEW_PORT_NODE (x, y, node);
-	  have_node_within_view_port = 1;
-	}
+	add_node_to_index (&builder, node, x, y);
 
-	line_pointer->x2 = x;
+	line.x2 = x;
 
 	if (y >= y_level[last_valid_y_level]) {
 	  y_level[x] = y;
@@ -1095,29 +2005,20 @@ do_update_internal_view_port (const SgfGameTree *tree,
 	    y_level[x++] = y;
 	  while (y_level[x] < y);
 
-	  x = line_pointer->x2;
+	  x = line.x2;
 	}
 
 	while (x < branch_leaf_x) {
 	  x++;
 	  node = node->child;
 
-	  if (IS_WITHIN_VIEW_PORT (x, y)) {
-	    WRITE_VIEW_PORT_NODE (x, y, node);
-	    have_node_within_view_port = 1;
-	  }
+	  add_node_to_index (&builder, node, x, y);
 	}
 
-	if (have_node_within_view_port
-	    || (view_port_x0 <= line_pointer->x0
-		&& line_pointer->x0 < view_port_x1
-		&& line_pointer->y0 < view_port_y1
-		&& y_level[line_pointer->x0] >= view_port_y0)) {
-	  line_pointer->y1 = y_level[line_pointer->x0];
-	  line_pointer->x3 = branch_leaf_x;
+	line.y1 = y_level[line.x0];
+	line.x3 = branch_leaf_x;
 
-	  line_pointer++;
-	}
+	add_line_to_index (&builder, &line);
       }
       else {
 	y = ++y_level[x];
@@ -1131,37 +2032,30 @@ do_update_internal_view_port (const SgfGameTree *tree,
 	    y_level[x_scan] = y;
 	}
 
-	if (IS_WITHIN_VIEW_PORT (x, y))
-	  WRITE_VIEW_PORT_NODE (x, y, node);
+	add_node_to_index (&builder, node, x, y);
 
-	if (IS_WITHIN_VIEW_PORT (x, y)
-	    || (view_port_x0 <= x - 1 && x - 1 < view_port_x1
-		&& y_level[x - 1] < view_port_y1 && y - 1 >= view_port_y0)) {
-	  line_pointer->x0 = x - 1;
-	  line_pointer->y0 = y_level[x - 1];
-	  line_pointer->y1 = y - 1;
-	  line_pointer->x2 = x;
-	  line_pointer->x3 = x;
+	line.x0 = x - 1;
+	line.y0 = y_level[x - 1];
+	line.y1 = y - 1;
+	line.x2 = x;
+	line.x3 = x;
 
-	  line_pointer++;
-	}
+	add_line_to_index (&builder, &line);
 
 	y_level[x - 1] = y - 1;
       }
     }
     else {
-      int have_node_within_view_port = 0;
-
-      line_pointer->x0 = x - 1;
+      line.x0 = x - 1;
 
       if (x > last_valid_y_level) {
-	if (x > y_level_array_size) {
-	  y_level_array_size += ROUND_UP (x, Y_LEVEL_ARRAY_SIZE_GRAIN);
+	if (x >= y_level_array_size) {
+	  y_level_array_size = ROUND_UP (x + 1, Y_LEVEL_ARRAY_SIZE_GRAIN);
 	  y_level = utils_realloc (y_level, y_level_array_size * sizeof (int));
 	}
 
 	y = y_level[last_valid_y_level];
-	line_pointer->y0 = y;
+	line.y0 = y;
 
 	while (++last_valid_y_level < x)
 	  y_level[last_valid_y_level] = y;
@@ -1169,17 +2063,14 @@ do_update_internal_view_port (const SgfGameTree *tree,
 	y_level[x] = ++y;
       }
       else {
-	line_pointer->y0 = y_level[x - 1];
+	line.y0 = y_level[x - 1];
 
 	y_level[x - 1] = y_level[x];
 	y = ++y_level[x];
       }
 
       while (1) {
-	if (IS_WITHIN_VIEW_PORT (x, y)) {
-	  WRITE_VIEW_PORT_NODE (x, y, node);
-	  have_node_within_view_port = 1;
-	}
+	add_node_to_index (&builder, node, x, y);
 
 	if (!node->child || node->is_collapsed)
 	  break;
@@ -1188,16 +2079,11 @@ do_update_internal_view_port (const SgfGameTree *tree,
 	node = node->child;
       }
 
-      if (have_node_within_view_port
-	  || (view_port_x0 <= line_pointer->x0
-	      && line_pointer->x0 < view_port_x1
-	      && view_port_y0 <= y - 1 && line_pointer->y0 < view_port_y1)) {
-	line_pointer->y1 = y - 1;
-	line_pointer->x2 = line_pointer->x0 + 1;
-	line_pointer->x3 = x;
+      line.y1 = y - 1;
+      line.x2 = line.x0 + 1;
+      line.x3 = x;
 
-	line_pointer++;
-      }
+      add_line_to_index (&builder, &line);
     }
   } while (!node->has_intermediate_map_data);
 
@@ -1205,214 +2091,41 @@ do_update_internal_view_port (const SgfGameTree *tree,
 
   utils_free (y_level);
 
-  PRINT_RUN_TIME (do_update_internal_view_port);
-
-  return line_pointer;
-}
-
-
-/* Get `node_to_find's coordinates in the `tree's map.  Uses the same
- * algorithm as update_internal_map_data(), but never lays out more
- * than one chunk of the tree and stops if bumps into
- * `node_to_find'.
- */
-static int
-get_node_coordinates (SgfGameTree *tree, const SgfNode *node_to_find,
-		      int *node_x, int *node_y)
-{
-  const SgfGameTreeMapData *intermediate_data;
-  const SgfNode *node;
-  int x;
-  int *y_level;
-  int y_level_array_size;
-  int last_valid_y_level;
-  DECLARE_TIME_VARIABLES;
-
-  update_internal_map_data (tree);
-
-  STORE_STARTING_TIME;
-
-  intermediate_data = find_intermediate_data_for_node (tree, node_to_find, 0);
-
-  if (intermediate_data) {
-    last_valid_y_level = intermediate_data->last_valid_y_level;
-    y_level_array_size = ROUND_UP (last_valid_y_level + 1,
-				   Y_LEVEL_ARRAY_SIZE_GRAIN);
-    y_level	       = utils_malloc (y_level_array_size * sizeof (int));
-    memcpy (y_level, intermediate_data->y_level,
-	    (last_valid_y_level + 1) * sizeof (int));
-
-    node	       = intermediate_data->node;
-    x		       = intermediate_data->x;
+  if (index->num_items > 0) {
+    index->items = utils_realloc (index->items,
+				  (index->num_items
+				   * sizeof (SgfGameTreeMapIndexItem)));
+    qsort (index->items, index->num_items, sizeof (SgfGameTreeMapIndexItem),
+	   compare_map_index_items);
   }
   else {
-    y_level_array_size = Y_LEVEL_ARRAY_INITIAL_SIZE;
-    y_level	       = utils_malloc (y_level_array_size * sizeof (int));
-    y_level[0]	       = 0;
-    last_valid_y_level = 0;
-
-    node = tree->root;
-    x    = 0;
-
-    while (node->child && !node->is_collapsed) {
-      if (node == node_to_find)
-	goto found_the_node;
-
-      node = node->child;
-      x++;
-    }
+    utils_free (index->items);
+    index->items = NULL;
   }
 
-  do {
-    while (!node->next) {
-      if (node == node_to_find)
-	goto found_the_node;
-
-      if (!node->parent)
-	goto failed_to_find_node;
-
-      x--;
-      node = node->parent;
-    }
-
-    if (node == node_to_find)
-      goto found_the_node;
-
-    node = node->next;
-
-    if (x < last_valid_y_level) {
-      if (node->child && !node->is_collapsed) {
-	SgfNode *branch_scan_node;
-	int branch_scan_x;
-	int branch_highest_y;
-	int branch_scan_delta;
-	int branch_y;
-
-	branch_scan_node = node->child;
-	branch_scan_x	 = x + 1;
-
-	while (branch_scan_x < last_valid_y_level
-	       && branch_scan_node->child
-	       && !branch_scan_node->is_collapsed) {
-	  branch_scan_node = branch_scan_node->child;
-	  branch_scan_x++;
-	}
-
-	branch_highest_y = y_level[branch_scan_x] + 1;
-	for (branch_y = y_level[x] + 1, branch_scan_delta = 1;
-	     branch_scan_delta < branch_highest_y - branch_y;
-	     branch_scan_delta++) {
-	  branch_y = MAX (branch_y,
-			  (y_level[x + branch_scan_delta] + 1
-			   - branch_scan_delta));
-	}
-
-	y_level[x - 1] = branch_y - 1;
-	y_level[x]     = branch_y;
-
-	while (branch_y < branch_highest_y) {
-	  if (node == node_to_find)
-	    goto found_the_node;
-
-	  y_level[++x] = ++branch_y;
-	  node	       = node->child;
-	}
-
-	if (branch_y >= y_level[last_valid_y_level]) {
-	  last_valid_y_level = x;
-
-	  while (node->child && !node->is_collapsed) {
-	    if (node == node_to_find)
-	      goto found_the_node;
-
-	    x++;
-	    node = node->child;
-	  }
-	}
-	else {
-	  int x_scan;
-
-	  while (node->child && !node->is_collapsed) {
-	    if (node == node_to_find)
-	      goto found_the_node;
-
-	    y_level[++x] = branch_y;
-	    node	 = node->child;
-	  }
-
-	  for (x_scan = x + 1; y_level[x_scan] < branch_y; x_scan++)
-	    y_level[x_scan] = branch_y;
-	}
-      }
-      else {
-	y_level[x - 1] = y_level[x]++;
-
-	if (node == node_to_find)
-	  goto found_the_node;
-
-	if (y_level[x] >= y_level[last_valid_y_level])
-	  last_valid_y_level = x;
-	else {
-	  int y = y_level[x];
-	  int x_scan;
-
-	  for (x_scan = x + 1; y_level[x_scan] < y; x_scan++)
-	    y_level[x_scan] = y;
-	}
-      }
-    }
-    else {
-      if (x > last_valid_y_level) {
-	int previous_branch_y;
-
-	if (x > y_level_array_size) {
-	  y_level_array_size = ROUND_UP (x, Y_LEVEL_ARRAY_SIZE_GRAIN);
-	  y_level	     = utils_realloc (y_level,
-					      (y_level_array_size
-					       * sizeof (int)));
-	}
-
-	previous_branch_y = y_level[last_valid_y_level];
-	while (++last_valid_y_level < x)
-	  y_level[last_valid_y_level] = previous_branch_y;
+  for (k = 0, index->num_runs = 0; k < index->num_items; k++) {
+    if (index->items[k].node)
+      index->num_runs++;
+  }
 
-	y_level[x] = previous_branch_y + 1;
-      }
-      else
-	y_level[x - 1] = y_level[x]++;
+  if (index->num_runs > 0) {
+    SgfGameTreeMapIndexItem **run_pointer;
 
-      while (node->child && !node->is_collapsed) {
-	if (node == node_to_find)
-	  goto found_the_node;
+    index->runs = utils_malloc (index->num_runs
+				* sizeof (SgfGameTreeMapIndexItem *));
 
-	x++;
-	node = node->child;
-      }
+    for (k = 0, run_pointer = index->runs; k < index->num_items; k++) {
+      if (index->items[k].node)
+	*run_pointer++ = index->items + k;
     }
-  } while (!node->has_intermediate_map_data);
 
- failed_to_find_node:
-  /* Can happen if the requested node is within a collapsed subtree or
-   * if the call is seriously f*cked up with a non-existant node, for
-   * instance.
-   */
-
-  utils_free (y_level);
-
-  PRINT_RUN_TIME (get_node_coordinates);
-
-  return 0;
-
- found_the_node:
-
-  *node_x = x;
-  *node_y = y_level[MIN (x, last_valid_y_level)];
-
-  utils_free (y_level);
-
-  PRINT_RUN_TIME (get_node_coordinates);
+    qsort (index->runs, index->num_runs, sizeof (SgfGameTreeMapIndexItem *),
+	   compare_map_index_runs);
+  }
+  else
+    index->runs = NULL;
 
-  return 1;
+  return index;
 }
 
 
@@ -31,6 +31,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 
 inline static void  free_property_value (SgfProperty *property);
 
@@ -54,6 +58,8 @@ sgf_collection_new (void)
   collection->num_modified_undo_histories = 0;
   collection->is_irreversibly_modified	  = 0;
 
+  collection->source_filename		  = NULL;
+
   collection->notification_callback	  = NULL;
   collection->user_data			  = NULL;
 
@@ -78,6 +84,7 @@ sgf_collection_delete (SgfCollection *collection)
     this_tree = next_tree;
   }
 
+  utils_free (collection->source_filename);
   utils_free (collection);
 }
 
@@ -141,6 +148,56 @@ sgf_collection_set_unmodified (SgfCollection *collection)
 }
 
 
+/* Remember the file `collection' corresponds to and its status as
+ * returned by stat().  Source byte ranges of non-dirty game trees
+ * must refer to this file.  Pass NULL `filename' to forget the file,
+ * e.g. if it becomes inaccessible.
+ */
+void
+sgf_collection_set_source_file (SgfCollection *collection,
+				const char *filename,
+				const struct stat *file_status)
+{
+  assert (collection);
+  assert (!filename || file_status);
+
+  utils_free (collection->source_filename);
+
+  collection->source_filename = utils_duplicate_string (filename);
+  if (filename)
+    collection->source_file_status = *file_status;
+}
+
+
+/* Determine if `file_status' describes the very same, unchanged file
+ * `collection' was last read from or written to.  Besides size and
+ * modification time, compare device and inode, so that a file
+ * replaced by another one of the same size is detected, and
+ * nanoseconds of modification time where available, so that a
+ * rewrite within the same second is detected too.
+ */
+int
+sgf_collection_source_file_is_unchanged (const SgfCollection *collection,
+					 const struct stat *file_status)
+{
+  const struct stat *source_file_status = &collection->source_file_status;
+
+  assert (collection);
+  assert (file_status);
+
+  return (collection->source_filename
+	  && file_status->st_dev == source_file_status->st_dev
+	  && file_status->st_ino == source_file_status->st_ino
+	  && file_status->st_size == source_file_status->st_size
+	  && file_status->st_mtime == source_file_status->st_mtime
+#if defined _POSIX_VERSION && _POSIX_VERSION >= 200809L
+	  && (file_status->st_mtim.tv_nsec
+	      == source_file_status->st_mtim.tv_nsec)
+#endif
+	  );
+}
+
+
 void
 sgf_collection_set_notification_callback
   (SgfCollection *collection,
@@ -176,6 +233,12 @@ sgf_game_tree_new (void)
 
   tree->undo_operation_level  = 0;
 
+  tree->transaction_level     = 0;
+  tree->notifications_are_deferred = 0;
+
+  tree->is_dirty	      = 0;
+  tree->source_length	      = -1;
+
   tree->char_set	      = NULL;
 
   tree->application_name      = NULL;
@@ -186,11 +249,19 @@ sgf_game_tree_new (void)
 
   memory_pool_init (&tree->property_pool, sizeof (SgfProperty),
 		    STRUCTURE_FIELD_OFFSET (SgfProperty, item_index));
+  sgf_undo_entry_pool_init (tree);
 
   tree->notification_callback = NULL;
   tree->user_data	      = NULL;
 
   tree->map_data_list	      = NULL;
+  tree->map_is_valid	      = 0;
+  tree->map_first_chunk_is_modified = 1;
+  tree->map_first_chunk_index = NULL;
+  tree->map_layout_is_deferred = 0;
+  tree->map_layout_frontier   = NULL;
+
+  memset (&tree->map_statistics, 0, sizeof (SgfGameTreeMapStatistics));
 
   tree->view_port_nodes	      = NULL;
   tree->view_port_lines	      = NULL;
@@ -246,6 +317,7 @@ sgf_game_tree_delete (SgfGameTree *tree)
   SgfUndoHistory *undo_history;
 
   assert (tree);
+  assert (tree->transaction_level == 0);
 
   if (tree->notification_callback)
     tree->notification_callback (tree, SGF_GAME_TREE_DELETED, tree->user_data);
@@ -269,6 +341,8 @@ sgf_game_tree_delete (SgfGameTree *tree)
   if (tree->node_pool.item_size > 0)
     memory_pool_flush (&tree->node_pool);
 
+  memory_pool_flush (&tree->undo_entry_pool);
+
 #else
 
   if (tree->root)
@@ -34,6 +34,9 @@ const SgfUndoOperationInfo sgf_undo_operations[] = {
   { sgf_operation_change_property_do_change,
     sgf_operation_change_property_do_change,
     sgf_operation_change_property_free_data },
+  { sgf_operation_change_text_property_do_change,
+    sgf_operation_change_text_property_do_change,
+    sgf_operation_change_text_property_free_data },
   { sgf_operation_change_real_property_do_change,
     sgf_operation_change_real_property_do_change,
     NULL },
@@ -17,6 +17,7 @@ typedef enum {
   SGF_OPERATION_NEW_PROPERTY,
   SGF_OPERATION_DELETE_PROPERTY,
   SGF_OPERATION_CHANGE_PROPERTY,
+  SGF_OPERATION_CHANGE_TEXT_PROPERTY,
   SGF_OPERATION_CHANGE_REAL_PROPERTY,
   SGF_OPERATION_CUSTOM,
   SGF_NUM_OPERATIONS
@@ -40,16 +40,35 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <string.h>
 
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
 #endif
 
 
+inline static SgfUndoHistoryEntry *
+		    undo_history_entry_new (SgfGameTree *tree,
+					    SgfUndoOperation operation);
 inline static void  delete_undo_history_entry (SgfUndoHistoryEntry *entry,
 					       int is_applied,
 					       SgfGameTree *tree);
 
+static int	    get_entry_memory_size (const SgfUndoHistoryEntry *entry);
+static int	    coalesce_with_last_applied_entry
+		      (SgfGameTree *tree, SgfUndoHistoryEntry *entry);
+static void	    coalesce_with_previous_action (SgfUndoHistory *history,
+						   SgfGameTree *tree);
+static void	    forget_oldest_actions (SgfUndoHistory *history,
+					   SgfGameTree *tree);
+
+static void	    set_text_delta
+		      (SgfChangeTextPropertyOperationEntry *change_entry,
+		       const char *current_text, const char *other_text);
+static char *	    apply_text_delta
+		      (const SgfChangeTextPropertyOperationEntry *change_entry,
+		       const char *current_text);
+
 static void	    begin_undoing_or_redoing (SgfGameTree *tree);
 static void	    set_is_modifying_map (SgfGameTree *tree);
 static void	    set_is_modifying_tree (SgfGameTree *tree);
@@ -63,6 +82,13 @@ inline static SgfProperty **
 					const SgfProperty *next);
 
 
+/* Used as `unmodified_state_entry' of histories that had to forget
+ * their unmodified state because of the memory limit.  It is never
+ * linked into any history, so no state matches it.
+ */
+static SgfUndoHistoryEntry  unreachable_state_entry;
+
+
 SgfUndoHistory *
 sgf_undo_history_new (SgfGameTree *tree)
 {
@@ -75,6 +101,9 @@ sgf_undo_history_new (SgfGameTree *tree)
   history->last_applied_entry	  = NULL;
   history->unmodified_state_entry = NULL;
 
+  history->memory_used		  = 0;
+  history->memory_limit		  = SGF_DEFAULT_UNDO_HISTORY_MEMORY_LIMIT;
+
   history->notification_callback  = NULL;
   history->user_data		  = NULL;
 
@@ -199,12 +228,33 @@ sgf_undo_history_delete_redo_entries (SgfUndoHistory *history,
   while (this_entry) {
     SgfUndoHistoryEntry *next_entry = this_entry->next;
 
+    history->memory_used -= this_entry->memory_size;
     delete_undo_history_entry (this_entry, 0, tree);
     this_entry = next_entry;
   }
 }
 
 
+/* Set the approximate limit on memory taken by the entries of
+ * `history'.  Once it is exceeded, oldest actions are forgotten, but
+ * the last applied action is always kept.  Zero `memory_limit' means
+ * no limit.
+ */
+void
+sgf_undo_history_set_memory_limit (SgfUndoHistory *history, int memory_limit,
+				   SgfGameTree *tree)
+{
+  assert (history);
+  assert (tree);
+  assert (memory_limit >= 0);
+
+  history->memory_limit = memory_limit;
+
+  if (tree->undo_operation_level == 0)
+    forget_oldest_actions (history, tree);
+}
+
+
 void
 sgf_undo_history_set_notification_callback
   (SgfUndoHistory *history,
@@ -249,14 +299,71 @@ sgf_utils_end_action (SgfGameTree *tree)
   assert (tree->undo_operation_level >= 0);
 
   if (tree->undo_operation_level == 0) {
-    if (tree->undo_history && tree->undo_history->last_entry)
+    /* A transaction started inside an action must be committed
+     * before the action ends.
+     */
+    assert (tree->transaction_level == 0 || tree->notifications_are_deferred);
+
+    if (tree->undo_history && tree->undo_history->last_entry) {
+      coalesce_with_previous_action (tree->undo_history, tree);
+
       tree->undo_history->last_entry->is_last_in_action = 1;
+      forget_oldest_actions (tree->undo_history, tree);
+    }
 
     end_undoing_or_redoing (tree);
   }
 }
 
 
+/* Open a transaction on the `tree'.  Must always be paired by a call
+ * to sgf_utils_commit_transaction().  Transactions nest, only the
+ * outermost pair matters.
+ *
+ * A transaction doesn't affect undo history: any number of actions
+ * (and undos or redos) can be performed inside it.  However, instead
+ * of sending modification notifications after each of them, the tree
+ * accumulates the changes and reports them once, at commit time.
+ * `SGF_ABOUT_TO_MODIFY_TREE' and `SGF_ABOUT_TO_MODIFY_MAP' are still
+ * sent before the first change, since listeners may need to look at
+ * the unmodified tree.  Current node changes are not deferred, so
+ * that code inside the transaction sees the same current node it
+ * would see without it.
+ *
+ * Use transactions for scripted or otherwise bulk edits of a tree,
+ * which would otherwise cause a listener update and a map relayout
+ * per primitive action.
+ */
+void
+sgf_utils_begin_transaction (SgfGameTree *tree)
+{
+  assert (tree);
+
+  if (tree->transaction_level++ == 0 && tree->undo_operation_level == 0) {
+    begin_undoing_or_redoing (tree);
+    tree->notifications_are_deferred = 1;
+  }
+}
+
+
+/* Commit a transaction, i.e. send all the notifications postponed
+ * since the matching call to sgf_utils_begin_transaction().
+ */
+void
+sgf_utils_commit_transaction (SgfGameTree *tree)
+{
+  assert (tree);
+  assert (tree->transaction_level > 0);
+
+  if (--tree->transaction_level == 0 && tree->notifications_are_deferred) {
+    assert (tree->undo_operation_level == 0);
+
+    tree->notifications_are_deferred = 0;
+    end_undoing_or_redoing (tree);
+  }
+}
+
+
 void
 sgf_utils_undo (SgfGameTree *tree)
 {
@@ -271,6 +378,7 @@ sgf_utils_undo (SgfGameTree *tree)
     return;
 
   begin_undoing_or_redoing (tree);
+  tree->is_dirty = 1;
 
   entry = tree->undo_history->last_applied_entry;
 
@@ -305,6 +413,7 @@ sgf_utils_redo (SgfGameTree *tree)
 	     ? history->last_applied_entry->next : history->first_entry);
 
   begin_undoing_or_redoing (tree);
+  tree->is_dirty = 1;
 
   while (1) {
     sgf_undo_operations[entry->operation_index].redo (entry, tree);
@@ -324,13 +433,21 @@ sgf_utils_redo (SgfGameTree *tree)
 
 /* All remaining functions are private to the SGF module. */
 
+void
+sgf_undo_entry_pool_init (SgfGameTree *tree)
+{
+  memory_pool_init (&tree->undo_entry_pool, sizeof (SgfAnyOperationEntry),
+		    STRUCTURE_FIELD_OFFSET (SgfUndoHistoryEntry, item_index));
+}
+
+
 SgfUndoHistoryEntry *
-sgf_new_node_undo_history_entry_new (SgfNode *new_node)
+sgf_new_node_undo_history_entry_new (SgfGameTree *tree, SgfNode *new_node)
 {
   SgfNodeOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfNodeOperationEntry));
+    = ((SgfNodeOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_NEW_NODE));
 
-  operation_data->entry.operation_index	   = SGF_OPERATION_NEW_NODE;
   operation_data->node			   = new_node;
   operation_data->parent_current_variation
     = new_node->parent->current_variation;
@@ -340,13 +457,13 @@ sgf_new_node_undo_history_entry_new (SgfNode *new_node)
 
 
 SgfUndoHistoryEntry *
-sgf_delete_node_undo_history_entry_new (SgfNode *node)
+sgf_delete_node_undo_history_entry_new (SgfGameTree *tree, SgfNode *node)
 {
   SgfNodeOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfNodeOperationEntry));
+    = ((SgfNodeOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_DELETE_NODE));
 
-  operation_data->entry.operation_index = SGF_OPERATION_DELETE_NODE;
-  operation_data->node			= node;
+  operation_data->node = node;
 
   /* This field is used after node deletion.  So, we should set it so
    * it is _not_ equal to the `node', which is being deleted.  Use a
@@ -360,13 +477,13 @@ sgf_delete_node_undo_history_entry_new (SgfNode *node)
 
 
 SgfUndoHistoryEntry *
-sgf_delete_node_children_undo_history_entry_new (SgfNode *node)
+sgf_delete_node_children_undo_history_entry_new (SgfGameTree *tree,
+						 SgfNode *node)
 {
   SgfNodeOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfNodeOperationEntry));
+    = ((SgfNodeOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_DELETE_NODE_CHILDREN));
 
-  operation_data->entry.operation_index
-    = SGF_OPERATION_DELETE_NODE_CHILDREN;
   operation_data->node			   = node->child;
   operation_data->parent_current_variation = node->current_variation;
 
@@ -375,12 +492,13 @@ sgf_delete_node_children_undo_history_entry_new (SgfNode *node)
 
 
 SgfUndoHistoryEntry *
-sgf_swap_nodes_undo_history_entry_new (SgfNode *node1, SgfNode *node2)
+sgf_swap_nodes_undo_history_entry_new (SgfGameTree *tree,
+				       SgfNode *node1, SgfNode *node2)
 {
   SgfTwoNodesOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfTwoNodesOperationEntry));
+    = ((SgfTwoNodesOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_SWAP_NODES));
 
-  operation_data->entry.operation_index	   = SGF_OPERATION_SWAP_NODES;
   operation_data->node1			   = node1;
   operation_data->node2			   = node2;
   operation_data->parent_current_variation = node1->parent->current_variation;
@@ -391,15 +509,16 @@ sgf_swap_nodes_undo_history_entry_new (SgfNode *node1, SgfNode *node2)
 
 SgfUndoHistoryEntry *
 sgf_change_node_inlined_color_undo_history_entry_new
-  (SgfNode *node, SgfUndoOperation operation, int new_color, int side_effect)
+  (SgfGameTree *tree, SgfNode *node, SgfUndoOperation operation,
+   int new_color, int side_effect)
 {
   SgfChangeNodeInlinedColorOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfChangeNodeInlinedColorOperationEntry));
+    = ((SgfChangeNodeInlinedColorOperationEntry *)
+       undo_history_entry_new (tree, operation));
 
-  operation_data->entry.operation_index = operation;
-  operation_data->node			= node;
-  operation_data->color			= new_color;
-  operation_data->side_effect		= side_effect;
+  operation_data->node	      = node;
+  operation_data->color	      = new_color;
+  operation_data->side_effect = side_effect;
 
   return (SgfUndoHistoryEntry *) operation_data;
 }
@@ -411,46 +530,72 @@ sgf_new_property_undo_history_entry_new (SgfGameTree *tree, SgfNode *node,
 					 int side_effect)
 {
   SgfPropertyOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfPropertyOperationEntry));
+    = ((SgfPropertyOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_NEW_PROPERTY));
 
-  operation_data->entry.operation_index = SGF_OPERATION_NEW_PROPERTY;
-  operation_data->node			= node;
-  operation_data->property		= sgf_property_new (tree, type, *link);
-  operation_data->side_effect		= side_effect;
+  operation_data->node	      = node;
+  operation_data->property    = sgf_property_new (tree, type, *link);
+  operation_data->side_effect = side_effect;
 
   return (SgfUndoHistoryEntry *) operation_data;
 }
 
 
 SgfUndoHistoryEntry *
-sgf_delete_property_undo_history_entry_new (SgfNode *node,
+sgf_delete_property_undo_history_entry_new (SgfGameTree *tree, SgfNode *node,
 					    SgfProperty *property,
 					    int side_effect)
 {
   SgfPropertyOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfPropertyOperationEntry));
+    = ((SgfPropertyOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_DELETE_PROPERTY));
 
-  operation_data->entry.operation_index = SGF_OPERATION_DELETE_PROPERTY;
-  operation_data->node			= node;
-  operation_data->property		= property;
-  operation_data->side_effect		= side_effect;
+  operation_data->node	      = node;
+  operation_data->property    = property;
+  operation_data->side_effect = side_effect;
 
   return (SgfUndoHistoryEntry *) operation_data;
 }
 
 
 SgfUndoHistoryEntry *
-sgf_change_property_undo_history_entry_new (SgfNode *node,
+sgf_change_property_undo_history_entry_new (SgfGameTree *tree, SgfNode *node,
 					    SgfProperty *property,
 					    int side_effect)
 {
   SgfChangePropertyOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfChangePropertyOperationEntry));
+    = ((SgfChangePropertyOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_CHANGE_PROPERTY));
+
+  operation_data->node	      = node;
+  operation_data->property    = property;
+  operation_data->side_effect = side_effect;
+
+  return (SgfUndoHistoryEntry *) operation_data;
+}
+
+
+/* Unlike with other property changing entries, `new_text' is passed
+ * here, because the entry only stores its difference from the current
+ * value.  `new_text' is freed.
+ */
+SgfUndoHistoryEntry *
+sgf_change_text_property_undo_history_entry_new (SgfGameTree *tree,
+						 SgfNode *node,
+						 SgfProperty *property,
+						 char *new_text,
+						 int side_effect)
+{
+  SgfChangeTextPropertyOperationEntry *operation_data
+    = ((SgfChangeTextPropertyOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_CHANGE_TEXT_PROPERTY));
 
-  operation_data->entry.operation_index = SGF_OPERATION_CHANGE_PROPERTY;
-  operation_data->node			= node;
-  operation_data->property		= property;
-  operation_data->side_effect		= side_effect;
+  operation_data->node	      = node;
+  operation_data->property    = property;
+  operation_data->side_effect = side_effect;
+
+  set_text_delta (operation_data, property->value.text, new_text);
+  utils_free (new_text);
 
   return (SgfUndoHistoryEntry *) operation_data;
 }
@@ -459,19 +604,20 @@ sgf_change_property_undo_history_entry_new (SgfNode *node,
 #if SGF_REAL_VALUES_ALLOCATED_SEPARATELY
 
 SgfUndoHistoryEntry *
-sgf_change_real_property_undo_history_entry_new (SgfNode *node,
+sgf_change_real_property_undo_history_entry_new (SgfGameTree *tree,
+						 SgfNode *node,
 						 SgfProperty *property,
 						 double new_value,
 						 int side_effect)
 {
   SgfChangeRealPropertyOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfChangeRealPropertyOperationEntry));
+    = ((SgfChangeRealPropertyOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_CHANGE_REAL_PROPERTY));
 
-  operation_data->entry.operation_index = SGF_OPERATION_CHANGE_REAL_PROPERTY;
-  operation_data->node			= node;
-  operation_data->property		= property;
-  operation_data->value			= new_value;
-  operation_data->side_effect		= side_effect;
+  operation_data->node	      = node;
+  operation_data->property    = property;
+  operation_data->value	      = new_value;
+  operation_data->side_effect = side_effect;
 
   return (SgfUndoHistoryEntry *) operation_data;
 }
@@ -481,21 +627,37 @@ sgf_change_real_property_undo_history_entry_new (SgfNode *node,
 
 SgfUndoHistoryEntry *
 sgf_custom_undo_history_entry_new
-  (const SgfCustomUndoHistoryEntryData *entry_data, void *user_data,
-   SgfNode *node_to_switch_to)
+  (SgfGameTree *tree, const SgfCustomUndoHistoryEntryData *entry_data,
+   void *user_data, SgfNode *node_to_switch_to)
 {
   SgfCustomOperationEntry *operation_data
-    = utils_malloc (sizeof (SgfCustomOperationEntry));
+    = ((SgfCustomOperationEntry *)
+       undo_history_entry_new (tree, SGF_OPERATION_CUSTOM));
 
-  operation_data->entry.operation_index = SGF_OPERATION_CUSTOM;
-  operation_data->entry_data		= entry_data;
-  operation_data->user_data		= user_data;
-  operation_data->node_to_switch_to	= node_to_switch_to;
+  operation_data->entry_data	    = entry_data;
+  operation_data->user_data	    = user_data;
+  operation_data->node_to_switch_to = node_to_switch_to;
 
   return (SgfUndoHistoryEntry *) operation_data;
 }
 
 
+/* Undo history entries of all types are allocated from the same
+ * per-tree memory pool.  Edits tend to create many small entries, and
+ * the pool avoids both the allocation overhead and fragmentation.
+ */
+inline static SgfUndoHistoryEntry *
+undo_history_entry_new (SgfGameTree *tree, SgfUndoOperation operation)
+{
+  SgfUndoHistoryEntry *entry = memory_pool_alloc (&tree->undo_entry_pool);
+
+  entry->operation_index = operation;
+  entry->memory_size	 = 0;
+
+  return entry;
+}
+
+
 inline static void
 delete_undo_history_entry (SgfUndoHistoryEntry *entry, int is_applied,
 			   SgfGameTree *tree)
@@ -505,16 +667,73 @@ delete_undo_history_entry (SgfUndoHistoryEntry *entry, int is_applied,
 							   tree);
   }
 
-  utils_free (entry);
+  memory_pool_free (&tree->undo_entry_pool, entry);
 }
 
 
-
+/* Estimate the number of bytes taken by an undo history entry.  Only
+ * the data owned by the entry itself is counted: e.g. deleted nodes
+ * are not.  The estimate must not change when the entry is undone or
+ * redone.
+ */
+static int
+get_entry_memory_size (const SgfUndoHistoryEntry *entry)
+{
+  int memory_size = sizeof (SgfAnyOperationEntry);
+
+  if (entry->operation_index == SGF_OPERATION_CHANGE_TEXT_PROPERTY) {
+    const SgfChangeTextPropertyOperationEntry *change_entry
+      = (const SgfChangeTextPropertyOperationEntry *) entry;
+
+    /* Sum of the lengths of both old and new text fragments. */
+    memory_size += strlen (change_entry->text) + 1 + change_entry->length;
+  }
+  else if (entry->operation_index == SGF_OPERATION_CHANGE_PROPERTY) {
+    const SgfChangePropertyOperationEntry *change_entry
+      = (const SgfChangePropertyOperationEntry *) entry;
+    const SgfValue *value = &change_entry->value;
+
+    switch (property_info[change_entry->property->type].value_type) {
+    case SGF_SIMPLE_TEXT:
+    case SGF_FAKE_SIMPLE_TEXT:
+    case SGF_TEXT:
+      if (value->text)
+	memory_size += strlen (value->text) + 1;
+
+      break;
+
+    case SGF_LIST_OF_POINT:
+    case SGF_ELIST_OF_POINT:
+      if (value->position_list) {
+	memory_size += ((value->position_list->num_positions + 1)
+			* sizeof (int));
+      }
+
+      break;
+
+    default:
+      break;
+    }
+  }
+  else if (entry->operation_index == SGF_OPERATION_NEW_PROPERTY
+	   || entry->operation_index == SGF_OPERATION_DELETE_PROPERTY)
+    memory_size += sizeof (SgfProperty);
+
+  return memory_size;
+}
+
+
+
 
 static void
 begin_undoing_or_redoing (SgfGameTree *tree)
 {
   tree->node_to_switch_to = NULL;
+
+  /* Everything else is tracked from the start of the transaction. */
+  if (tree->notifications_are_deferred)
+    return;
+
   tree->is_modifying_map  = 0;
   tree->is_modifying_tree = 0;
 
@@ -568,6 +787,10 @@ end_undoing_or_redoing (SgfGameTree *tree)
     GAME_TREE_DO_NOTIFY (tree, SGF_CURRENT_NODE_CHANGED);
   }
 
+  tree->node_to_switch_to = NULL;
+  if (tree->notifications_are_deferred)
+    return;
+
   if (tree->is_modifying_tree)
     GAME_TREE_DO_NOTIFY (tree, SGF_TREE_MODIFIED);
   if (tree->is_modifying_map)
@@ -603,6 +826,11 @@ sgf_utils_apply_undo_history_entry (SgfGameTree *tree,
   if (history) {
     sgf_undo_history_delete_redo_entries (history, tree);
 
+    if (coalesce_with_last_applied_entry (tree, entry)) {
+      tree->is_dirty = 1;
+      return;
+    }
+
     if (history->last_applied_entry) {
       history->last_applied_entry->next = entry;
       entry->previous			= history->last_applied_entry;
@@ -621,8 +849,13 @@ sgf_utils_apply_undo_history_entry (SgfGameTree *tree,
 
   /* Perform the operation. */
   sgf_undo_operations[entry->operation_index].redo (entry, tree);
+  tree->is_dirty = 1;
 
-  if (!history) {
+  if (history) {
+    entry->memory_size	  = get_entry_memory_size (entry);
+    history->memory_used += entry->memory_size;
+  }
+  else {
     delete_undo_history_entry (entry, 1, tree);
 
     tree->collection->is_irreversibly_modified = 1;
@@ -630,7 +863,229 @@ sgf_utils_apply_undo_history_entry (SgfGameTree *tree,
 }
 
 
-
+/* Merge a property change `entry' into the last applied entry of the
+ * current undo history, if the latter changes the same property as
+ * part of the same, still unfinished, action.  Then the old entry
+ * goes on storing the original value and the new one is applied and
+ * deleted right away.  Return non-zero if merged.
+ */
+static int
+coalesce_with_last_applied_entry (SgfGameTree *tree,
+				  SgfUndoHistoryEntry *entry)
+{
+  SgfUndoHistory *history = tree->undo_history;
+  SgfUndoHistoryEntry *last_entry = history->last_applied_entry;
+  const SgfPropertyOperationEntry *property_entry;
+  const SgfPropertyOperationEntry *last_property_entry;
+
+  if (!last_entry
+      || last_entry->is_last_in_action
+      || last_entry->is_hidden
+      || last_entry == history->unmodified_state_entry
+      || last_entry->operation_index != entry->operation_index)
+    return 0;
+
+  switch (entry->operation_index) {
+  case SGF_OPERATION_CHANGE_PROPERTY:
+  case SGF_OPERATION_CHANGE_TEXT_PROPERTY:
+#if SGF_REAL_VALUES_ALLOCATED_SEPARATELY
+  case SGF_OPERATION_CHANGE_REAL_PROPERTY:
+#endif
+    break;
+
+  default:
+    return 0;
+  }
+
+  /* All property changing entries start with the same fields as
+   * `SgfPropertyOperationEntry', so use it for the checks.
+   */
+  property_entry      = (const SgfPropertyOperationEntry *) entry;
+  last_property_entry = (const SgfPropertyOperationEntry *) last_entry;
+
+  if (property_entry->node != last_property_entry->node
+      || property_entry->property != last_property_entry->property
+      || property_entry->side_effect != last_property_entry->side_effect)
+    return 0;
+
+  if (entry->operation_index == SGF_OPERATION_CHANGE_TEXT_PROPERTY) {
+    SgfChangeTextPropertyOperationEntry *last_change_entry
+      = (SgfChangeTextPropertyOperationEntry *) last_entry;
+    SgfProperty *property = last_change_entry->property;
+    char *original_text = apply_text_delta (last_change_entry,
+					    property->value.text);
+
+    sgf_undo_operations[entry->operation_index].redo (entry, tree);
+    delete_undo_history_entry (entry, 1, tree);
+
+    /* Recompute the delta against the original text. */
+    utils_free (last_change_entry->text);
+    set_text_delta (last_change_entry, property->value.text, original_text);
+    utils_free (original_text);
+
+    history->memory_used    -= last_entry->memory_size;
+    last_entry->memory_size  = get_entry_memory_size (last_entry);
+    history->memory_used    += last_entry->memory_size;
+  }
+  else {
+    /* The new entry ends up holding the intermediate value, which is
+     * not needed anymore.
+     */
+    sgf_undo_operations[entry->operation_index].redo (entry, tree);
+    delete_undo_history_entry (entry, 1, tree);
+  }
+
+  return 1;
+}
+
+
+/* If the action just finished consists of a single text change and
+ * the previous action is a single change of the same text, merge the
+ * two into one action.  This way typing a comment, which sets the
+ * text after each keystroke, doesn't produce an undo step per
+ * character.  Nesting doesn't matter: only the entries that end up in
+ * the history are looked at.
+ */
+static void
+coalesce_with_previous_action (SgfUndoHistory *history, SgfGameTree *tree)
+{
+  SgfUndoHistoryEntry *last_entry = history->last_entry;
+  SgfUndoHistoryEntry *previous_entry = last_entry->previous;
+  SgfChangeTextPropertyOperationEntry *last_change_entry;
+  SgfChangeTextPropertyOperationEntry *previous_change_entry;
+  SgfProperty *property;
+  char *intermediate_text;
+  char *original_text;
+
+  if (last_entry->is_last_in_action
+      || last_entry != history->last_applied_entry
+      || !previous_entry
+      || !previous_entry->is_last_in_action
+      || (previous_entry->previous
+	  && !previous_entry->previous->is_last_in_action)
+      || last_entry->is_hidden
+      || previous_entry->is_hidden
+      || previous_entry == history->unmodified_state_entry
+      || last_entry->operation_index != SGF_OPERATION_CHANGE_TEXT_PROPERTY
+      || previous_entry->operation_index != SGF_OPERATION_CHANGE_TEXT_PROPERTY)
+    return;
+
+  last_change_entry	= (SgfChangeTextPropertyOperationEntry *) last_entry;
+  previous_change_entry = ((SgfChangeTextPropertyOperationEntry *)
+			   previous_entry);
+
+  if (last_change_entry->node != previous_change_entry->node
+      || last_change_entry->property != previous_change_entry->property
+      || last_change_entry->side_effect != previous_change_entry->side_effect)
+    return;
+
+  /* Make the previous entry change the text right from its value
+   * before the previous action.
+   */
+  property	    = last_change_entry->property;
+  intermediate_text = apply_text_delta (last_change_entry,
+					property->value.text);
+  original_text	    = apply_text_delta (previous_change_entry,
+					intermediate_text);
+  utils_free (intermediate_text);
+
+  utils_free (previous_change_entry->text);
+  set_text_delta (previous_change_entry, property->value.text, original_text);
+  utils_free (original_text);
+
+  history->memory_used	     -= (previous_entry->memory_size
+				 + last_entry->memory_size);
+  previous_entry->memory_size = get_entry_memory_size (previous_entry);
+  history->memory_used	     += previous_entry->memory_size;
+
+  previous_entry->next	      = NULL;
+  history->last_entry	      = previous_entry;
+  history->last_applied_entry = previous_entry;
+
+  delete_undo_history_entry (last_entry, 1, tree);
+}
+
+
+/* Forget oldest actions of `history' until it fits in its memory
+ * limit.  Hidden actions are always forgotten together with the
+ * action they are attached to.  The last applied action is never
+ * forgotten, nor are the actions that can only be redone.
+ */
+static void
+forget_oldest_actions (SgfUndoHistory *history, SgfGameTree *tree)
+{
+  if (history->memory_limit == 0)
+    return;
+
+  while (history->memory_used > history->memory_limit) {
+    SgfUndoHistoryEntry *last_forgotten_entry = history->first_entry;
+    SgfUndoHistoryEntry *this_entry;
+
+    if (!history->last_applied_entry)
+      return;
+
+    /* Find the end of the oldest action and any hidden actions that
+     * follow it.
+     */
+    while (1) {
+      while (!last_forgotten_entry->is_last_in_action) {
+	if (last_forgotten_entry == history->last_applied_entry)
+	  return;
+
+	last_forgotten_entry = last_forgotten_entry->next;
+      }
+
+      if (last_forgotten_entry == history->last_applied_entry)
+	return;
+
+      this_entry = last_forgotten_entry->next;
+      while (!this_entry->is_last_in_action)
+	this_entry = this_entry->next;
+
+      if (!this_entry->is_hidden)
+	break;
+
+      last_forgotten_entry = this_entry;
+    }
+
+    /* The state right after the last forgotten entry becomes the
+     * initial one.  Any earlier state cannot be reached anymore.
+     */
+    if (history->unmodified_state_entry == last_forgotten_entry)
+      history->unmodified_state_entry = NULL;
+    else if (!history->unmodified_state_entry)
+      history->unmodified_state_entry = &unreachable_state_entry;
+    else {
+      for (this_entry = history->first_entry;
+	   this_entry != last_forgotten_entry; this_entry = this_entry->next) {
+	if (this_entry == history->unmodified_state_entry) {
+	  history->unmodified_state_entry = &unreachable_state_entry;
+	  break;
+	}
+      }
+    }
+
+    this_entry			   = history->first_entry;
+    history->first_entry	   = last_forgotten_entry->next;
+    history->first_entry->previous = NULL;
+
+    while (1) {
+      SgfUndoHistoryEntry *next_entry = this_entry->next;
+      int is_last_forgotten_entry = (this_entry == last_forgotten_entry);
+
+      history->memory_used -= this_entry->memory_size;
+      delete_undo_history_entry (this_entry, 1, tree);
+
+      if (is_last_forgotten_entry)
+	break;
+
+      this_entry = next_entry;
+    }
+  }
+}
+
+
+
 
 void
 sgf_operation_add_node (SgfUndoHistoryEntry *entry, SgfGameTree *tree)
@@ -643,7 +1098,7 @@ sgf_operation_add_node (SgfUndoHistoryEntry *entry, SgfGameTree *tree)
   tree->node_to_switch_to = node;
 
   * find_node_link (node->parent, node->next) = node;
-  sgf_game_tree_invalidate_map (tree, node->parent);
+  sgf_game_tree_invalidate_map (tree, node);
 }
 
 
@@ -658,11 +1113,11 @@ sgf_operation_delete_node (SgfUndoHistoryEntry *entry, SgfGameTree *tree)
 
   tree->node_to_switch_to = parent;
 
+  sgf_game_tree_invalidate_map (tree, node);
+
   * find_node_link (parent, node) = node->next;
   parent->current_variation = (((SgfNodeOperationEntry *) entry)
 			       ->parent_current_variation);
-
-  sgf_game_tree_invalidate_map (tree, parent);
 }
 
 
@@ -715,10 +1170,10 @@ sgf_operation_delete_node_children_redo (SgfUndoHistoryEntry *entry,
 
   tree->node_to_switch_to = parent;
 
+  sgf_game_tree_invalidate_map (tree, parent);
+
   parent->child		    = NULL;
   parent->current_variation = NULL;
-
-  sgf_game_tree_invalidate_map (tree, parent);
 }
 
 
@@ -757,6 +1212,9 @@ sgf_operation_swap_nodes_do_swap (SgfUndoHistoryEntry *entry,
 
   tree->node_to_switch_to = node1;
 
+  sgf_game_tree_invalidate_map (tree, node1);
+  sgf_game_tree_invalidate_map (tree, node2);
+
   link = &parent->child;
   while (*link != node1 && *link != node2) {
     assert (*link);
@@ -781,8 +1239,6 @@ sgf_operation_swap_nodes_do_swap (SgfUndoHistoryEntry *entry,
   } while (*link != node2);
 
   *link = node1;
-
-  sgf_game_tree_invalidate_map (tree, parent);
 }
 
 
@@ -998,6 +1454,103 @@ sgf_operation_change_property_free_data (SgfUndoHistoryEntry *entry,
 }
 
 
+/* Works as both undo and redo handler.  Since we just swap the text
+ * fragments between the property and the undo history entry, it will
+ * always do the right thing.
+ */
+void
+sgf_operation_change_text_property_do_change (SgfUndoHistoryEntry *entry,
+					      SgfGameTree *tree)
+{
+  SgfChangeTextPropertyOperationEntry *const change_entry
+    = (SgfChangeTextPropertyOperationEntry *) entry;
+  SgfProperty *property = change_entry->property;
+  char *new_text = apply_text_delta (change_entry, property->value.text);
+  int new_length = strlen (change_entry->text);
+
+  if (!change_entry->side_effect)
+    tree->node_to_switch_to = change_entry->node;
+
+  utils_free (change_entry->text);
+  change_entry->text = utils_duplicate_as_string ((property->value.text
+						   + change_entry->offset),
+						  change_entry->length);
+  change_entry->length = new_length;
+
+  utils_free (property->value.text);
+  property->value.text = new_text;
+}
+
+
+void
+sgf_operation_change_text_property_free_data (SgfUndoHistoryEntry *entry,
+					      int is_applied,
+					      SgfGameTree *tree)
+{
+  UNUSED (tree);
+  UNUSED (is_applied);
+
+  utils_free (((SgfChangeTextPropertyOperationEntry *) entry)->text);
+}
+
+
+/* Make `change_entry' describe how to turn `current_text' into
+ * `other_text'.  Common prefix and suffix of the texts are not stored.
+ */
+static void
+set_text_delta (SgfChangeTextPropertyOperationEntry *change_entry,
+		const char *current_text, const char *other_text)
+{
+  int current_length = strlen (current_text);
+  int other_length   = strlen (other_text);
+  int prefix_length  = 0;
+  int suffix_length  = 0;
+
+  while (prefix_length < current_length && prefix_length < other_length
+	 && current_text[prefix_length] == other_text[prefix_length])
+    prefix_length++;
+
+  while (suffix_length < current_length - prefix_length
+	 && suffix_length < other_length - prefix_length
+	 && (current_text[current_length - 1 - suffix_length]
+	     == other_text[other_length - 1 - suffix_length]))
+    suffix_length++;
+
+  change_entry->offset = prefix_length;
+  change_entry->length = current_length - prefix_length - suffix_length;
+  change_entry->text   = utils_duplicate_as_string ((other_text
+						     + prefix_length),
+						    (other_length
+						     - prefix_length
+						     - suffix_length));
+}
+
+
+/* Return a newly allocated text that `change_entry' turns
+ * `current_text' into.
+ */
+static char *
+apply_text_delta (const SgfChangeTextPropertyOperationEntry *change_entry,
+		  const char *current_text)
+{
+  int current_length  = strlen (current_text);
+  int fragment_length = strlen (change_entry->text);
+  int suffix_offset   = change_entry->offset + change_entry->length;
+  int suffix_length   = current_length - suffix_offset;
+  char *text = utils_malloc (change_entry->offset + fragment_length
+			     + suffix_length + 1);
+
+  assert (suffix_length >= 0);
+
+  memcpy (text, current_text, change_entry->offset);
+  memcpy (text + change_entry->offset, change_entry->text, fragment_length);
+  memcpy (text + change_entry->offset + fragment_length,
+	  current_text + suffix_offset, suffix_length + 1);
+
+  return text;
+}
+
+
 #if SGF_REAL_VALUES_ALLOCATED_SEPARATELY
 
 /* Works as both undo and redo handler.  Since we just swap values
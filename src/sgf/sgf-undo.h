@@ -47,6 +47,14 @@ struct _SgfUndoHistoryEntry {
   unsigned char		operation_index;
   char			is_last_in_action;
   char			is_hidden;
+
+  MEMORY_POOL_ITEM_INDEX;
+
+  /* Approximate number of bytes the entry accounts for in its undo
+   * history's memory budget.  Only valid for entries that are linked
+   * into a history.
+   */
+  int			memory_size;
 };
 
 
@@ -58,11 +66,15 @@ typedef struct _SgfChangeNodeInlinedColorOperationEntry
 typedef struct _SgfPropertyOperationEntry	SgfPropertyOperationEntry;
 typedef struct _SgfChangePropertyOperationEntry
 		SgfChangePropertyOperationEntry;
+typedef struct _SgfChangeTextPropertyOperationEntry
+		SgfChangeTextPropertyOperationEntry;
 typedef struct _SgfChangeRealPropertyOperationEntry
 		SgfChangeRealPropertyOperationEntry;
 
 typedef struct _SgfCustomOperationEntry		SgfCustomOperationEntry;
 
+typedef union _SgfAnyOperationEntry		SgfAnyOperationEntry;
+
 struct _SgfNodeOperationEntry {
   SgfUndoHistoryEntry	entry;
 
@@ -94,13 +106,34 @@ struct _SgfPropertyOperationEntry {
   int			side_effect;
 };
 
+/* All property change entries must start with the same fields as
+ * `SgfPropertyOperationEntry' does.
+ */
 struct _SgfChangePropertyOperationEntry {
   SgfUndoHistoryEntry	entry;
 
   SgfNode	       *node;
   SgfProperty	       *property;
+  int			side_effect;
   SgfValue		value;
+};
+
+/* Text property changes are stored as deltas: only the part of the
+ * text between the common prefix and the common suffix of the old and
+ * new values is kept.  `text' is the replacement for the `length'
+ * bytes that start at `offset' in the property's current value.
+ * Applying the entry swaps the two, so it works for both undo and
+ * redo.
+ */
+struct _SgfChangeTextPropertyOperationEntry {
+  SgfUndoHistoryEntry	entry;
+
+  SgfNode	       *node;
+  SgfProperty	       *property;
   int			side_effect;
+  char		       *text;
+  int			offset;
+  int			length;
 };
 
 struct _SgfChangeRealPropertyOperationEntry {
@@ -108,8 +141,8 @@ struct _SgfChangeRealPropertyOperationEntry {
 
   SgfNode	       *node;
   SgfProperty	       *property;
-  double		value;
   int			side_effect;
+  double		value;
 };
 
 struct _SgfCustomOperationEntry {
@@ -121,6 +154,18 @@ struct _SgfCustomOperationEntry {
   SgfNode	       *node_to_switch_to;
 };
 
+/* Only used to determine the size of undo entry pool items. */
+union _SgfAnyOperationEntry {
+  SgfNodeOperationEntry			    node_entry;
+  SgfTwoNodesOperationEntry		    two_nodes_entry;
+  SgfChangeNodeInlinedColorOperationEntry   change_color_entry;
+  SgfPropertyOperationEntry		    property_entry;
+  SgfChangePropertyOperationEntry	    change_property_entry;
+  SgfChangeTextPropertyOperationEntry	    change_text_property_entry;
+  SgfChangeRealPropertyOperationEntry	    change_real_property_entry;
+  SgfCustomOperationEntry		    custom_entry;
+};
+
 
 /* Undo operations. */
 extern const SgfUndoOperationInfo    sgf_undo_operations[];
@@ -165,6 +210,11 @@ DECLARE_UNDO_OR_REDO_FUNCTION (sgf_operation_change_property_do_change);
 
 DECLARE_FREE_DATA_FUNCTION (sgf_operation_change_property_free_data);
 
+/* Used as both undo and redo handler. */
+DECLARE_UNDO_OR_REDO_FUNCTION (sgf_operation_change_text_property_do_change);
+
+DECLARE_FREE_DATA_FUNCTION (sgf_operation_change_text_property_free_data);
+
 
 #if SGF_REAL_VALUES_ALLOCATED_SEPARATELY
 
@@ -182,30 +232,43 @@ DECLARE_FREE_DATA_FUNCTION (sgf_operation_custom_free_data);
 void		       sgf_utils_apply_undo_history_entry
 			 (SgfGameTree *tree, SgfUndoHistoryEntry *entry);
 
+void		       sgf_undo_entry_pool_init (SgfGameTree *tree);
+
 
-SgfUndoHistoryEntry *  sgf_new_node_undo_history_entry_new (SgfNode *new_node);
-SgfUndoHistoryEntry *  sgf_delete_node_undo_history_entry_new (SgfNode *node);
+SgfUndoHistoryEntry *  sgf_new_node_undo_history_entry_new
+			 (SgfGameTree *tree, SgfNode *new_node);
+SgfUndoHistoryEntry *  sgf_delete_node_undo_history_entry_new
+			 (SgfGameTree *tree, SgfNode *node);
 SgfUndoHistoryEntry *  sgf_delete_node_children_undo_history_entry_new
-			 (SgfNode *node);
-SgfUndoHistoryEntry *  sgf_swap_nodes_undo_history_entry_new (SgfNode *node1,
-							      SgfNode *node2);
+			 (SgfGameTree *tree, SgfNode *node);
+SgfUndoHistoryEntry *  sgf_swap_nodes_undo_history_entry_new
+			 (SgfGameTree *tree, SgfNode *node1, SgfNode *node2);
 SgfUndoHistoryEntry *  sgf_change_node_inlined_color_undo_history_entry_new
-			 (SgfNode *node, SgfUndoOperation operation,
+			 (SgfGameTree *tree, SgfNode *node,
+			  SgfUndoOperation operation,
 			  int new_color, int side_effect);
 
 SgfUndoHistoryEntry *  sgf_new_property_undo_history_entry_new
 			 (SgfGameTree *tree, SgfNode *node, SgfProperty **link,
 			  SgfType type, int side_effect);
 SgfUndoHistoryEntry *  sgf_delete_property_undo_history_entry_new
-			 (SgfNode *node, SgfProperty *property, int side_effect);
+			 (SgfGameTree *tree, SgfNode *node,
+			  SgfProperty *property, int side_effect);
 SgfUndoHistoryEntry *  sgf_change_property_undo_history_entry_new
-			 (SgfNode *node, SgfProperty *property, int side_effect);
+			 (SgfGameTree *tree, SgfNode *node,
+			  SgfProperty *property, int side_effect);
+SgfUndoHistoryEntry *  sgf_change_text_property_undo_history_entry_new
+			 (SgfGameTree *tree, SgfNode *node,
+			  SgfProperty *property, char *new_text,
+			  int side_effect);
 SgfUndoHistoryEntry *  sgf_change_real_property_undo_history_entry_new
-			 (SgfNode *node, SgfProperty *property,
+			 (SgfGameTree *tree, SgfNode *node,
+			  SgfProperty *property,
 			  double new_value, int side_effect);
 
 SgfUndoHistoryEntry *  sgf_custom_undo_history_entry_new
-			 (const SgfCustomUndoHistoryEntryData *entry_data,
+			 (SgfGameTree *tree,
+			  const SgfCustomUndoHistoryEntryData *entry_data,
 			  void *user_data, SgfNode *node_to_switch_to);
 
 
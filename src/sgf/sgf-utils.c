@@ -420,7 +420,7 @@ sgf_utils_append_variation (SgfGameTree *tree, int color, ...)
 
   sgf_utils_begin_action (tree);
   sgf_utils_apply_undo_history_entry
-    (tree, sgf_new_node_undo_history_entry_new (new_node));
+    (tree, sgf_new_node_undo_history_entry_new (tree, new_node));
   sgf_utils_end_action (tree);
 
   return new_node;
@@ -444,6 +444,11 @@ sgf_utils_apply_setup_changes (SgfGameTree *tree,
   assert (tree->board);
   assert (grid);
 
+  /* Leaving the old setup node, replacing the setup properties and
+   * entering the new node must be reported as one change.
+   */
+  sgf_utils_begin_transaction (tree);
+
   node = tree->current_node;
   if (node->move_color == SETUP_NODE) {
     if (node->parent)
@@ -465,8 +470,11 @@ sgf_utils_apply_setup_changes (SgfGameTree *tree,
   sgf_utils_begin_action (tree);
 
   if (IS_STONE (node->move_color)) {
-    if (!have_any_difference)
+    if (!have_any_difference) {
+      sgf_utils_end_action (tree);
+      sgf_utils_commit_transaction (tree);
       return 0;
+    }
 
     node	       = sgf_node_new (tree, node);
     node->move_color   = new_move_color;
@@ -481,7 +489,7 @@ sgf_utils_apply_setup_changes (SgfGameTree *tree,
   else if (node->move_color != new_move_color) {
     SgfUndoHistoryEntry *entry
       = (sgf_change_node_inlined_color_undo_history_entry_new
-	 (node, SGF_OPERATION_CHANGE_NODE_MOVE_COLOR, new_move_color,
+	 (tree, node, SGF_OPERATION_CHANGE_NODE_MOVE_COLOR, new_move_color,
 	  side_effect));
 
     sgf_utils_apply_undo_history_entry (tree, entry);
@@ -503,7 +511,7 @@ sgf_utils_apply_setup_changes (SgfGameTree *tree,
   if (created_new_node) {
     tree->undo_history = undo_history;
     sgf_utils_apply_undo_history_entry
-      (tree, sgf_new_node_undo_history_entry_new (node));
+      (tree, sgf_new_node_undo_history_entry_new (tree, node));
   }
   else {
     if (node->parent)
@@ -513,6 +521,7 @@ sgf_utils_apply_setup_changes (SgfGameTree *tree,
   }
 
   sgf_utils_end_action (tree);
+  sgf_utils_commit_transaction (tree);
 
   return anything_changed;
 }
@@ -524,7 +533,9 @@ sgf_utils_apply_markup_changes (SgfGameTree *tree,
 				int side_effect)
 {
   int num_positions[NUM_SGF_MARKUPS];
-  int positions[NUM_SGF_MARKUPS][BOARD_MAX_POSITIONS];
+  int list_start[NUM_SGF_MARKUPS];
+  int *positions;
+  int num_marked_positions = 0;
   BoardPositionList *new_markup_lists[NUM_SGF_MARKUPS];
   int k;
   int x;
@@ -538,28 +549,51 @@ sgf_utils_apply_markup_changes (SgfGameTree *tree,
   for (k = 0; k < NUM_SGF_MARKUPS; k++)
     num_positions[k] = 0;
 
+  /* Count positions with each markup first, so that all the lists fit
+   * in one array with an entry per board point.
+   */
   for (y = 0; y < tree->board_height; y++) {
     for (x = 0; x < tree->board_width; x++) {
-      int pos    = POSITION (x, y);
-      int markup = markup_grid[pos];
+      int markup = markup_grid[POSITION (x, y)];
 
       if (markup != SGF_MARKUP_NONE) {
 	assert (markup < NUM_SGF_MARKUPS);
-
-	positions[markup][num_positions[markup]++] = pos;
+	num_positions[markup]++;
       }
     }
   }
 
+  for (k = 0; k < NUM_SGF_MARKUPS; k++) {
+    list_start[k] = num_marked_positions;
+    num_marked_positions += num_positions[k];
+    num_positions[k] = 0;
+  }
+
+  positions = (num_marked_positions > 0
+	       ? utils_malloc (num_marked_positions * sizeof (int)) : NULL);
+
+  for (y = 0; y < tree->board_height; y++) {
+    for (x = 0; x < tree->board_width; x++) {
+      int pos    = POSITION (x, y);
+      int markup = markup_grid[pos];
+
+      if (markup != SGF_MARKUP_NONE)
+	positions[list_start[markup] + num_positions[markup]++] = pos;
+    }
+  }
+
   for (k = 0; k < NUM_SGF_MARKUPS; k++) {
     if (num_positions[k] > 0) {
-      new_markup_lists[k] = board_position_list_new (positions[k],
+      new_markup_lists[k] = board_position_list_new ((positions
+						      + list_start[k]),
 						     num_positions[k]);
     }
     else
       new_markup_lists[k] = NULL;
   }
 
+  utils_free (positions);
+
   sgf_utils_begin_action (tree);
 
   anything_changed |= (sgf_utils_set_list_of_point_property
@@ -629,7 +663,7 @@ sgf_utils_set_number_property (SgfNode *node, SgfGameTree *tree, SgfType type,
       if ((*link)->value.number == number)
 	return 0;
 
-      entry = sgf_change_property_undo_history_entry_new (node, *link,
+      entry = sgf_change_property_undo_history_entry_new (tree, node, *link,
 							  side_effect);
       ((SgfChangePropertyOperationEntry *) entry)->value.number = number;
     }
@@ -647,7 +681,7 @@ sgf_utils_set_number_property (SgfNode *node, SgfGameTree *tree, SgfType type,
 	    || (!IS_STONE (node->move_color) && IS_STONE (number)));
 
     entry = (sgf_change_node_inlined_color_undo_history_entry_new
-	     (node, SGF_OPERATION_CHANGE_NODE_TO_PLAY_COLOR, number,
+	     (tree, node, SGF_OPERATION_CHANGE_NODE_TO_PLAY_COLOR, number,
 	      side_effect));
   }
 
@@ -676,8 +710,8 @@ sgf_utils_set_real_property (SgfNode *node, SgfGameTree *tree, SgfType type,
     if (* (*link)->value.real == value)
       return 0;
 
-    entry = sgf_change_real_property_undo_history_entry_new (node, *link,
-							     value,
+    entry = sgf_change_real_property_undo_history_entry_new (tree, node,
+							     *link, value,
 							     side_effect);
 
 #else /* not SGF_REAL_VALUES_ALLOCATED_SEPARATELY */
@@ -685,7 +719,7 @@ sgf_utils_set_real_property (SgfNode *node, SgfGameTree *tree, SgfType type,
     if ((*link)->value.real == value)
       return 0;
 
-    entry = sgf_change_property_undo_history_entry_new (node, *link,
+    entry = sgf_change_property_undo_history_entry_new (tree, node, *link,
 							side_effect);
     ((SgfChangePropertyOperationEntry *) entry)->value.real = value;
 
@@ -858,7 +892,7 @@ sgf_utils_apply_custom_undo_entry
   assert (tree);
   assert (entry_data);
 
-  entry = sgf_custom_undo_history_entry_new (entry_data, user_data,
+  entry = sgf_custom_undo_history_entry_new (tree, entry_data, user_data,
 					     node_to_switch_to);
 
   sgf_utils_begin_action (tree);
@@ -978,7 +1012,7 @@ sgf_utils_delete_current_node (SgfGameTree *tree)
   assert (tree->current_node->parent);
   assert (tree->board_state);
 
-  entry = sgf_delete_node_undo_history_entry_new (tree->current_node);
+  entry = sgf_delete_node_undo_history_entry_new (tree, tree->current_node);
 
   sgf_utils_begin_action (tree);
   sgf_utils_apply_undo_history_entry (tree, entry);
@@ -999,7 +1033,8 @@ sgf_utils_delete_current_node_children (SgfGameTree *tree)
   if (!tree->current_node->child)
     return;
 
-  entry = sgf_delete_node_children_undo_history_entry_new (tree->current_node);
+  entry = sgf_delete_node_children_undo_history_entry_new (tree,
+							   tree->current_node);
 
   sgf_utils_begin_action (tree);
   sgf_utils_apply_undo_history_entry (tree, entry);
@@ -1018,7 +1053,7 @@ sgf_utils_swap_current_node_with (SgfGameTree *tree, SgfNode *swap_with)
   assert (tree->current_node != swap_with);
   assert (tree->current_node->parent == swap_with->parent);
 
-  entry = sgf_swap_nodes_undo_history_entry_new (tree->current_node,
+  entry = sgf_swap_nodes_undo_history_entry_new (tree, tree->current_node,
 						 swap_with);
   sgf_utils_begin_action (tree);
   sgf_utils_apply_undo_history_entry (tree, entry);
@@ -1037,7 +1072,8 @@ sgf_utils_delete_property (SgfNode *node, SgfGameTree *tree, SgfType type,
 
   if (sgf_node_find_property (node, type, &link)) {
     SgfUndoHistoryEntry *entry
-      = sgf_delete_property_undo_history_entry_new (node, *link, side_effect);
+      = sgf_delete_property_undo_history_entry_new (tree, node, *link,
+						    side_effect);
 
     sgf_utils_begin_action (tree);
     sgf_utils_apply_undo_history_entry (tree, entry);
@@ -1059,12 +1095,17 @@ sgf_utils_set_node_is_collapsed (SgfGameTree *tree, SgfNode *node,
 
   if ((is_collapsed && !node->is_collapsed)
       || (!is_collapsed && node->is_collapsed)) {
-    GAME_TREE_DO_NOTIFY (tree, SGF_ABOUT_TO_MODIFY_MAP);
+    /* Inside a transaction, notify only once for all the changes. */
+    if (!tree->notifications_are_deferred || !tree->is_modifying_map)
+      GAME_TREE_DO_NOTIFY (tree, SGF_ABOUT_TO_MODIFY_MAP);
 
     node->is_collapsed = (is_collapsed ? 1 : 0);
     sgf_game_tree_invalidate_map (tree, node);
 
-    GAME_TREE_DO_NOTIFY (tree, SGF_MAP_MODIFIED);
+    if (tree->notifications_are_deferred)
+      tree->is_modifying_map = 1;
+    else
+      GAME_TREE_DO_NOTIFY (tree, SGF_MAP_MODIFIED);
   }
 }
 
@@ -1440,14 +1481,18 @@ sgf_utils_paste_sgf (SgfGameTree *tree, SgfNode *parent_node,
 						  tree, parent_node);
   sgf_collection_delete (parsed_collection);
 
+  sgf_utils_begin_transaction (tree);
+
   if (parent_node != tree->current_node)
     sgf_utils_do_switch_to_given_node (tree, parent_node);
 
   sgf_utils_begin_action (tree);
   sgf_utils_apply_undo_history_entry
-    (tree, sgf_new_node_undo_history_entry_new (node_to_paste));
+    (tree, sgf_new_node_undo_history_entry_new (tree, node_to_paste));
   sgf_utils_end_action (tree);
 
+  sgf_utils_commit_transaction (tree);
+
   return SGF_PASTED;
 }
 
@@ -1667,11 +1712,13 @@ add_horizontal_coordinates (const SgfGameTree *tree, StringBuffer *buffer)
   string_buffer_add_characters (buffer, ' ', tree->board_height < 10 ? 3 : 4);
 
   for (x = 0; x < tree->board_width; x++) {
-    char coordinate_character
-      = game_info[tree->game].horizontal_coordinates[x];
+    char coordinate[3];
 
-    string_buffer_add_character (buffer, ' ');
-    string_buffer_add_character (buffer, coordinate_character);
+    /* Two-letter coordinates take the separating space. */
+    if (game_get_horizontal_coordinate (tree->game, x, coordinate) == 1)
+      string_buffer_add_character (buffer, ' ');
+
+    string_buffer_cat_string (buffer, coordinate);
   }
 
   string_buffer_add_character (buffer, '\n');
@@ -2035,14 +2082,28 @@ do_set_pointer_property (SgfNode *node, SgfGameTree *tree, SgfType type,
 	return 0;
       }
 
-      entry = sgf_change_property_undo_history_entry_new (node, *link,
-							  side_effect);
+      if (tree->undo_history
+	  && (property_info[type].value_type == SGF_SIMPLE_TEXT
+	      || property_info[type].value_type == SGF_FAKE_SIMPLE_TEXT
+	      || property_info[type].value_type == SGF_TEXT)) {
+	/* Only store the changed part of the text, it's a waste of
+	 * memory to keep whole comment for every small edit.
+	 */
+	entry = sgf_change_text_property_undo_history_entry_new (tree, node,
+								 *link,
+								 new_value,
+								 side_effect);
+      }
+      else {
+	entry = sgf_change_property_undo_history_entry_new (tree, node, *link,
+							    side_effect);
 
-      ((SgfChangePropertyOperationEntry *) entry)->value.memory_block
-	= new_value;
+	((SgfChangePropertyOperationEntry *) entry)->value.memory_block
+	  = new_value;
+      }
     }
     else
-      entry = sgf_delete_property_undo_history_entry_new (node, *link,
+      entry = sgf_delete_property_undo_history_entry_new (tree, node, *link,
 							  side_effect);
   }
   else {
@@ -20,6 +20,11 @@
 \* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 
+/* For copy_file_range(), if it is present at all. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "sgf.h"
 #include "sgf-writer.h"
 #include "sgf-privates.h"
@@ -28,13 +33,140 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <iconv.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined HAVE_SYS_UIO_H && defined HAVE_WRITEV
+#include <sys/uio.h>
+#define USE_WRITEV		1
+#else
+#define USE_WRITEV		0
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define WRITER_THREADS_SUPPORTED	1
+#else
+#define WRITER_THREADS_SUPPORTED	0
+#endif
 
 
 #define SGF_WRITER_BUFFER_SIZE	0x4000
 
+/* Game trees are serialized into chunk lists of this granularity
+ * when writing files.  Most game records fit in one chunk.
+ */
+#define SGF_WRITER_CHUNK_SIZE	0x2000
+
+#if USE_WRITEV && !defined IOV_MAX
+#define IOV_MAX			1024
+#endif
+
+
+#ifdef HAVE_COPY_FILE_RANGE
+
+/* Type copy_file_range() uses for file offsets. */
+#ifdef __GLIBC__
+typedef loff_t		SourceFileOffset;
+#else
+typedef off_t		SourceFileOffset;
+#endif
+
+#endif
+
+
+typedef struct _SgfChunkedWritingData	SgfChunkedWritingData;
+
+struct _SgfChunkedWritingData {
+  SgfGameTree		  **trees;
+  int			    num_trees;
+  int			    force_utf8;
+
+  /* Serialized trees, NULL for those not serialized yet. */
+  BufferedWriterChunkData **serialized_trees;
+
+  int			    file_descriptor;
+  char			   *error;
+
+  /* Collection source file, from which clean trees are copied
+   * verbatim, or -1 if all trees are serialized.  In the latter case
+   * `copy_tree_from_source' is NULL.
+   */
+  int			    source_file_descriptor;
+  char			   *copy_tree_from_source;
+  int			    use_copy_file_range;
+
+  /* Offsets of trees in the output file; the last element is the
+   * total size of the output.
+   */
+  off_t			   *output_offsets;
+  off_t			    output_offset;
+
+#if WRITER_THREADS_SUPPORTED
+
+  /* All fields below are protected by the mutex. */
+  pthread_mutex_t	    mutex;
+  pthread_cond_t	    tree_serialized;
+  pthread_cond_t	    trees_written;
+
+  int			    next_tree_to_serialize;
+  int			    next_tree_to_write;
+  int			    max_trees_in_flight;
+  int			    stop_serializing;
+
+#endif
+};
+
+
+static int	    determine_num_threads
+		      (const SgfWriterParameters *parameters, int num_trees);
+
+static int	    open_source_file (const SgfCollection *collection,
+				      struct stat *source_file_status);
+static int	    can_copy_tree_from_source (const SgfGameTree *tree,
+					       int force_utf8,
+					       off_t source_file_size);
+static void	    update_source_file_information
+		      (SgfChunkedWritingData *data,
+		       SgfCollection *collection, const char *filename);
+
+static BufferedWriterChunkData *
+		    serialize_game_tree (SgfChunkedWritingData *data,
+					 int tree_index);
+static int	    write_serialized_trees (SgfChunkedWritingData *data,
+					    int first_tree, int last_tree);
+static int	    copy_source_range (SgfChunkedWritingData *data,
+				       off_t offset, off_t length);
+static int	    source_file_truncated (SgfChunkedWritingData *data);
+
+#if USE_WRITEV
+static int	    write_io_vectors (int file_descriptor,
+				      struct iovec *io_vectors,
+				      int num_io_vectors);
+#endif
+
+static int	    write_buffer (int file_descriptor,
+				  const char *buffer, size_t length);
+
+#if WRITER_THREADS_SUPPORTED
+
+static int	    write_trees_in_parallel (SgfChunkedWritingData *data,
+					     int num_threads,
+					     int *num_trees_written,
+					     const int *cancellation_flag);
+static void *	    serialize_game_trees_thread (void *chunked_data);
+
+#endif
 
 static void	    write_collection (SgfWritingData *data,
 				      SgfCollection *collection,
@@ -45,6 +177,8 @@ static void	    write_node_sequence (SgfWritingData *data,
 					 const SgfNode *node);
 
 
+inline static void  do_write_property_name (SgfWritingData *data,
+					    SgfType type);
 inline static void  do_write_point (SgfWritingData *data, BoardPoint point);
 static void	    do_write_point_or_rectangle (SgfWritingData *data,
 						 BoardPoint left_top,
@@ -62,35 +196,233 @@ static int	    do_write_text (SgfWritingData *data, const char *text,
 				   char terminating_character, int simple);
 
 
-/* NOTE: if `filename' is NULL, write to stdout.
- * FIXME: add proper comment and actually write this function.
+const SgfWriterParameters sgf_writer_defaults = {
+  0,				/* Use as many threads as there are CPUs. */
+  256				/* Max trees serialized but not written. */
+};
+
+
+/* Write `collection' to file `filename' or to stdout if `filename' is
+ * NULL.  Return NULL on success or a dynamically allocated error
+ * string.
+ *
+ * This is a shortcut for sgf_write_file_with_progress() with default
+ * parameters and no progress tracking.
  */
 char *
 sgf_write_file (const char *filename, SgfCollection *collection,
 		int force_utf8)
 {
-  SgfWritingData data;
-  const char *initialization_error;
+  char *error = NULL;
+
+  sgf_write_file_with_progress (filename, collection, force_utf8,
+				&sgf_writer_defaults, NULL, NULL, &error);
+
+  return error;
+}
+
+
+/* Write `collection' to file `filename' (stdout if it is NULL).  Game
+ * trees are independent of each other, so they are serialized in
+ * parallel (if threads are supported) into separate chunk lists, which
+ * are then written out in order with writev().  At most
+ * `parameters->max_trees_in_flight' serialized trees are kept in
+ * memory at any time.
+ *
+ * Saving is incremental if the collection remembers its source file
+ * and the file hasn't changed since: trees that are not dirty are
+ * copied from it verbatim (with copy_file_range() where supported)
+ * and only dirty ones are serialized.  When overwriting the source
+ * file itself, the output goes to a temporary file first, which then
+ * replaces the original.  On success, the collection is bound to the
+ * written file, so subsequent saves are incremental too.
+ *
+ * The function is suitable for calling from a background thread, as
+ * long as the collection is not modified meanwhile: the writer only
+ * updates source file information in the collection and its trees,
+ * after writing is complete.  As with sgf_parse_file(),
+ * `num_trees_written' (if not NULL) is updated as the writing
+ * progresses and writing stops as soon as `*cancellation_flag'
+ * becomes nonzero.  Note that a cancelled write leaves an incomplete
+ * file behind, unless the source file is being overwritten.
+ *
+ * Return SGF_WRITTEN, SGF_WRITING_CANCELLED or SGF_ERROR_WRITING_FILE.
+ * In the last case `*error' (if `error' is not NULL) is set to a
+ * dynamically allocated error string.
+ */
+int
+sgf_write_file_with_progress (const char *filename, SgfCollection *collection,
+			      int force_utf8,
+			      const SgfWriterParameters *parameters,
+			      int *num_trees_written,
+			      const int *cancellation_flag, char **error)
+{
+  SgfChunkedWritingData data;
+  SgfGameTree *tree;
+  struct stat source_file_status;
+  char *temporary_filename = NULL;
+  int num_threads;
+  int result = SGF_WRITTEN;
+  int k;
 
   assert (collection);
 
-  initialization_error = buffered_writer_init (&data.writer, filename,
-					       SGF_WRITER_BUFFER_SIZE);
-  if (initialization_error)
-    return utils_duplicate_string (initialization_error);
+  if (!parameters)
+    parameters = &sgf_writer_defaults;
 
-  write_collection (&data, collection, force_utf8);
+  if (num_trees_written)
+    *num_trees_written = 0;
+
+  data.source_file_descriptor = open_source_file (collection,
+						  &source_file_status);
+
+  if (data.source_file_descriptor != -1 && filename) {
+    struct stat file_status;
 
-  if (data.writer.successful) {
-    buffered_writer_dispose (&data.writer);
-    return NULL;
+    if (stat (filename, &file_status) == 0
+	&& file_status.st_dev == source_file_status.st_dev
+	&& file_status.st_ino == source_file_status.st_ino) {
+      /* Cannot read trees from the file while overwriting it. */
+#ifdef HAVE_MKSTEMP
+      temporary_filename = utils_cat_strings (NULL, filename, ".XXXXXX",
+					      NULL);
+      data.file_descriptor = mkstemp (temporary_filename);
+
+      if (data.file_descriptor != -1)
+	fchmod (data.file_descriptor, file_status.st_mode & 07777);
+      else {
+	utils_free (temporary_filename);
+	temporary_filename = NULL;
+      }
+#endif
+
+      if (!temporary_filename) {
+	close (data.source_file_descriptor);
+	data.source_file_descriptor = -1;
+      }
+    }
   }
-  else {
-    char* error = utils_duplicate_string (data.writer.error_string);
 
-    buffered_writer_dispose (&data.writer);
-    return error;
+  if (!filename) {
+    fflush (stdout);
+    data.file_descriptor = fileno (stdout);
+  }
+  else if (!temporary_filename) {
+    data.file_descriptor = open (filename, O_WRONLY | O_CREAT | O_TRUNC,
+				 0666);
+    if (data.file_descriptor == -1) {
+      if (error)
+	*error = utils_duplicate_string (strerror (errno));
+
+      if (data.source_file_descriptor != -1)
+	close (data.source_file_descriptor);
+
+      return SGF_ERROR_WRITING_FILE;
+    }
+  }
+
+  for (data.num_trees = 0, tree = collection->first_tree; tree;
+       tree = tree->next)
+    data.num_trees++;
+
+  data.trees		= utils_malloc (data.num_trees * sizeof (SgfGameTree *));
+  data.serialized_trees = utils_malloc0 (data.num_trees
+					 * sizeof (BufferedWriterChunkData *));
+  data.force_utf8	= force_utf8;
+  data.error		= NULL;
+
+  for (k = 0, tree = collection->first_tree; tree; tree = tree->next)
+    data.trees[k++] = tree;
+
+  if (data.source_file_descriptor != -1) {
+    data.copy_tree_from_source = utils_malloc (data.num_trees);
+    for (k = 0; k < data.num_trees; k++) {
+      data.copy_tree_from_source[k]
+	= can_copy_tree_from_source (data.trees[k], force_utf8,
+				     source_file_status.st_size);
+    }
+
+    data.use_copy_file_range = 1;
+  }
+  else
+    data.copy_tree_from_source = NULL;
+
+  data.output_offsets	 = utils_malloc ((data.num_trees + 1)
+					 * sizeof (off_t));
+  data.output_offsets[0] = 0;
+  data.output_offset	 = 0;
+
+  num_threads = determine_num_threads (parameters, data.num_trees);
+
+#if WRITER_THREADS_SUPPORTED
+
+  if (num_threads > 1) {
+    data.max_trees_in_flight = MAX (parameters->max_trees_in_flight,
+				    num_threads);
+    result = write_trees_in_parallel (&data, num_threads,
+				      num_trees_written, cancellation_flag);
+  }
+
+#endif
+
+  if (num_threads <= 1) {
+    for (k = 0; k < data.num_trees; k++) {
+      if (cancellation_flag && *cancellation_flag) {
+	result = SGF_WRITING_CANCELLED;
+	break;
+      }
+
+      data.serialized_trees[k] = serialize_game_tree (&data, k);
+      if (!write_serialized_trees (&data, k, k)) {
+	result = SGF_ERROR_WRITING_FILE;
+	break;
+      }
+
+      if (num_trees_written)
+	*num_trees_written = k + 1;
+    }
+  }
+
+  for (k = 0; k < data.num_trees; k++) {
+    if (data.serialized_trees[k])
+      buffered_writer_free_memory_chunks (data.serialized_trees[k]);
+  }
+
+  if (data.source_file_descriptor != -1)
+    close (data.source_file_descriptor);
+
+  if (filename && close (data.file_descriptor) == -1
+      && result == SGF_WRITTEN) {
+    data.error = utils_duplicate_string (strerror (errno));
+    result     = SGF_ERROR_WRITING_FILE;
+  }
+
+  if (temporary_filename) {
+    if (result == SGF_WRITTEN && rename (temporary_filename, filename) == -1) {
+      data.error = utils_duplicate_string (strerror (errno));
+      result     = SGF_ERROR_WRITING_FILE;
+    }
+
+    if (result != SGF_WRITTEN)
+      unlink (temporary_filename);
+
+    utils_free (temporary_filename);
   }
+
+  if (result == SGF_WRITTEN && filename)
+    update_source_file_information (&data, collection, filename);
+
+  utils_free (data.output_offsets);
+  utils_free (data.copy_tree_from_source);
+  utils_free (data.serialized_trees);
+  utils_free (data.trees);
+
+  if (result == SGF_ERROR_WRITING_FILE && error)
+    *error = data.error;
+  else
+    utils_free (data.error);
+
+  return result;
 }
 
 
@@ -110,6 +442,479 @@ sgf_write_in_memory (SgfCollection *collection, int force_utf8,
 }
 
 
+
+static int
+determine_num_threads (const SgfWriterParameters *parameters, int num_trees)
+{
+#if WRITER_THREADS_SUPPORTED
+
+  int num_threads = parameters->num_threads;
+
+  if (num_threads <= 0) {
+#if defined HAVE_UNISTD_H && defined _SC_NPROCESSORS_ONLN
+    num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+    num_threads = 1;
+#endif
+  }
+
+  /* There is no point in threads for a single tree. */
+  return MAX (MIN (num_threads, num_trees), 1);
+
+#else
+
+  UNUSED (parameters);
+  UNUSED (num_trees);
+
+  return 1;
+
+#endif
+}
+
+
+/* Open collection source file for reading.  Return its descriptor,
+ * or -1 if it cannot be opened or has been changed since the
+ * collection was read from or written to it.
+ */
+static int
+open_source_file (const SgfCollection *collection,
+		  struct stat *source_file_status)
+{
+  int file_descriptor;
+
+  if (!collection->source_filename)
+    return -1;
+
+  file_descriptor = open (collection->source_filename, O_RDONLY);
+  if (file_descriptor == -1)
+    return -1;
+
+  if (fstat (file_descriptor, source_file_status) == 0
+      && sgf_collection_source_file_is_unchanged (collection,
+						  source_file_status))
+    return file_descriptor;
+
+  close (file_descriptor);
+  return -1;
+}
+
+
+/* Determine if `tree' can be copied from the source file.  It must
+ * have a source representation, must not be modified since and the
+ * full serialization must not change its encoding.
+ */
+static int
+can_copy_tree_from_source (const SgfGameTree *tree, int force_utf8,
+			   off_t source_file_size)
+{
+  return (tree->source_length >= 0 && !tree->is_dirty
+	  && tree->source_offset + tree->source_length <= source_file_size
+	  && (!force_utf8
+	      || (tree->char_set && strcmp (tree->char_set, "UTF-8") == 0)));
+}
+
+
+/* After a successful write, make the collection refer to the new file
+ * and all its trees to their locations in it.
+ */
+static void
+update_source_file_information (SgfChunkedWritingData *data,
+				SgfCollection *collection,
+				const char *filename)
+{
+  struct stat file_status;
+  int k;
+
+  for (k = 0; k < data->num_trees; k++) {
+    SgfGameTree *tree = data->trees[k];
+
+    /* Don't count the newline after the tree and the separator. */
+    tree->source_offset = data->output_offsets[k];
+    tree->source_length = (data->output_offsets[k + 1] - tree->source_offset
+			   - (tree->next ? 2 : 1));
+    tree->is_dirty	= 0;
+  }
+
+  if (stat (filename, &file_status) == 0)
+    sgf_collection_set_source_file (collection, filename, &file_status);
+  else
+    sgf_collection_set_source_file (collection, NULL, NULL);
+}
+
+
+/* Serialize one game tree into a list of memory chunks.  Trees are
+ * separated by empty lines, so the separating newline is appended to
+ * all but the last tree.  For trees copied from the source file, only
+ * the newline after the closing parenthesis and the separator are
+ * generated.
+ */
+static BufferedWriterChunkData *
+serialize_game_tree (SgfChunkedWritingData *data, int tree_index)
+{
+  SgfGameTree *tree = data->trees[tree_index];
+  SgfWritingData writing_data;
+
+  buffered_writer_init_memory (&writing_data.writer, SGF_WRITER_CHUNK_SIZE);
+
+  if (data->copy_tree_from_source && data->copy_tree_from_source[tree_index])
+    buffered_writer_add_newline (&writing_data.writer);
+  else {
+    writing_data.tree = tree;
+    write_game_tree (&writing_data, tree, data->force_utf8);
+  }
+
+  if (tree->next)
+    buffered_writer_add_newline (&writing_data.writer);
+
+  return buffered_writer_steal_memory_chunks (&writing_data.writer);
+}
+
+
+/* Write serialized trees from `first_tree' to `last_tree', inclusive,
+ * and free their chunks.  On error, store error string in `data' and
+ * return zero.
+ */
+static int
+write_serialized_trees (SgfChunkedWritingData *data,
+			int first_tree, int last_tree)
+{
+#if USE_WRITEV
+  struct iovec io_vectors[IOV_MAX];
+  int num_io_vectors = 0;
+#endif
+  int successful = 1;
+  int k;
+
+  for (k = first_tree; k <= last_tree && successful; k++) {
+    BufferedWriterChunkData *chunk;
+
+    if (data->copy_tree_from_source && data->copy_tree_from_source[k]) {
+#if USE_WRITEV
+      if (num_io_vectors > 0) {
+	successful = write_io_vectors (data->file_descriptor,
+				       io_vectors, num_io_vectors);
+	num_io_vectors = 0;
+      }
+
+      if (successful)
+#endif
+	successful = copy_source_range (data, data->trees[k]->source_offset,
+					data->trees[k]->source_length);
+
+      data->output_offset += data->trees[k]->source_length;
+    }
+
+    for (chunk = data->serialized_trees[k]; chunk && successful;
+	 chunk = chunk->next_chunk) {
+      data->output_offset += chunk->chunk_size;
+
+#if USE_WRITEV
+
+      if (num_io_vectors == IOV_MAX) {
+	successful = write_io_vectors (data->file_descriptor,
+				       io_vectors, num_io_vectors);
+	num_io_vectors = 0;
+      }
+
+      io_vectors[num_io_vectors].iov_base = (void *) (chunk + 1);
+      io_vectors[num_io_vectors].iov_len  = chunk->chunk_size;
+      num_io_vectors++;
+
+#else
+
+      successful = write_buffer (data->file_descriptor,
+				 (const char *) (chunk + 1),
+				 chunk->chunk_size);
+
+#endif
+    }
+
+    data->output_offsets[k + 1] = data->output_offset;
+  }
+
+#if USE_WRITEV
+  if (successful && num_io_vectors > 0) {
+    successful = write_io_vectors (data->file_descriptor,
+				   io_vectors, num_io_vectors);
+  }
+#endif
+
+  for (k = first_tree; k <= last_tree; k++) {
+    buffered_writer_free_memory_chunks (data->serialized_trees[k]);
+    data->serialized_trees[k] = NULL;
+  }
+
+  if (!successful && !data->error)
+    data->error = utils_duplicate_string (strerror (errno));
+
+  return successful;
+}
+
+
+/* Copy `length' bytes at `offset' in the source file to the output.
+ * Use copy_file_range() if possible, so that the kernel does the
+ * copying (or even shares extents on file systems that support it).
+ * Fall back to plain read() and write() if it is not supported for
+ * the given files, e.g. when writing to a pipe.
+ */
+static int
+copy_source_range (SgfChunkedWritingData *data, off_t offset, off_t length)
+{
+  char buffer[SGF_WRITER_BUFFER_SIZE];
+
+#ifdef HAVE_COPY_FILE_RANGE
+
+  if (data->use_copy_file_range) {
+    SourceFileOffset source_offset = offset;
+
+    while (length > 0) {
+      ssize_t bytes_copied = copy_file_range (data->source_file_descriptor,
+					      &source_offset,
+					      data->file_descriptor, NULL,
+					      length, 0);
+
+      if (bytes_copied > 0)
+	length -= bytes_copied;
+      else if (bytes_copied == 0)
+	return source_file_truncated (data);
+      else if (errno != EINTR) {
+	if (errno != ENOSYS && errno != EXDEV && errno != EINVAL
+	    && errno != EBADF && errno != EOPNOTSUPP)
+	  return 0;
+
+	data->use_copy_file_range = 0;
+	break;
+      }
+    }
+
+    if (length == 0)
+      return 1;
+
+    offset = source_offset;
+  }
+
+#endif
+
+  if (lseek (data->source_file_descriptor, offset, SEEK_SET) == -1)
+    return 0;
+
+  while (length > 0) {
+    ssize_t bytes_read = read (data->source_file_descriptor, buffer,
+			       MIN (length, (off_t) sizeof buffer));
+
+    if (bytes_read > 0) {
+      if (!write_buffer (data->file_descriptor, buffer, bytes_read))
+	return 0;
+
+      length -= bytes_read;
+    }
+    else if (bytes_read == 0)
+      return source_file_truncated (data);
+    else if (errno != EINTR)
+      return 0;
+  }
+
+  return 1;
+}
+
+
+static int
+source_file_truncated (SgfChunkedWritingData *data)
+{
+  data->error = utils_duplicate_string ("source file is truncated");
+  return 0;
+}
+
+
+#if USE_WRITEV
+
+
+/* Write all given buffers, restarting writev() after partial writes
+ * and interruptions.  Modifies `io_vectors' array.
+ */
+static int
+write_io_vectors (int file_descriptor, struct iovec *io_vectors,
+		  int num_io_vectors)
+{
+  while (num_io_vectors > 0) {
+    ssize_t bytes_written = writev (file_descriptor,
+				    io_vectors, num_io_vectors);
+
+    if (bytes_written == -1) {
+      if (errno == EINTR)
+	continue;
+
+      return 0;
+    }
+
+    while (num_io_vectors > 0 && bytes_written >= io_vectors->iov_len) {
+      bytes_written -= io_vectors->iov_len;
+      io_vectors++;
+      num_io_vectors--;
+    }
+
+    if (num_io_vectors > 0) {
+      io_vectors->iov_base  = ((char *) io_vectors->iov_base) + bytes_written;
+      io_vectors->iov_len  -= bytes_written;
+    }
+  }
+
+  return 1;
+}
+
+
+#endif /* USE_WRITEV */
+
+
+static int
+write_buffer (int file_descriptor, const char *buffer, size_t length)
+{
+  while (length > 0) {
+    ssize_t bytes_written = write (file_descriptor, buffer, length);
+
+    if (bytes_written == -1) {
+      if (errno == EINTR)
+	continue;
+
+      return 0;
+    }
+
+    buffer += bytes_written;
+    length -= bytes_written;
+  }
+
+  return 1;
+}
+
+
+#if WRITER_THREADS_SUPPORTED
+
+
+/* Serialize trees in `num_threads' worker threads and write them out
+ * in order from the calling thread as soon as they become available.
+ */
+static int
+write_trees_in_parallel (SgfChunkedWritingData *data, int num_threads,
+			 int *num_trees_written, const int *cancellation_flag)
+{
+  pthread_t *threads = utils_malloc (num_threads * sizeof (pthread_t));
+  int num_threads_started;
+  int result = SGF_WRITTEN;
+  int k;
+
+  pthread_mutex_init (&data->mutex, NULL);
+  pthread_cond_init (&data->tree_serialized, NULL);
+  pthread_cond_init (&data->trees_written, NULL);
+
+  data->next_tree_to_serialize = 0;
+  data->next_tree_to_write     = 0;
+  data->stop_serializing       = 0;
+
+  for (num_threads_started = 0; num_threads_started < num_threads;
+       num_threads_started++) {
+    if (pthread_create (threads + num_threads_started, NULL,
+			serialize_game_trees_thread, data) != 0)
+      break;
+  }
+
+  for (k = 0; k < data->num_trees; ) {
+    int first_tree = k;
+
+    if (cancellation_flag && *cancellation_flag) {
+      result = SGF_WRITING_CANCELLED;
+      break;
+    }
+
+    pthread_mutex_lock (&data->mutex);
+
+    if (num_threads_started == 0) {
+      /* Could not start any thread, serialize here. */
+      pthread_mutex_unlock (&data->mutex);
+      data->serialized_trees[k] = serialize_game_tree (data, k);
+      pthread_mutex_lock (&data->mutex);
+    }
+
+    while (!data->serialized_trees[k])
+      pthread_cond_wait (&data->tree_serialized, &data->mutex);
+
+    while (k < data->num_trees && data->serialized_trees[k])
+      k++;
+
+    pthread_mutex_unlock (&data->mutex);
+
+    if (!write_serialized_trees (data, first_tree, k - 1)) {
+      result = SGF_ERROR_WRITING_FILE;
+      break;
+    }
+
+    pthread_mutex_lock (&data->mutex);
+    data->next_tree_to_write = k;
+    pthread_cond_broadcast (&data->trees_written);
+    pthread_mutex_unlock (&data->mutex);
+
+    if (num_trees_written)
+      *num_trees_written = k;
+  }
+
+  pthread_mutex_lock (&data->mutex);
+  data->stop_serializing = 1;
+  pthread_cond_broadcast (&data->trees_written);
+  pthread_mutex_unlock (&data->mutex);
+
+  for (k = 0; k < num_threads_started; k++)
+    pthread_join (threads[k], NULL);
+
+  pthread_cond_destroy (&data->trees_written);
+  pthread_cond_destroy (&data->tree_serialized);
+  pthread_mutex_destroy (&data->mutex);
+
+  utils_free (threads);
+
+  return result;
+}
+
+
+static void *
+serialize_game_trees_thread (void *chunked_data)
+{
+  SgfChunkedWritingData *data = (SgfChunkedWritingData *) chunked_data;
+
+  pthread_mutex_lock (&data->mutex);
+
+  while (1) {
+    int tree_index;
+    BufferedWriterChunkData *serialized_tree;
+
+    /* Don't run too far ahead of the writing thread. */
+    while (!data->stop_serializing
+	   && data->next_tree_to_serialize < data->num_trees
+	   && (data->next_tree_to_serialize
+	       >= data->next_tree_to_write + data->max_trees_in_flight))
+      pthread_cond_wait (&data->trees_written, &data->mutex);
+
+    if (data->stop_serializing
+	|| data->next_tree_to_serialize == data->num_trees)
+      break;
+
+    tree_index = data->next_tree_to_serialize++;
+    pthread_mutex_unlock (&data->mutex);
+
+    serialized_tree = serialize_game_tree (data, tree_index);
+
+    pthread_mutex_lock (&data->mutex);
+    data->serialized_trees[tree_index] = serialized_tree;
+    pthread_cond_signal (&data->tree_serialized);
+  }
+
+  pthread_mutex_unlock (&data->mutex);
+
+  return NULL;
+}
+
+
+#endif /* WRITER_THREADS_SUPPORTED */
+
+
 
 static void
 write_collection (SgfWritingData *data, SgfCollection *collection,
@@ -135,27 +940,46 @@ write_game_tree (SgfWritingData *data, SgfGameTree *tree, int force_utf8)
   const BoardPositionList *root_white_stones;
   BoardPositionList *black_stones;
   BoardPositionList *white_stones;
-  int default_setup_hidden = 0;
 
-  buffered_writer_cprintf (&data->writer, "(;GM[%d]FF[4]\n", tree->game);
+  buffered_writer_add_ascii (&data->writer, "(;GM[", 5);
+  buffered_writer_add_integer (&data->writer, tree->game);
+  buffered_writer_add_ascii (&data->writer, "]FF[4]", 6);
+  buffered_writer_add_newline (&data->writer);
 
   if (force_utf8 || tree->char_set) {
-    buffered_writer_cprintf (&data->writer, "CA[%s]\n",
-			     force_utf8 ? "UTF-8" : tree->char_set);
+    buffered_writer_cat_strings (&data->writer,
+				 "CA[", force_utf8 ? "UTF-8" : tree->char_set,
+				 "]", NULL);
+    buffered_writer_add_newline (&data->writer);
   }
 
   buffered_writer_cat_string (&data->writer,
 			      "AP[" PACKAGE_NAME ":" PACKAGE_VERSION "]\n");
 
-  if (tree->board_width == tree->board_height)
-    buffered_writer_cprintf (&data->writer, "SZ[%d]\n", tree->board_width);
-  else {
-    buffered_writer_cprintf (&data->writer, "SZ[%d:%d]\n",
-			     tree->board_width, tree->board_height);
+  buffered_writer_add_ascii (&data->writer, "SZ[", 3);
+  buffered_writer_add_integer (&data->writer, tree->board_width);
+
+  if (tree->board_width != tree->board_height) {
+    buffered_writer_add_character (&data->writer, ':');
+    buffered_writer_add_integer (&data->writer, tree->board_height);
+  }
+
+  buffered_writer_add_character (&data->writer, ']');
+  buffered_writer_add_newline (&data->writer);
+
+  if (tree->style_is_set) {
+    buffered_writer_add_ascii (&data->writer, "ST[", 3);
+    buffered_writer_add_integer (&data->writer, tree->style);
+    buffered_writer_add_character (&data->writer, ']');
+    buffered_writer_add_newline (&data->writer);
   }
 
-  if (tree->style_is_set)
-    buffered_writer_cprintf (&data->writer, "ST[%d]\n", tree->style);
+  /* Default setup is not written out.  The tree is not modified
+   * (write_node_sequence() skips the properties instead), so that
+   * several trees can be written in parallel and writing can happen
+   * in a background thread.
+   */
+  data->default_setup_hidden = 0;
 
   root_black_stones
     = sgf_node_get_list_of_point_property_value (root, SGF_ADD_BLACK);
@@ -171,16 +995,11 @@ write_game_tree (SgfWritingData *data, SgfGameTree *tree, int force_utf8)
 				&black_stones, &white_stones)) {
       if (board_position_lists_are_equal (root_black_stones, black_stones)
 	  && board_position_lists_are_equal (root_white_stones,
-					     white_stones)) {
-	sgf_node_delete_property (root, tree, SGF_ADD_BLACK);
-	sgf_node_delete_property (root, tree, SGF_ADD_WHITE);
+					     white_stones))
+	data->default_setup_hidden = 1;
 
-	default_setup_hidden = 1;
-      }
-      else {
-	board_position_list_delete (black_stones);
-	board_position_list_delete (white_stones);
-      }
+      board_position_list_delete (black_stones);
+      board_position_list_delete (white_stones);
     }
   }
 
@@ -212,13 +1031,6 @@ write_game_tree (SgfWritingData *data, SgfGameTree *tree, int force_utf8)
     buffered_writer_add_newline (&data->writer);
   buffered_writer_add_character (&data->writer, ')');
   buffered_writer_add_newline (&data->writer);
-
-  if (default_setup_hidden) {
-    sgf_node_add_list_of_point_property (root, tree,
-					 SGF_ADD_BLACK, black_stones, 0);
-    sgf_node_add_list_of_point_property (root, tree,
-					 SGF_ADD_WHITE, white_stones, 0);
-  }
 }
 
 
@@ -230,9 +1042,10 @@ write_node_sequence (SgfWritingData *data, const SgfNode *node)
     SgfProperty *property;
 
     if (IS_STONE (node->move_color)) {
-      buffered_writer_add_character (&data->writer,
-				     node->move_color == BLACK ? 'B' : 'W');
-      buffered_writer_add_character (&data->writer, '[');
+      buffered_writer_add_two_characters (&data->writer,
+					  (node->move_color == BLACK
+					   ? 'B' : 'W'),
+					  '[');
 
       data->do_write_move (data, node);
 
@@ -242,21 +1055,23 @@ write_node_sequence (SgfWritingData *data, const SgfNode *node)
     to_play.color = node->to_play_color;
 
     for (property = node->properties; property; property = property->next) {
+      if ((property->type == SGF_ADD_BLACK || property->type == SGF_ADD_WHITE)
+	  && data->default_setup_hidden && node == data->tree->root)
+	continue;
+
       if (property_info[property->type].value_writer) {
 	if (data->writer.column >= FILL_BREAK_POINT)
 	  buffered_writer_add_newline (&data->writer);
 
 	if (to_play.color != EMPTY
 	    && property->type > SGF_LAST_SETUP_PROPERTY) {
-	  buffered_writer_cat_string (&data->writer,
-				      property_info[SGF_TO_PLAY].name);
+	  do_write_property_name (data, SGF_TO_PLAY);
 	  sgf_write_color (data, &to_play);
 
 	  to_play.color = EMPTY;
 	}
 
-	buffered_writer_cat_string (&data->writer,
-				    property_info[property->type].name);
+	do_write_property_name (data, property->type);
 
 	property_info[property->type].value_writer (data, &property->value);
 
@@ -271,8 +1086,7 @@ write_node_sequence (SgfWritingData *data, const SgfNode *node)
 
     /* This can happen if there are no properties after `PL'. */
     if (to_play.color != EMPTY) {
-      buffered_writer_cat_string (&data->writer,
-				  property_info[SGF_TO_PLAY].name);
+      do_write_property_name (data, SGF_TO_PLAY);
       sgf_write_color (data, &to_play);
     }
 
@@ -291,8 +1105,7 @@ write_node_sequence (SgfWritingData *data, const SgfNode *node)
     do {
       if (data->writer.column > 0)
 	buffered_writer_add_newline (&data->writer);
-      buffered_writer_add_character (&data->writer, '(');
-      buffered_writer_add_character (&data->writer, ';');
+      buffered_writer_add_two_characters (&data->writer, '(', ';');
 
       write_node_sequence (data, node);
 
@@ -309,33 +1122,56 @@ write_node_sequence (SgfWritingData *data, const SgfNode *node)
 
 
 
+/* Property names are plain ASCII, so column needs not be scanned. */
+inline static void
+do_write_property_name (SgfWritingData *data, SgfType type)
+{
+  buffered_writer_add_ascii (&data->writer, property_info[type].name,
+			     strlen (property_info[type].name));
+}
+
+
+#define SGF_COORDINATE(coordinate)					\
+  ((coordinate) < 'z' - 'a' + 1						\
+   ? 'a' + (coordinate) : 'A' + ((coordinate) - ('z' - 'a' + 1)))
+
+
 inline static void
 do_write_point (SgfWritingData *data, BoardPoint point)
 {
-  buffered_writer_add_character (&data->writer,
-				 (point.x < 'z' - 'a' + 1
-				  ? 'a' + point.x
-				  : 'A' + (point.x - ('z' - 'a' + 1))));
-  buffered_writer_add_character (&data->writer,
-				 (point.y < 'z' - 'a' + 1
-				  ? 'a' + point.y
-				  : 'A' + (point.y - ('z' - 'a' + 1))));
+  buffered_writer_add_two_characters (&data->writer,
+				      SGF_COORDINATE (point.x),
+				      SGF_COORDINATE (point.y));
 }
 
 
+/* Compose the whole value in a local buffer, it is then added to the
+ * writer at once.
+ */
 static void
 do_write_point_or_rectangle (SgfWritingData *data,
 			     BoardPoint left_top, BoardPoint right_bottom)
 {
-  buffered_writer_add_character (&data->writer, '[');
+  char value[sizeof "[aa:bb]"];
+  int length;
+
+  value[0] = '[';
+  value[1] = SGF_COORDINATE (left_top.x);
+  value[2] = SGF_COORDINATE (left_top.y);
 
-  do_write_point (data, left_top);
   if (left_top.x != right_bottom.x || left_top.y != right_bottom.y) {
-    buffered_writer_add_character (&data->writer, ':');
-    do_write_point (data, right_bottom);
+    value[3] = ':';
+    value[4] = SGF_COORDINATE (right_bottom.x);
+    value[5] = SGF_COORDINATE (right_bottom.y);
+    value[6] = ']';
+    length   = 7;
+  }
+  else {
+    value[3] = ']';
+    length   = 4;
   }
 
-  buffered_writer_add_character (&data->writer, ']');
+  buffered_writer_add_ascii (&data->writer, value, length);
   if (data->writer.column >= FILL_BREAK_POINT)
     buffered_writer_add_newline (&data->writer);
 }
@@ -376,8 +1212,7 @@ sgf_write_none (SgfWritingData *data, const SgfValue *value)
 {
   UNUSED (value);
 
-  buffered_writer_add_character (&data->writer, '[');
-  buffered_writer_add_character (&data->writer, ']');
+  buffered_writer_add_two_characters (&data->writer, '[', ']');
 }
 
 
@@ -385,7 +1220,7 @@ void
 sgf_write_number (SgfWritingData *data, const SgfValue *value)
 {
   buffered_writer_add_character (&data->writer, '[');
-  buffered_writer_cprintf (&data->writer, "%d", value->number);
+  buffered_writer_add_integer (&data->writer, value->number);
   buffered_writer_add_character (&data->writer, ']');
 }
 
@@ -396,9 +1231,9 @@ sgf_write_real (SgfWritingData *data, const SgfValue *value)
   buffered_writer_add_character (&data->writer, '[');
 
 #if SGF_REAL_VALUES_ALLOCATED_SEPARATELY
-  buffered_writer_cprintf (&data->writer, "%.f", *value->real);
+  buffered_writer_add_real (&data->writer, *value->real);
 #else
-  buffered_writer_cprintf (&data->writer, "%.f", value->real);
+  buffered_writer_add_real (&data->writer, value->real);
 #endif
 
   buffered_writer_add_character (&data->writer, ']');
@@ -408,8 +1243,8 @@ sgf_write_real (SgfWritingData *data, const SgfValue *value)
 void
 sgf_write_double (SgfWritingData *data, const SgfValue *value)
 {
-  buffered_writer_add_character (&data->writer, '[');
-  buffered_writer_add_character (&data->writer, value->emphasized ? '2' : '1');
+  buffered_writer_add_two_characters (&data->writer,
+				      '[', value->emphasized ? '2' : '1');
   buffered_writer_add_character (&data->writer, ']');
 }
 
@@ -417,11 +1252,8 @@ sgf_write_double (SgfWritingData *data, const SgfValue *value)
 void
 sgf_write_color (SgfWritingData *data, const SgfValue *value)
 {
-  buffered_writer_add_character (&data->writer, '[');
-
-  buffered_writer_add_character (&data->writer,
-				 value->color == BLACK ? 'B' : 'W');
-
+  buffered_writer_add_two_characters (&data->writer,
+				      '[', value->color == BLACK ? 'B' : 'W');
   buffered_writer_add_character (&data->writer, ']');
 }
 
@@ -745,8 +1577,10 @@ sgf_write_figure_description (SgfWritingData *data, const SgfValue *value)
 {
   buffered_writer_add_character (&data->writer, '[');
 
-  if (value->figure)
-    buffered_writer_cprintf (&data->writer, "%d:", value->figure->flags);
+  if (value->figure) {
+    buffered_writer_add_integer (&data->writer, value->figure->flags);
+    buffered_writer_add_character (&data->writer, ':');
+  }
 
   if (value->figure && value->figure->diagram_name)
     do_write_text (data, value->figure->diagram_name, ']', 1);
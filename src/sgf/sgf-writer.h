@@ -42,6 +42,7 @@ struct _SgfWritingData {
   BufferedWriter   writer;
 
   SgfGameTree	  *tree;
+  int		   default_setup_hidden;
   iconv_t	   utf8_to_tree_encoding;
   void (* do_write_move) (SgfWritingData *data, const SgfNode *node);
 };
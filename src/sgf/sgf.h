@@ -29,6 +29,9 @@
 #include "utils.h"
 #include "../quarry.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 
 
 /* `sgf-tree.c' global declarations and functions. */
@@ -140,6 +143,8 @@ typedef void (* SgfCustomOperationEntryFunction) (void *user_data,
 typedef struct _SgfCustomUndoHistoryEntryData	SgfCustomUndoHistoryEntryData;
 
 typedef struct _SgfGameTreeMapData		SgfGameTreeMapData;
+typedef struct _SgfGameTreeMapIndex		SgfGameTreeMapIndex;
+typedef struct _SgfGameTreeMapStatistics	SgfGameTreeMapStatistics;
 typedef struct _SgfGameTreeMapLine		SgfGameTreeMapLine;
 
 typedef void (* SgfGameTreeNotificationCallback)
@@ -346,6 +351,13 @@ struct _SgfUndoHistory {
 
   SgfUndoHistory	 *next;
 
+  /* Approximate memory taken by the entries and the limit on it.
+   * When the limit is exceeded, oldest actions are forgotten.  Zero
+   * limit means that the history may grow without bound.
+   */
+  int			  memory_used;
+  int			  memory_limit;
+
   SgfUndoHistoryNotificationCallback  notification_callback;
   void			 *user_data;
 };
@@ -367,6 +379,32 @@ struct _SgfGameTreeMapData {
   int			  last_valid_y_level;
 
   int			  largest_x_so_far;
+
+  /* Properties of the tree chunk between this data point and the
+   * next one: the lowest `y_level' element it depends on, the largest
+   * `x' in it and whether it has been modified since last layout.
+   */
+  int			  chunk_lowest_x;
+  int			  chunk_largest_x;
+  int			  chunk_is_modified;
+
+  /* Spatial index of the chunk, built on first view port query. */
+  SgfGameTreeMapIndex	 *chunk_index;
+};
+
+/* Counters accumulated by map functions over a tree's lifetime.  Times
+ * are in seconds.
+ */
+struct _SgfGameTreeMapStatistics {
+  int			  num_map_updates;
+  int			  num_layed_out_nodes;
+  int			  num_reused_chunks;
+  double		  map_update_time;
+
+  int			  num_view_port_updates;
+  int			  num_view_port_chunks;
+  int			  num_skipped_view_port_chunks;
+  double		  view_port_update_time;
 };
 
 struct _SgfGameTreeMapLine {
@@ -411,6 +449,26 @@ struct _SgfGameTree {
   unsigned int		  could_undo : 1;
   unsigned int		  could_redo : 1;
 
+  /* Nesting level of sgf_utils_begin_transaction() calls.  While a
+   * transaction is open, modification notifications are postponed,
+   * unless it was started inside an action.
+   */
+  int			  transaction_level;
+  unsigned int		  notifications_are_deferred : 1;
+
+  /* Set whenever the tree is changed after it was parsed or last
+   * saved.  Clean trees can be copied verbatim from their source file
+   * instead of being serialized again (see `source_offset' below).
+   */
+  unsigned int		  is_dirty : 1;
+
+  /* Byte range of the tree text (from its opening to its closing
+   * parenthesis) in the collection's source file.  `source_length' is
+   * negative if the tree has no exact source representation.
+   */
+  off_t			  source_offset;
+  off_t			  source_length;
+
   int			  file_format;
   char			 *char_set;
   char			 *application_name;
@@ -420,6 +478,7 @@ struct _SgfGameTree {
 
   MemoryPool		  node_pool;
   MemoryPool		  property_pool;
+  MemoryPool		  undo_entry_pool;
 
   SgfGameTreeNotificationCallback  notification_callback;
   void			 *user_data;
@@ -429,7 +488,19 @@ struct _SgfGameTree {
   int			  map_height;
 
   SgfGameTreeMapData	 *map_data_list;
-  SgfGameTreeMapData	 *last_valid_data_point;
+
+  unsigned int		  map_is_valid : 1;
+  unsigned int		  map_first_chunk_is_modified : 1;
+  SgfGameTreeMapIndex	 *map_first_chunk_index;
+
+  /* See sgf_game_tree_update_map_partially() and
+   * sgf_game_tree_set_map_layout_deferred().  `map_layout_frontier'
+   * is the data point up to which an incomplete map is layed out.
+   */
+  unsigned int		  map_layout_is_deferred : 1;
+  SgfGameTreeMapData	 *map_layout_frontier;
+
+  SgfGameTreeMapStatistics  map_statistics;
 
   int			  view_port_x0;
   int			  view_port_y0;
@@ -450,6 +521,13 @@ struct _SgfCollection {
   int			  num_modified_undo_histories;
   int			  is_irreversibly_modified;
 
+  /* The file the collection was last parsed from or written to, with
+   * its status at that moment.  Used for saving incrementally;
+   * `source_filename' is NULL if there is no such file.
+   */
+  char			 *source_filename;
+  struct stat		  source_file_status;
+
   SgfCollectionNotificationCallback  notification_callback;
   void			 *user_data;
 };
@@ -506,6 +584,12 @@ void		 sgf_collection_add_game_tree (SgfCollection *collection,
 
 int		 sgf_collection_is_modified (const SgfCollection *collection);
 void		 sgf_collection_set_unmodified (SgfCollection *collection);
+void		 sgf_collection_set_source_file
+		   (SgfCollection *collection, const char *filename,
+		    const struct stat *file_status);
+int		 sgf_collection_source_file_is_unchanged
+		   (const SgfCollection *collection,
+		    const struct stat *file_status);
 
 void		 sgf_collection_set_notification_callback
 		   (SgfCollection *collection,
@@ -794,14 +878,39 @@ extern const SgfParserParameters	sgf_parser_defaults;
 
 
 
-/* `sgf-writer.c' global functions. */
+/* `sgf-writer.c' global declarations, functions and variables. */
+
+enum {
+  SGF_WRITTEN,
+  SGF_WRITING_CANCELLED,
+  SGF_ERROR_WRITING_FILE
+};
+
+
+typedef struct _SgfWriterParameters	SgfWriterParameters;
+
+struct _SgfWriterParameters {
+  /* Zero or negative means as many as there are processors. */
+  int		num_threads;
+
+  int		max_trees_in_flight;
+};
+
 
 char *		 sgf_write_file (const char *filename,
 				 SgfCollection *collection, int force_utf8);
+int		 sgf_write_file_with_progress
+		   (const char *filename, SgfCollection *collection,
+		    int force_utf8, const SgfWriterParameters *parameters,
+		    int *num_trees_written, const int *cancellation_flag,
+		    char **error);
 char *		 sgf_write_in_memory (SgfCollection *collection,
 				      int force_utf8, int *sgf_length);
 
 
+extern const SgfWriterParameters	sgf_writer_defaults;
+
+
 
 /* `sgf-utils.c' global declarations and functions. */
 
@@ -962,7 +1071,11 @@ char *	      sgf_utils_export_position_as_senseis_library_diagram
 
 
 
-/* `sgf-undo.c' global functions. */
+/* `sgf-undo.c' global declarations and functions. */
+
+/* Default memory limit of new undo histories, in bytes. */
+#define SGF_DEFAULT_UNDO_HISTORY_MEMORY_LIMIT	(16 * 1024 * 1024)
+
 
 SgfUndoHistory *  sgf_undo_history_new (SgfGameTree *tree);
 void		  sgf_undo_history_delete (SgfUndoHistory *history,
@@ -986,9 +1099,16 @@ void *		  sgf_undo_history_get_last_applied_custom_entry_data
 void		  sgf_undo_history_delete_redo_entries
 		    (SgfUndoHistory *history, SgfGameTree *tree);
 
+void		  sgf_undo_history_set_memory_limit
+		    (SgfUndoHistory *history, int memory_limit,
+		     SgfGameTree *tree);
+
 void		  sgf_utils_begin_action (SgfGameTree *tree);
 void		  sgf_utils_end_action (SgfGameTree *tree);
 
+void		  sgf_utils_begin_transaction (SgfGameTree *tree);
+void		  sgf_utils_commit_transaction (SgfGameTree *tree);
+
 
 #define sgf_utils_can_undo(tree)					\
   ((tree)->undo_history && (tree)->undo_history->last_applied_entry)
@@ -1003,10 +1123,80 @@ void		  sgf_utils_redo (SgfGameTree *tree);
 
 
 
-/* `sgf-diff-utils.c' global functions. */
+/* `sgf-diff-utils.c' global declarations, functions and variables. */
+
+enum {
+  SGF_TEXT_DIFF_MYERS,
+  SGF_TEXT_DIFF_PATIENCE,
+  SGF_TEXT_DIFF_HISTOGRAM
+};
+
+
+typedef struct _SgfDiffParameters	SgfDiffParameters;
+
+struct _SgfDiffParameters {
+  /* If set, matched nodes with different comments are reported, with
+   * text difference of the comments in place of comment text.
+   */
+  int		compare_comments;
+
+  int		text_diff_algorithm;
+  int		diff_text_words;
+};
+
 
 SgfCollection *	 sgf_diff (const SgfCollection *from_collection,
-			   const SgfCollection *to_collection);
+			   const SgfCollection *to_collection,
+			   const SgfDiffParameters *parameters);
+char *		 sgf_diff_text (const char *from_text, const char *to_text,
+				const SgfDiffParameters *parameters);
+
+
+extern const SgfDiffParameters	sgf_diff_defaults;
+
+
+
+
+/* `sgf-replay.c' global declarations, functions and variables. */
+
+typedef struct _SgfReplayPosition	SgfReplayPosition;
+
+/* Position passed to sgf_replay_collection() callback.  `board' is
+ * the position right after `node' has been played; `node_depth' is
+ * zero for tree root.
+ */
+struct _SgfReplayPosition {
+  const SgfGameTree    *tree;
+  int			tree_index;
+
+  const SgfNode	       *node;
+  int			node_depth;
+
+  const Board	       *board;
+};
+
+typedef void (* SgfReplayCallback) (const SgfReplayPosition *position,
+				    void *user_data);
+
+
+typedef struct _SgfReplayParameters	SgfReplayParameters;
+
+struct _SgfReplayParameters {
+  /* Zero or negative means as many as there are processors. */
+  int		num_threads;
+
+  /* If set, all variations are replayed, not only main lines. */
+  int		all_variations;
+};
+
+
+int		 sgf_replay_collection (const SgfCollection *collection,
+					const SgfReplayParameters *parameters,
+					SgfReplayCallback callback,
+					void *user_data);
+
+
+extern const SgfReplayParameters	sgf_replay_defaults;
 
 
 
@@ -1024,6 +1214,11 @@ enum {
 void		sgf_game_tree_invalidate_map (SgfGameTree *tree,
 					      SgfNode *node);
 
+int		sgf_game_tree_update_map_partially (SgfGameTree *tree,
+						    int max_nodes_to_lay_out);
+void		sgf_game_tree_set_map_layout_deferred (SgfGameTree *tree,
+						       int is_deferred);
+
 void		sgf_game_tree_get_map_dimensions (SgfGameTree *tree,
 						  int *map_width,
 						  int *map_height);
@@ -295,6 +295,7 @@ parse_ugf_buffer (SgfParsingData *data,
 	data->zero_byte_error_position.line	  = 0;
 
 	data->board = NULL;
+	data->common_marked_positions = NULL;
 	data->error_list = *error_list;
 
 	data->latin1_to_utf8 = iconv_open ("UTF-8", "ISO-8859-1");
@@ -408,8 +409,10 @@ parse_ugf_buffer (SgfParsingData *data,
 			&& data->tree_char_set_to_utf8 != NULL)
 		iconv_close (data->tree_char_set_to_utf8);
 
-	if (data->board)
+	if (data->board) {
 		board_delete (data->board);
+		utils_free (data->common_marked_positions);
+	}
 
 	iconv_close (data->latin1_to_utf8);
 
@@ -536,25 +539,7 @@ ugf_root_node (SgfParsingData *data, const char *width_string)
 			else
 				assert (0);
 
-			if (!data->board) {
-				data->board = board_new (data->game,
-						data->board_width, data->board_height);
-			} else {
-				board_set_parameters (data->board, data->game,
-						data->board_width, data->board_height);
-			}
-
-			data->board_common_mark = 0;
-			data->board_change_mark = 0;
-			data->board_markup_mark = 0;
-			board_fill_uint_grid (data->board, data->common_marked_positions, 0);
-			board_fill_uint_grid (data->board, data->changed_positions, 0);
-			board_fill_uint_grid (data->board, data->marked_positions, 0);
-
-			if (data->game == GAME_GO) {
-				data->board_territory_mark = 0;
-				board_fill_uint_grid (data->board, data->territory_positions, 0);
-			}
+			set_up_board (data);
 		}
 	}
 
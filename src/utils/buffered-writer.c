@@ -29,6 +29,10 @@
  *
  * - Tracks current column in the output stream, thus making output
  *   formatting easier for higher level code.
+ *
+ * - Provides non-varargs primitives for writing numbers and short
+ *   ASCII strings, which avoid formatting string parsing, temporary
+ *   allocations and column scanning in the common case.
  */
 
 
@@ -37,6 +41,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
@@ -49,6 +54,25 @@
 #endif
 
 
+/* Number of fractional digits buffered_writer_add_real() considers.
+ * Same as default precision of utils_cprintf().
+ */
+#define REAL_PRECISION		6
+#define REAL_SCALE		1000000.0
+
+/* Above this magnitude, utils_vncprintf() loses precision in the last
+ * digits, so fixed point would give different (if more exact) text.
+ */
+#define REAL_FIXED_POINT_LIMIT	100000000.0
+
+/* Largest distance, in units of the sixth fractional digit, from the
+ * nearest such unit at which a number is still formatted in fixed
+ * point.  Far below the half unit where rounding becomes ambiguous,
+ * but well above errors of decimal fractions stored in binary.
+ */
+#define REAL_MAX_ERROR		0.001
+
+
 static void	flush_buffer (BufferedWriter *writer);
 static void	update_column (BufferedWriter *writer,
 			       const char *buffer, size_t length);
@@ -169,6 +193,43 @@ buffered_writer_dispose_memory (BufferedWriter *writer, int *data_length)
 }
 
 
+/* Finish writing to memory and return the list of filled chunks
+ * without concatenating them.  Data of each chunk immediately follows
+ * its BufferedWriterChunkData header.  Caller becomes the owner of
+ * the list and must eventually free it with
+ * buffered_writer_free_memory_chunks().
+ */
+BufferedWriterChunkData *
+buffered_writer_steal_memory_chunks (BufferedWriter *writer)
+{
+  BufferedWriterChunkData *chunk;
+
+  assert (writer);
+  assert (!writer->file);
+  assert (writer->first_chunk);
+
+  chunk		    = ((BufferedWriterChunkData*) writer->buffer) - 1;
+  chunk->chunk_size = writer->buffer_pointer - writer->buffer;
+
+  chunk = writer->first_chunk;
+  writer->first_chunk = NULL;
+
+  return chunk;
+}
+
+
+void
+buffered_writer_free_memory_chunks (BufferedWriterChunkData *first_chunk)
+{
+  while (first_chunk) {
+    BufferedWriterChunkData *next_chunk = first_chunk->next_chunk;
+
+    utils_free (first_chunk);
+    first_chunk = next_chunk;
+  }
+}
+
+
 void
 buffered_writer_add_character (BufferedWriter *writer, char character)
 {
@@ -240,6 +301,139 @@ buffered_writer_add_newline (BufferedWriter *writer)
 }
 
 
+/* Add `length' bytes of ASCII text, which must contain no newlines
+ * and no tabs.  Unlike buffered_writer_cat_as_string(), this doesn't
+ * need to scan the text to update current column.
+ */
+void
+buffered_writer_add_ascii (BufferedWriter *writer,
+			   const char *buffer, size_t length)
+{
+  assert (writer);
+  assert (buffer);
+
+  if (!writer->iconv_handle
+      && writer->buffer_end - writer->buffer_pointer > length) {
+    memcpy (writer->buffer_pointer, buffer, length);
+
+    writer->buffer_pointer += length;
+    writer->column	   += length;
+  }
+  else
+    buffered_writer_cat_as_string (writer, buffer, length);
+}
+
+
+/* Add two ASCII characters at once, e.g. an SGF point.  Neither can
+ * be a newline or a tab.
+ */
+void
+buffered_writer_add_two_characters (BufferedWriter *writer,
+				    char first_character,
+				    char second_character)
+{
+  assert (writer);
+  assert (!(first_character & 0x80) && !(second_character & 0x80));
+
+  if (!writer->iconv_handle
+      && writer->buffer_end - writer->buffer_pointer > 2) {
+    writer->buffer_pointer[0] = first_character;
+    writer->buffer_pointer[1] = second_character;
+
+    writer->buffer_pointer += 2;
+    writer->column	   += 2;
+  }
+  else {
+    buffered_writer_add_character (writer, first_character);
+    buffered_writer_add_character (writer, second_character);
+  }
+}
+
+
+/* Add decimal representation of `number'.  Equivalent to, but much
+ * faster than buffered_writer_cprintf() with "%d" format.
+ */
+void
+buffered_writer_add_integer (BufferedWriter *writer, int number)
+{
+  char digits[3 * sizeof (int) + 1];
+  char *digits_end = digits + sizeof digits;
+  char *scan	   = digits_end;
+  unsigned int magnitude = (number >= 0
+			    ? (unsigned int) number
+			    : - (unsigned int) number);
+
+  do {
+    *--scan = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+
+  if (number < 0)
+    *--scan = '-';
+
+  buffered_writer_add_ascii (writer, scan, digits_end - scan);
+}
+
+
+/* Add `number' formatted as buffered_writer_cprintf() formats it with
+ * "%.f" specifier: at most six fractional digits with trailing zeros
+ * removed, but at least one.  Numbers below REAL_FIXED_POINT_LIMIT in
+ * magnitude that are within REAL_MAX_ERROR units of the sixth digit
+ * from a multiple of 10^-6 (e.g. komi and times with few decimals)
+ * are formatted in fixed point.  Rounding them is unambiguous, so the
+ * text is the very same.  Anything else is passed to
+ * buffered_writer_cprintf().
+ */
+void
+buffered_writer_add_real (BufferedWriter *writer, double number)
+{
+  char text[3 * sizeof (unsigned long) + REAL_PRECISION + 3];
+  char *text_end = text + sizeof text;
+  char *scan	 = text_end;
+  double magnitude = (number >= 0.0 ? number : -number);
+  double scaled_magnitude = floor (magnitude * REAL_SCALE + 0.5);
+  double scaled_fraction;
+  unsigned long integral_part;
+  unsigned long fraction;
+  int num_fraction_digits;
+
+  /* The first test also catches NaNs. */
+  if (!(magnitude < REAL_FIXED_POINT_LIMIT)
+      || fabs (magnitude * REAL_SCALE - scaled_magnitude) > REAL_MAX_ERROR) {
+    buffered_writer_cprintf (writer, "%.f", number);
+    return;
+  }
+
+  /* Both are exact: `scaled_magnitude' is an integer below 2^53. */
+  scaled_fraction = fmod (scaled_magnitude, REAL_SCALE);
+  integral_part	  = (unsigned long) ((scaled_magnitude - scaled_fraction)
+				     / REAL_SCALE);
+  fraction	  = (unsigned long) scaled_fraction;
+
+  for (num_fraction_digits = REAL_PRECISION;
+       num_fraction_digits > 1 && fraction % 10 == 0;
+       num_fraction_digits--)
+    fraction /= 10;
+
+  while (--num_fraction_digits >= 0) {
+    *--scan = '0' + fraction % 10;
+    fraction /= 10;
+  }
+
+  *--scan = '.';
+
+  do {
+    *--scan = '0' + integral_part % 10;
+    integral_part /= 10;
+  } while (integral_part);
+
+  if (number < 0.0)
+    *--scan = '-';
+
+  buffered_writer_add_ascii (writer, scan, text_end - scan);
+}
+
+
 void
 buffered_writer_cat_string (BufferedWriter *writer, const char *string)
 {
@@ -451,11 +645,17 @@ flush_buffer (BufferedWriter *writer)
 }
 
 
+/* Update current column after `buffer' of `length' bytes is written.
+ * Only characters after the last newline matter.  In the common case
+ * (no tabs) column advances by the number of UTF-8 starters, which
+ * are counted in a simple loop compilers are able to vectorize.
+ */
 static void
 update_column (BufferedWriter *writer, const char *buffer, size_t length)
 {
   const char *last_line;
   const char *buffer_end = buffer + length;
+  const char *tab;
 
 #ifdef HAVE_MEMRCHR
 
@@ -469,19 +669,29 @@ update_column (BufferedWriter *writer, const char *buffer, size_t length)
 
 #else
 
-  size_t k;
+  const char *newline;
 
-  for (k = length; --k >= 0;) {
-    if (buffer[k] == '\n') {
-      writer->column = 0;
-      break;
-    }
-  }
-
-  last_line = buffer + (k + 1);
+  for (last_line = buffer;
+       (newline = memchr (last_line, '\n', buffer_end - last_line)) != NULL;
+       last_line = newline + 1)
+    writer->column = 0;
 
 #endif
 
+  tab = memchr (last_line, '\t', buffer_end - last_line);
+
+  if (!tab) {
+    size_t num_continuation_bytes = 0;
+    const unsigned char *scan;
+
+    for (scan = (const unsigned char *) last_line;
+	 scan < (const unsigned char *) buffer_end; scan++)
+      num_continuation_bytes += ((*scan & 0xc0) == 0x80);
+
+    writer->column += (buffer_end - last_line) - num_continuation_bytes;
+    return;
+  }
+
   while (last_line < buffer_end) {
     if (IS_UTF8_STARTER (*last_line)) {
       writer->column++;
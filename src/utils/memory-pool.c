@@ -156,6 +156,7 @@ memory_pool_alloc (MemoryPool *pool)
       chunk->next = NULL;
       chunk->previous = pool->last_chunk;
 
+      pool->last_chunk->next = chunk;
       pool->last_chunk = chunk;
     }
     else {
@@ -214,6 +215,7 @@ memory_pool_free (MemoryPool *pool, void *item)
       chunk->previous = NULL;
       chunk->next = pool->first_chunk;
 
+      pool->first_chunk->previous = chunk;
       pool->first_chunk = chunk;
     }
   }
@@ -280,19 +280,25 @@ string_buffer_vcprintf (StringBuffer *string_buffer,
 			const char *format_string, va_list arguments)
 {
   int length;
+  int space_left;
   va_list arguments_copy;
 
   assert (string_buffer);
   assert (format_string);
 
+  space_left = string_buffer->current_size - string_buffer->length;
+
+  /* utils_vncprintf() needs room for at least one character besides
+   * the terminating zero; otherwise just find the length.
+   */
   QUARRY_VA_COPY (arguments_copy, arguments);
-  length = utils_vncprintf (string_buffer->string + string_buffer->length,
-			    (string_buffer->current_size
-			     - string_buffer->length),
-			    format_string, arguments_copy);
+  length = utils_vncprintf ((space_left > 1
+			     ? string_buffer->string + string_buffer->length
+			     : NULL),
+			    space_left, format_string, arguments_copy);
   va_end (arguments_copy);
 
-  if (length >= string_buffer->current_size - string_buffer->length) {
+  if (length >= space_left) {
     reallocate_if_needed (string_buffer, length);
     length = utils_vncprintf (string_buffer->string + string_buffer->length,
 			      (string_buffer->current_size
@@ -544,6 +544,11 @@ int		buffered_writer_dispose (BufferedWriter *writer);
 char *		buffered_writer_dispose_memory (BufferedWriter *writer,
 						int *data_length);
 
+BufferedWriterChunkData *
+		buffered_writer_steal_memory_chunks (BufferedWriter *writer);
+void		buffered_writer_free_memory_chunks
+		  (BufferedWriterChunkData *first_chunk);
+
 #define buffered_writer_set_iconv_handle(writer, handle)	\
   ((writer)->iconv_handle = (handle))
 
@@ -552,6 +557,16 @@ void		buffered_writer_add_character (BufferedWriter *writer,
 					       char character);
 void		buffered_writer_add_newline (BufferedWriter *writer);
 
+void		buffered_writer_add_ascii (BufferedWriter *writer,
+					   const char *buffer, size_t length);
+void		buffered_writer_add_two_characters (BufferedWriter *writer,
+						    char first_character,
+						    char second_character);
+void		buffered_writer_add_integer (BufferedWriter *writer,
+					     int number);
+void		buffered_writer_add_real (BufferedWriter *writer,
+					  double number);
+
 void		buffered_writer_cat_string (BufferedWriter *writer,
 					    const char *string);
 void		buffered_writer_cat_strings (BufferedWriter *writer, ...);